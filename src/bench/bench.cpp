@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <iostream>
 #include <iomanip>
+#include <regex>
 #include <sys/time.h>
 
 benchmark::BenchRunner::BenchmarkMap &benchmark::BenchRunner::benchmarks() {
@@ -27,13 +28,19 @@ benchmark::BenchRunner::BenchRunner(std::string name, benchmark::BenchFunction f
 }
 
 void
-benchmark::BenchRunner::RunAll(double elapsedTimeForOne)
+benchmark::BenchRunner::RunAll(double elapsedTimeForOne, const std::string& filter)
 {
     perf_init();
+    std::regex reFilter(filter);
+    std::smatch baseMatch;
+
     std::cout << "#Benchmark" << "," << "count" << "," << "min" << "," << "max" << "," << "average" << ","
               << "min_cycles" << "," << "max_cycles" << "," << "average_cycles" << "\n";
 
     for (const auto &p: benchmarks()) {
+        if (!std::regex_match(p.first, baseMatch, reFilter)) {
+            continue;
+        }
         State state(p.first, elapsedTimeForOne);
         p.second(state);
     }
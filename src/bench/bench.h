@@ -70,7 +70,7 @@ namespace benchmark {
     public:
         BenchRunner(std::string name, BenchFunction func);
 
-        static void RunAll(double elapsedTimeForOne=1.0);
+        static void RunAll(double elapsedTimeForOne=1.0, const std::string& filter=".*");
     };
 }
 
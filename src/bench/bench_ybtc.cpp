@@ -10,16 +10,32 @@
 #include "util.h"
 #include "random.h"
 
+#include <iostream>
+
+static const char* DEFAULT_BENCH_FILTER = ".*";
+
 int
 main(int argc, char** argv)
 {
+    gArgs.ParseParameters(argc, argv);
+
+    if (gArgs.IsArgSet("-?") || gArgs.IsArgSet("-h") || gArgs.IsArgSet("-help")) {
+        std::cout << HelpMessageGroup(_("Options:"))
+                  << HelpMessageOpt("-?", _("Print this help message and exit"))
+                  << HelpMessageOpt("-filter=<regex>", strprintf(_("Regular expression filter to select benchmark by name (default: %s)"), DEFAULT_BENCH_FILTER))
+                  << HelpMessageOpt("-blockindexentries=<n>", _("Entries of the synthetic block index of the BlockIndex benchmarks, e.g. 10000000 for a year of blocks (default: 100000)"));
+        return 0;
+    }
+
     SHA256AutoDetect();
     RandomInit();
     ECC_Start();
     SetupEnvironment();
     fPrintToDebugLog = false; // don't want to write to debug.log file
 
-    benchmark::BenchRunner::RunAll();
+    std::string regex_filter = gArgs.GetArg("-filter", DEFAULT_BENCH_FILTER);
+
+    benchmark::BenchRunner::RunAll(1.0, regex_filter);
 
     ECC_Stop();
 }
@@ -0,0 +1,287 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockimport.h"
+#include "blockwriter.h"
+#include "chainparams.h"
+#include "coins.h"
+#include "consensus/consensus.h"
+#include "consensus/merkle.h"
+#include "consensus/validation.h"
+#include "filemap.h"
+#include "hash.h"
+#include "netmessagemaker.h"
+#include "primitives/block.h"
+#include "random.h"
+#include "streams.h"
+#include "undo.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+/* Block spacing of the synthetic chain, and blocks between block index writes */
+static const int64_t BLOCK_SPACING = 3;
+static const int BLOCKS_PER_WRITE = DATABASE_WRITE_INTERVAL / BLOCK_SPACING;
+/* The records of each file are rewritten from the start past this size */
+static const unsigned int BLOCK_FILE_WRAP = 16 * 1024 * 1024;
+/* Blocks in the block file that blocks are served from */
+static const int SERVED_BLOCKS = 1000;
+
+/** Block and undo data of a small block, its transactions spending two coins each */
+struct SyntheticBlock
+{
+    CBlock block;
+    CBlockUndo blockundo;
+
+    SyntheticBlock()
+    {
+        FastRandomContext rand(true);
+        for (int i = 0; i < 8; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(i == 0 ? 1 : 2);
+            for (CTxIn& txin : tx.vin) {
+                txin.prevout = COutPoint(rand.rand256(), 0);
+                txin.scriptSig = CScript() << rand.randbytes(72) << rand.randbytes(33);
+            }
+            tx.vout.resize(2);
+            for (CTxOut& txout : tx.vout) {
+                txout.nValue = rand.randrange(COIN);
+                txout.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << rand.randbytes(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+            }
+            block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+            if (i > 0) {
+                CTxUndo txundo;
+                for (int j = 0; j < 2; j++)
+                    txundo.vprevout.emplace_back(block.vtx[0]->vout[j], 1, false);
+                blockundo.vtxundo.push_back(txundo);
+            }
+        }
+        block.nVersion = BLOCK_VERSION_CASINO_SIGNED;
+        block.nTime = 1500000000;
+        block.nBits = 0x207fffff;
+        block.vchBlockSig = rand.randbytes(65);
+        block.hashMerkleRoot = BlockMerkleRoot(block);
+    }
+};
+
+/** Where the next block and undo record go, as FindBlockPos and FindUndoPos would place them */
+struct SyntheticPos
+{
+    unsigned int nBlockPos = 0;
+    unsigned int nUndoPos = 0;
+
+    void Next(size_t nBlockSize, size_t nUndoSize)
+    {
+        nBlockPos += nBlockSize;
+        nUndoPos += nUndoSize;
+        if (nBlockPos > BLOCK_FILE_WRAP || nUndoPos > BLOCK_FILE_WRAP)
+            nBlockPos = nUndoPos = 0;
+    }
+};
+
+static void SerializeRecords(SyntheticBlock& synthetic, const CMessageHeader::MessageStartChars& messageStart, std::vector<unsigned char>& blockData, std::vector<unsigned char>& undoData)
+{
+    synthetic.block.nTime += BLOCK_SPACING;
+    unsigned int nBlockSize = GetSerializeSize(synthetic.block, SER_DISK, CLIENT_VERSION);
+    CVectorWriter(SER_DISK, CLIENT_VERSION, blockData, 0, FLATDATA(messageStart), nBlockSize, synthetic.block);
+    CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
+    hasher << synthetic.block.GetHash() << synthetic.blockundo;
+    unsigned int nUndoSize = GetSerializeSize(synthetic.blockundo, SER_DISK, CLIENT_VERSION);
+    CVectorWriter(SER_DISK, CLIENT_VERSION, undoData, 0, FLATDATA(messageStart), nUndoSize, synthetic.blockundo, hasher.GetHash());
+}
+
+static fs::path BlockFilePath(const fs::path& dir, int nFile, bool fUndo)
+{
+    return dir / strprintf("%s%05u.dat", fUndo ? "rev" : "blk", nFile);
+}
+
+/** One iteration connects a block: its block and undo records are queued for the writer thread */
+static void BlockWriter_GroupCommit(benchmark::State& state)
+{
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const CMessageHeader::MessageStartChars& messageStart = chainParams->MessageStart();
+    SyntheticBlock synthetic;
+    SyntheticPos pos;
+    {
+        CBlockFileWriter writer([&dir](int nFile, bool fUndo) { return BlockFilePath(dir, nFile, fUndo); });
+        writer.Start();
+        int nBlocks = 0;
+        while (state.KeepRunning()) {
+            std::vector<unsigned char> blockData, undoData;
+            SerializeRecords(synthetic, messageStart, blockData, undoData);
+            const size_t nBlockSize = blockData.size(), nUndoSize = undoData.size();
+            writer.Append(0, false, pos.nBlockPos, std::move(blockData));
+            writer.Append(0, true, pos.nUndoPos, std::move(undoData));
+            pos.Next(nBlockSize, nUndoSize);
+            if (++nBlocks % BLOCKS_PER_WRITE == 0)
+                assert(writer.Sync());
+        }
+        writer.Stop();
+        assert(writer.Sync());
+    }
+    fs::remove_all(dir);
+}
+
+/** The same blocks, each record written by opening, seeking and closing the file as before */
+static void BlockWriter_PerBlock(benchmark::State& state)
+{
+    const fs::path dir = fs::temp_directory_path() / fs::unique_path();
+    fs::create_directories(dir);
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const CMessageHeader::MessageStartChars& messageStart = chainParams->MessageStart();
+    SyntheticBlock synthetic;
+    SyntheticPos pos;
+    auto write = [&dir](bool fUndo, unsigned int nPos, const std::vector<unsigned char>& data) {
+        FILE* file = fsbridge::fopen(BlockFilePath(dir, 0, fUndo), "rb+");
+        if (!file)
+            file = fsbridge::fopen(BlockFilePath(dir, 0, fUndo), "wb+");
+        assert(file && fseek(file, nPos, SEEK_SET) == 0);
+        CAutoFile fileout(file, SER_DISK, CLIENT_VERSION);
+        fileout.write((const char*)data.data(), data.size());
+    };
+    auto commit = [&dir](bool fUndo) {
+        FILE* file = fsbridge::fopen(BlockFilePath(dir, 0, fUndo), "rb+");
+        FileCommit(file);
+        fclose(file);
+    };
+    int nBlocks = 0;
+    while (state.KeepRunning()) {
+        std::vector<unsigned char> blockData, undoData;
+        SerializeRecords(synthetic, messageStart, blockData, undoData);
+        write(false, pos.nBlockPos, blockData);
+        write(true, pos.nUndoPos, undoData);
+        pos.Next(blockData.size(), undoData.size());
+        if (++nBlocks % BLOCKS_PER_WRITE == 0) {
+            commit(false);
+            commit(true);
+        }
+    }
+    fs::remove_all(dir);
+}
+
+/** A block file of synthetic blocks, laid out as WriteBlockToDisk does */
+struct SyntheticBlockFile
+{
+    fs::path dir;
+    std::vector<unsigned int> vPos;
+    std::vector<uint256> vHash;
+
+    explicit SyntheticBlockFile(const CMessageHeader::MessageStartChars& messageStart)
+    {
+        dir = fs::temp_directory_path() / fs::unique_path();
+        fs::create_directories(dir);
+        SyntheticBlock synthetic;
+        FILE* file = fsbridge::fopen(BlockFilePath(dir, 0, false), "wb");
+        assert(file);
+        unsigned int nPos = 0;
+        for (int i = 0; i < SERVED_BLOCKS; i++) {
+            std::vector<unsigned char> blockData, undoData;
+            SerializeRecords(synthetic, messageStart, blockData, undoData);
+            size_t nWritten = fwrite(blockData.data(), 1, blockData.size(), file);
+            assert(nWritten == blockData.size());
+            vPos.push_back(nPos + CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t));
+            vHash.push_back(synthetic.block.GetHash());
+            nPos += blockData.size();
+        }
+        fclose(file);
+    }
+
+    ~SyntheticBlockFile()
+    {
+        fs::remove_all(dir);
+    }
+};
+
+/** One iteration answers a getdata for a witness block with the block as it is stored */
+static void BlockServe_Raw(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const CMessageHeader::MessageStartChars& messageStart = chainParams->MessageStart();
+    SyntheticBlockFile blocks(messageStart);
+    CBlockFileMap blockFileMap([&blocks](int nFile) { return BlockFilePath(blocks.dir, nFile, false); });
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    int i = 0;
+    while (state.KeepRunning()) {
+        std::vector<unsigned char> vchBlock;
+        bool fRead = blockFileMap.ReadRecord(0, blocks.vPos[i], (const unsigned char*)messageStart, MAX_BLOCK_SERIALIZED_SIZE, vchBlock);
+        CBlockHeader header;
+        CDataStream ssHeader((const char*)vchBlock.data(), (const char*)vchBlock.data() + std::min<size_t>(vchBlock.size(), 1024), SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+        assert(fRead && header.GetHash() == blocks.vHash[i]);
+        CSerializedNetMsg msg = msgMaker.MakeRaw(NetMsgType::BLOCK, std::move(vchBlock));
+        i = (i + 1) % SERVED_BLOCKS;
+    }
+}
+
+/** The same, reading the block through stdio, deserializing and serializing it again as before */
+static void BlockServe_Deserialize(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    SyntheticBlockFile blocks(chainParams->MessageStart());
+    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    int i = 0;
+    while (state.KeepRunning()) {
+        CAutoFile filein(fsbridge::fopen(BlockFilePath(blocks.dir, 0, false), "rb"), SER_DISK, CLIENT_VERSION);
+        assert(!filein.IsNull() && fseek(filein.Get(), blocks.vPos[i], SEEK_SET) == 0);
+        CBlock block;
+        filein >> block;
+        assert(block.GetHash() == blocks.vHash[i]);
+        CSerializedNetMsg msg = msgMaker.Make(NetMsgType::BLOCK, block);
+        i = (i + 1) % SERVED_BLOCKS;
+    }
+}
+
+/** Threads deserializing and checking the blocks of an import */
+static const int IMPORT_THREADS = 4;
+
+/** One iteration imports the block file: it is read, deserialized and checked ahead of the consumer */
+static void BlockImport_Pipelined(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    SyntheticBlockFile blocks(chainParams->MessageStart());
+    const std::vector<CBlockImportFile> vFiles{CBlockImportFile{BlockFilePath(blocks.dir, 0, false), 0}};
+    while (state.KeepRunning()) {
+        CBlockImportReader reader(vFiles, chainParams->MessageStart(), chainParams->GetConsensus(), IMPORT_THREADS);
+        CImportedBlock imported;
+        size_t nBlocks = 0;
+        while (reader.Next(imported))
+            assert(imported.pos.nPos == blocks.vPos[nBlocks++]);
+        assert(nBlocks == blocks.vPos.size());
+    }
+}
+
+/** The same, each record found, deserialized and checked in turn through a buffered file as before */
+static void BlockImport_Serial(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    const CMessageHeader::MessageStartChars& messageStart = chainParams->MessageStart();
+    SyntheticBlockFile blocks(messageStart);
+    while (state.KeepRunning()) {
+        CBufferedFile blkdat(fsbridge::fopen(BlockFilePath(blocks.dir, 0, false), "rb"), 2 * MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE + 8, SER_DISK, CLIENT_VERSION);
+        size_t nBlocks = 0;
+        while (nBlocks < blocks.vPos.size()) {
+            unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+            unsigned int nSize;
+            blkdat.FindByte(messageStart[0]);
+            blkdat >> FLATDATA(buf) >> nSize;
+            assert(memcmp(buf, messageStart, CMessageHeader::MESSAGE_START_SIZE) == 0 && blkdat.GetPos() == blocks.vPos[nBlocks]);
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            blkdat >> *pblock;
+            CValidationState validationState;
+            CheckBlock(*pblock, validationState, chainParams->GetConsensus());
+            nBlocks++;
+        }
+    }
+}
+
+BENCHMARK(BlockWriter_GroupCommit);
+BENCHMARK(BlockWriter_PerBlock);
+BENCHMARK(BlockServe_Raw);
+BENCHMARK(BlockServe_Deserialize);
+BENCHMARK(BlockImport_Pipelined);
+BENCHMARK(BlockImport_Serial);
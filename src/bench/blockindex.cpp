@@ -0,0 +1,189 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "indexsnapshot.h"
+#include "random.h"
+#include "streams.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+
+#include <fstream>
+#include <iostream>
+#include <stdio.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+/* Default entries of the synthetic block index: one chain of casino-signed headers */
+static const size_t DEFAULT_BLOCK_INDEX_ENTRIES = 100000;
+
+/* Entries of the synthetic block index, -blockindexentries; 10000000 is about a year of blocks */
+static size_t BlockIndexEntries()
+{
+    return std::max<int64_t>(gArgs.GetArg("-blockindexentries", DEFAULT_BLOCK_INDEX_ENTRIES), 1);
+}
+
+struct ResidentBytes
+{
+    size_t nAnon = 0;
+    size_t nFile = 0;
+};
+
+/* Resident memory of the process, anonymous and mapped from files; false where /proc/self/status does not tell */
+static bool GetResidentBytes(ResidentBytes& resident)
+{
+#ifdef __GLIBC__
+    // Give back what was freed, so that using it again counts
+    malloc_trim(0);
+#endif
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    int nFound = 0;
+    while (std::getline(status, line)) {
+        size_t nKB;
+        if (sscanf(line.c_str(), "RssAnon: %zu kB", &nKB) == 1) {
+            resident.nAnon = nKB * 1024;
+            nFound++;
+        } else if (sscanf(line.c_str(), "RssFile: %zu kB", &nKB) == 1) {
+            resident.nFile = nKB * 1024;
+            nFound++;
+        }
+    }
+    return nFound == 2;
+}
+
+/* Print what loading nEntries added to the resident memory since before, per entry */
+static void ReportResidentGrowth(const std::string& name, size_t nEntries, const ResidentBytes& before)
+{
+    ResidentBytes after;
+    if (!GetResidentBytes(after))
+        return;
+    const double nAnon = after.nAnon > before.nAnon ? after.nAnon - before.nAnon : 0;
+    const double nFile = after.nFile > before.nFile ? after.nFile - before.nFile : 0;
+    std::cout << name << "-rss," << nEntries << " entries," << nAnon / nEntries << " anonymous bytes per entry,"
+              << nFile / nEntries << " mapped bytes per entry\n";
+}
+
+static void MakeBlockIndex(CBlockIndexArena& arena, BlockMap& mapIndex, std::vector<const CBlockIndex*>& vIndex)
+{
+    FastRandomContext rand(true);
+    const size_t nEntries = BlockIndexEntries();
+    CBlockIndex* entries = arena.Allocate(nEntries);
+    mapIndex.reserve(nEntries);
+    vIndex.reserve(nEntries);
+    for (size_t i = 0; i < nEntries; i++) {
+        CBlockIndex* pindex = &entries[i];
+        pindex->pprev = i > 0 ? &entries[i - 1] : nullptr;
+        pindex->nHeight = i;
+        pindex->nStatus = BLOCK_VALID_SCRIPTS | BLOCK_HAVE_DATA | BLOCK_HAVE_UNDO;
+        pindex->nTx = 2;
+        pindex->nFile = i / 10000;
+        pindex->nDataPos = (i % 10000) * 400;
+        pindex->nUndoPos = (i % 10000) * 100;
+        pindex->nVersion = BLOCK_VERSION_CASINO_SIGNED;
+        pindex->hashMerkleRoot = rand.rand256();
+        pindex->nTime = 1500000000 + i * 3;
+        pindex->nBits = 0x207fffff;
+        arena.SetBlockSig(*pindex, rand.randbytes(65));
+        pindex->phashBlock = &mapIndex.emplace(pindex->GetBlockHeader().GetHash(), pindex).first->first;
+        vIndex.push_back(pindex);
+    }
+}
+
+// Startup from the block index snapshot: map the file and fill a fresh
+// mapBlockIndex with entries allocated in one piece. The first run also prints
+// the memory it leaves resident: anonymous for the entries and mapBlockIndex,
+// mapped for the pages of the snapshot, which the entries point into for their
+// signatures and the kernel may drop. With -blockindexentries=10000000 this is
+// the startup of a node a year of blocks old.
+static void BlockIndex_LoadSnapshot(benchmark::State& state)
+{
+    CBlockIndexArena arena;
+    BlockMap mapIndex;
+    std::vector<const CBlockIndex*> vIndex;
+    MakeBlockIndex(arena, mapIndex, vIndex);
+    const fs::path path = fs::temp_directory_path() / fs::unique_path();
+    const uint256 nonce = GetRandHash();
+    bool fWritten = WriteBlockIndexSnapshotFile(path, vIndex, nonce);
+    assert(fWritten);
+    // Only the loaded index is in memory then, as at startup
+    const size_t nEntries = vIndex.size();
+    std::vector<const CBlockIndex*>().swap(vIndex);
+    BlockMap().swap(mapIndex);
+    arena.Clear();
+
+    bool fReported = false;
+    while (state.KeepRunning()) {
+        ResidentBytes before;
+        const bool fReport = !fReported && GetResidentBytes(before);
+        CBlockIndexArena arenaLoaded;
+        BlockMap mapLoaded;
+        bool fLoaded = ReadBlockIndexSnapshotFile(path, nonce, arenaLoaded, mapLoaded);
+        assert(fLoaded && mapLoaded.size() == nEntries);
+        // The signature read from the mapping is part of the header hash
+        assert(mapLoaded.begin()->second->GetBlockHeader().GetHash() == mapLoaded.begin()->first);
+        if (fReport)
+            ReportResidentGrowth("BlockIndex_LoadSnapshot", nEntries, before);
+        fReported = true;
+    }
+    fs::remove(path);
+}
+
+// What LoadBlockIndexGuts does per entry of the block tree DB, minus LevelDB
+// itself: deserialize a CDiskBlockIndex, hash its header and link it by hash.
+// The first run prints the memory it leaves resident, as above.
+static void BlockIndex_LoadDatabaseEntries(benchmark::State& state)
+{
+    CBlockIndexArena arena;
+    BlockMap mapIndex;
+    std::vector<const CBlockIndex*> vIndex;
+    MakeBlockIndex(arena, mapIndex, vIndex);
+    CDataStream ssEntries(SER_DISK, CLIENT_VERSION);
+    for (const CBlockIndex* pindex : vIndex)
+        ssEntries << CDiskBlockIndex(pindex);
+    const size_t nEntries = vIndex.size();
+    std::vector<const CBlockIndex*>().swap(vIndex);
+    BlockMap().swap(mapIndex);
+    arena.Clear();
+
+    bool fReported = false;
+    while (state.KeepRunning()) {
+        CDataStream ss(ssEntries);
+        ResidentBytes before;
+        const bool fReport = !fReported && GetResidentBytes(before);
+        CBlockIndexArena arenaLoaded;
+        BlockMap mapLoaded;
+        auto insert = [&](const uint256& hash) -> CBlockIndex* {
+            if (hash.IsNull())
+                return nullptr;
+            auto inserted = mapLoaded.emplace(hash, nullptr);
+            if (inserted.second) {
+                inserted.first->second = arenaLoaded.Allocate();
+                inserted.first->second->phashBlock = &inserted.first->first;
+            }
+            return inserted.first->second;
+        };
+        for (size_t i = 0; i < nEntries; i++) {
+            CDiskBlockIndex diskindex;
+            ss >> diskindex;
+            CBlockIndex* pindex = insert(diskindex.GetBlockHash());
+            pindex->pprev = insert(diskindex.hashPrev);
+            pindex->nHeight = diskindex.nHeight;
+            pindex->nStatus = diskindex.nStatus;
+            arenaLoaded.SetBlockSig(*pindex, diskindex.vchBlockSig);
+        }
+        assert(mapLoaded.size() == nEntries);
+        if (fReport)
+            ReportResidentGrowth("BlockIndex_LoadDatabaseEntries", nEntries, before);
+        fReported = true;
+    }
+}
+
+BENCHMARK(BlockIndex_LoadSnapshot);
+BENCHMARK(BlockIndex_LoadDatabaseEntries);
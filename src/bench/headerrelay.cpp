@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "blockencodings.h"
+#include "chain.h"
+#include "random.h"
+#include "streams.h"
+#include "version.h"
+#include "versionbits.h"
+
+/* Headers per message, as in a getheaders response */
+static const int HEADER_RELAY_HEADERS = 2000;
+
+static std::vector<CBlock> SignedHeaders()
+{
+    FastRandomContext rand(true);
+    std::vector<CBlock> vHeaders(HEADER_RELAY_HEADERS);
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        CBlock& header = vHeaders[i];
+        header.nVersion = VERSIONBITS_TOP_BITS | BLOCK_VERSION_CASINO_SIGNED;
+        header.hashPrevBlock = i > 0 ? vHeaders[i - 1].GetHash() : uint256();
+        header.hashMerkleRoot = rand.rand256();
+        header.hashStateRoot = rand.rand256();
+        header.nTime = 1500000000 + i * CHAIN_BLOCK_INTERVAL / 1000 + rand.randrange(2);
+        header.nBits = 0x207fffff;
+        header.nHeight = 1000 + i;
+        header.vchBlockSig = rand.randbytes(65);
+    }
+    return vHeaders;
+}
+
+// Writing and reading a "headers" message of HEADER_RELAY_HEADERS headers
+static void HeaderRelay_Legacy(benchmark::State& state)
+{
+    const std::vector<CBlock> vHeaders = SignedHeaders();
+    std::vector<CBlockHeader> vRead(vHeaders.size());
+    while (state.KeepRunning()) {
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << vHeaders;
+        unsigned int nCount = ReadCompactSize(ss);
+        for (unsigned int n = 0; n < nCount; n++) {
+            ss >> vRead[n];
+            ReadCompactSize(ss);
+        }
+        assert(vRead.back().nHeight == vHeaders.back().nHeight);
+    }
+}
+
+// The same headers as a "cmpctheaders" message, each stream continuing the last run
+static void HeaderRelay_Compact(benchmark::State& state)
+{
+    const std::vector<CBlock> vHeaders = SignedHeaders();
+    std::vector<CBlockHeader> vRead(vHeaders.size());
+    while (state.KeepRunning()) {
+        CompactHeaderStream sent, received;
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        ss << CompactHeaders(sent, vHeaders);
+        unsigned int nCount = ReadCompactSize(ss);
+        for (unsigned int n = 0; n < nCount; n++)
+            received.Read(ss, vRead[n]);
+        assert(vRead.back().GetHash() == vHeaders.back().GetHash());
+    }
+}
+
+BENCHMARK(HeaderRelay_Legacy);
+BENCHMARK(HeaderRelay_Compact);
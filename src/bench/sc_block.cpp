@@ -0,0 +1,96 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "scface.h"
+#include "script/script.h"
+#include "txmempool.h"
+#include "utiltime.h"
+#include "validation.h"
+#include "bench/sc_fixture.h"
+
+/* Number of contract calls in the synthetic block */
+static const uint32_t BLOCK_CONTRACT_TXS = 100;
+
+// A block made only of CASINO refill() calls from distinct senders, shaped like
+// the OP_CALL outputs the miner puts into the coinbase.
+static CBlock ContractHeavyBlock()
+{
+    CBlock block;
+    const std::vector<unsigned char> casino = ParseHex(GENESIS_CONTRACT_ADDRESS_ETH);
+    const std::vector<unsigned char> data = ParseHex(CASINO_REFILL);
+    for (uint32_t i = 0; i < BLOCK_CONTRACT_TXS; i++) {
+        const sc::Address sender = benchmark::ScTestAddress(1 + i);
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout.n = i;
+        tx.vout.resize(1);
+        tx.vout[0].scriptPubKey = CScript() << CScriptNum(0) << sender.asBytes() << CScriptNum(60000000)
+            << CScriptNum(25) << data << casino << OP_CALL;
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+static void SC_GetBlockContract(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    fixture.DeployCasino();
+    const CBlock block = ContractHeavyBlock();
+
+    fixture.Swap(pState);
+    const sc::h256 root = pState->rootHash();
+    while (state.KeepRunning()) {
+        // Connect the same block on top of the same parent state every time.
+        pState->setRoot(root);
+        std::vector<CTxOut> vRefundGasFee;
+        SmartContract sc;
+        sc.GetBlockContract(block, vRefundGasFee);
+        assert(vRefundGasFee.size() == BLOCK_CONTRACT_TXS);
+    }
+    fixture.Swap(pState);
+}
+
+BENCHMARK(SC_GetBlockContract);
+
+// A call into a contract that loops until it runs out of gas, dry-run the way
+// the mempool does: within the gas cap the run is abandoned at the time limit,
+// and with less gas it ends in a failed execution instead of a VM error.
+static void SC_MempoolDryRun(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address loop = benchmark::ScTestAddress(0x100);
+    fixture.DeployRuntime(loop, sc::bytes{0x5b, 0x60, 0x00, 0x56}); // JUMPDEST PUSH1 0 JUMP
+
+    CMutableTransaction tx;
+    tx.vin.resize(1);
+    tx.vout.resize(1);
+    const sc::Address sender = benchmark::ScTestAddress(1);
+    auto call = [&](uint64_t nGas) {
+        return CScript() << CScriptNum(0) << sender.asBytes() << CScriptNum(nGas)
+            << CScriptNum(25) << std::vector<unsigned char>() << loop.asBytes() << OP_CALL;
+    };
+
+    SmartContract smct(&fixture.State());
+    while (state.KeepRunning()) {
+        CContractPreExecution result;
+        bool fFinalFailure;
+        tx.vout[0].scriptPubKey = call(MAX_MEMPOOL_DRYRUN_GAS + 1);
+        assert(!smct.PreExecuteTx(CTransaction(tx), result, fFinalFailure, MAX_MEMPOOL_DRYRUN_GAS, MAX_MEMPOOL_DRYRUN_TIME * 1000));
+
+        const int64_t nStart = GetTimeMicros();
+        tx.vout[0].scriptPubKey = call(MAX_MEMPOOL_DRYRUN_GAS);
+        assert(!smct.PreExecuteTx(CTransaction(tx), result, fFinalFailure, MAX_MEMPOOL_DRYRUN_GAS, 1000));
+        assert(GetTimeMicros() - nStart < MAX_MEMPOOL_DRYRUN_TIME * 1000);
+
+        tx.vout[0].scriptPubKey = call(100000);
+        assert(smct.PreExecuteTx(CTransaction(tx), result, fFinalFailure, MAX_MEMPOOL_DRYRUN_GAS, MAX_MEMPOOL_DRYRUN_TIME * 1000));
+        assert(!result.fSuccess && result.nGasUsed == 100000);
+    }
+}
+
+BENCHMARK(SC_MempoolDryRun);
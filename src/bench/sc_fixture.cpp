@@ -0,0 +1,72 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench/sc_fixture.h"
+
+#include "chain.h"
+#include "utilstrencodings.h"
+
+namespace benchmark {
+
+ScStateFixture::ScStateFixture()
+{
+    path = fs::temp_directory_path() / fs::unique_path("ybtc_bench_sc_%%%%-%%%%-%%%%");
+    fs::create_directories(path);
+    const sc::h256 hashDB(sc::sha3(sc::rlp("")));
+    state.reset(new sc::State(sc::u256(0), sc::State::openDB(path.string(), hashDB, sc::WithExisting::Kill), sc::BaseState::Empty));
+    state->setRoot(hashDB);
+}
+
+ScStateFixture::~ScStateFixture()
+{
+    // Close the leveldb handle before removing its directory.
+    state.reset();
+    fs::remove_all(path);
+}
+
+void ScStateFixture::DeployRuntime(const sc::Address& addr, const sc::bytes& code)
+{
+    state->createContract(addr);
+    state->setNewCode(addr, sc::bytes(code));
+    state->commit(sc::State::CommitBehaviour::KeepEmptyAccounts);
+}
+
+sc::Address ScStateFixture::DeployCasino(const sc::Address& sender)
+{
+    sc::Address addr(ParseHex(GENESIS_CONTRACT_ADDRESS_ETH));
+    sc::Transaction tx(true, 0, 25, 60000000, addr, ParseHex(GENESIS_CONTRACT_CODE));
+    tx.forceSender(sender);
+    state->execute(tx);
+    return addr;
+}
+
+sc::ExecutionResult ScStateFixture::Call(const sc::Address& to, const sc::bytes& data, const sc::Address& sender, sc::Permanence permanence, sc::u256 gas)
+{
+    sc::Transaction tx(false, 0, 25, gas, to, data);
+    tx.forceSender(sender);
+    return state->execute(tx, permanence);
+}
+
+sc::Address ScTestAddress(uint32_t n)
+{
+    sc::Address addr;
+    addr[0] = 0x0b;
+    addr[16] = n >> 24;
+    addr[17] = n >> 16;
+    addr[18] = n >> 8;
+    addr[19] = n;
+    return addr;
+}
+
+sc::bytes ScCallData(const std::string& selector, const std::vector<sc::u256>& args)
+{
+    sc::bytes data = ParseHex(selector);
+    for (const sc::u256& arg : args) {
+        sc::h256 word(arg);
+        data.insert(data.end(), word.data(), word.data() + sc::h256::size);
+    }
+    return data;
+}
+
+} // namespace benchmark
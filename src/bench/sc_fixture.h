@@ -0,0 +1,55 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef YBTC_BENCH_SC_FIXTURE_H
+#define YBTC_BENCH_SC_FIXTURE_H
+
+#include "fs.h"
+#include "scexecutive.h"
+#include "scstate.h"
+#include "sctransaction.h"
+
+#include <memory>
+#include <string>
+
+namespace benchmark {
+
+/** 20-byte address derived from a small integer, for synthetic senders and contracts. */
+sc::Address ScTestAddress(uint32_t n);
+
+/**
+ * Contract state on a temporary on-disk OverlayDB, shared by the sc:: benchmarks.
+ * The database directory is removed again when the fixture goes out of scope.
+ */
+class ScStateFixture
+{
+public:
+    ScStateFixture();
+    ~ScStateFixture();
+
+    sc::State& State() { return *state; }
+    std::string Path() const { return path.string(); }
+    /** Exchange the fixture's State with another owner, e.g. the global pState used by SmartContract. */
+    void Swap(std::unique_ptr<sc::State>& other) { state.swap(other); }
+
+    /** Install runtime code at an address without running an init transaction. */
+    void DeployRuntime(const sc::Address& addr, const sc::bytes& code);
+    /** Run the compiled Genesis CASINO init code and install it at GENESIS_CONTRACT_ADDRESS_ETH; sender becomes player 0. */
+    sc::Address DeployCasino(const sc::Address& sender = ScTestAddress(0));
+
+    /** Execute a message call from a given sender. */
+    sc::ExecutionResult Call(const sc::Address& to, const sc::bytes& data, const sc::Address& sender,
+        sc::Permanence permanence = sc::Permanence::Committed, sc::u256 gas = 60000000);
+
+private:
+    fs::path path;
+    std::unique_ptr<sc::State> state;
+};
+
+/** ABI call data: 4-byte selector given in hex followed by 32-byte big-endian words. */
+sc::bytes ScCallData(const std::string& selector, const std::vector<sc::u256>& args = std::vector<sc::u256>());
+
+} // namespace benchmark
+
+#endif // YBTC_BENCH_SC_FIXTURE_H
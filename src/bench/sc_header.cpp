@@ -0,0 +1,84 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "casino.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "chainparamsbase.h"
+#include "consensus/validation.h"
+#include "key.h"
+#include "timedata.h"
+#include "validation.h"
+#include "versionbits.h"
+#include "bench/sc_fixture.h"
+
+#include <limits>
+
+/* Number of headers validated per run, all of them in casino phase 0 */
+static const int HEADER_SYNC_HEADERS = 250;
+
+// Headers-first sync of a regtest chain whose slots all belong to one miner,
+// validated the way AcceptBlockHeader does with (fCasino) or without the slot check.
+static void HeaderSync(benchmark::State& state, bool fCasino)
+{
+    const std::unique_ptr<CChainParams> chainParams = CreateChainParams(CBaseChainParams::REGTEST);
+    Consensus::Params consensus = chainParams->GetConsensus();
+    consensus.CasinoSlotHeight = fCasino ? 2 : std::numeric_limits<int>::max();
+
+    // Phase 0 belongs to the casino's creator
+    CKey key;
+    key.MakeNewKey(true);
+    const CKeyID id = key.GetPubKey().GetID();
+    benchmark::ScStateFixture fixture;
+    fixture.DeployCasino(sc::h160(std::vector<unsigned char>(id.begin(), id.end())));
+
+    std::vector<CBlockHeader> vHeaders(HEADER_SYNC_HEADERS + 2);
+    std::vector<uint256> vHashes(vHeaders.size());
+    std::vector<CBlockIndex> vIndex(vHeaders.size());
+    for (size_t i = 0; i < vHeaders.size(); i++) {
+        CBlockHeader& header = vHeaders[i];
+        header.nVersion = VERSIONBITS_TOP_BITS | BLOCK_VERSION_CASINO_SIGNED;
+        header.hashPrevBlock = i > 0 ? vHashes[i - 1] : uint256();
+        header.nTime = 1500000000 + i * CHAIN_BLOCK_INTERVAL / 1000;
+        header.nHeight = i;
+        if (i == 1)
+            header.hashStateRoot = sc::h256Touint(fixture.State().rootHash());
+        SignCasinoHeader(header, key);
+        vHashes[i] = header.GetHash();
+
+        vIndex[i] = CBlockIndex(header);
+        vIndex[i].phashBlock = &vHashes[i];
+        vIndex[i].pprev = i > 0 ? &vIndex[i - 1] : nullptr;
+        vIndex[i].nHeight = i;
+        vIndex[i].nStatus = BLOCK_VALID_SCRIPTS;
+        vIndex[i].BuildSkip();
+    }
+
+    fixture.Swap(pState);
+    LOCK(cs_main);
+    while (state.KeepRunning()) {
+        for (size_t i = 2; i < vHeaders.size(); i++) {
+            CValidationState validationState;
+            vHeaders[i].GetHash();
+            bool fValid = CheckCasinoHeader(vHeaders[i], validationState, consensus, &vIndex[i - 1], GetAdjustedTime());
+            assert(fValid);
+        }
+    }
+    fixture.Swap(pState);
+}
+
+static void SC_HeaderSync(benchmark::State& state)
+{
+    HeaderSync(state, false);
+}
+
+static void SC_HeaderSyncCasino(benchmark::State& state)
+{
+    HeaderSync(state, true);
+}
+
+BENCHMARK(SC_HeaderSync);
+BENCHMARK(SC_HeaderSyncCasino);
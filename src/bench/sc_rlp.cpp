@@ -0,0 +1,97 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "scdb.h"
+#include "scrlp.h"
+#include "scsha3.h"
+
+// Account RLP as written by sc::commit: [nonce, balance, storageRoot, codeHash]
+static void SC_RLP_EncodeAccount(benchmark::State& state)
+{
+    const sc::h256 storageRoot = sc::sha3(sc::bytes(32, 0x01));
+    const sc::h256 codeHash = sc::sha3(sc::bytes(32, 0x02));
+    sc::u256 balance = sc::u256(1) << 100;
+    while (state.KeepRunning()) {
+        sc::RLPStream s(4);
+        s << sc::u256(7) << balance++ << storageRoot << codeHash;
+        assert(s.out().size() > 64);
+    }
+}
+
+// Same record written into one stream that is cleared and reused, as sc::commit does.
+static void SC_RLP_EncodeAccount_Reused(benchmark::State& state)
+{
+    const sc::h256 storageRoot = sc::sha3(sc::bytes(32, 0x01));
+    const sc::h256 codeHash = sc::sha3(sc::bytes(32, 0x02));
+    sc::u256 balance = sc::u256(1) << 100;
+    sc::RLPStream s;
+    while (state.KeepRunning()) {
+        s.clear();
+        s.appendList(4) << sc::u256(7) << balance++ << storageRoot << codeHash;
+        assert(s.out().size() > 64);
+    }
+}
+
+// Full trie branch node: 16 child hashes and an empty value.
+static void SC_RLP_EncodeBranchNode(benchmark::State& state)
+{
+    sc::h256s children;
+    for (int i = 0; i < 16; i++)
+        children.push_back(sc::sha3(sc::bytes(1, i)));
+    while (state.KeepRunning()) {
+        sc::RLPStream r(17, sc::c_trieBranchReserve);
+        for (auto const& h : children)
+            r << h;
+        r << "";
+        sc::bytes b = r.invalidate();
+        assert(b.size() == 532);
+    }
+}
+
+static void SC_RLP_DecodeAccount(benchmark::State& state)
+{
+    sc::RLPStream s(4);
+    s << sc::u256(7) << (sc::u256(1) << 100) << sc::sha3(sc::bytes(32, 0x01)) << sc::sha3(sc::bytes(32, 0x02));
+    const sc::bytes encoded = s.out();
+    while (state.KeepRunning()) {
+        sc::RLP r(encoded);
+        sc::u256 nonce = r[0].toInt<sc::u256>();
+        sc::u256 balance = r[1].toInt<sc::u256>();
+        sc::h256 root = r[2].toHash<sc::h256>();
+        sc::h256 code = r[3].toHash<sc::h256>();
+        assert(nonce == 7 && balance != 0 && root && code);
+    }
+}
+
+// Storage values are RLP encoded individually before being inserted into the storage trie.
+static void SC_RLP_EncodeStorageValue(benchmark::State& state)
+{
+    sc::u256 value = sc::u256(1) << 200;
+    while (state.KeepRunning()) {
+        sc::bytes b = sc::rlp(value++);
+        assert(b.size() == 27);
+    }
+}
+
+static void RunSha3(benchmark::State& state, size_t size)
+{
+    const sc::bytes data(size, 0x5a);
+    while (state.KeepRunning()) {
+        sc::h256 h = sc::sha3(data);
+        assert(h);
+    }
+}
+
+static void SC_Keccak256_32b(benchmark::State& state) { RunSha3(state, 32); }
+static void SC_Keccak256_1KB(benchmark::State& state) { RunSha3(state, 1024); }
+
+BENCHMARK(SC_RLP_EncodeAccount);
+BENCHMARK(SC_RLP_EncodeAccount_Reused);
+BENCHMARK(SC_RLP_EncodeBranchNode);
+BENCHMARK(SC_RLP_DecodeAccount);
+BENCHMARK(SC_RLP_EncodeStorageValue);
+BENCHMARK(SC_Keccak256_32b);
+BENCHMARK(SC_Keccak256_1KB);
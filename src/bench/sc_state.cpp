@@ -0,0 +1,183 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/sc_fixture.h"
+
+#include "scstate.h"
+
+/* Number of storage slots populated in the contract used by the SLOAD/SSTORE benchmarks */
+static const uint32_t STORAGE_SLOTS = 1000;
+
+static void PopulateStorage(benchmark::ScStateFixture& fixture, const sc::Address& contract)
+{
+    sc::State& s = fixture.State();
+    fixture.DeployRuntime(contract, sc::bytes(1, 0x00));
+    for (uint32_t i = 0; i < STORAGE_SLOTS; i++)
+        s.setStorage(contract, i, sc::u256(i) + 1);
+    s.commit(sc::State::CommitBehaviour::KeepEmptyAccounts);
+}
+
+// SLOAD against a State whose account and storage caches were just dropped,
+// so every read walks the account trie and the storage trie.
+static void SC_State_SLOAD_Cold(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    PopulateStorage(fixture, contract);
+    sc::State& s = fixture.State();
+    const sc::h256 root = s.rootHash();
+
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        s.setRoot(root);
+        sc::u256 v = s.storage(contract, n++ % STORAGE_SLOTS);
+        assert(v != 0);
+    }
+}
+
+// SLOAD of slots already present in the account's storage overlay.
+static void SC_State_SLOAD_Warm(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    PopulateStorage(fixture, contract);
+    sc::State& s = fixture.State();
+    for (uint32_t i = 0; i < STORAGE_SLOTS; i++)
+        s.storage(contract, i);
+
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        sc::u256 v = s.storage(contract, n++ % STORAGE_SLOTS);
+        assert(v != 0);
+    }
+}
+
+// SLOAD through a fresh fork of the State, as block assembly reads the tip's
+// state: every read walks the tries, whose nodes come from the base's overlay.
+static void SC_State_SLOAD_Fork(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    PopulateStorage(fixture, contract);
+    const sc::State& s = fixture.State();
+    const sc::h256 root = s.rootHash();
+
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        sc::State view = sc::State::fork(s, root);
+        sc::u256 v = view.storage(contract, n++ % STORAGE_SLOTS);
+        assert(v != 0);
+    }
+}
+
+static void SC_State_SSTORE_Cold(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    PopulateStorage(fixture, contract);
+    sc::State& s = fixture.State();
+    const sc::h256 root = s.rootHash();
+    const size_t savepoint = s.savepoint();
+
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        s.setRoot(root);
+        s.setStorage(contract, n % STORAGE_SLOTS, n);
+        s.rollback(savepoint);
+        n++;
+    }
+}
+
+static void SC_State_SSTORE_Warm(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    PopulateStorage(fixture, contract);
+    sc::State& s = fixture.State();
+    for (uint32_t i = 0; i < STORAGE_SLOTS; i++)
+        s.storage(contract, i);
+    const size_t savepoint = s.savepoint();
+
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        s.setStorage(contract, n % STORAGE_SLOTS, n);
+        // Undo through the changelog so it does not grow without bound.
+        s.rollback(savepoint);
+        n++;
+    }
+}
+
+// EXTCODESIZE/CALL style code access right after the account cache was dropped:
+// the code comes from the shared CodeCache instead of the state database.
+static void SC_State_Code_Cold(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    fixture.DeployRuntime(contract, sc::bytes(4096, 0x5b));
+    sc::State& s = fixture.State();
+    const sc::h256 root = s.rootHash();
+
+    while (state.KeepRunning()) {
+        s.setRoot(root);
+        const sc::bytes& code = s.code(contract);
+        assert(code.size() == 4096);
+    }
+}
+
+// sc::commit of N dirty accounts, each with a number of dirty storage slots.
+static void RunCommit(benchmark::State& state, uint32_t nAccounts, uint32_t nSlots)
+{
+    benchmark::ScStateFixture fixture;
+    sc::State& s = fixture.State();
+    for (uint32_t a = 0; a < nAccounts; a++)
+        fixture.DeployRuntime(benchmark::ScTestAddress(a + 1), sc::bytes(1, 0x00));
+
+    uint32_t round = 0;
+    while (state.KeepRunning()) {
+        round++;
+        for (uint32_t a = 0; a < nAccounts; a++) {
+            const sc::Address addr = benchmark::ScTestAddress(a + 1);
+            s.addBalance(addr, 1);
+            for (uint32_t k = 0; k < nSlots; k++)
+                s.setStorage(addr, k, sc::u256(round) + k);
+        }
+        s.commit(sc::State::CommitBehaviour::KeepEmptyAccounts);
+    }
+}
+
+static void SC_Commit_10Accounts_0Slots(benchmark::State& state) { RunCommit(state, 10, 0); }
+static void SC_Commit_10Accounts_10Slots(benchmark::State& state) { RunCommit(state, 10, 10); }
+static void SC_Commit_100Accounts_1Slot(benchmark::State& state) { RunCommit(state, 100, 1); }
+static void SC_Commit_1Account_256Slots(benchmark::State& state) { RunCommit(state, 1, 256); }
+
+// Write the in-memory trie layer to the on-disk leveldb.
+static void SC_OverlayDB_Commit(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    sc::State& s = fixture.State();
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    fixture.DeployRuntime(contract, sc::bytes(1, 0x00));
+
+    uint32_t round = 0;
+    while (state.KeepRunning()) {
+        round++;
+        for (uint32_t k = 0; k < 64; k++)
+            s.setStorage(contract, k, sc::u256(round) + k);
+        s.commit(sc::State::CommitBehaviour::KeepEmptyAccounts);
+        s.db().commit();
+    }
+}
+
+BENCHMARK(SC_State_SLOAD_Cold);
+BENCHMARK(SC_State_SLOAD_Warm);
+BENCHMARK(SC_State_SLOAD_Fork);
+BENCHMARK(SC_State_SSTORE_Cold);
+BENCHMARK(SC_State_SSTORE_Warm);
+BENCHMARK(SC_State_Code_Cold);
+BENCHMARK(SC_Commit_10Accounts_0Slots);
+BENCHMARK(SC_Commit_10Accounts_10Slots);
+BENCHMARK(SC_Commit_100Accounts_1Slot);
+BENCHMARK(SC_Commit_1Account_256Slots);
+BENCHMARK(SC_OverlayDB_Commit);
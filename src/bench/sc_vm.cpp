@@ -0,0 +1,196 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+#include "bench/sc_fixture.h"
+
+#include "chain.h"
+#include "scvm.h"
+
+using sc::Instruction;
+
+/* Number of times the measured snippet is repeated in the generated contract */
+static const int OPCODE_REPEAT = 1000;
+
+static sc::byte op(Instruction inst) { return static_cast<sc::byte>(inst); }
+
+// Build runtime code that runs `setup` once, then `body` OPCODE_REPEAT times, then STOPs.
+// Each body must leave the stack as it found it so the repetition cannot overflow it.
+static sc::bytes RepeatedCode(const sc::bytes& setup, const sc::bytes& body)
+{
+    sc::bytes code(setup);
+    for (int i = 0; i < OPCODE_REPEAT; i++)
+        code.insert(code.end(), body.begin(), body.end());
+    code.push_back(op(Instruction::STOP));
+    return code;
+}
+
+static void RunOpcode(benchmark::State& state, const sc::bytes& setup, const sc::bytes& body)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    const sc::Address sender = benchmark::ScTestAddress(2);
+    fixture.DeployRuntime(contract, RepeatedCode(setup, body));
+
+    while (state.KeepRunning()) {
+        sc::ExecutionResult res = fixture.Call(contract, sc::bytes(32, 0x11), sender, sc::Permanence::Reverted);
+        assert(res.excepted == sc::TransactionException::None);
+    }
+}
+
+// Binary arithmetic: PUSH1 a, PUSH1 b, <op>, POP
+static void RunBinaryOpcode(benchmark::State& state, Instruction inst)
+{
+    RunOpcode(state, {}, {op(Instruction::PUSH1), 0x07, op(Instruction::PUSH1), 0x03, op(inst), op(Instruction::POP)});
+}
+
+static void SC_OP_ADD(benchmark::State& state) { RunBinaryOpcode(state, Instruction::ADD); }
+static void SC_OP_MUL(benchmark::State& state) { RunBinaryOpcode(state, Instruction::MUL); }
+static void SC_OP_DIV(benchmark::State& state) { RunBinaryOpcode(state, Instruction::DIV); }
+static void SC_OP_MOD(benchmark::State& state) { RunBinaryOpcode(state, Instruction::MOD); }
+static void SC_OP_EXP(benchmark::State& state) { RunBinaryOpcode(state, Instruction::EXP); }
+static void SC_OP_LT(benchmark::State& state) { RunBinaryOpcode(state, Instruction::LT); }
+static void SC_OP_EQ(benchmark::State& state) { RunBinaryOpcode(state, Instruction::EQ); }
+static void SC_OP_AND(benchmark::State& state) { RunBinaryOpcode(state, Instruction::AND); }
+
+static void SC_OP_PUSH1_POP(benchmark::State& state)
+{
+    RunOpcode(state, {}, {op(Instruction::PUSH1), 0x01, op(Instruction::POP)});
+}
+
+static void SC_OP_PUSH32_POP(benchmark::State& state)
+{
+    sc::bytes body(1, op(Instruction::PUSH32));
+    body.insert(body.end(), 32, 0xab);
+    body.push_back(op(Instruction::POP));
+    RunOpcode(state, {}, body);
+}
+
+static void SC_OP_DUP2_SWAP1(benchmark::State& state)
+{
+    RunOpcode(state, {op(Instruction::PUSH1), 0x01, op(Instruction::PUSH1), 0x02},
+        {op(Instruction::DUP2), op(Instruction::SWAP1), op(Instruction::POP)});
+}
+
+static void SC_OP_MSTORE_MLOAD(benchmark::State& state)
+{
+    RunOpcode(state, {},
+        {op(Instruction::PUSH1), 0x2a, op(Instruction::PUSH1), 0x40, op(Instruction::MSTORE),
+            op(Instruction::PUSH1), 0x40, op(Instruction::MLOAD), op(Instruction::POP)});
+}
+
+static void SC_OP_SHA3(benchmark::State& state)
+{
+    RunOpcode(state, {},
+        {op(Instruction::PUSH1), 0x20, op(Instruction::PUSH1), 0x00, op(Instruction::SHA3), op(Instruction::POP)});
+}
+
+static void SC_OP_CALLDATALOAD(benchmark::State& state)
+{
+    RunOpcode(state, {}, {op(Instruction::PUSH1), 0x00, op(Instruction::CALLDATALOAD), op(Instruction::POP)});
+}
+
+static void SC_OP_JUMP(benchmark::State& state)
+{
+    // PUSH2 <pc+4>, JUMP, JUMPDEST: each repetition jumps to the JUMPDEST right after it.
+    sc::bytes code;
+    for (int i = 0; i < OPCODE_REPEAT; i++) {
+        size_t dest = code.size() + 4;
+        code.push_back(op(Instruction::PUSH2));
+        code.push_back(dest >> 8);
+        code.push_back(dest & 0xff);
+        code.push_back(op(Instruction::JUMP));
+        code.push_back(op(Instruction::JUMPDEST));
+    }
+    code.push_back(op(Instruction::STOP));
+
+    benchmark::ScStateFixture fixture;
+    const sc::Address contract = benchmark::ScTestAddress(1);
+    fixture.DeployRuntime(contract, code);
+    while (state.KeepRunning()) {
+        sc::ExecutionResult res = fixture.Call(contract, sc::bytes(), benchmark::ScTestAddress(2), sc::Permanence::Reverted);
+        assert(res.excepted == sc::TransactionException::None);
+    }
+}
+
+static void SC_OP_SLOAD(benchmark::State& state)
+{
+    RunOpcode(state, {}, {op(Instruction::PUSH1), 0x05, op(Instruction::SLOAD), op(Instruction::POP)});
+}
+
+static void SC_OP_SSTORE(benchmark::State& state)
+{
+    RunOpcode(state, {}, {op(Instruction::PUSH1), 0x2a, op(Instruction::PUSH1), 0x05, op(Instruction::SSTORE)});
+}
+
+static void SC_OP_BALANCE(benchmark::State& state)
+{
+    RunOpcode(state, {}, {op(Instruction::CALLER), op(Instruction::BALANCE), op(Instruction::POP)});
+}
+
+// Genesis CASINO contract, executed the way the miner and ConnectBlock do.
+
+static void SC_Casino_getTotalPlayer(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address casino = fixture.DeployCasino();
+    const sc::bytes data = benchmark::ScCallData(CASINO_GETTOTALPLAYER);
+    while (state.KeepRunning()) {
+        sc::ExecutionResult res = fixture.Call(casino, data, benchmark::ScTestAddress(0), sc::Permanence::Reverted);
+        assert(res.output.size() == 32);
+    }
+}
+
+static void SC_Casino_refill(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address casino = fixture.DeployCasino();
+    const sc::bytes data = benchmark::ScCallData(CASINO_REFILL);
+    uint32_t n = 0;
+    while (state.KeepRunning()) {
+        // Rotate through more senders than there are register slots so both the
+        // hit and the lowest-balance replacement paths are exercised.
+        fixture.Call(casino, data, benchmark::ScTestAddress(1 + (n++ % 300)));
+    }
+}
+
+static void SC_Casino_setNextWinners(benchmark::State& state)
+{
+    benchmark::ScStateFixture fixture;
+    const sc::Address casino = fixture.DeployCasino();
+    const sc::bytes refill = benchmark::ScCallData(CASINO_REFILL);
+    for (uint32_t i = 1; i <= 64; i++)
+        fixture.Call(casino, refill, benchmark::ScTestAddress(i));
+
+    uint32_t phase = 0;
+    while (state.KeepRunning()) {
+        // setNextWinners requires the current phase and advances it by one.
+        const sc::bytes data = benchmark::ScCallData(CASINO_SETNEXTWINNERS, {phase, (sc::u256(7) << 32) | 3});
+        fixture.Call(casino, data, benchmark::ScTestAddress(0));
+        phase++;
+    }
+}
+
+BENCHMARK(SC_OP_ADD);
+BENCHMARK(SC_OP_MUL);
+BENCHMARK(SC_OP_DIV);
+BENCHMARK(SC_OP_MOD);
+BENCHMARK(SC_OP_EXP);
+BENCHMARK(SC_OP_LT);
+BENCHMARK(SC_OP_EQ);
+BENCHMARK(SC_OP_AND);
+BENCHMARK(SC_OP_PUSH1_POP);
+BENCHMARK(SC_OP_PUSH32_POP);
+BENCHMARK(SC_OP_DUP2_SWAP1);
+BENCHMARK(SC_OP_MSTORE_MLOAD);
+BENCHMARK(SC_OP_SHA3);
+BENCHMARK(SC_OP_CALLDATALOAD);
+BENCHMARK(SC_OP_JUMP);
+BENCHMARK(SC_OP_SLOAD);
+BENCHMARK(SC_OP_SSTORE);
+BENCHMARK(SC_OP_BALANCE);
+
+BENCHMARK(SC_Casino_getTotalPlayer);
+BENCHMARK(SC_Casino_refill);
+BENCHMARK(SC_Casino_setNextWinners);
@@ -148,7 +148,8 @@ public:
     // Dummy for deserialization
     CBlockHeaderAndShortTxIDs() {}
 
-    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID);
+    /** fPrefillContracts sends contract txs in full, for receivers whose mempool may lack them */
+    CBlockHeaderAndShortTxIDs(const CBlock& block, bool fUseWTXID, bool fPrefillContracts = false);
 
     uint64_t GetShortID(const uint256& txhash) const;
 
@@ -206,4 +207,113 @@ public:
     ReadStatus FillBlock(CBlock& block, const std::vector<CTransactionRef>& vtx_missing);
 };
 
+/**
+ * One direction of the delta encoding of "cmpctheaders" messages. Each
+ * header is written relative to the header written before it on the same
+ * connection, getheaders responses and announcements alike, so both ends
+ * only have to see the messages in the order they were sent.
+ *
+ * A header that extends the previous one leaves out its prev hash and
+ * height; nVersion and nBits are written when they change, and nTime as the
+ * zigzag encoded difference to the previous nTime. The roots and the
+ * signature are written in full.
+ */
+class CompactHeaderStream {
+private:
+    // The header written or read last
+    uint256 hashLast;
+    int32_t nVersion = 0;
+    uint32_t nTime = 0;
+    uint32_t nBits = 0;
+    uint32_t nHeight = 0;
+
+    void Update(const CBlockHeader& header)
+    {
+        hashLast = header.GetHash();
+        nVersion = header.nVersion;
+        nTime = header.nTime;
+        nBits = header.nBits;
+        nHeight = header.nHeight;
+    }
+
+public:
+    enum : uint8_t {
+        HAS_PREV = 1,    //!< hashPrevBlock and nHeight follow
+        HAS_VERSION = 2, //!< nVersion follows
+        HAS_BITS = 4,    //!< nBits follows
+    };
+
+    template <typename Stream>
+    void Write(Stream& s, const CBlockHeader& header)
+    {
+        uint8_t flags = 0;
+        if (header.hashPrevBlock != hashLast || header.nHeight != nHeight + 1)
+            flags |= HAS_PREV;
+        if (header.nVersion != nVersion)
+            flags |= HAS_VERSION;
+        if (header.nBits != nBits)
+            flags |= HAS_BITS;
+        s << flags;
+        if (flags & HAS_PREV)
+            s << header.hashPrevBlock << header.nHeight;
+        if (flags & HAS_VERSION)
+            s << header.nVersion;
+        if (flags & HAS_BITS)
+            s << header.nBits;
+        uint64_t nTimeDelta = header.nTime >= nTime ? uint64_t(header.nTime - nTime) << 1 : (uint64_t(nTime - header.nTime) << 1) - 1;
+        s << VARINT(nTimeDelta) << header.hashMerkleRoot << header.hashStateRoot;
+        if (header.nVersion & BLOCK_VERSION_CASINO_SIGNED)
+            s << header.vchBlockSig;
+        Update(header);
+    }
+
+    template <typename Stream>
+    void Read(Stream& s, CBlockHeader& header)
+    {
+        uint8_t flags;
+        s >> flags;
+        if (flags & ~(HAS_PREV | HAS_VERSION | HAS_BITS))
+            throw std::ios_base::failure("unknown compact header flags");
+        header.hashPrevBlock = hashLast;
+        header.nHeight = nHeight + 1;
+        header.nVersion = nVersion;
+        header.nBits = nBits;
+        if (flags & HAS_PREV)
+            s >> header.hashPrevBlock >> header.nHeight;
+        if (flags & HAS_VERSION)
+            s >> header.nVersion;
+        if (flags & HAS_BITS)
+            s >> header.nBits;
+        uint64_t nTimeDelta = 0;
+        s >> VARINT(nTimeDelta);
+        const uint64_t nMagnitude = (nTimeDelta >> 1) + (nTimeDelta & 1);
+        if (nTimeDelta & 1 ? nMagnitude > nTime : nMagnitude > std::numeric_limits<uint32_t>::max() - nTime)
+            throw std::ios_base::failure("compact header time out of range");
+        header.nTime = nTimeDelta & 1 ? nTime - nMagnitude : nTime + nMagnitude;
+        s >> header.hashMerkleRoot >> header.hashStateRoot;
+        header.vchBlockSig.clear();
+        if (header.nVersion & BLOCK_VERSION_CASINO_SIGNED)
+            s >> header.vchBlockSig;
+        Update(header);
+    }
+};
+
+/** The headers of a "cmpctheaders" message, written with the stream of the peer they go to */
+class CompactHeaders {
+private:
+    CompactHeaderStream& stream;
+    const std::vector<CBlock>& headers;
+
+public:
+    CompactHeaders(CompactHeaderStream& streamIn, const std::vector<CBlock>& headersIn) : stream(streamIn), headers(headersIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        WriteCompactSize(s, headers.size());
+        for (const CBlock& header : headers)
+            stream.Write(s, header);
+    }
+};
+
 #endif
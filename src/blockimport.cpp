@@ -0,0 +1,298 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "clientversion.h"
+#include "coins.h"
+#include "consensus/validation.h"
+#include "crypto/common.h"
+#include "streams.h"
+#include "util.h"
+#include "utiltime.h"
+#include "validation.h"
+
+#include <algorithm>
+#include <string.h>
+
+static const size_t RECORD_HEADER_SIZE = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+
+CBlockImportReader::CBlockImportReader(const std::vector<CBlockImportFile>& vFilesIn, const CMessageHeader::MessageStartChars& messageStartIn, const Consensus::Params& paramsIn, int nThreadsIn)
+    : vFiles(vFilesIn), params(paramsIn), nThreads(std::max(nThreadsIn, 1))
+{
+    memcpy(messageStart, messageStartIn, CMessageHeader::MESSAGE_START_SIZE);
+    thread = boost::thread(&CBlockImportReader::ThreadScan, this);
+}
+
+CBlockImportReader::~CBlockImportReader()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    cond.notify_all();
+    thread.join();
+}
+
+void CBlockImportReader::ThreadScan()
+{
+    RenameThread("ybtc-importscan");
+    try {
+        for (const CBlockImportFile& file : vFiles) {
+            if (!ScanFile(file))
+                break;
+        }
+    } catch (const std::exception& e) {
+        PrintExceptionContinue(&e, "CBlockImportReader::ThreadScan()");
+    }
+    boost::lock_guard<boost::mutex> lock(mutex);
+    fDone = true;
+    cond.notify_all();
+}
+
+bool CBlockImportReader::ScanFile(const CBlockImportFile& file)
+{
+    FILE* fileIn = fsbridge::fopen(file.path, "rb");
+    if (!fileIn) {
+        LogPrintf("Unable to open file %s\n", file.path.string());
+        return true;
+    }
+    if (file.nFile >= 0)
+        LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)file.nFile);
+
+    // Room for a batch and for the block that ends it, wherever it starts
+    std::vector<unsigned char> vBuf(IMPORT_BATCH_SIZE + RECORD_HEADER_SIZE + MAX_BLOCK_SERIALIZED_SIZE);
+    size_t nBuf = 0;
+    uint64_t nBufPos = 0;
+    bool fEof = false;
+    bool fContinue = true;
+    while (fContinue) {
+        if (!fEof) {
+            nBuf += fread(vBuf.data() + nBuf, 1, vBuf.size() - nBuf, fileIn);
+            fEof = nBuf < vBuf.size();
+            if (fEof && ferror(fileIn))
+                LogPrintf("%s: failed to read %s after %u bytes\n", __func__, file.path.string(), nBufPos + nBuf);
+        }
+
+        // Find the records of the next batch
+        std::vector<Record> vRecords;
+        size_t nBytes = 0;
+        size_t nScan = 0;
+        bool fEnd = false;
+        std::vector<size_t> vTruncated;
+        while (nBytes < IMPORT_BATCH_SIZE) {
+            const unsigned char* p = static_cast<const unsigned char*>(memchr(vBuf.data() + nScan, messageStart[0], nBuf - nScan));
+            if (!p) {
+                nScan = nBuf;
+                fEnd = fEof;
+                break;
+            }
+            const size_t nStart = p - vBuf.data();
+            if (nStart + RECORD_HEADER_SIZE > nBuf) {
+                // no valid block header found; don't complain
+                nScan = nStart;
+                fEnd = fEof;
+                break;
+            }
+            nScan = nStart + 1;
+            if (memcmp(p, messageStart, CMessageHeader::MESSAGE_START_SIZE))
+                continue;
+            const unsigned int nSize = ReadLE32(p + CMessageHeader::MESSAGE_START_SIZE);
+            if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                continue;
+            if (nStart + RECORD_HEADER_SIZE + nSize > nBuf) {
+                if (!fEof) {
+                    nScan = nStart;
+                    break;
+                }
+                vTruncated.push_back(nStart);
+                continue;
+            }
+            vRecords.push_back(Record{nStart, nSize});
+            nBytes += nSize;
+            nScan = nStart + RECORD_HEADER_SIZE + nSize;
+        }
+
+        // Deserialize and check them
+        std::vector<CImportedBlock> vBlocks(vRecords.size());
+        std::vector<size_t> vConsumed(vRecords.size());
+        std::vector<std::string> vErrors(vRecords.size());
+        ParallelFor(vRecords.size(), nThreads, [&](size_t i) {
+            const Record& rec = vRecords[i];
+            const char* pdata = reinterpret_cast<const char*>(vBuf.data() + rec.nStart + RECORD_HEADER_SIZE);
+            try {
+                CDataStream ss(pdata, pdata + rec.nSize, SER_DISK, CLIENT_VERSION);
+                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+                ss >> *pblock;
+                vConsumed[i] = rec.nSize - ss.size();
+                CValidationState state;
+                CheckBlock(*pblock, state, params);
+                vBlocks[i].pblock = pblock;
+                vBlocks[i].pos = CDiskBlockPos(file.nFile, nBufPos + rec.nStart + RECORD_HEADER_SIZE);
+                vBlocks[i].nSize = rec.nSize;
+            } catch (const std::exception& e) {
+                vErrors[i] = e.what();
+            }
+        });
+
+        // Resume one byte after a record that failed, or where one turned out to end
+        size_t nResume = nScan;
+        for (size_t i = 0; i < vRecords.size(); i++) {
+            if (!vBlocks[i].pblock) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, vErrors[i]);
+                vBlocks.resize(i);
+                nResume = vRecords[i].nStart + 1;
+                fEnd = false;
+                break;
+            }
+            if (vConsumed[i] != vRecords[i].nSize) {
+                vBlocks.resize(i + 1);
+                nResume = vRecords[i].nStart + RECORD_HEADER_SIZE + vConsumed[i];
+                fEnd = false;
+                break;
+            }
+        }
+        for (size_t nStart : vTruncated) {
+            if (nStart < nResume)
+                LogPrintf("%s: Deserialize or I/O error - block at %u of %s ends past the end of the file\n", __func__, nBufPos + nStart, file.path.string());
+        }
+        if (!vBlocks.empty() && !Push(std::move(vBlocks))) {
+            fclose(fileIn);
+            return false;
+        }
+        fContinue = !fEnd && (nResume < nBuf || !fEof);
+
+        memmove(vBuf.data(), vBuf.data() + nResume, nBuf - nResume);
+        nBuf -= nResume;
+        nBufPos += nResume;
+    }
+    fclose(fileIn);
+    return true;
+}
+
+bool CBlockImportReader::Push(std::vector<CImportedBlock>&& vBlocks)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (queue.size() >= MAX_IMPORT_QUEUED_BATCHES && !fStop)
+        cond.wait(lock);
+    if (fStop)
+        return false;
+    queue.push_back(std::move(vBlocks));
+    cond.notify_all();
+    return true;
+}
+
+bool CBlockImportReader::Next(CImportedBlock& block)
+{
+    while (nCurrent == vCurrent.size()) {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        while (queue.empty() && !fDone)
+            cond.wait(lock);
+        if (queue.empty())
+            return false;
+        vCurrent = std::move(queue.front());
+        queue.pop_front();
+        nCurrent = 0;
+        cond.notify_all();
+    }
+    block = std::move(vCurrent[nCurrent++]);
+    return true;
+}
+
+CBlockPrefetcher::CBlockPrefetcher(std::vector<Entry>&& vPathIn, const CCoinsView* pcoinsviewIn, const Consensus::Params& paramsIn, int nThreads)
+    : vPath(std::move(vPathIn)), pcoinsview(pcoinsviewIn), params(paramsIn)
+{
+    for (size_t i = 0; i < vPath.size(); i++)
+        mapPosition[vPath[i].pindex] = i;
+    nStartTime = nLastReport = GetTimeMillis();
+    for (int i = 0; i < nThreads && (size_t)i < vPath.size(); i++)
+        threads.create_thread(boost::bind(&CBlockPrefetcher::ThreadPrefetch, this));
+}
+
+CBlockPrefetcher::~CBlockPrefetcher()
+{
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        fStop = true;
+    }
+    cond.notify_all();
+    threads.join_all();
+    if (nTakes > 0) {
+        int64_t nTime = std::max<int64_t>(GetTimeMillis() - nStartTime, 1);
+        LogPrintf("Connected %u imported blocks in %dms (%.1f blocks/s), %u of them read ahead\n", nTakes, nTime, nTakes * 1000.0 / nTime, nHits);
+    }
+}
+
+void CBlockPrefetcher::ThreadPrefetch()
+{
+    RenameThread("ybtc-prefetch");
+    while (true) {
+        size_t i;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (!fStop && nNext < vPath.size() && (nNext >= nTaken + MAX_PREFETCH_BLOCKS || nReadyBytes >= MAX_PREFETCH_BYTES))
+                cond.wait(lock);
+            if (fStop || nNext >= vPath.size())
+                return;
+            i = nNext++;
+        }
+
+        // ConnectTip reads whatever is missing here itself
+        const Entry& entry = vPath[i];
+        std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        if (!ReadBlockFromDisk(*pblock, entry.pos, params) || pblock->GetHash() != entry.hash)
+            continue;
+        CValidationState state;
+        CheckBlock(*pblock, state, params);
+        if (pcoinsview) {
+            for (const auto& tx : pblock->vtx) {
+                if (tx->IsCoinBase())
+                    continue;
+                for (const CTxIn& txin : tx->vin)
+                    pcoinsview->HaveCoin(txin.prevout);
+            }
+        }
+        const size_t nSize = ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION);
+
+        boost::lock_guard<boost::mutex> lock(mutex);
+        if (i < nTaken)
+            continue;
+        mapReady[i] = std::make_pair(std::move(pblock), nSize);
+        nReadyBytes += nSize;
+    }
+}
+
+std::shared_ptr<const CBlock> CBlockPrefetcher::Take(const CBlockIndex* pindex)
+{
+    auto itPosition = mapPosition.find(pindex);
+    if (itPosition == mapPosition.end())
+        return nullptr;
+    const size_t nPosition = itPosition->second;
+
+    std::shared_ptr<const CBlock> pblock;
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        nTaken = std::max(nTaken, nPosition + 1);
+        nNext = std::max(nNext, nTaken);
+        while (!mapReady.empty() && mapReady.begin()->first < nTaken) {
+            if (mapReady.begin()->first == nPosition)
+                pblock = mapReady.begin()->second.first;
+            nReadyBytes -= mapReady.begin()->second.second;
+            mapReady.erase(mapReady.begin());
+        }
+    }
+    cond.notify_all();
+
+    nTakes++;
+    if (pblock)
+        nHits++;
+    int64_t nNow = GetTimeMillis();
+    if (nNow - nLastReport >= IMPORT_PROGRESS_INTERVAL * 1000) {
+        LogPrintf("Connecting imported blocks: height %d, %.1f blocks/s, %u of %u read ahead\n", pindex->nHeight,
+            (nTakes - nLastReportTakes) * 1000.0 / (nNow - nLastReport), nHits, nTakes);
+        nLastReport = nNow;
+        nLastReportTakes = nTakes;
+    }
+    return pblock;
+}
@@ -0,0 +1,164 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef YBTC_BLOCKIMPORT_H
+#define YBTC_BLOCKIMPORT_H
+
+#include "chain.h"
+#include "fs.h"
+#include "primitives/block.h"
+#include "protocol.h"
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <unordered_map>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+class CCoinsView;
+
+namespace Consensus {
+struct Params;
+}
+
+/** Serialized bytes of blocks decoded together, by the scanning thread and its helpers */
+static const size_t IMPORT_BATCH_SIZE = 8 * 1024 * 1024;
+/** Decoded batches the scanning may get ahead of the blocks being accepted */
+static const size_t MAX_IMPORT_QUEUED_BATCHES = 4;
+/** Serialized bytes of imported blocks that may wait in memory for their parent */
+static const size_t MAX_IMPORT_UNKNOWN_PARENT_BYTES = 64 * 1024 * 1024;
+/** Seconds between reports of the import and connect throughput */
+static const int64_t IMPORT_PROGRESS_INTERVAL = 10;
+
+/** Threads reading blocks ahead of their connection */
+static const int BLOCK_PREFETCH_THREADS = 2;
+/** Blocks on the path to the best header that may be read ahead of the tip */
+static const size_t MAX_PREFETCH_BLOCKS = 1024;
+/** Serialized bytes of blocks read ahead and not taken yet */
+static const size_t MAX_PREFETCH_BYTES = 64 * 1024 * 1024;
+
+struct CBlockImportFile
+{
+    fs::path path;
+    int nFile; //!< Block file being reindexed, or -1 for a file imported from elsewhere
+};
+
+struct CImportedBlock
+{
+    std::shared_ptr<const CBlock> pblock;
+    CDiskBlockPos pos; //!< Where the block data starts; nFile is -1 outside of the block files
+    unsigned int nSize = 0;
+};
+
+/**
+ * Reads blocks from block files (-reindex) or exported ones (bootstrap.dat,
+ * -loadblock) for an import, ahead of the thread that accepts them.
+ *
+ * A thread reads the files in large chunks and finds the records in them the
+ * same way the import always has: the message start, a size and the
+ * block. The records of a chunk are deserialized and checked (CheckBlock) by
+ * nThreads threads at once, which leaves fChecked set on the good ones. Where
+ * a record does not decode, or decodes to less than its size, the blocks after
+ * it are dropped and the scan resumes where the one-record-at-a-time reader
+ * would have resumed, so the same blocks come out in the same order.
+ */
+class CBlockImportReader
+{
+public:
+    CBlockImportReader(const std::vector<CBlockImportFile>& vFilesIn, const CMessageHeader::MessageStartChars& messageStartIn, const Consensus::Params& paramsIn, int nThreadsIn);
+    ~CBlockImportReader();
+
+    CBlockImportReader(const CBlockImportReader&) = delete;
+    CBlockImportReader& operator=(const CBlockImportReader&) = delete;
+
+    /** Next block in file order. False once all files are read. */
+    bool Next(CImportedBlock& block);
+
+private:
+    struct Record
+    {
+        size_t nStart;       //!< Offset of the message start in the chunk
+        unsigned int nSize;
+    };
+
+    const std::vector<CBlockImportFile> vFiles;
+    CMessageHeader::MessageStartChars messageStart;
+    const Consensus::Params& params;
+    const int nThreads;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<std::vector<CImportedBlock>> queue;
+    bool fDone = false;
+    bool fStop = false;
+    boost::thread thread;
+
+    //! Batch being handed out by Next (only touched by its caller)
+    std::vector<CImportedBlock> vCurrent;
+    size_t nCurrent = 0;
+
+    void ThreadScan();
+    /** Read one file; false if stopped meanwhile */
+    bool ScanFile(const CBlockImportFile& file);
+    /** Queue a batch, waiting while the queue is full; false if stopped meanwhile */
+    bool Push(std::vector<CImportedBlock>&& vBlocks);
+};
+
+/**
+ * Reads the blocks on a path of block index entries, in order and a bounded
+ * distance ahead of the one connected, while an import connects them. Each is
+ * checked (CheckBlock) and the coins its inputs spend are looked up in the
+ * coins database, so that ConnectTip finds the block in memory, its context-
+ * free checks done and the coins it needs warm in the database caches.
+ *
+ * Contract state is not touched: it is only safe to read in ConnectTip, under
+ * cs_main, so contracts keep executing there alone.
+ */
+class CBlockPrefetcher
+{
+public:
+    struct Entry
+    {
+        const CBlockIndex* pindex;
+        CDiskBlockPos pos;
+        uint256 hash;
+    };
+
+    CBlockPrefetcher(std::vector<Entry>&& vPathIn, const CCoinsView* pcoinsviewIn, const Consensus::Params& paramsIn, int nThreads);
+    ~CBlockPrefetcher();
+
+    CBlockPrefetcher(const CBlockPrefetcher&) = delete;
+    CBlockPrefetcher& operator=(const CBlockPrefetcher&) = delete;
+
+    /** The block of pindex if it was read ahead, or nullptr. Blocks before it on the path are dropped. */
+    std::shared_ptr<const CBlock> Take(const CBlockIndex* pindex);
+
+private:
+    const std::vector<Entry> vPath;
+    const CCoinsView* const pcoinsview;
+    const Consensus::Params& params;
+    std::unordered_map<const CBlockIndex*, size_t> mapPosition;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    size_t nNext = 0;  //!< Next position to read
+    size_t nTaken = 0; //!< Position after the last one taken
+    std::map<size_t, std::pair<std::shared_ptr<const CBlock>, size_t>> mapReady;
+    size_t nReadyBytes = 0;
+    bool fStop = false;
+    boost::thread_group threads;
+
+    int64_t nStartTime;
+    int64_t nLastReport;
+    uint64_t nTakes = 0;
+    uint64_t nHits = 0;
+    uint64_t nLastReportTakes = 0;
+
+    void ThreadPrefetch();
+};
+
+#endif // YBTC_BLOCKIMPORT_H
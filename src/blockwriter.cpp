@@ -0,0 +1,269 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#if defined(HAVE_CONFIG_H)
+#include "config/ybtc-config.h"
+#endif
+
+#include "blockwriter.h"
+
+#include "util.h"
+#include "utiltime.h"
+
+#include <errno.h>
+
+#if HAVE_DECL_PWRITEV
+#include <limits.h>
+#include <sys/uio.h>
+#endif
+
+#if HAVE_DECL_PWRITEV
+#ifdef IOV_MAX
+static const int MAX_GROUP_RECORDS = IOV_MAX;
+#else
+static const int MAX_GROUP_RECORDS = 1024;
+#endif
+
+/** Write all of iov at nPos of fd, resuming after short writes */
+static bool WriteVector(int fd, struct iovec* iov, int iovcnt, off_t nPos)
+{
+    while (iovcnt > 0) {
+        ssize_t nWritten = pwritev(fd, iov, iovcnt, nPos);
+        if (nWritten < 0) {
+            if (errno == EINTR)
+                continue;
+            return false;
+        }
+        nPos += nWritten;
+        while (iovcnt > 0 && (size_t)nWritten >= iov->iov_len) {
+            nWritten -= iov->iov_len;
+            iov++;
+            iovcnt--;
+        }
+        if (iovcnt > 0) {
+            iov->iov_base = static_cast<char*>(iov->iov_base) + nWritten;
+            iov->iov_len -= nWritten;
+        }
+    }
+    return true;
+}
+#else
+static const int MAX_GROUP_RECORDS = 1024;
+#endif
+
+CBlockFileWriter::CBlockFileWriter(PathFunc pathFuncIn, size_t nMaxPendingIn) : pathFunc(pathFuncIn), nMaxPending(nMaxPendingIn)
+{
+}
+
+CBlockFileWriter::~CBlockFileWriter()
+{
+    Stop();
+    Sync();
+}
+
+void CBlockFileWriter::Start()
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    if (pthread)
+        return;
+    fStop = false;
+    stats.fAsync = true;
+    pthread = new boost::thread(&CBlockFileWriter::ThreadWrite, this);
+}
+
+void CBlockFileWriter::Stop()
+{
+    boost::thread* pthreadStop;
+    {
+        // Appends from here on write in the caller
+        boost::lock_guard<boost::mutex> lock(mutex);
+        pthreadStop = pthread;
+        pthread = nullptr;
+        fStop = true;
+        stats.fAsync = false;
+    }
+    if (!pthreadStop)
+        return;
+    cond.notify_all();
+    pthreadStop->join();
+    delete pthreadStop;
+}
+
+void CBlockFileWriter::ThreadWrite()
+{
+    RenameThread("ybtc-blockwrite");
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (queue.empty() && !fStop)
+                cond.wait(lock);
+            if (queue.empty())
+                return;
+        }
+        boost::lock_guard<boost::mutex> lockWrite(csWrite);
+        boost::unique_lock<boost::mutex> lock(mutex);
+        WriteQueue(lock);
+    }
+}
+
+bool CBlockFileWriter::WriteQueue(boost::unique_lock<boost::mutex>& lock)
+{
+    if (queue.empty())
+        return fOk;
+    // Records queued from here on are left to the next call
+    std::vector<const Record*> vRecords;
+    vRecords.reserve(queue.size());
+    for (const Record& rec : queue)
+        vRecords.push_back(&rec);
+    lock.unlock();
+
+    int64_t nStart = GetTimeMicros();
+    size_t nBytes = 0;
+    uint64_t nGroups = 0;
+    bool fWritten = true;
+    for (size_t i = 0; i < vRecords.size();) {
+        const Record& first = *vRecords[i];
+        size_t nEnd = i + 1;
+        unsigned int nPosEnd = first.nPos + first.data.size();
+        while (nEnd < vRecords.size() && nEnd - i < (size_t)MAX_GROUP_RECORDS &&
+               vRecords[nEnd]->nFile == first.nFile && vRecords[nEnd]->fUndo == first.fUndo && vRecords[nEnd]->nPos == nPosEnd) {
+            nPosEnd += vRecords[nEnd]->data.size();
+            nEnd++;
+        }
+        FILE* file = GetFile(first.nFile, first.fUndo);
+        bool fGroupOk = file != nullptr;
+#if HAVE_DECL_PWRITEV
+        std::vector<struct iovec> iov(nEnd - i);
+        for (size_t j = i; j < nEnd; j++) {
+            iov[j - i].iov_base = const_cast<unsigned char*>(vRecords[j]->data.data());
+            iov[j - i].iov_len = vRecords[j]->data.size();
+        }
+        fGroupOk = fGroupOk && WriteVector(fileno(file), iov.data(), iov.size(), first.nPos);
+#else
+        fGroupOk = fGroupOk && fseek(file, first.nPos, SEEK_SET) == 0;
+        for (size_t j = i; fGroupOk && j < nEnd; j++)
+            fGroupOk = fwrite(vRecords[j]->data.data(), 1, vRecords[j]->data.size(), file) == vRecords[j]->data.size();
+        // Readers open the file on their own
+        fGroupOk = fGroupOk && fflush(file) == 0;
+#endif
+        if (!fGroupOk) {
+            LogPrintf("%s: failed to write %u bytes at %u of %s\n", __func__, nPosEnd - first.nPos, first.nPos, pathFunc(first.nFile, first.fUndo).string());
+            fWritten = false;
+        }
+        for (size_t j = i; j < nEnd; j++)
+            nBytes += vRecords[j]->data.size();
+        nGroups++;
+        i = nEnd;
+    }
+    int64_t nWriteTime = GetTimeMicros() - nStart;
+
+    lock.lock();
+    // Failed records are dropped as well: fOk stays false and readers must not wait for them
+    queue.erase(queue.begin(), queue.begin() + vRecords.size());
+    nPending -= nBytes;
+    fOk = fOk && fWritten;
+    stats.nGroups += nGroups;
+    stats.nWriteTime += nWriteTime;
+    cond.notify_all();
+    return fOk;
+}
+
+FILE* CBlockFileWriter::GetFile(int nFile, bool fUndo)
+{
+    FILE*& file = mapFiles[std::make_pair(nFile, fUndo)];
+    if (!file) {
+        fs::path path = pathFunc(nFile, fUndo);
+        file = fsbridge::fopen(path, "rb+");
+        if (!file)
+            file = fsbridge::fopen(path, "wb+");
+        if (!file)
+            LogPrintf("Unable to open file %s\n", path.string());
+    }
+    return file;
+}
+
+bool CBlockFileWriter::Append(int nFile, bool fUndo, unsigned int nPos, std::vector<unsigned char>&& data)
+{
+    const size_t nSize = data.size();
+    boost::unique_lock<boost::mutex> lockWrite(csWrite, boost::defer_lock);
+    {
+        boost::lock_guard<boost::mutex> lock(mutex);
+        if (!pthread)
+            lockWrite.lock();
+    }
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!fOk)
+        return false;
+    if (pthread && !queue.empty() && nPending + nSize > nMaxPending) {
+        int64_t nStart = GetTimeMicros();
+        while (pthread && !queue.empty() && nPending + nSize > nMaxPending)
+            cond.wait(lock);
+        stats.nWaitTime += GetTimeMicros() - nStart;
+    }
+    // The writer only waits for an empty queue: records added meanwhile join its next group
+    const bool fWake = queue.empty();
+    queue.push_back(Record{nFile, fUndo, nPos, std::move(data)});
+    nPending += nSize;
+    stats.nAppends++;
+    stats.nBytes += nSize;
+    if (lockWrite.owns_lock())
+        return WriteQueue(lock);
+    if (fWake)
+        cond.notify_all();
+    return true;
+}
+
+void CBlockFileWriter::WaitForRead(int nFile, bool fUndo, unsigned int nPos)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    int64_t nStart = 0;
+    while (true) {
+        bool fPending = false;
+        for (const Record& rec : queue) {
+            if (rec.nFile == nFile && rec.fUndo == fUndo && nPos >= rec.nPos && nPos < rec.nPos + rec.data.size()) {
+                fPending = true;
+                break;
+            }
+        }
+        if (!fPending)
+            break;
+        if (nStart == 0)
+            nStart = GetTimeMicros();
+        cond.wait(lock);
+    }
+    if (nStart != 0)
+        stats.nWaitTime += GetTimeMicros() - nStart;
+}
+
+bool CBlockFileWriter::Sync()
+{
+    boost::lock_guard<boost::mutex> lockWrite(csWrite);
+    bool fWritten;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fWritten = WriteQueue(lock);
+    }
+    int64_t nStart = GetTimeMicros();
+    size_t nFiles = mapFiles.size();
+    for (const auto& file : mapFiles) {
+        if (file.second) {
+            FileCommit(file.second);
+            fclose(file.second);
+        }
+    }
+    mapFiles.clear();
+    boost::lock_guard<boost::mutex> lock(mutex);
+    stats.nSyncs++;
+    stats.nFilesSynced += nFiles;
+    stats.nSyncTime += GetTimeMicros() - nStart;
+    return fWritten;
+}
+
+CBlockWriterStats CBlockFileWriter::GetStats()
+{
+    boost::lock_guard<boost::mutex> lock(mutex);
+    CBlockWriterStats ret = stats;
+    ret.nPending = nPending;
+    return ret;
+}
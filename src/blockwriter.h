@@ -0,0 +1,109 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef YBTC_BLOCKWRITER_H
+#define YBTC_BLOCKWRITER_H
+
+#include "fs.h"
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <utility>
+#include <vector>
+
+#include <boost/thread.hpp>
+
+/** Default for -blockwriter, appending block and undo data in a background thread */
+static const bool DEFAULT_BLOCK_WRITER = true;
+/** Bytes of block and undo data that may wait for the writer before appends block */
+static const size_t MAX_BLOCK_WRITER_PENDING = 32 * 1024 * 1024;
+
+struct CBlockWriterStats
+{
+    bool fAsync = false;         //!< Whether a thread does the writes
+    uint64_t nAppends = 0;       //!< Blocks and undo records appended
+    uint64_t nBytes = 0;         //!< ...bytes of them
+    uint64_t nGroups = 0;        //!< Vectored writes they took
+    uint64_t nSyncs = 0;         //!< Durability points
+    uint64_t nFilesSynced = 0;   //!< Files made durable by them
+    size_t nPending = 0;         //!< Bytes queued and not yet written
+    int64_t nWriteTime = 0;      //!< Microseconds spent writing
+    int64_t nSyncTime = 0;       //!< Microseconds spent syncing
+    int64_t nWaitTime = 0;       //!< Microseconds appends and reads waited for the writer
+};
+
+/**
+ * Appends block (blk?????.dat) and undo (rev?????.dat) records for the caller,
+ * who has already placed them with FindBlockPos/FindUndoPos.
+ *
+ * Records go to a queue that a thread writes out in groups: the records queued
+ * meanwhile for one file at consecutive positions take a single vectored write
+ * to a handle that stays open. Nothing is synced per record. Sync() is the
+ * durability point: it writes out the queue and syncs each file written since
+ * the previous one, once. The block index must only be written after it, so
+ * that it never names data that a crash could lose.
+ *
+ * Without the thread (before Start, after Stop) Append writes in the caller.
+ */
+class CBlockFileWriter
+{
+public:
+    /** Path of block file nFile, or of its undo file */
+    typedef std::function<fs::path(int nFile, bool fUndo)> PathFunc;
+
+    explicit CBlockFileWriter(PathFunc pathFuncIn, size_t nMaxPendingIn = MAX_BLOCK_WRITER_PENDING);
+    ~CBlockFileWriter();
+
+    void Start();
+    /** Write out the queue and stop the thread */
+    void Stop();
+
+    /** Queue data to be written at nPos of file nFile. False once a write failed. */
+    bool Append(int nFile, bool fUndo, unsigned int nPos, std::vector<unsigned char>&& data);
+
+    /** Wait until data queued for position nPos of file nFile, if any, can be read from the file */
+    void WaitForRead(int nFile, bool fUndo, unsigned int nPos);
+
+    /** Write out the queue, sync what was written and close the files. False if any write failed. */
+    bool Sync();
+
+    CBlockWriterStats GetStats();
+
+private:
+    struct Record
+    {
+        int nFile;
+        bool fUndo;
+        unsigned int nPos;
+        std::vector<unsigned char> data;
+    };
+
+    const PathFunc pathFunc;
+    const size_t nMaxPending;
+
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    //! Records not yet written, oldest first; the writer drops them once they are
+    std::deque<Record> queue;
+    size_t nPending = 0;
+    bool fStop = false;
+    bool fOk = true;
+    CBlockWriterStats stats;
+    boost::thread* pthread = nullptr;
+
+    //! Files written since the last sync (only touched with csWrite held)
+    boost::mutex csWrite;
+    std::map<std::pair<int, bool>, FILE*> mapFiles;
+
+    void ThreadWrite();
+    /** Take the records at the front of the queue and write them. Requires csWrite. */
+    bool WriteQueue(boost::unique_lock<boost::mutex>& lock);
+    bool WriteRecords(std::deque<Record>::const_iterator begin, std::deque<Record>::const_iterator end);
+    FILE* GetFile(int nFile, bool fUndo);
+};
+
+#endif // YBTC_BLOCKWRITER_H
@@ -6,13 +6,120 @@
 #include "casino.h"
 
 #include "arith_uint256.h"
+#include "casinoschedule.h"
 #include "chain.h"
+#include "consensus/validation.h"
+#include "key.h"
 #include "primitives/block.h"
+#include "pubkey.h"
 #include "uint256.h"
+#include "validation.h"
 
+//! Block intervals after its parent from which the other winners of the phase may fill a slot
+static const int64_t CASINO_SLOT_TIMEOUT = 4;
+//! Block intervals after its parent from which anyone may fill a slot, so a phase whose winners all left still ends
+static const int64_t CASINO_SLOT_ABANDONED = CHAIN_PHASE_SIZE;
+//! Seconds a casino header may be ahead of adjusted time, one block interval
+static const int64_t CASINO_MAX_FUTURE_TIME = CHAIN_BLOCK_INTERVAL / 1000;
 
 bool CheckCasino(uint256 hash, unsigned int nBits, const Consensus::Params& params)
 {
 
     return true;
 }
+
+bool IsCasinoSlotEnforced(int nHeight, const Consensus::Params& params)
+{
+    return nHeight >= params.CasinoSlotHeight;
+}
+
+int64_t GetCasinoSlotTime(const CBlockIndex* pindexPrev, CasinoSlotProducer producer)
+{
+    const int64_t nIntervals = producer == CASINO_PRODUCER_MINER ? 1 : producer == CASINO_PRODUCER_WINNERS ? CASINO_SLOT_TIMEOUT : CASINO_SLOT_ABANDONED;
+    return pindexPrev->GetBlockTime() + nIntervals * CHAIN_BLOCK_INTERVAL / 1000;
+}
+
+// Compare the producer to the schedule of the block's phase
+static bool CheckScheduledProducer(const CBlockHeader& block, CValidationState& state, const CBlockIndex* pindexPrev, const CPubKey& producer, const CCasinoSchedule& schedule)
+{
+    const int nHeight = pindexPrev->nHeight + 1;
+    const sc::h160* pminer = schedule.SlotMiner(nHeight);
+    if (!pminer || block.GetBlockTime() >= GetCasinoSlotTime(pindexPrev, CASINO_PRODUCER_ANYONE))
+        return true;
+    const CKeyID id = producer.GetID();
+    const sc::h160 address(std::vector<unsigned char>(id.begin(), id.end()));
+    if (address == *pminer)
+        return true;
+    if (block.GetBlockTime() >= GetCasinoSlotTime(pindexPrev, CASINO_PRODUCER_WINNERS) && schedule.MinerIndex(address) != 0)
+        return true;
+    return state.DoS(100, false, REJECT_INVALID, "bad-casino-producer", false, strprintf("slot belongs to %s", pminer->hex()));
+}
+
+// Recover the producer of a header, from a canonical signature only
+static bool RecoverCasinoProducer(const CBlockHeader& block, CValidationState& state, CPubKey& producer)
+{
+    // RecoverCompact only looks at the low bits of the header byte and takes
+    // high-S signatures, so each of those would give the block another hash
+    if (block.vchBlockSig.size() != 65 || block.vchBlockSig[0] < 31 || block.vchBlockSig[0] > 34 || !CPubKey::CheckLowSCompact(block.vchBlockSig))
+        return state.DoS(100, false, REJECT_INVALID, "bad-casino-sig", false, "non-canonical producer signature");
+    if (!producer.RecoverCompact(block.GetSignatureHash(), block.vchBlockSig))
+        return state.DoS(100, false, REJECT_INVALID, "bad-casino-sig", false, "invalid producer signature");
+    return true;
+}
+
+bool CheckCasinoHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& params, const CBlockIndex* pindexPrev, int64_t nAdjustedTime)
+{
+    AssertLockHeld(cs_main);
+    const int nHeight = pindexPrev->nHeight + 1;
+    if (!IsCasinoSlotEnforced(nHeight, params))
+        return true;
+
+    if (block.nHeight != (uint32_t)nHeight)
+        return state.DoS(100, false, REJECT_INVALID, "bad-casino-height", false, "header height does not follow its parent");
+    if (!(block.nVersion & BLOCK_VERSION_CASINO_SIGNED) || block.vchBlockSig.empty())
+        return state.DoS(100, false, REJECT_INVALID, "bad-casino-unsigned", false, "header is not signed by its producer");
+    if (block.GetBlockTime() < GetCasinoSlotTime(pindexPrev, CASINO_PRODUCER_MINER))
+        return state.DoS(100, false, REJECT_INVALID, "time-too-early-for-slot", false, "block is earlier than its slot");
+    // The slot timeouts are measured against nTime, which the producer picks;
+    // holding it to our clock keeps a slot from being taken over ahead of time.
+    // Not a DoS: the clocks of honest peers differ by a few seconds too.
+    if (block.GetBlockTime() > nAdjustedTime + CASINO_MAX_FUTURE_TIME)
+        return state.Invalid(false, REJECT_INVALID, "time-too-new-for-slot", "block timestamp ahead of its slot");
+
+    CPubKey producer;
+    if (!RecoverCasinoProducer(block, state, producer))
+        return false;
+
+    // Advisory: only if the schedule is known without connecting anything
+    CCasinoSchedule schedule;
+    if (!GetCasinoSchedule(pindexPrev, GetCasinoPhase(pindexPrev), schedule))
+        return true;
+    return CheckScheduledProducer(block, state, pindexPrev, producer, schedule);
+}
+
+bool CheckCasinoProducer(const CBlockHeader& block, CValidationState& state, const Consensus::Params& params, const CBlockIndex* pindexPrev)
+{
+    AssertLockHeld(cs_main);
+    const int nHeight = pindexPrev->nHeight + 1;
+    if (!IsCasinoSlotEnforced(nHeight, params))
+        return true;
+
+    CPubKey producer;
+    if (!RecoverCasinoProducer(block, state, producer))
+        return false;
+
+    // Phase 0 has no schedule before its block 1 exists
+    const uint32_t nPhase = GetCasinoPhase(pindexPrev);
+    if (!pindexPrev->GetAncestor(GetCasinoScheduleHeight(nPhase)))
+        return true;
+    CCasinoSchedule schedule;
+    if (!GetCasinoSchedule(pindexPrev, nPhase, schedule))
+        return state.Error(strprintf("cannot read the casino schedule of phase %u", nPhase));
+    return CheckScheduledProducer(block, state, pindexPrev, producer, schedule);
+}
+
+bool SignCasinoHeader(CBlockHeader& block, const CKey& key)
+{
+    assert(block.nVersion & BLOCK_VERSION_CASINO_SIGNED);
+    return key.SignCompact(block.GetSignatureHash(), block.vchBlockSig);
+}
@@ -12,9 +12,49 @@
 
 class CBlockHeader;
 class CBlockIndex;
+class CKey;
+class CValidationState;
 class uint256;
 
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits */
 bool CheckCasino(uint256 hash, unsigned int nBits, const Consensus::Params&);
 
+/** Whether the block at nHeight must be signed by the miner of its casino slot */
+bool IsCasinoSlotEnforced(int nHeight, const Consensus::Params& params);
+
+/** Who may fill a casino slot, in the order the slot opens to them */
+enum CasinoSlotProducer {
+    CASINO_PRODUCER_MINER,   //!< The slot's miner in the phase schedule
+    CASINO_PRODUCER_WINNERS, //!< Any winner of the phase, once the slot's miner timed out
+    CASINO_PRODUCER_ANYONE,  //!< Any signer, once all winners had time to take the slot over
+};
+
+/** Earliest time of a block on pindexPrev that producer may fill the slot of */
+int64_t GetCasinoSlotTime(const CBlockIndex* pindexPrev, CasinoSlotProducer producer);
+
+/**
+ * Check what a casino header can show with nothing but the headers before it:
+ * the block is at its height, carries a canonical producer signature (a
+ * compressed key's, low-S) and is not earlier than its slot, nor more than a
+ * block interval past nAdjustedTime, so that the slot timeouts follow the time
+ * the header arrives rather than the one its producer wrote. This is not slot
+ * validation. Who signed is only compared to the schedule of the phase when
+ * that schedule happens to be known already, to turn a bad producer away
+ * early; during headers-first sync it usually is not, and the header passes.
+ * CheckCasinoProducer enforces the producer when the block is connected.
+ * Requires cs_main.
+ */
+bool CheckCasinoHeader(const CBlockHeader& block, CValidationState& state, const Consensus::Params& params, const CBlockIndex* pindexPrev, int64_t nAdjustedTime);
+
+/**
+ * Check that the producer of a block on pindexPrev may fill its slot at the
+ * block's time. The schedule of a phase is read from the state of the block that
+ * closed the previous phase, so that block must be connected, as all ancestors
+ * of a block being connected are. Requires cs_main.
+ */
+bool CheckCasinoProducer(const CBlockHeader& block, CValidationState& state, const Consensus::Params& params, const CBlockIndex* pindexPrev);
+
+/** Sign a header as its producer; the header must have BLOCK_VERSION_CASINO_SIGNED set */
+bool SignCasinoHeader(CBlockHeader& block, const CKey& key);
+
 #endif // YBTC_POW_H
@@ -0,0 +1,161 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "casinoschedule.h"
+
+#include "chain.h"
+#include "txdb.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+#include "scsha3.h"
+#include "scrlp.h"
+
+#include <algorithm>
+#include <map>
+
+// Storage layout of the casino contract (GENESIS_CONTRACT_CODE)
+static const unsigned int CASINO_SLOT_PHASE = 0x001;   //!< Phase set by the last setNextWinners
+static const unsigned int CASINO_SLOT_PLAYERS = 0x002; //!< Address of each of the 256 players
+static const unsigned int CASINO_SLOT_WINNERS = 0x202; //!< CHAIN_PHASE_PLAYER player slots per phase
+static const unsigned int CASINO_SLOT_SEEDS = 0x302;   //!< Seed of each phase
+static const unsigned int CASINO_PLAYERS = 256;
+//! The winners and seeds of a phase are overwritten this many phases later
+static const unsigned int CASINO_PHASE_RING = 128;
+
+//! Schedules by the hash of the block that set them (protected by cs_main)
+static std::map<uint256, CCasinoSchedule> mapCasinoSchedules;
+
+const sc::h160* CCasinoSchedule::SlotMiner(int nHeight) const
+{
+    if (vMiners.empty())
+        return nullptr;
+    // The miner with winner index i builds on the blocks whose index in the phase is i - 1
+    return &vMiners[((nHeight - 1) % CHAIN_PHASE_SIZE + 1) % vMiners.size()];
+}
+
+uint32_t CCasinoSchedule::MinerIndex(const sc::h160& address) const
+{
+    for (uint32_t i = 0; i < vMiners.size(); i++)
+        if (vMiners[i] == address)
+            return i + 1;
+    return 0;
+}
+
+uint32_t GetCasinoPhase(const CBlockIndex* pindexPrev)
+{
+    return pindexPrev->nHeight / CHAIN_PHASE_SIZE;
+}
+
+int GetCasinoScheduleHeight(uint32_t nPhase)
+{
+    return nPhase == 0 ? 1 : nPhase * CHAIN_PHASE_SIZE;
+}
+
+// Read the winners of nPhase the way isWinnerMe and getWinnerSeed do, at the
+// state root of pindex, through a fork so pState and its caches are left alone.
+// fComplete is false if the contract at that root has not set the winners of
+// nPhase, or has overwritten them since.
+static bool ReadCasinoSchedule(const CBlockIndex* pindex, uint32_t nPhase, CCasinoSchedule& schedule, bool& fComplete)
+{
+    AssertLockHeld(cs_main);
+    schedule = CCasinoSchedule();
+    schedule.nPhase = nPhase;
+    schedule.hashBlock = pindex->GetBlockHash();
+    fComplete = false;
+
+    const sc::Address casino(ParseHex(GENESIS_CONTRACT_ADDRESS_ETH));
+    sc::h256 hashStateRoot(sc::sha3(sc::rlp("")));
+    if (pindex->hashStateRoot != uint256())
+        hashStateRoot = sc::uintToh256(pindex->hashStateRoot);
+
+    try {
+        sc::State view = sc::State::fork(*pState, hashStateRoot);
+        sc::u256 nLastPhase = view.storage(casino, CASINO_SLOT_PHASE);
+        if (nPhase > nLastPhase || nLastPhase >= nPhase + CASINO_PHASE_RING)
+            return true;
+        const unsigned int nRing = nPhase % CASINO_PHASE_RING;
+        schedule.nSeed = static_cast<uint32_t>(view.storage(casino, CASINO_SLOT_SEEDS + nRing) & 0xffff);
+        for (unsigned int i = 0; i < CHAIN_PHASE_PLAYER; i++) {
+            sc::u256 nPlayer = view.storage(casino, CASINO_SLOT_WINNERS + CHAIN_PHASE_PLAYER * nRing + i);
+            if (nPlayer >= CASINO_PLAYERS)
+                break;
+            schedule.vPlayers.push_back(static_cast<uint32_t>(nPlayer));
+            schedule.vMiners.push_back(sc::right160(sc::h256(view.storage(casino, CASINO_SLOT_PLAYERS + nPlayer))));
+        }
+        // A phase the casino set too few winners for has none
+        if (schedule.vMiners.size() != CHAIN_PHASE_PLAYER) {
+            schedule.vPlayers.clear();
+            schedule.vMiners.clear();
+        }
+        fComplete = true;
+    } catch (...) {
+        return false;
+    }
+    return true;
+}
+
+bool GetCasinoSchedule(const CBlockIndex* pindex, uint32_t nPhase, CCasinoSchedule& schedule)
+{
+    AssertLockHeld(cs_main);
+    const CBlockIndex* pindexSchedule = pindex->GetAncestor(GetCasinoScheduleHeight(nPhase));
+    if (!pindexSchedule)
+        return false;
+    const uint256& hashBlock = pindexSchedule->GetBlockHash();
+
+    std::map<uint256, CCasinoSchedule>::const_iterator it = mapCasinoSchedules.find(hashBlock);
+    if (it != mapCasinoSchedules.end()) {
+        schedule = it->second;
+        return true;
+    }
+
+    if (!pblocktree || !pblocktree->ReadCasinoSchedule(hashBlock, schedule) || schedule.nPhase != nPhase) {
+        // Only a connected block's state root is in the state DB
+        if (!pindexSchedule->IsValid(BLOCK_VALID_SCRIPTS))
+            return false;
+        bool fComplete;
+        if (!ReadCasinoSchedule(pindexSchedule, nPhase, schedule, fComplete))
+            return error("%s: cannot read the winners of phase %u at block %s", __func__, nPhase, hashBlock.ToString());
+        // Without winners to keep, read it again next time rather than pin an empty schedule
+        if (!fComplete)
+            return true;
+        if (pblocktree && !pblocktree->WriteCasinoSchedule(schedule))
+            LogPrintf("%s: failed to write the schedule of phase %u\n", __func__, nPhase);
+    }
+    mapCasinoSchedules.emplace(hashBlock, schedule);
+    return true;
+}
+
+std::vector<sc::h160> GetUpcomingCasinoMiners(const CBlockIndex* pindex, int nSlots)
+{
+    AssertLockHeld(cs_main);
+    std::vector<sc::h160> vMiners;
+    CCasinoSchedule schedule;
+    bool fSchedule = false;
+    for (int nHeight = pindex->nHeight + 1; nHeight <= pindex->nHeight + nSlots; nHeight++) {
+        // The block at nHeight is built on one in phase (nHeight - 1) / CHAIN_PHASE_SIZE
+        uint32_t nPhase = (nHeight - 1) / CHAIN_PHASE_SIZE;
+        if (!fSchedule || schedule.nPhase != nPhase) {
+            // The next phase is unknown until the block that closes this one
+            if (!GetCasinoSchedule(pindex, nPhase, schedule))
+                break;
+            fSchedule = true;
+        }
+        const sc::h160* pminer = schedule.SlotMiner(nHeight);
+        if (pminer && std::find(vMiners.begin(), vMiners.end(), *pminer) == vMiners.end())
+            vMiners.push_back(*pminer);
+    }
+    return vMiners;
+}
+
+void CasinoScheduleBlockConnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    uint32_t nPhase = pindex->nHeight / CHAIN_PHASE_SIZE;
+    if (GetCasinoScheduleHeight(nPhase) != pindex->nHeight)
+        return;
+    CCasinoSchedule schedule;
+    if (GetCasinoSchedule(pindex, nPhase, schedule))
+        LogPrint(BCLog::BENCH, "CASINO schedule of phase %u set by block %s, %u miners\n", nPhase, pindex->GetBlockHash().ToString(), schedule.vMiners.size());
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef YBTC_CASINOSCHEDULE_H
+#define YBTC_CASINOSCHEDULE_H
+
+#include "scfixedhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <vector>
+
+class CBlockIndex;
+
+/**
+ * Winners of one casino phase.
+ *
+ * The block that closes phase n-1 (height n * CHAIN_PHASE_SIZE, or block 1 for
+ * phase 0, whose winners the contract constructor sets) leaves the player slots
+ * of the winners of phase n in the casino contract's storage. The schedule is
+ * read from there at that block's state root, so it depends on nothing but that
+ * block and is keyed by its hash: after a reorg the ancestors of the new tip
+ * lead to the schedule of whichever block closed the phase on that branch.
+ */
+struct CCasinoSchedule
+{
+    uint32_t nPhase;
+    uint256 hashBlock;              //!< Block whose state holds the winners
+    uint32_t nSeed;                 //!< getWinnerSeed(nPhase)
+    std::vector<uint32_t> vPlayers; //!< Player slot of each winner, in winner order
+    std::vector<sc::h160> vMiners;  //!< Address of each winner, empty if the phase has none
+
+    CCasinoSchedule() : nPhase(0), nSeed(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nPhase);
+        READWRITE(hashBlock);
+        READWRITE(nSeed);
+        READWRITE(vPlayers);
+        READWRITE(vMiners);
+    }
+
+    //! Winner whose turn it is to mine the block at nHeight, null if the phase has no winners
+    const sc::h160* SlotMiner(int nHeight) const;
+    //! 1-based position of address among the winners, 0 if it is not one (what isWinnerMe returns)
+    uint32_t MinerIndex(const sc::h160& address) const;
+};
+
+/** Phase of the block built on pindexPrev */
+uint32_t GetCasinoPhase(const CBlockIndex* pindexPrev);
+
+/** Height of the block that sets the winners of nPhase */
+int GetCasinoScheduleHeight(uint32_t nPhase);
+
+/**
+ * Schedule of nPhase on the chain ending at pindex, false if pindex is below the
+ * block that sets it or that block has not been connected yet. Served from
+ * memory, then from the block tree DB; only the first lookup of a phase on a
+ * branch reads the contract storage. If the casino had not set the winners of
+ * nPhase at that block the schedule has none, and is read again each time
+ * instead of being kept. Requires cs_main.
+ */
+bool GetCasinoSchedule(const CBlockIndex* pindex, uint32_t nPhase, CCasinoSchedule& schedule);
+
+/**
+ * Winners that mine the nSlots blocks after pindex, each once and in slot
+ * order, as far as the schedules on the chain ending at pindex know them.
+ * Requires cs_main.
+ */
+std::vector<sc::h160> GetUpcomingCasinoMiners(const CBlockIndex* pindex, int nSlots);
+
+/** Called by ConnectTip; reads the schedule set by a block that closes a phase while it is fresh */
+void CasinoScheduleBlockConnected(const CBlockIndex* pindex);
+
+#endif // YBTC_CASINOSCHEDULE_H
@@ -5,6 +5,58 @@
 
 #include "chain.h"
 
+#include <string.h>
+
+CBlockIndex* CBlockIndexArena::Allocate()
+{
+    if (nChunkUsed == nChunkSize) {
+        vChunks.emplace_back(new CBlockIndex[CHUNK_SIZE]);
+        nChunkSize = CHUNK_SIZE;
+        nChunkUsed = 0;
+        nCapacity += CHUNK_SIZE;
+    }
+    return &vChunks.back()[nChunkUsed++];
+}
+
+CBlockIndex* CBlockIndexArena::Allocate(size_t n)
+{
+    assert(n > 0);
+    vChunks.emplace_back(new CBlockIndex[n]);
+    nChunkSize = nChunkUsed = n;
+    nCapacity += n;
+    return &vChunks.back()[0];
+}
+
+void CBlockIndexArena::SetBlockSig(CBlockIndex& index, const std::vector<unsigned char>& vchBlockSig)
+{
+    index.pchBlockSig = nullptr;
+    index.nBlockSigSize = vchBlockSig.size();
+    if (vchBlockSig.empty())
+        return;
+    if (nSigChunkUsed + vchBlockSig.size() > SIG_CHUNK_SIZE) {
+        vSigChunks.emplace_back(new unsigned char[std::max(SIG_CHUNK_SIZE, vchBlockSig.size())]);
+        nSigChunkUsed = 0;
+    }
+    unsigned char* pch = &vSigChunks.back()[nSigChunkUsed];
+    memcpy(pch, vchBlockSig.data(), vchBlockSig.size());
+    nSigChunkUsed += vchBlockSig.size();
+    index.pchBlockSig = pch;
+}
+
+void CBlockIndexArena::KeepMapping(std::shared_ptr<const CFileMapping> mapping)
+{
+    vMappings.push_back(std::move(mapping));
+}
+
+void CBlockIndexArena::Clear()
+{
+    vChunks.clear();
+    nChunkSize = nChunkUsed = nCapacity = 0;
+    vSigChunks.clear();
+    nSigChunkUsed = SIG_CHUNK_SIZE;
+    vMappings.clear();
+}
+
 /**
  * CChain implementation
  */
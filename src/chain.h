@@ -12,8 +12,11 @@
 #include "tinyformat.h"
 #include "uint256.h"
 
+#include <memory>
 #include <vector>
 
+class CFileMapping;
+
 /**
  * Maximum amount of time that a block timestamp is allowed to exceed the
  * current network-adjusted time before the block will be accepted.
@@ -235,6 +238,9 @@ public:
     uint256 hashStateRoot;
     unsigned int nTime;
     unsigned int nBits;
+    //! vchBlockSig of the header, held by the CBlockIndexArena of the entry (see CBlockIndexArena::SetBlockSig)
+    const unsigned char* pchBlockSig;
+    unsigned int nBlockSigSize;
 
     //! (memory only) Sequential id assigned to distinguish order in which blocks are received.
     int32_t nSequenceId;
@@ -263,6 +269,8 @@ public:
         hashStateRoot = uint256();
         nTime          = 0;
         nBits          = 0;
+        pchBlockSig    = nullptr;
+        nBlockSigSize  = 0;
     }
 
     CBlockIndex()
@@ -279,6 +287,7 @@ public:
         hashStateRoot  = block.hashStateRoot;
         nTime          = block.nTime;
         nBits          = block.nBits;
+        // The signature is left to the arena that holds the entry
     }
 
     CDiskBlockPos GetBlockPos() const {
@@ -310,6 +319,7 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nHeight        = nHeight;
+        block.vchBlockSig.assign(pchBlockSig, pchBlockSig + nBlockSigSize);
         return block;
     }
 
@@ -396,6 +406,7 @@ class CDiskBlockIndex : public CBlockIndex
 {
 public:
     uint256 hashPrev;
+    std::vector<unsigned char> vchBlockSig;
 
     CDiskBlockIndex() {
         hashPrev = uint256();
@@ -403,6 +414,7 @@ public:
 
     explicit CDiskBlockIndex(const CBlockIndex* pindex) : CBlockIndex(*pindex) {
         hashPrev = (pprev ? pprev->GetBlockHash() : uint256());
+        vchBlockSig.assign(pchBlockSig, pchBlockSig + nBlockSigSize);
     }
 
     ADD_SERIALIZE_METHODS;
@@ -430,6 +442,8 @@ public:
         READWRITE(hashStateRoot);
         READWRITE(nTime);
         READWRITE(nBits);
+        if (this->nVersion & BLOCK_VERSION_CASINO_SIGNED)
+            READWRITE(vchBlockSig);
     }
 
     uint256 GetBlockHash() const
@@ -442,6 +456,7 @@ public:
         block.nTime           = nTime;
         block.nBits           = nBits;
         block.nHeight         = nHeight;
+        block.vchBlockSig     = vchBlockSig;
         return block.GetHash();
     }
 
@@ -457,6 +472,49 @@ public:
     }
 };
 
+/**
+ * Storage of the entries of mapBlockIndex. They are allocated in chunks of
+ * consecutive entries rather than one heap node each, which saves the
+ * allocator's overhead per entry and keeps entries created together, such as
+ * a loaded index in height order, next to each other. Entries never move and
+ * are only freed all together.
+ *
+ * The arena also holds the signatures of its entries: copied into chunks of
+ * bytes, or left in a mapped file it keeps, such as the block index snapshot.
+ */
+class CBlockIndexArena
+{
+private:
+    std::vector<std::unique_ptr<CBlockIndex[]>> vChunks;
+    size_t nChunkSize;
+    size_t nChunkUsed;
+    size_t nCapacity;
+    std::vector<std::unique_ptr<unsigned char[]>> vSigChunks;
+    size_t nSigChunkUsed;
+    std::vector<std::shared_ptr<const CFileMapping>> vMappings;
+
+public:
+    //! Entries in a chunk allocated for single entries
+    static const size_t CHUNK_SIZE = 4096;
+    //! Bytes in a chunk of signatures
+    static const size_t SIG_CHUNK_SIZE = 65536;
+
+    CBlockIndexArena() : nChunkSize(0), nChunkUsed(0), nCapacity(0), nSigChunkUsed(SIG_CHUNK_SIZE) {}
+
+    //! A null entry
+    CBlockIndex* Allocate();
+    //! n consecutive null entries
+    CBlockIndex* Allocate(size_t n);
+    //! Copy vchBlockSig for index, an entry of this arena
+    void SetBlockSig(CBlockIndex& index, const std::vector<unsigned char>& vchBlockSig);
+    //! Keep mapping as long as the entries, which may point into it
+    void KeepMapping(std::shared_ptr<const CFileMapping> mapping);
+    //! Free all entries
+    void Clear();
+
+    size_t Capacity() const { return nCapacity; }
+};
+
 /** An in-memory indexed chain of blocks. */
 class CChain {
 private:
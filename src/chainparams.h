@@ -77,6 +77,7 @@ public:
     const CCheckpointData& Checkpoints() const { return checkpointData; }
     const ChainTxData& TxData() const { return chainTxData; }
     void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
+    void UpdateCasinoSlotHeight(int nHeight);
 protected:
     CChainParams() {}
 
@@ -120,4 +121,9 @@ void SelectParams(const std::string& chain);
  */
 void UpdateVersionBitsParameters(Consensus::DeploymentPos d, int64_t nStartTime, int64_t nTimeout);
 
+/**
+ * Allows modifying the casino slot activation height on regtest.
+ */
+void UpdateCasinoSlotHeight(int nHeight);
+
 #endif // YBTC_CHAINPARAMS_H
@@ -0,0 +1,131 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "filemap.h"
+
+#include "crypto/common.h"
+#include "protocol.h"
+#include "util.h"
+
+#include <algorithm>
+#include <string.h>
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+CFileMapping::CFileMapping(const fs::path& path, bool fSequential) : pbegin(nullptr), nSize(0)
+{
+#ifdef WIN32
+    FILE* file = fsbridge::fopen(path, "rb");
+    if (!file)
+        return;
+    fseek(file, 0, SEEK_END);
+    long nLength = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    if (nLength > 0) {
+        vData.resize(nLength);
+        if (fread(vData.data(), 1, vData.size(), file) == vData.size()) {
+            pbegin = vData.data();
+            nSize = vData.size();
+        }
+    }
+    fclose(file);
+#else
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        // Shared, so that data written to the file later shows through
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        if (addr != MAP_FAILED) {
+            if (fSequential)
+                madvise(addr, st.st_size, MADV_SEQUENTIAL);
+            pbegin = static_cast<const unsigned char*>(addr);
+            nSize = st.st_size;
+        }
+    }
+    close(fd);
+#endif
+}
+
+CFileMapping::~CFileMapping()
+{
+#ifndef WIN32
+    if (pbegin)
+        munmap(const_cast<unsigned char*>(pbegin), nSize);
+#endif
+}
+
+CBlockFileMap::CBlockFileMap(PathFunc pathFuncIn, size_t nMaxFilesIn) : pathFunc(pathFuncIn), nMaxFiles(nMaxFilesIn)
+{
+}
+
+std::shared_ptr<const CFileMapping> CBlockFileMap::Get(int nFile, uint64_t nEnd)
+{
+    LOCK(cs);
+    Entry& entry = mapFiles[nFile];
+    if (!entry.mapping || entry.mapping->size() < nEnd) {
+        // Readers of the previous mapping keep it until they are done
+        entry.mapping = std::make_shared<const CFileMapping>(pathFunc(nFile));
+        if (!entry.mapping->begin()) {
+            mapFiles.erase(nFile);
+            return nullptr;
+        }
+    }
+    entry.nLastUsed = ++nUseCounter;
+    std::shared_ptr<const CFileMapping> mapping = entry.mapping;
+
+    while (mapFiles.size() > std::max<size_t>(nMaxFiles, 1)) {
+        auto itOldest = mapFiles.begin();
+        for (auto it = mapFiles.begin(); it != mapFiles.end(); ++it) {
+            if (it->second.nLastUsed < itOldest->second.nLastUsed)
+                itOldest = it;
+        }
+        mapFiles.erase(itOldest);
+    }
+    return mapping;
+}
+
+bool CBlockFileMap::Read(int nFile, unsigned int nPos, size_t nSize, std::vector<unsigned char>& vch)
+{
+#ifdef WIN32
+    FILE* file = fsbridge::fopen(pathFunc(nFile), "rb");
+    if (!file)
+        return false;
+    vch.resize(nSize);
+    bool fOk = fseek(file, nPos, SEEK_SET) == 0 && fread(vch.data(), 1, nSize, file) == nSize;
+    fclose(file);
+    return fOk;
+#else
+    const uint64_t nEnd = (uint64_t)nPos + nSize;
+    std::shared_ptr<const CFileMapping> mapping = Get(nFile, nEnd);
+    if (!mapping || mapping->size() < nEnd)
+        return false;
+    vch.assign(mapping->begin() + nPos, mapping->begin() + nEnd);
+    return true;
+#endif
+}
+
+bool CBlockFileMap::ReadRecord(int nFile, unsigned int nPos, const unsigned char* messageStart, size_t nMaxSize, std::vector<unsigned char>& vch)
+{
+    const size_t nHeaderSize = CMessageHeader::MESSAGE_START_SIZE + sizeof(uint32_t);
+    std::vector<unsigned char> vchHeader;
+    if (nPos < nHeaderSize || !Read(nFile, nPos - nHeaderSize, nHeaderSize, vchHeader))
+        return false;
+    if (memcmp(vchHeader.data(), messageStart, CMessageHeader::MESSAGE_START_SIZE) != 0)
+        return false;
+    const uint32_t nSize = ReadLE32(vchHeader.data() + CMessageHeader::MESSAGE_START_SIZE);
+    return nSize > 0 && nSize <= nMaxSize && Read(nFile, nPos, nSize, vch);
+}
+
+void CBlockFileMap::Drop(int nFile)
+{
+    LOCK(cs);
+    mapFiles.erase(nFile);
+}
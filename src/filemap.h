@@ -0,0 +1,88 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef YBTC_FILEMAP_H
+#define YBTC_FILEMAP_H
+
+#include "fs.h"
+#include "sync.h"
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <vector>
+
+/** Read-only view of a whole file, mapped where the platform allows */
+class CFileMapping
+{
+private:
+    const unsigned char* pbegin;
+    size_t nSize;
+#ifdef WIN32
+    std::vector<unsigned char> vData;
+#endif
+
+public:
+    /** Map the file at path; fSequential if it will be read once, in order */
+    explicit CFileMapping(const fs::path& path, bool fSequential = false);
+    ~CFileMapping();
+
+    CFileMapping(const CFileMapping&) = delete;
+    CFileMapping& operator=(const CFileMapping&) = delete;
+
+    const unsigned char* begin() const { return pbegin; }
+    size_t size() const { return nSize; }
+};
+
+/** Block files kept mapped for serving blocks */
+static const unsigned int MAX_BLOCK_FILE_MAPS = 8;
+
+/**
+ * Reads ranges of the block files (blk?????.dat) from mappings kept across
+ * reads, so serving a block costs a lookup and one copy of its bytes instead
+ * of opening, seeking and reading the file through stdio buffers.
+ *
+ * A file is mapped at the size it has when first read and mapped again once a
+ * read goes beyond that. The least recently read mappings are dropped beyond
+ * nMaxFiles. Where files are not mapped (WIN32), ranges are read from the file.
+ */
+class CBlockFileMap
+{
+public:
+    /** Path of block file nFile */
+    typedef std::function<fs::path(int nFile)> PathFunc;
+
+    explicit CBlockFileMap(PathFunc pathFuncIn, size_t nMaxFilesIn = MAX_BLOCK_FILE_MAPS);
+
+    /** Copy nSize bytes at nPos of block file nFile to vch. False if the file does not hold them. */
+    bool Read(int nFile, unsigned int nPos, size_t nSize, std::vector<unsigned char>& vch);
+
+    /**
+     * Copy the record at nPos of block file nFile to vch: the bytes that the
+     * message start and the little-endian size in front of nPos announce, up
+     * to nMaxSize. False if they are missing or announce something else.
+     */
+    bool ReadRecord(int nFile, unsigned int nPos, const unsigned char* messageStart, size_t nMaxSize, std::vector<unsigned char>& vch);
+
+    /** Drop the mapping of block file nFile, before it is removed or shrunk */
+    void Drop(int nFile);
+
+private:
+    struct Entry
+    {
+        std::shared_ptr<const CFileMapping> mapping;
+        uint64_t nLastUsed;
+    };
+
+    const PathFunc pathFunc;
+    const size_t nMaxFiles;
+    CCriticalSection cs;
+    std::map<int, Entry> mapFiles;
+    uint64_t nUseCounter = 0;
+
+    std::shared_ptr<const CFileMapping> Get(int nFile, uint64_t nEnd);
+};
+
+#endif // YBTC_FILEMAP_H
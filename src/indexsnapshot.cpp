@@ -0,0 +1,267 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "indexsnapshot.h"
+
+#include "chain.h"
+#include "filemap.h"
+#include "util.h"
+#include "validation.h"
+
+#include "leveldb/util/crc32c.h"
+
+#include <algorithm>
+#include <limits>
+#include <string.h>
+
+#include <boost/thread.hpp>
+
+static const uint32_t SNAPSHOT_MAGIC = 0x78646962; // "bidx"
+static const uint32_t SNAPSHOT_VERSION = 2;
+/** Bytes after the header hashed on their own, so that the checksum can be verified on several threads */
+static const size_t SNAPSHOT_CHECKSUM_CHUNK = 16 * 1024 * 1024;
+
+struct SnapshotHeader
+{
+    uint32_t nMagic;
+    uint32_t nVersion;
+    unsigned char nonce[32];
+    uint64_t nRecords;
+    uint64_t nSigSize;      //!< Bytes of signatures after the records
+    uint32_t nChecksum;     //!< CRC32C of this header with a null checksum and of the CRC32Cs of the chunks after it
+    uint32_t nReserved;
+};
+
+/** An entry as CDiskBlockIndex stores it, with its hash and its parent's position */
+struct SnapshotRecord
+{
+    unsigned char hash[32];
+    unsigned char hashMerkleRoot[32];
+    unsigned char hashStateRoot[32];
+    uint32_t nPrev;         //!< Position of the parent plus one, 0 for none
+    int32_t nHeight;
+    uint32_t nStatus;
+    uint32_t nTx;
+    int32_t nFile;
+    uint32_t nDataPos;
+    uint32_t nUndoPos;
+    int32_t nVersion;
+    uint32_t nTime;
+    uint32_t nBits;
+    uint32_t nSigOffset;    //!< Position of vchBlockSig in the signatures
+    uint32_t nSigSize;
+};
+
+static_assert(sizeof(SnapshotHeader) == 64, "snapshot header must not be padded");
+static_assert(sizeof(SnapshotRecord) == 144, "snapshot records must not be padded");
+
+/** CRC32C of a snapshot header, with the checksum itself left out */
+static uint32_t SnapshotHeaderChecksum(const SnapshotHeader& header)
+{
+    SnapshotHeader headerNull = header;
+    headerNull.nChecksum = 0;
+    return leveldb::crc32c::Value(reinterpret_cast<const char*>(&headerNull), sizeof(headerNull));
+}
+
+/** Checksum of a snapshot as it is written */
+class SnapshotChecksumWriter
+{
+private:
+    uint32_t nChecksum;
+    uint32_t nChunk = 0;
+    size_t nChunkUsed = 0;
+
+    void FinishChunk()
+    {
+        nChecksum = leveldb::crc32c::Extend(nChecksum, reinterpret_cast<const char*>(&nChunk), sizeof(nChunk));
+        nChunk = 0;
+        nChunkUsed = 0;
+    }
+
+public:
+    explicit SnapshotChecksumWriter(const SnapshotHeader& header) : nChecksum(SnapshotHeaderChecksum(header)) {}
+
+    void Write(const unsigned char* data, size_t nSize)
+    {
+        while (nSize > 0) {
+            const size_t nPart = std::min(nSize, SNAPSHOT_CHECKSUM_CHUNK - nChunkUsed);
+            nChunk = leveldb::crc32c::Extend(nChunk, reinterpret_cast<const char*>(data), nPart);
+            nChunkUsed += nPart;
+            data += nPart;
+            nSize -= nPart;
+            if (nChunkUsed == SNAPSHOT_CHECKSUM_CHUNK)
+                FinishChunk();
+        }
+    }
+
+    uint32_t Finalize()
+    {
+        if (nChunkUsed > 0)
+            FinishChunk();
+        return nChecksum;
+    }
+};
+
+/** Whether the checksum in the header of the mapped snapshot matches what follows it */
+static bool VerifySnapshotChecksum(const SnapshotHeader& header, const unsigned char* data, size_t nSize, int nThreads)
+{
+    const size_t nChunks = (nSize + SNAPSHOT_CHECKSUM_CHUNK - 1) / SNAPSHOT_CHECKSUM_CHUNK;
+    std::vector<uint32_t> vChunks(nChunks);
+    ParallelFor(nChunks, nThreads, [&](size_t i) {
+        const size_t nStart = i * SNAPSHOT_CHECKSUM_CHUNK;
+        vChunks[i] = leveldb::crc32c::Value(reinterpret_cast<const char*>(data + nStart), std::min(SNAPSHOT_CHECKSUM_CHUNK, nSize - nStart));
+    });
+    uint32_t nChecksum = SnapshotHeaderChecksum(header);
+    for (uint32_t nChunk : vChunks)
+        nChecksum = leveldb::crc32c::Extend(nChecksum, reinterpret_cast<const char*>(&nChunk), sizeof(nChunk));
+    return nChecksum == header.nChecksum;
+}
+
+bool WriteBlockIndexSnapshotFile(const fs::path& path, const std::vector<const CBlockIndex*>& vIndex, const uint256& nonce)
+{
+    // Position of each entry, looked up by address for its children
+    std::vector<std::pair<const CBlockIndex*, uint32_t>> vPos;
+    vPos.reserve(vIndex.size());
+    for (size_t i = 0; i < vIndex.size(); i++)
+        vPos.emplace_back(vIndex[i], i);
+    std::sort(vPos.begin(), vPos.end());
+
+    fs::path pathTmp = path;
+    pathTmp += ".new";
+    FILE* file = fsbridge::fopen(pathTmp, "wb");
+    if (!file)
+        return error("%s: cannot open %s", __func__, pathTmp.string());
+
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    header.nMagic = SNAPSHOT_MAGIC;
+    header.nVersion = SNAPSHOT_VERSION;
+    memcpy(header.nonce, nonce.begin(), sizeof(header.nonce));
+    header.nRecords = vIndex.size();
+    for (const CBlockIndex* pindex : vIndex)
+        header.nSigSize += pindex->nBlockSigSize;
+    // Written again with the checksum once the rest is
+    bool fOk = header.nSigSize <= std::numeric_limits<uint32_t>::max() && fwrite(&header, sizeof(header), 1, file) == 1;
+    SnapshotChecksumWriter checksum(header);
+
+    uint32_t nSigOffset = 0;
+    for (size_t i = 0; fOk && i < vIndex.size(); i++) {
+        const CBlockIndex* pindex = vIndex[i];
+        SnapshotRecord rec;
+        memset(&rec, 0, sizeof(rec));
+        memcpy(rec.hash, pindex->phashBlock->begin(), sizeof(rec.hash));
+        memcpy(rec.hashMerkleRoot, pindex->hashMerkleRoot.begin(), sizeof(rec.hashMerkleRoot));
+        memcpy(rec.hashStateRoot, pindex->hashStateRoot.begin(), sizeof(rec.hashStateRoot));
+        if (pindex->pprev) {
+            auto it = std::lower_bound(vPos.begin(), vPos.end(), std::make_pair((const CBlockIndex*)pindex->pprev, (uint32_t)0));
+            if (it == vPos.end() || it->first != pindex->pprev || it->second >= i) {
+                fOk = error("%s: %s does not come after its parent", __func__, pindex->GetBlockHash().ToString());
+                break;
+            }
+            rec.nPrev = it->second + 1;
+        }
+        rec.nHeight = pindex->nHeight;
+        rec.nStatus = pindex->nStatus;
+        rec.nTx = pindex->nTx;
+        rec.nFile = pindex->nFile;
+        rec.nDataPos = pindex->nDataPos;
+        rec.nUndoPos = pindex->nUndoPos;
+        rec.nVersion = pindex->nVersion;
+        rec.nTime = pindex->nTime;
+        rec.nBits = pindex->nBits;
+        rec.nSigOffset = nSigOffset;
+        rec.nSigSize = pindex->nBlockSigSize;
+        nSigOffset += rec.nSigSize;
+        fOk = fwrite(&rec, sizeof(rec), 1, file) == 1;
+        checksum.Write(reinterpret_cast<const unsigned char*>(&rec), sizeof(rec));
+    }
+    for (size_t i = 0; fOk && i < vIndex.size(); i++) {
+        const CBlockIndex* pindex = vIndex[i];
+        fOk = pindex->nBlockSigSize == 0 || fwrite(pindex->pchBlockSig, pindex->nBlockSigSize, 1, file) == 1;
+        checksum.Write(pindex->pchBlockSig, pindex->nBlockSigSize);
+    }
+    if (fOk) {
+        header.nChecksum = checksum.Finalize();
+        fOk = fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    }
+
+    if (fOk)
+        FileCommit(file);
+    fOk = fclose(file) == 0 && fOk;
+    if (!fOk || !RenameOver(pathTmp, path)) {
+        fs::remove(pathTmp);
+        return error("%s: failed to write %s", __func__, path.string());
+    }
+    return true;
+}
+
+bool ReadBlockIndexSnapshotFile(const fs::path& path, const uint256& nonce, CBlockIndexArena& arena, BlockMap& mapIndex, int nThreads)
+{
+    // Records are read once, in order; signatures only now and then
+    std::shared_ptr<const CFileMapping> pmapping = std::make_shared<const CFileMapping>(path, true);
+    const CFileMapping& mapping = *pmapping;
+    if (!mapping.begin())
+        return error("%s: cannot map %s", __func__, path.string());
+
+    SnapshotHeader header;
+    if (mapping.size() < sizeof(header))
+        return error("%s: %s is truncated", __func__, path.string());
+    memcpy(&header, mapping.begin(), sizeof(header));
+    if (header.nMagic != SNAPSHOT_MAGIC || header.nVersion != SNAPSHOT_VERSION)
+        return error("%s: %s is not a snapshot this version can read", __func__, path.string());
+    if (memcmp(header.nonce, nonce.begin(), sizeof(header.nonce)) != 0)
+        return error("%s: %s does not match the block tree database", __func__, path.string());
+    if (header.nRecords == 0 || header.nRecords > std::numeric_limits<uint32_t>::max() ||
+        mapping.size() != sizeof(header) + header.nRecords * sizeof(SnapshotRecord) + header.nSigSize)
+        return error("%s: %s has a wrong size", __func__, path.string());
+    if (!VerifySnapshotChecksum(header, mapping.begin() + sizeof(header), mapping.size() - sizeof(header), nThreads))
+        return error("%s: %s does not match its checksum", __func__, path.string());
+
+    const SnapshotRecord* records = reinterpret_cast<const SnapshotRecord*>(mapping.begin() + sizeof(header));
+    const unsigned char* sigs = mapping.begin() + sizeof(header) + header.nRecords * sizeof(SnapshotRecord);
+
+    // The entries point at their signatures in the mapping, which is only
+    // paged in for the headers that are read again. Where files are read
+    // rather than mapped (WIN32), they are copied to the arena instead of
+    // keeping all of the file.
+#ifndef WIN32
+    arena.KeepMapping(pmapping);
+#endif
+    const size_t nRecords = header.nRecords;
+    CBlockIndex* entries = arena.Allocate(nRecords);
+    mapIndex.reserve(mapIndex.size() + nRecords);
+    for (size_t i = 0; i < nRecords; i++) {
+        boost::this_thread::interruption_point();
+        const SnapshotRecord& rec = records[i];
+        if (rec.nPrev > i || (uint64_t)rec.nSigOffset + rec.nSigSize > header.nSigSize)
+            return error("%s: entry %u of %s is corrupt", __func__, i, path.string());
+
+        uint256 hash;
+        memcpy(hash.begin(), rec.hash, sizeof(rec.hash));
+        CBlockIndex* pindex = &entries[i];
+        auto inserted = mapIndex.emplace(hash, pindex);
+        if (!inserted.second)
+            return error("%s: %s holds %s twice", __func__, path.string(), hash.ToString());
+        pindex->phashBlock = &inserted.first->first;
+        pindex->pprev = rec.nPrev ? &entries[rec.nPrev - 1] : nullptr;
+        pindex->nHeight = rec.nHeight;
+        pindex->nStatus = rec.nStatus;
+        pindex->nTx = rec.nTx;
+        pindex->nFile = rec.nFile;
+        pindex->nDataPos = rec.nDataPos;
+        pindex->nUndoPos = rec.nUndoPos;
+        pindex->nVersion = rec.nVersion;
+        memcpy(pindex->hashMerkleRoot.begin(), rec.hashMerkleRoot, sizeof(rec.hashMerkleRoot));
+        memcpy(pindex->hashStateRoot.begin(), rec.hashStateRoot, sizeof(rec.hashStateRoot));
+        pindex->nTime = rec.nTime;
+        pindex->nBits = rec.nBits;
+#ifndef WIN32
+        pindex->pchBlockSig = rec.nSigSize ? sigs + rec.nSigOffset : nullptr;
+        pindex->nBlockSigSize = rec.nSigSize;
+#else
+        arena.SetBlockSig(*pindex, std::vector<unsigned char>(sigs + rec.nSigOffset, sigs + rec.nSigOffset + rec.nSigSize));
+#endif
+    }
+    return true;
+}
@@ -0,0 +1,47 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef YBTC_INDEXSNAPSHOT_H
+#define YBTC_INDEXSNAPSHOT_H
+
+#include "fs.h"
+#include "uint256.h"
+
+#include <unordered_map>
+#include <vector>
+
+class CBlockIndex;
+class CBlockIndexArena;
+struct BlockHasher;
+
+/** Default for -indexsnapshot */
+static const bool DEFAULT_INDEX_SNAPSHOT = true;
+
+/**
+ * The block index snapshot is a flat copy of mapBlockIndex, written at shutdown
+ * so that the next startup maps it instead of iterating and deserializing every
+ * entry of the block tree DB and hashing its header again.
+ *
+ * It holds a fixed-size record per entry, parents before children, that refers
+ * to its parent by position rather than by hash, followed by the casino
+ * signatures, which nothing reads while loading. A CRC32C checksum in the header
+ * covers the header and all that follows it, and is verified before any entry is
+ * used, as nothing else checks the entries on the way in. A nonce in the header must
+ * match the one sealed in the block tree DB, which drops the seal as soon as
+ * the snapshot has been loaded, so the snapshot is never used once the DB has
+ * changed without it.
+ */
+
+/** Write the entries of vIndex, in which parents come before their children, to path */
+bool WriteBlockIndexSnapshotFile(const fs::path& path, const std::vector<const CBlockIndex*>& vIndex, const uint256& nonce);
+
+/**
+ * Map the snapshot at path, written with nonce, verify its checksum on nThreads
+ * threads and add its entries to mapIndex, allocated from arena. The arena keeps
+ * the mapping, as the entries point at their signatures in it. False if there
+ * is no such snapshot or it is broken, in which case mapIndex may hold part of it.
+ */
+bool ReadBlockIndexSnapshotFile(const fs::path& path, const uint256& nonce, CBlockIndexArena& arena, std::unordered_map<uint256, CBlockIndex*, BlockHasher>& mapIndex, int nThreads = 1);
+
+#endif // YBTC_INDEXSNAPSHOT_H
@@ -11,6 +11,8 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockimport.h"
+#include "blockwriter.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -19,6 +21,7 @@
 #include "fs.h"
 #include "httpserver.h"
 #include "httprpc.h"
+#include "indexsnapshot.h"
 #include "key.h"
 #include "validation.h"
 #include "miner.h"
@@ -34,6 +37,9 @@
 #include "script/standard.h"
 #include "script/sigcache.h"
 #include "scheduler.h"
+#include "sccallindex.h"
+#include "screceipt.h"
+#include "statelayers.h"
 #include "timedata.h"
 #include "txdb.h"
 #include "txmempool.h"
@@ -193,6 +199,7 @@ void Shutdown()
     }
     GenerateYbtcs(false, 0, Params());
 #endif
+    StopTemplateBuilder();
     MapPort(false);
 
     // Because these depend on each-other, we make sure that neither can be
@@ -239,14 +246,23 @@ void Shutdown()
         if (pcoinsTip != nullptr) {
             FlushStateToDisk();
         }
+        StopBlockPrefetch();
+        StopChainstateWriter();
+        StopBlockFileWriter();
+        if (pcoinsTip != nullptr && gArgs.GetBoolArg("-indexsnapshot", DEFAULT_INDEX_SNAPSHOT))
+            DumpBlockIndexSnapshot();
         delete pcoinsTip;
         pcoinsTip = nullptr;
+        delete pcoinswritebehind;
+        pcoinswritebehind = nullptr;
         delete pcoinscatcher;
         pcoinscatcher = nullptr;
         delete pcoinsdbview;
         pcoinsdbview = nullptr;
         delete pblocktree;
         pblocktree = nullptr;
+        delete preceiptdb;
+        preceiptdb = nullptr;
         delete pState.release();
         pState = nullptr;
     }
@@ -273,6 +289,8 @@ void Shutdown()
 #endif
     UnregisterAllValidationInterfaces();
     GetMainSignals().UnregisterBackgroundSignalScheduler();
+    delete pcontractcallindex;
+    pcontractcallindex = nullptr;
 #ifdef ENABLE_WALLET
     for (CWalletRef pwallet : vpwallets) {
         delete pwallet;
@@ -349,6 +367,8 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-blocknotify=<cmd>", _("Execute command when the best block changes (%s in cmd is replaced by block hash)"));
     if (showDebug)
         strUsage += HelpMessageOpt("-blocksonly", strprintf(_("Whether to operate in a blocks only mode (default: %u)"), DEFAULT_BLOCKSONLY));
+    strUsage += HelpMessageOpt("-blockwriter", strprintf(_("Append blocks and undo data to the block files in a background thread, syncing them only when the block index is written (default: %u)"), DEFAULT_BLOCK_WRITER));
+    strUsage += HelpMessageOpt("-asyncflush", strprintf(_("Write the chainstate and contract state to disk in a background thread, so that block connection goes on meanwhile (default: %u)"), DEFAULT_ASYNC_FLUSH));
     strUsage +=HelpMessageOpt("-assumevalid=<hex>", strprintf(_("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)"), defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()));
     strUsage += HelpMessageOpt("-conf=<file>", strprintf(_("Specify configuration file (default: %s)"), YBTC_CONF_FILENAME));
     if (mode == HMM_YBTCD)
@@ -361,9 +381,12 @@ std::string HelpMessage(HelpMessageMode mode)
     if (showDebug) {
         strUsage += HelpMessageOpt("-dbbatchsize", strprintf("Maximum database write batch size in bytes (default: %u)", nDefaultDbBatchSize));
     }
+    strUsage += HelpMessageOpt("-contractcodecache=<n>", strprintf(_("Set the contract code cache size in megabytes (default: %d)"), DEFAULT_CONTRACT_CODE_CACHE));
+    strUsage += HelpMessageOpt("-statelayers=<n>", strprintf(_("Keep the contract state results of this many recent blocks, so that a reorg connecting them again does not execute their contracts again (default: %u)"), DEFAULT_STATE_LAYERS));
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-indexsnapshot", strprintf(_("Write the block index to a snapshot at shutdown, which the next startup maps instead of reading the block index database (default: %u)"), DEFAULT_INDEX_SNAPSHOT));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
@@ -382,6 +405,8 @@ std::string HelpMessage(HelpMessageMode mode)
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
             "(default: 0 = disable pruning blocks, 1 = allow manual pruning via RPC, >%u = automatically prune block files to stay under the specified target size in MiB)"), MIN_DISK_SPACE_FOR_BLOCK_FILES / 1024 / 1024));
     strUsage += HelpMessageOpt("-reindex-chainstate", _("Rebuild chain state from the currently indexed blocks"));
+    strUsage += HelpMessageOpt("-contractindex", strprintf(_("Maintain an index of contract calls by contract and by sender, used by the getcontractcalls and getsendercalls rpc calls (default: %u)"), DEFAULT_CONTRACTINDEX));
+    strUsage += HelpMessageOpt("-receiptindex", strprintf(_("Maintain an index of contract execution receipts and logs, used by the getlogs rpc call (default: %u)"), DEFAULT_RECEIPTINDEX));
     strUsage += HelpMessageOpt("-reindex", _("Rebuild chain state and block index from the blk*.dat files on disk"));
 #ifndef WIN32
     strUsage += HelpMessageOpt("-sysperms", _("Create new files with system default permissions, instead of umask 077 (only effective with disabled wallet functionality)"));
@@ -393,6 +418,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-banscore=<n>", strprintf(_("Threshold for disconnecting misbehaving peers (default: %u)"), DEFAULT_BANSCORE_THRESHOLD));
     strUsage += HelpMessageOpt("-bantime=<n>", strprintf(_("Number of seconds to keep misbehaving peers from reconnecting (default: %u)"), DEFAULT_MISBEHAVING_BANTIME));
     strUsage += HelpMessageOpt("-bind=<addr>", _("Bind to given address and always listen on it. Use [host]:port notation for IPv6"));
+    strUsage += HelpMessageOpt("-compactheaders", strprintf(_("Ask peers to send headers delta encoded in cmpctheaders messages (default: %u)"), DEFAULT_COMPACT_HEADERS));
     strUsage += HelpMessageOpt("-connect=<ip>", _("Connect only to the specified node(s); -connect=0 disables automatic connections"));
     strUsage += HelpMessageOpt("-discover", _("Discover own IP addresses (default: 1 when listening and no -externalip or -proxy)"));
     strUsage += HelpMessageOpt("-dns", _("Allow DNS lookups for -addnode, -seednode and -connect") + " " + strprintf(_("(default: %u)"), DEFAULT_NAME_LOOKUP));
@@ -412,6 +438,7 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-port=<port>", strprintf(_("Listen for connections on <port> (default: %u or testnet: %u)"), defaultChainParams->GetDefaultPort(), testnetChainParams->GetDefaultPort()));
     strUsage += HelpMessageOpt("-proxy=<ip:port>", _("Connect through SOCKS5 proxy"));
     strUsage += HelpMessageOpt("-proxyrandomize", strprintf(_("Randomize credentials for every proxy connection. This enables Tor stream isolation (default: %u)"), DEFAULT_PROXYRANDOMIZE));
+    strUsage += HelpMessageOpt("-slotrelay", strprintf(_("Push new blocks to peers that mine the next casino slots, and prove to peers that we mine ours (default: %u)"), DEFAULT_SLOT_RELAY));
     strUsage += HelpMessageOpt("-seednode=<ip>", _("Connect to a node to retrieve peer addresses, and disconnect"));
     strUsage += HelpMessageOpt("-timeout=<n>", strprintf(_("Specify connection timeout in milliseconds (minimum: 1, default: %d)"), DEFAULT_CONNECT_TIMEOUT));
     strUsage += HelpMessageOpt("-torcontrol=<ip>:<port>", strprintf(_("Tor control port to use if onion listening enabled (default: %s)"), DEFAULT_TOR_CONTROL));
@@ -460,6 +487,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT));
         strUsage += HelpMessageOpt("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT));
+        strUsage += HelpMessageOpt("-casinoslotheight=<n>", "Require headers to be signed by the miner of their casino slot from height <n> (regtest-only)");
         strUsage += HelpMessageOpt("-vbparams=deployment:start:end", "Use given start/end times for specified version bits deployment (regtest-only)");
     }
     strUsage += HelpMessageOpt("-debug=<category>", strprintf(_("Output debugging information (default: %u, supplying <category> is optional)"), 0) + ". " +
@@ -511,6 +539,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageGroup(_("Block creation options:"));
     strUsage += HelpMessageOpt("-blockmaxweight=<n>", strprintf(_("Set maximum BIP141 block weight (default: %d)"), DEFAULT_BLOCK_MAX_WEIGHT));
     strUsage += HelpMessageOpt("-blockmaxsize=<n>", _("Set maximum BIP141 block weight to this * 4. Deprecated, use blockmaxweight"));
+    strUsage += HelpMessageOpt("-blockmaxgas=<n>", strprintf(_("Set the gas budget of the contract transactions included in a block (%d to %d, default: %d)"), MIN_BLOCK_GAS_LIMIT, MAX_BLOCK_GAS_LIMIT, DEFAULT_BLOCK_GAS_LIMIT));
+    strUsage += HelpMessageOpt("-blockmaxcontracttime=<n>", strprintf(_("Stop adding contract transactions to a block after executing them for <n> milliseconds (default: %d)"), DEFAULT_BLOCK_MAX_CONTRACT_TIME));
+    strUsage += HelpMessageOpt("-blocktemplatebuilder", _("Keep a block template up to date in the background for the miner and getblocktemplate (default: 1 with -gen, otherwise 0)"));
+    strUsage += HelpMessageOpt("-blocktemplaterefresh=<n>", strprintf(_("Extend the background block template at most every <n> milliseconds as transactions arrive (default: %d)"), DEFAULT_BLOCK_TEMPLATE_REFRESH));
     strUsage += HelpMessageOpt("-blockmintxfee=<amt>", strprintf(_("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)"), CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)));
     if (showDebug)
         strUsage += HelpMessageOpt("-blockversion=<n>", "Override block version to test forking scenarios");
@@ -648,18 +680,10 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!fs::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        std::vector<CBlockImportFile> vFiles;
+        for (int nFile = 0; fs::exists(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk")); nFile++)
+            vFiles.push_back(CBlockImportFile{GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"), nFile});
+        LoadExternalBlockFiles(chainparams, vFiles);
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -670,23 +694,17 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
     // hardcoded $DATADIR/bootstrap.dat
     fs::path pathBootstrap = GetDataDir() / "bootstrap.dat";
     if (fs::exists(pathBootstrap)) {
-        FILE *file = fsbridge::fopen(pathBootstrap, "rb");
-        if (file) {
-            fs::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
-            LogPrintf("Importing bootstrap.dat...\n");
-            LoadExternalBlockFile(chainparams, file);
-            RenameOver(pathBootstrap, pathBootstrapOld);
-        } else {
-            LogPrintf("Warning: Could not open bootstrap file %s\n", pathBootstrap.string());
-        }
+        fs::path pathBootstrapOld = GetDataDir() / "bootstrap.dat.old";
+        LogPrintf("Importing bootstrap.dat...\n");
+        LoadExternalBlockFiles(chainparams, {CBlockImportFile{pathBootstrap, -1}});
+        RenameOver(pathBootstrap, pathBootstrapOld);
     }
 
     // -loadblock=
     for (const fs::path& path : vImportFiles) {
-        FILE *file = fsbridge::fopen(path, "rb");
-        if (file) {
+        if (fs::exists(path)) {
             LogPrintf("Importing blocks file %s...\n", path.string());
-            LoadExternalBlockFile(chainparams, file);
+            LoadExternalBlockFiles(chainparams, {CBlockImportFile{path, -1}});
         } else {
             LogPrintf("Warning: Could not open blocks file %s\n", path.string());
         }
@@ -694,10 +712,12 @@ void ThreadImport(std::vector<fs::path> vImportFiles)
 
     // scan for better chains in the block chain database, that are not yet connected in the active best chain
     CValidationState state;
+    StartBlockPrefetch(chainparams);
     if (!ActivateBestChain(state, chainparams)) {
         LogPrintf("Failed to connect best block");
         StartShutdown();
     }
+    StopBlockPrefetch();
 
     if (gArgs.GetBoolArg("-stopafterblockimport", DEFAULT_STOPAFTERBLOCKIMPORT)) {
         LogPrintf("Stopping after block import\n");
@@ -845,7 +865,7 @@ ServiceFlags nRelevantServices = NODE_NETWORK;
 int nMaxConnections;
 int nUserMaxConnections;
 int nFD;
-ServiceFlags nLocalServices = NODE_NETWORK;
+ServiceFlags nLocalServices = ServiceFlags(NODE_NETWORK | NODE_LARGE_HEADERS);
 
 } // namespace
 
@@ -1171,6 +1191,19 @@ bool AppInitParameterInteraction()
             }
         }
     }
+
+    if (gArgs.IsArgSet("-casinoslotheight")) {
+        // Allow enforcing signed casino slots on regtest
+        if (!chainparams.MineBlocksOnDemand()) {
+            return InitError("The casino slot height may only be overridden on regtest.");
+        }
+        int64_t nHeight;
+        if (!ParseInt64(gArgs.GetArg("-casinoslotheight", ""), &nHeight) || nHeight < 0 || nHeight > std::numeric_limits<int>::max()) {
+            return InitError(strprintf("Invalid casino slot height (%s)", gArgs.GetArg("-casinoslotheight", "")));
+        }
+        UpdateCasinoSlotHeight(nHeight);
+        LogPrintf("Enforcing signed casino slots from height %d\n", nHeight);
+    }
     return true;
 }
 
@@ -1261,6 +1294,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
     }
+    threadGroup.create_thread(&ThreadContractDryRun);
 
     // Start the lightweight task scheduler thread
     CScheduler::Function serviceLoop = boost::bind(&CScheduler::serviceQueue, &scheduler);
@@ -1412,6 +1446,10 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     int64_t nBlockTreeDBCache = nTotalCache / 8;
     nBlockTreeDBCache = std::min(nBlockTreeDBCache, (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nReceiptDBCache = gArgs.GetBoolArg("-receiptindex", DEFAULT_RECEIPTINDEX) ? std::min(nTotalCache / 8, nMaxReceiptDBCache << 20) : 0;
+    nTotalCache -= nReceiptDBCache;
+    int64_t nContractIndexCache = gArgs.GetBoolArg("-contractindex", DEFAULT_CONTRACTINDEX) ? std::min(nTotalCache / 8, nMaxContractIndexDBCache << 20) : 0;
+    nTotalCache -= nContractIndexCache;
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1420,7 +1458,15 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
+    if (nReceiptDBCache > 0)
+        LogPrintf("* Using %.1fMiB for contract receipt database\n", nReceiptDBCache * (1.0 / 1024 / 1024));
+    if (nContractIndexCache > 0)
+        LogPrintf("* Using %.1fMiB for contract call index database\n", nContractIndexCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set (plus up to %.1fMiB of unused mempool space)\n", nCoinCacheUsage * (1.0 / 1024 / 1024), nMempoolSizeMax * (1.0 / 1024 / 1024));
+    int64_t nContractCodeCache = std::max(gArgs.GetArg("-contractcodecache", DEFAULT_CONTRACT_CODE_CACHE), (int64_t)1) << 20;
+    sc::CodeCache::instance().setMaxMemory(nContractCodeCache);
+    LogPrintf("* Using %.1fMiB for contract code cache\n", nContractCodeCache * (1.0 / 1024 / 1024));
+    SetMaxStateLayers(std::max(gArgs.GetArg("-statelayers", DEFAULT_STATE_LAYERS), (int64_t)0));
 
     bool fLoaded = false;
     while (!fLoaded && !fRequestShutdown) {
@@ -1430,16 +1476,24 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         uiInterface.InitMessage(_("Loading block index..."));
 
         nStart = GetTimeMillis();
+        // Time of each startup phase, for the breakdown logged once loaded
+        int64_t nTimeIndex = 0, nTimeChainstate = 0, nTimeState = 0, nTimeRewind = 0, nTimeVerify = 0;
         do {
             try {
+                int64_t nPhaseStart = GetTimeMillis();
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinswritebehind;
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete preceiptdb;
+                preceiptdb = nullptr;
                 delete pState.release();
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReset);
+                if (nReceiptDBCache > 0)
+                    preceiptdb = new CContractReceiptDB(nReceiptDBCache, false, fReset);
 
                 if (fReset) {
                     pblocktree->WriteReindexing(true);
@@ -1464,6 +1518,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 // (we're likely using a testnet datadir, or the other way around).
                 if (!mapBlockIndex.empty() && mapBlockIndex.count(chainparams.GetConsensus().hashGenesisBlock) == 0)
                     return InitError(_("Incorrect or no genesis block found. Wrong datadir for network?"));
+                nTimeIndex = GetTimeMillis() - nPhaseStart;
+                nPhaseStart = GetTimeMillis();
 
                 // Check for changed -txindex state
                 if (fTxIndex != gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
@@ -1507,7 +1563,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 }
 
                 // The on-disk coinsdb is now in a good state, create the cache
-                pcoinsTip = new CCoinsViewCache(pcoinscatcher);
+                pcoinswritebehind = new CCoinsViewWriteBehind(pcoinscatcher, pcoinsdbview);
+                pcoinsTip = new CCoinsViewCache(pcoinswritebehind);
 
                 bool is_coinsview_empty = fReset || fReindexChainState || pcoinsTip->GetBestBlock().IsNull();
                 if (!is_coinsview_empty) {
@@ -1518,6 +1575,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                     }
                     assert(chainActive.Tip() != nullptr);
                 }
+                nTimeChainstate = GetTimeMillis() - nPhaseStart;
+                nPhaseStart = GetTimeMillis();
 
                 // Initial State begin
                 fs::path fabStateDir = GetDataDir() / "statebtc";
@@ -1534,6 +1593,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                 }
                 pState->commit(sc::State::CommitBehaviour::RemoveEmptyAccounts);
                 // Initial State end
+                nTimeState = GetTimeMillis() - nPhaseStart;
+                nPhaseStart = GetTimeMillis();
 
                 if (!fReset) {
                     // Note that RewindBlockIndex MUST run even if we're about to -reindex-chainstate.
@@ -1545,6 +1606,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                         break;
                     }
                 }
+                nTimeRewind = GetTimeMillis() - nPhaseStart;
+                nPhaseStart = GetTimeMillis();
 
                 if (!is_coinsview_empty) {
                     uiInterface.InitMessage(_("Verifying blocks..."));
@@ -1571,6 +1634,7 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
                         break;
                     }
                 }
+                nTimeVerify = GetTimeMillis() - nPhaseStart;
             } catch (const std::exception& e) {
                 LogPrintf("%s\n", e.what());
                 strLoadError = _("Error opening block database");
@@ -1578,6 +1642,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
             }
 
             fLoaded = true;
+            LogPrintf("Startup: block index %dms, chainstate %dms, contract state %dms, rewind %dms, verify %dms\n",
+                nTimeIndex, nTimeChainstate, nTimeState, nTimeRewind, nTimeVerify);
         } while(false);
 
         if (!fLoaded && !fRequestShutdown) {
@@ -1611,6 +1677,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
     if (fLoaded) {
         LogPrintf(" block index %15dms\n", GetTimeMillis() - nStart);
     }
+    StartChainstateWriter();
+    StartBlockFileWriter();
 
     fs::path est_path = GetDataDir() / FEE_ESTIMATES_FILENAME;
     CAutoFile est_filein(fsbridge::fopen(est_path, "rb"), SER_DISK, CLIENT_VERSION);
@@ -1673,8 +1741,18 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         vImportFiles.push_back(strFile);
     }
 
+    if (nContractIndexCache > 0) {
+        pcontractcallindex = new CContractCallIndex(nContractIndexCache, false, fReindex);
+        RegisterValidationInterface(pcontractcallindex);
+    }
+
     threadGroup.create_thread(boost::bind(&ThreadImport, vImportFiles));
 
+    // Index the receipts of blocks connected before -receiptindex was enabled
+    StartReceiptIndex(threadGroup);
+    if (pcontractcallindex)
+        pcontractcallindex->Start(threadGroup);
+
     // Wait for genesis block to be processed
     {
         boost::unique_lock<boost::mutex> lock(cs_GenesisWait);
@@ -1747,6 +1825,8 @@ bool AppInitMain(boost::thread_group& threadGroup, CScheduler& scheduler)
         return false;
     }
 
+    if (gArgs.GetBoolArg("-blocktemplatebuilder", gArgs.GetBoolArg("-gen", DEFAULT_GENERATE)))
+        StartTemplateBuilder(chainparams);
 #ifdef ENABLE_WALLET
     GenerateYbtcs(gArgs.GetBoolArg("-gen", DEFAULT_GENERATE), gArgs.GetArg("-genproclimit", DEFAULT_GENERATE_THREADS), chainparams);
 #endif
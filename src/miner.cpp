@@ -8,6 +8,7 @@
 #include "amount.h"
 #include "base58.h"
 #include "casino.h"
+#include "casinoschedule.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "coins.h"
@@ -17,6 +18,7 @@
 #include "consensus/validation.h"
 #include "hash.h"
 #include "net.h"
+#include "net_processing.h"
 #include "policy/feerate.h"
 #include "policy/policy.h"
 #include "primitives/transaction.h"
@@ -36,6 +38,8 @@
 #include <random>
 #include <unordered_set>
 
+#include <boost/thread.hpp>
+
 //////////////////////////////////////////////////////////////////////////////
 //
 // YbtcMiner
@@ -54,6 +58,8 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
 {
     int64_t nOldTime = pblock->nTime;
     int64_t nNewTime = std::max(pindexPrev->GetMedianTimePast() + 1, GetAdjustedTime());
+    if (IsCasinoSlotEnforced(pindexPrev->nHeight + 1, consensusParams))
+        nNewTime = std::max(nNewTime, GetCasinoSlotTime(pindexPrev, CASINO_PRODUCER_MINER));
 
     if (nOldTime < nNewTime)
         pblock->nTime = nNewTime;
@@ -65,6 +71,8 @@ BlockAssembler::Options::Options()
 {
     blockMinFeeRate = CFeeRate(DEFAULT_BLOCK_MIN_TX_FEE);
     nBlockMaxWeight = DEFAULT_BLOCK_MAX_WEIGHT;
+    nBlockMaxGas = DEFAULT_BLOCK_GAS_LIMIT;
+    nMaxContractTime = DEFAULT_BLOCK_MAX_CONTRACT_TIME;
 }
 
 BlockAssembler::BlockAssembler(const CChainParams& params, const Options& options) : chainparams(params)
@@ -72,6 +80,8 @@ BlockAssembler::BlockAssembler(const CChainParams& params, const Options& option
     blockMinFeeRate = options.blockMinFeeRate;
     // Limit weight to between 4K and MAX_BLOCK_WEIGHT-4K for sanity:
     nBlockMaxWeight = std::max<size_t>(4000, std::min<size_t>(MAX_BLOCK_WEIGHT - 4000, options.nBlockMaxWeight));
+    nBlockMaxGas = std::max(MIN_BLOCK_GAS_LIMIT, std::min(MAX_BLOCK_GAS_LIMIT, options.nBlockMaxGas));
+    nMaxContractTime = std::max<int64_t>(0, options.nMaxContractTime);
 }
 
 static BlockAssembler::Options DefaultOptions(const CChainParams& params)
@@ -82,6 +92,8 @@ static BlockAssembler::Options DefaultOptions(const CChainParams& params)
     // If both are given, restrict both.
     BlockAssembler::Options options;
     options.nBlockMaxWeight = gArgs.GetArg("-blockmaxweight", DEFAULT_BLOCK_MAX_WEIGHT);
+    options.nBlockMaxGas = gArgs.GetArg("-blockmaxgas", DEFAULT_BLOCK_GAS_LIMIT);
+    options.nMaxContractTime = gArgs.GetArg("-blockmaxcontracttime", DEFAULT_BLOCK_MAX_CONTRACT_TIME);
     if (gArgs.IsArgSet("-blockmintxfee")) {
         CAmount n = 0;
         ParseMoney(gArgs.GetArg("-blockmintxfee", ""), n);
@@ -97,10 +109,13 @@ BlockAssembler::BlockAssembler(const CChainParams& params) : BlockAssembler(para
 void BlockAssembler::resetBlock()
 {
     inBlock.clear();
+    setContractWrites.clear();
 
     // Reserve space for coinbase tx
     nBlockWeight = 4000;
     nBlockSigOpsCost = 400;
+    nBlockGas = 0;
+    nContractTime = 0;
     fIncludeWitness = false;
 
     // These counters do not include coinbase tx
@@ -129,15 +144,28 @@ void BlockAssembler::RebuildRefundTransaction(const std::vector<CTxOut>& vRefund
 }
 
 std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
+{
+    // Contracts run without cs_main, so the tip may move on meanwhile; start over on the new one then
+    for (int nAttempt = 1; nAttempt < MAX_BLOCK_ASSEMBLY_ATTEMPTS; nAttempt++) {
+        if (AssembleBlock(scriptPubKeyIn, fMineWitnessTx))
+            return std::move(pblocktemplate);
+    }
+
+    // The tip keeps moving (IBD, reindex): hold it still for the last one
+    LogPrint(BCLog::BENCH, "CreateNewBlock(): tip moved during %d assemblies, assembling under cs_main\n", MAX_BLOCK_ASSEMBLY_ATTEMPTS - 1);
+    LOCK(cs_main);
+    bool fAssembled = AssembleBlock(scriptPubKeyIn, fMineWitnessTx);
+    assert(fAssembled);
+    return std::move(pblocktemplate);
+}
+
+bool BlockAssembler::AssembleBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx)
 {
     //int64_t nTimeStart = GetTimeMicros();
 
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
-
-    if (!pblocktemplate.get())
-        return nullptr;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -145,63 +173,87 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxFees.push_back(-1);       // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    LOCK2(cs_main, mempool.cs);
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    nHeight = pindexPrev->nHeight + 1;
-
-    pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
-    // -regtest only: allow overriding block.nVersion with
-    // -blockversion=N to test forking scenarios
-    if (chainparams.MineBlocksOnDemand())
-        pblock->nVersion = gArgs.GetArg("-blockversion", pblock->nVersion);
-
-    pblock->nTime = GetAdjustedTime();
-    const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
-
-    nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST) ? nMedianTimePast : pblock->GetBlockTime();
-
-    // Decide whether to include witness transactions
-    // This is only needed in case the witness softfork activation is reverted
-    // (which would require a very deep reorganization) or when
-    // -promiscuousmempoolflags is used.
-    // TODO: replace this with a call to main to assess validity of a mempool
-    // transaction (which in most cases can be a no-op).
-    fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
-
-    sc::h256 oldHashStateRoot(pState->rootHash());
-    SmartContract smct;
-
-    // Create coinbase transaction.
-    CMutableTransaction coinbaseTx;
-    coinbaseTx.vin.resize(1);
-    coinbaseTx.vin[0].prevout.SetNull();
-    coinbaseTx.vout.resize(1);
-    coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
-    coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
-    coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-
-    AddCasinoToCoinBaseTx(smct, coinbaseTx, nHeight);
-
-    originalRewardTx = coinbaseTx;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-
+    CBlockIndex* pindexPrev;
+    {
+        LOCK(cs_main);
+        pindexPrev = chainActive.Tip();
+        nHeight = pindexPrev->nHeight + 1;
+
+        pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
+        // -regtest only: allow overriding block.nVersion with
+        // -blockversion=N to test forking scenarios
+        if (chainparams.MineBlocksOnDemand())
+            pblock->nVersion = gArgs.GetArg("-blockversion", pblock->nVersion);
+
+        pblock->nTime = GetAdjustedTime();
+        const int64_t nMedianTimePast = pindexPrev->GetMedianTimePast();
+
+        nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST) ? nMedianTimePast : pblock->GetBlockTime();
+
+        // Decide whether to include witness transactions
+        // This is only needed in case the witness softfork activation is reverted
+        // (which would require a very deep reorganization) or when
+        // -promiscuousmempoolflags is used.
+        // TODO: replace this with a call to main to assess validity of a mempool
+        // transaction (which in most cases can be a no-op).
+        fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus()) && fMineWitnessTx;
+
+        // The block's contracts run on a fork of the tip's state; pState is left alone
+        hashParentStateRoot = sc::h256Touint(pState->rootHash());
+        stateView = std::make_shared<sc::State>(sc::State::fork(*pState, pState->rootHash()));
+
+        // Create coinbase transaction.
+        CMutableTransaction coinbaseTx;
+        coinbaseTx.vin.resize(1);
+        coinbaseTx.vin[0].prevout.SetNull();
+        coinbaseTx.vout.resize(1);
+        coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
+        coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
+        coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
+
+        SmartContract smct(stateView.get());
+        sc::AddressHash casinoTouched;
+        stateView->setAccessLog(&casinoTouched);
+        AddCasinoToCoinBaseTx(smct, coinbaseTx, pindexPrev, nHeight);
+        stateView->setAccessLog(nullptr);
+        AddContractWrites(casinoTouched);
+
+        originalRewardTx = coinbaseTx;
+        pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    }
 
     int nPackagesSelected = 0;
     int nDescendantsUpdated = 0;
 
     bool hasContract = false;
     std::vector<CTxOut> vRefundGasFee = std::vector<CTxOut>();
-    addPackageTxs(smct, nPackagesSelected, nDescendantsUpdated, hasContract, vRefundGasFee);
+    {
+        // Blocks can be validated while the contracts run
+        SmartContract smct(stateView.get());
+        if (!addPackageTxs(smct, nPackagesSelected, nDescendantsUpdated, hasContract, vRefundGasFee))
+            return false;
+    }
 
-    pblock->hashStateRoot = uint256(sc::h256Touint(sc::h256(pState->rootHash())));
-    pState->setRoot(oldHashStateRoot);
+    pblock->hashStateRoot = uint256(sc::h256Touint(sc::h256(stateView->rootHash())));
 
     //int64_t nTime1 = GetTimeMicros();
 
+    LOCK(cs_main);
+    if (chainActive.Tip() != pindexPrev)
+        return false;
+    FinishBlock(pindexPrev, hasContract, vRefundGasFee);
+    //int64_t nTime2 = GetTimeMicros();
+
+    //jyan LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+
+    return true;
+}
+
+void BlockAssembler::FinishBlock(CBlockIndex* pindexPrev, bool hasContract, const std::vector<CTxOut>& vRefundGasFee)
+{
     nLastBlockTx = nBlockTx;
     nLastBlockWeight = nBlockWeight;
 
-
     // Refund gas fee
     if (hasContract && vRefundGasFee.size() > 0)
         RebuildRefundTransaction(vRefundGasFee);
@@ -209,8 +261,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
     pblocktemplate->vTxFees[0] = -nFees;
 
-    // jyan LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
-
     // Fill in header
     pblock->hashPrevBlock = pindexPrev->GetBlockHash();
     UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
@@ -222,10 +272,75 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
         throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
     }
-    //int64_t nTime2 = GetTimeMicros();
 
-    //jyan LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    CBlockAssemblyState& assembly = pblocktemplate->assembly;
+    assembly.rewardTx = originalRewardTx;
+    assembly.vRefundGasFee = vRefundGasFee;
+    assembly.fHasContract = hasContract;
+    assembly.fIncludeWitness = fIncludeWitness;
+    assembly.nBlockWeight = nBlockWeight;
+    assembly.nBlockSigOpsCost = nBlockSigOpsCost;
+    assembly.nBlockGas = nBlockGas;
+    assembly.nContractTime = nContractTime;
+    assembly.nFees = nFees;
+    assembly.hashParentStateRoot = hashParentStateRoot;
+    assembly.setContractWrites = setContractWrites;
+    assembly.stateView = stateView;
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::ExtendBlock(const CBlockTemplate& base)
+{
+    resetBlock();
+
+    CBlockIndex* pindexPrev;
+    {
+        LOCK(cs_main);
+        pindexPrev = chainActive.Tip();
+        if (base.block.hashPrevBlock != pindexPrev->GetBlockHash() || !base.assembly.stateView)
+            return nullptr;
+    }
+
+    pblocktemplate.reset(new CBlockTemplate(base));
+    pblock = &pblocktemplate->block;
+    nHeight = pindexPrev->nHeight + 1;
+    nLockTimeCutoff = (STANDARD_LOCKTIME_VERIFY_FLAGS & LOCKTIME_MEDIAN_TIME_PAST) ? pindexPrev->GetMedianTimePast() : pblock->GetBlockTime();
+
+    const CBlockAssemblyState& assembly = base.assembly;
+    originalRewardTx = assembly.rewardTx;
+    std::vector<CTxOut> vRefundGasFee = assembly.vRefundGasFee;
+    bool hasContract = assembly.fHasContract;
+    fIncludeWitness = assembly.fIncludeWitness;
+    nBlockWeight = assembly.nBlockWeight;
+    nBlockSigOpsCost = assembly.nBlockSigOpsCost;
+    nBlockGas = assembly.nBlockGas;
+    nContractTime = assembly.nContractTime;
+    nFees = assembly.nFees;
+    hashParentStateRoot = assembly.hashParentStateRoot;
+    setContractWrites = assembly.setContractWrites;
+    // The contracts of base already ran; carry on from the state they left.
+    // A copy rather than a fork of it, so views do not pile up on each other.
+    stateView = std::make_shared<sc::State>(*assembly.stateView);
+
+    int nPackagesSelected = 0;
+    int nDescendantsUpdated = 0;
+    nBlockTx = pblock->vtx.size() - 1;
+    {
+        SmartContract smct(stateView.get());
+        if (!addPackageTxs(smct, nPackagesSelected, nDescendantsUpdated, hasContract, vRefundGasFee))
+            return nullptr;
+    }
+
+    if (nPackagesSelected == 0)
+        return std::move(pblocktemplate);
 
+    pblock->hashStateRoot = uint256(sc::h256Touint(sc::h256(stateView->rootHash())));
+
+    LOCK(cs_main);
+    if (chainActive.Tip() != pindexPrev)
+        return nullptr;
+    // Start the coinbase over, as its refunds and witness commitment change
+    pblock->vtx[0] = MakeTransactionRef(CMutableTransaction(originalRewardTx));
+    FinishBlock(pindexPrev, hasContract, vRefundGasFee);
     return std::move(pblocktemplate);
 }
 
@@ -241,13 +356,16 @@ void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
     }
 }
 
-bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost)
+bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost, uint64_t packageGas)
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
     if (nBlockWeight + WITNESS_SCALE_FACTOR * packageSize >= nBlockMaxWeight)
         return false;
     if (nBlockSigOpsCost + packageSigOpsCost >= MAX_BLOCK_SIGOPS_COST)
         return false;
+    // Contracts past the gas or time budget are left for a later block
+    if (packageGas > 0 && (nBlockGas + packageGas > nBlockMaxGas || nContractTime >= nMaxContractTime * 1000))
+        return false;
     return true;
 }
 
@@ -266,6 +384,18 @@ bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& packa
     return true;
 }
 
+bool BlockAssembler::TestPackageContracts(const CTxMemPool::setEntries& package)
+{
+    for (const CTxMemPool::txiter it : package) {
+        // Failed at mempool acceptance on accounts nothing in the block has
+        // touched since, so it would fail again here.
+        const CContractPreExecution* preExecution = it->GetContractPreExecution();
+        if (preExecution && !preExecution->fSuccess && IsPreExecutionValid(*preExecution))
+            return false;
+    }
+    return true;
+}
+
 // ================== Casino Contract ===========================
 
 bool BlockAssembler::GenerateCasinoList(std::vector<int>& winner, uint32_t totalPlayer, unsigned int seed)
@@ -288,7 +418,7 @@ bool BlockAssembler::GenerateCasinoList(std::vector<int>& winner, uint32_t total
 }
 
 
-bool BlockAssembler::AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransaction& coinbaseTx, int& nHeight)
+bool BlockAssembler::AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransaction& coinbaseTx, const CBlockIndex* pindexPrev, int& nHeight)
 {
     if (nHeight < 1) return true;
     bool hasCasino = false;
@@ -310,17 +440,23 @@ bool BlockAssembler::AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransact
         // Get next phase player number
         std::vector<unsigned char> output;
         auto dataTotalPlayer = CASINO_GETTOTALPLAYER;
-        CallContract(sc::h160(ParseHex(GENESIS_CONTRACT_ADDRESS_ETH)), ParseHex(dataTotalPlayer), &output);
+        CallContract(sc::h160(ParseHex(GENESIS_CONTRACT_ADDRESS_ETH)), ParseHex(dataTotalPlayer), &output, false, stateView.get());
         uint32_t totalPlayer = ConvertHexStringToUnsignedInt(output);
         LogPrint(BCLog::BENCH, "CASINOMINER ---  player number next phase %d \n", totalPlayer);
         if (totalPlayer == 0) totalPlayer = CHAIN_PHASE_PLAYER;
 
-        // Get next phase seed 
-        std::vector<unsigned char> output_seed;
+        // Get next phase seed, kept with the schedule of the previous phase
         auto prevPhase = currentPhase > 0 ? currentPhase - 1 : 0;
-        auto dataSeed = CASINO_GETWINNERSEED + str60zero + ConvertUnsignedIntToHexString(prevPhase);
-        CallContract(sc::h160(ParseHex(GENESIS_CONTRACT_ADDRESS_ETH)), ParseHex(dataSeed), &output_seed);
-        uint32_t winnerSeed = ConvertHexStringToUnsignedInt(output_seed);
+        uint32_t winnerSeed;
+        CCasinoSchedule prevSchedule;
+        if (GetCasinoSchedule(pindexPrev, prevPhase, prevSchedule)) {
+            winnerSeed = prevSchedule.nSeed;
+        } else {
+            std::vector<unsigned char> output_seed;
+            auto dataSeed = CASINO_GETWINNERSEED + str60zero + ConvertUnsignedIntToHexString(prevPhase);
+            CallContract(sc::h160(ParseHex(GENESIS_CONTRACT_ADDRESS_ETH)), ParseHex(dataSeed), &output_seed, false, stateView.get());
+            winnerSeed = ConvertHexStringToUnsignedInt(output_seed);
+        }
         LogPrint(BCLog::BENCH, "CASINOMINER ---  seed next phase %d \n", winnerSeed);
 
 
@@ -343,7 +479,7 @@ bool BlockAssembler::AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransact
         hasCasino = true;
     }
 
-    // refresh pState
+    // refresh the block's state
     if (hasCasino) {
         LogPrintf("CASINOMINER ---  casino in coinbase tx \n");
         CTxOut txout(0, scriptPubKey);
@@ -352,9 +488,9 @@ bool BlockAssembler::AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransact
         sc::u256 refundGasAmount = 0;
         std::vector<unsigned char> txOutput;
         std::vector<CTxOut> vRefundGasFee;
-        sc::h256 oldHashStateRoot(pState->rootHash());
+        sc::h256 oldHashStateRoot(stateView->rootHash());
         if (!smct.TxContractExec(coinbaseTx, refundGasAmount, vRefundGasFee, txOutput)) {
-            pState->setRoot(oldHashStateRoot);
+            stateView->setRoot(oldHashStateRoot);
             LogPrintf("CASINOMINER --- Casino contract quit abnormally ????????????????? ");
             return false;
         }
@@ -365,30 +501,70 @@ bool BlockAssembler::AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransact
 
 // ================== Smart Contract ===========================
 
-bool BlockAssembler::AttemptToAddContractToBlock(SmartContract& smct, CTxMemPool::txiter iter, std::vector<CTxOut>& vRefundGasFee)
+bool BlockAssembler::IsPreExecutionValid(const CContractPreExecution& preExecution) const
 {
-    CMutableTransaction tx(iter->GetTx());
-    LogPrintf("================================ txid %s\n", iter->GetTx().GetHash().ToString());
-
-    sc::u256 refundGasAmount = 0;
-    std::vector<unsigned char> txOutput;
-    sc::h256 oldHashStateRoot(pState->rootHash());
-    if (!smct.TxContractExec(tx, refundGasAmount, vRefundGasFee, txOutput)) {
-        pState->setRoot(oldHashStateRoot);
-        LogPrintf("Contract quit abnormally. ");
+    if (!preExecution.IsCurrent(hashParentStateRoot))
         return false;
+    for (const uint160& address : preExecution.vRead)
+        if (setContractWrites.count(address))
+            return false;
+    return true;
+}
+
+void BlockAssembler::AddContractWrites(const sc::AddressHash& touched)
+{
+    for (const sc::h160& address : touched)
+        setContractWrites.insert(uint160(address.asBytes()));
+}
+
+bool BlockAssembler::RefreshInBlock()
+{
+    AssertLockHeld(mempool.cs);
+    // Packages are only ever added on top of what is in the block, so
+    // everything it holds must still be in the mempool
+    inBlock.clear();
+    for (size_t i = 1; i < pblock->vtx.size(); i++) {
+        CTxMemPool::txiter it = mempool.mapTx.find(pblock->vtx[i]->GetHash());
+        if (it == mempool.mapTx.end())
+            return false;
+        inBlock.insert(it);
     }
+    return true;
+}
 
-    CTransactionRef txref = std::make_shared<CTransaction>(tx);
-    pblock->vtx.emplace_back(txref);
-    pblocktemplate->vTxFees.push_back(iter->GetFee());
-    pblocktemplate->vTxSigOpsCost.push_back(iter->GetSigOpCost());
-    this->nBlockWeight += iter->GetTxWeight();
-    ++nBlockTx;
-    this->nBlockSigOpsCost += iter->GetSigOpCost();
-    nFees += iter->GetFee();
-    inBlock.insert(iter);
+bool BlockAssembler::ExecutePackageContracts(SmartContract& smct, const std::vector<PackageTx>& vPackage, std::vector<CTxOut>& vRefundGasFee)
+{
+    for (const PackageTx& entry : vPackage) {
+        if (!entry.tx->HasCreateOrCall())
+            continue;
+        LogPrintf("================================ txid %s\n", entry.tx->GetHash().ToString());
+
+        // If the tx executes on what its pre-execution saw, it changes exactly the
+        // accounts recorded then; otherwise every account it looks up may change.
+        const CContractPreExecution* preExecution = entry.preExecution.get();
+        const bool fRepeat = preExecution && IsPreExecutionValid(*preExecution);
+        sc::AddressHash touched;
+        if (!fRepeat)
+            stateView->setAccessLog(&touched);
 
+        sc::u256 refundGasAmount = 0;
+        std::vector<unsigned char> txOutput;
+        CBlockReceipts receipts;
+        int64_t nTimeStart = GetTimeMicros();
+        bool fExecuted = smct.TxContractExec(*entry.tx, refundGasAmount, vRefundGasFee, txOutput, &receipts);
+        nContractTime += GetTimeMicros() - nTimeStart;
+        stateView->setAccessLog(nullptr);
+        for (const CContractReceipt& receipt : receipts.receipts)
+            nBlockGas += receipt.nGasUsed;
+        if (!fExecuted) {
+            LogPrintf("Contract quit abnormally. ");
+            return false;
+        }
+        if (fRepeat)
+            setContractWrites.insert(preExecution->vWrite.begin(), preExecution->vWrite.end());
+        else
+            AddContractWrites(touched);
+    }
     return true;
 }
 
@@ -447,10 +623,10 @@ int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& already
 // guaranteed to fail again, but as a belt-and-suspenders check we put it in
 // failedTx and avoid re-evaluation, since the re-evaluation would be using
 // cached size/sigops/fee values that are not actually correct.
-bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set& mapModifiedTx, CTxMemPool::setEntries& failedTx)
+bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set& mapModifiedTx, CTxMemPool::setEntries& failedTx, const std::set<uint256>& setFailedContracts)
 {
     assert(it != mempool.mapTx.end());
-    return mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it);
+    return mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it) || setFailedContracts.count(it->GetTx().GetHash());
 }
 
 void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries)
@@ -474,8 +650,60 @@ void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, CTxMemP
 // Each time through the loop, we compare the best transaction in
 // mapModifiedTxs with the next transaction in the mempool to decide what
 // transaction package to work on next.
-void BlockAssembler::addPackageTxs(SmartContract& smct, int& nPackagesSelected, int& nDescendantsUpdated, bool& hasContract, std::vector<CTxOut>& vRefundGasFee)
+bool BlockAssembler::addPackageTxs(SmartContract& smct, int& nPackagesSelected, int& nDescendantsUpdated, bool& hasContract, std::vector<CTxOut>& vRefundGasFee)
 {
+    // Txs whose contracts quit abnormally, left out of every later selection
+    std::set<uint256> setFailedContracts;
+    while (true) {
+        std::vector<PackageTx> vPackage;
+        {
+            LOCK(mempool.cs);
+            if (!RefreshInBlock())
+                return false;
+            SelectPackages(nPackagesSelected, nDescendantsUpdated, vPackage, setFailedContracts);
+        }
+        if (vPackage.empty())
+            return true;
+
+        // Run the package's contracts without mempool.cs, so the mempool keeps
+        // taking transactions meanwhile. Should the package not make it in, the
+        // accounts it wrote stay in setContractWrites, which only costs the
+        // pre-executions that read them.
+        const sc::h256 oldHashStateRoot(stateView->rootHash());
+        const size_t nOldRefunds = vRefundGasFee.size();
+        const uint64_t nOldBlockGas = nBlockGas;
+        const bool fExecuted = ExecutePackageContracts(smct, vPackage, vRefundGasFee);
+
+        LOCK(mempool.cs);
+        if (!RefreshInBlock())
+            return false;
+        // The package may have left the mempool meanwhile, e.g. replaced or
+        // evicted after its dry run
+        std::vector<CTxMemPool::txiter> vEntries;
+        for (const PackageTx& entry : vPackage) {
+            CTxMemPool::txiter it = mempool.mapTx.find(entry.tx->GetHash());
+            if (it == mempool.mapTx.end())
+                break;
+            vEntries.push_back(it);
+        }
+        if (!fExecuted || vEntries.size() != vPackage.size()) {
+            stateView->setRoot(oldHashStateRoot);
+            vRefundGasFee.resize(nOldRefunds);
+            nBlockGas = nOldBlockGas;
+            if (!fExecuted)
+                setFailedContracts.insert(vPackage.back().tx->GetHash());
+            continue;
+        }
+        for (CTxMemPool::txiter it : vEntries)
+            AddToBlock(it);
+        hasContract = true;
+        ++nPackagesSelected;
+    }
+}
+
+void BlockAssembler::SelectPackages(int& nPackagesSelected, int& nDescendantsUpdated, std::vector<PackageTx>& vPackage, const std::set<uint256>& setFailedContracts)
+{
+    AssertLockHeld(mempool.cs);
     // mapModifiedTx will store sorted packages after they are modified
     // because some of their txs are already in the block
     indexed_modified_transaction_set mapModifiedTx;
@@ -498,7 +726,7 @@ void BlockAssembler::addPackageTxs(SmartContract& smct, int& nPackagesSelected,
     while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty()) {
         // First try to find a new transaction in mapTx to evaluate.
         if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-            SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
+            SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx, setFailedContracts)) {
             ++mi;
             continue;
         }
@@ -533,21 +761,33 @@ void BlockAssembler::addPackageTxs(SmartContract& smct, int& nPackagesSelected,
         // contain anything that is inBlock.
         assert(!inBlock.count(iter));
 
+        if (fUsingModified && setFailedContracts.count(iter->GetTx().GetHash())) {
+            mapModifiedTx.get<ancestor_score>().erase(modit);
+            failedTx.insert(iter);
+            continue;
+        }
+
         uint64_t packageSize = iter->GetSizeWithAncestors();
-        CAmount packageFees = iter->GetModFeesWithAncestors();
         int64_t packageSigOpsCost = iter->GetSigOpCostWithAncestors();
+        uint64_t packageGas = iter->GetContractGasWithAncestors();
+        // Packages are ranked by the fees the miner keeps per unit of block
+        // space, expected contract gas included
+        CAmount packageMiningFees = iter->GetMiningFeesWithAncestors();
+        uint64_t packageMiningSize = iter->GetMiningSizeWithAncestors();
         if (fUsingModified) {
             packageSize = modit->nSizeWithAncestors;
-            packageFees = modit->nModFeesWithAncestors;
             packageSigOpsCost = modit->nSigOpCostWithAncestors;
+            packageGas = modit->nContractGasWithAncestors;
+            packageMiningFees = modit->GetMiningFeesWithAncestors();
+            packageMiningSize = modit->GetMiningSizeWithAncestors();
         }
 
-        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+        if (packageMiningFees < blockMinFeeRate.GetFee(packageMiningSize)) {
             // Everything else we might consider has a lower fee rate
             return;
         }
 
-        if (!TestPackage(packageSize, packageSigOpsCost)) {
+        if (!TestPackage(packageSize, packageSigOpsCost, packageGas)) {
             if (fUsingModified) {
                 // Since we always look at the best entry in mapModifiedTx,
                 // we must erase failed entries so that we can consider the
@@ -574,8 +814,8 @@ void BlockAssembler::addPackageTxs(SmartContract& smct, int& nPackagesSelected,
         onlyUnconfirmed(ancestors);
         ancestors.insert(iter);
 
-        // Test if all tx's are Final
-        if (!TestPackageTransactions(ancestors)) {
+        // Test if all tx's are Final and no contract in the package is known to fail
+        if (!TestPackageTransactions(ancestors) || !TestPackageContracts(ancestors)) {
             if (fUsingModified) {
                 mapModifiedTx.get<ancestor_score>().erase(modit);
                 failedTx.insert(iter);
@@ -590,16 +830,18 @@ void BlockAssembler::addPackageTxs(SmartContract& smct, int& nPackagesSelected,
         std::vector<CTxMemPool::txiter> sortedEntries;
         SortForBlock(ancestors, iter, sortedEntries);
 
-        for (size_t i = 0; i < sortedEntries.size(); ++i) {
-            const CTransaction& tx = sortedEntries[i]->GetTx();
-            if (tx.HasCreateOrCall()) {
-                if (!AttemptToAddContractToBlock(smct, sortedEntries[i], vRefundGasFee)) {
-                    continue;
-                }
-                hasContract = true;
-            } else {
-                AddToBlock(sortedEntries[i]);
+        // A package with contracts is handed back to run them without
+        // mempool.cs; iter, with all the others as ancestors, comes last
+        for (const CTxMemPool::txiter it : sortedEntries) {
+            if (it->GetTx().HasCreateOrCall()) {
+                for (const CTxMemPool::txiter entry : sortedEntries)
+                    vPackage.push_back(PackageTx{entry->GetSharedTx(), entry->GetSharedContractPreExecution()});
+                return;
             }
+        }
+
+        for (size_t i = 0; i < sortedEntries.size(); ++i) {
+            AddToBlock(sortedEntries[i]);
 
             // Erase from the modified set, if present
             mapModifiedTx.erase(sortedEntries[i]);
@@ -630,6 +872,209 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
 
+static CCriticalSection cs_minerSlotStats;
+static CMinerSlotStats minerSlotStats;
+
+CMinerSlotStats GetMinerSlotStats()
+{
+    LOCK(cs_minerSlotStats);
+    return minerSlotStats;
+}
+
+void RecordMinerBuildTime(int64_t nMicros)
+{
+    LOCK(cs_minerSlotStats);
+    minerSlotStats.nLastBuildTime = nMicros;
+    minerSlotStats.nMaxBuildTime = std::max(minerSlotStats.nMaxBuildTime, nMicros);
+    // Exponential moving average over about the last 8 templates
+    if (minerSlotStats.nAvgBuildTime == 0)
+        minerSlotStats.nAvgBuildTime = nMicros;
+    else
+        minerSlotStats.nAvgBuildTime += (nMicros - minerSlotStats.nAvgBuildTime) / 8;
+}
+
+void RecordMinerSlot(bool fFound, int64_t nLateness)
+{
+    LOCK(cs_minerSlotStats);
+    if (!fFound) {
+        minerSlotStats.nMissedSlots++;
+        return;
+    }
+    minerSlotStats.nBlocks++;
+    minerSlotStats.nLastLateness = nLateness;
+    if (nLateness > MINER_LATE_BLOCK)
+        minerSlotStats.nLateBlocks++;
+}
+
+// Background block template
+
+class CTemplateBuilder final : public CValidationInterface
+{
+public:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fTipChanged = true;
+    bool fMempoolChanged = false;
+    std::shared_ptr<const CBlockTemplate> ptemplate;
+    std::vector<unsigned char> vchMinerAddress; //!< minerAddress when ptemplate was built, as its casino call names it
+    CTemplateBuilderStats stats;
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            fTipChanged = true;
+            ptemplate.reset();
+            stats.nTemplateTime = 0;
+            stats.nTemplateTx = 0;
+        }
+        cond.notify_all();
+    }
+
+    void TransactionAddedToMempool(const CTransactionRef& ptx) override
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            fMempoolChanged = true;
+        }
+        cond.notify_all();
+    }
+};
+
+static CTemplateBuilder* ptemplateBuilder = nullptr;
+static boost::thread* ptemplateBuilderThread = nullptr;
+
+static void ThreadTemplateBuilder(const CChainParams& chainparams)
+{
+    RenameThread("ybtc-template");
+    CTemplateBuilder& builder = *ptemplateBuilder;
+    const int64_t nRefresh = std::max<int64_t>(0, gArgs.GetArg("-blocktemplaterefresh", DEFAULT_BLOCK_TEMPLATE_REFRESH));
+    // Consumers put their own script in; what it is does not change the block's validity
+    const CScript scriptDummy = CScript() << OP_TRUE;
+
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(builder.mutex);
+                while (!builder.fTipChanged && !builder.fMempoolChanged)
+                    builder.cond.wait(lock);
+            }
+            // Let a burst of transactions settle into one extension
+            MilliSleep(nRefresh);
+
+            bool fRebuild;
+            std::shared_ptr<const CBlockTemplate> pbase;
+            const std::vector<unsigned char> vchMinerAddress = minerAddress;
+            {
+                boost::lock_guard<boost::mutex> lock(builder.mutex);
+                fRebuild = builder.fTipChanged || !builder.ptemplate || builder.vchMinerAddress != vchMinerAddress;
+                builder.fTipChanged = false;
+                builder.fMempoolChanged = false;
+                pbase = builder.ptemplate;
+            }
+            if (IsInitialBlockDownload())
+                continue;
+
+            int64_t nStart = GetTimeMicros();
+            std::unique_ptr<CBlockTemplate> pblocktemplate;
+            bool fExtended = false;
+            try {
+                if (!fRebuild) {
+                    pblocktemplate = BlockAssembler(chainparams).ExtendBlock(*pbase);
+                    fExtended = pblocktemplate != nullptr;
+                }
+                if (!pblocktemplate)
+                    pblocktemplate = BlockAssembler(chainparams).CreateNewBlock(scriptDummy);
+            } catch (const std::runtime_error& e) {
+                LogPrintf("%s: %s\n", __func__, e.what());
+                pblocktemplate.reset();
+            }
+            int64_t nTime = GetTimeMicros() - nStart;
+
+            boost::lock_guard<boost::mutex> lock(builder.mutex);
+            CTemplateBuilderStats& stats = builder.stats;
+            if (!pblocktemplate) {
+                stats.nFailures++;
+                continue;
+            }
+            // Exponential moving averages over about the last 8 runs
+            if (fExtended) {
+                stats.nExtensions++;
+                stats.nLastExtendTime = nTime;
+                stats.nAvgExtendTime += stats.nAvgExtendTime == 0 ? nTime : (nTime - stats.nAvgExtendTime) / 8;
+            } else {
+                stats.nBuilds++;
+                stats.nLastBuildTime = nTime;
+                stats.nAvgBuildTime += stats.nAvgBuildTime == 0 ? nTime : (nTime - stats.nAvgBuildTime) / 8;
+            }
+            // A tip that moved meanwhile leaves the template for the rebuild it triggered
+            if (builder.fTipChanged)
+                continue;
+            stats.nTemplateTime = GetTimeMicros();
+            stats.nTemplateTx = pblocktemplate->block.vtx.size() - 1;
+            builder.ptemplate = std::move(pblocktemplate);
+            builder.vchMinerAddress = vchMinerAddress;
+        }
+    } catch (const boost::thread_interrupted&) {
+        LogPrintf("%s: stopped\n", __func__);
+        throw;
+    }
+}
+
+void StartTemplateBuilder(const CChainParams& chainparams)
+{
+    if (ptemplateBuilder)
+        return;
+    ptemplateBuilder = new CTemplateBuilder();
+    ptemplateBuilder->stats.fRunning = true;
+    RegisterValidationInterface(ptemplateBuilder);
+    ptemplateBuilderThread = new boost::thread(boost::bind(&ThreadTemplateBuilder, boost::cref(chainparams)));
+}
+
+void StopTemplateBuilder()
+{
+    if (!ptemplateBuilder)
+        return;
+    ptemplateBuilderThread->interrupt();
+    ptemplateBuilderThread->join();
+    delete ptemplateBuilderThread;
+    ptemplateBuilderThread = nullptr;
+    UnregisterValidationInterface(ptemplateBuilder);
+    delete ptemplateBuilder;
+    ptemplateBuilder = nullptr;
+}
+
+std::unique_ptr<CBlockTemplate> GetBuiltTemplate(const CScript& scriptPubKey, const CBlockIndex* pindexPrev)
+{
+    if (!ptemplateBuilder)
+        return nullptr;
+    std::shared_ptr<const CBlockTemplate> ptemplate;
+    {
+        boost::lock_guard<boost::mutex> lock(ptemplateBuilder->mutex);
+        if (ptemplateBuilder->vchMinerAddress != minerAddress)
+            return nullptr;
+        ptemplate = ptemplateBuilder->ptemplate;
+    }
+    if (!ptemplate || ptemplate->block.hashPrevBlock != pindexPrev->GetBlockHash())
+        return nullptr;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate(*ptemplate));
+    CMutableTransaction coinbaseTx(*pblocktemplate->block.vtx[0]);
+    coinbaseTx.vout[0].scriptPubKey = scriptPubKey;
+    pblocktemplate->block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    pblocktemplate->assembly.rewardTx.vout[0].scriptPubKey = scriptPubKey;
+    return pblocktemplate;
+}
+
+CTemplateBuilderStats GetTemplateBuilderStats()
+{
+    if (!ptemplateBuilder)
+        return CTemplateBuilderStats();
+    boost::lock_guard<boost::mutex> lock(ptemplateBuilder->mutex);
+    return ptemplateBuilder->stats;
+}
+
 #ifdef ENABLE_WALLET
 //
 #include "net.h"
@@ -681,25 +1126,44 @@ static void getMinerAddress()
     }
     auto address = CYbtcAddress(pubKey.GetID());
     minerAddress = ToByteVector(boost::get<CKeyID>(address.Get()));
+
+    // Prove to peers that we mine for this address, so they push us the blocks we build on
+    CKey key;
+    if (pwallet->GetKey(pubKey.GetID(), key))
+        SetSlotMinerKey(key);
 }
 
-static uint32_t IsActiveMiner(int currentPhase)
+// Sign the header with the key of minerAddress, the player the schedule knows us by
+static bool SignMinerBlock(CBlock* pblock)
 {
-    // Go to contrac, check permission
-    std::vector<unsigned char> output;
-    auto data = CASINO_ISWINNERME + str60zero + ConvertUnsignedIntToHexString(currentPhase);
-    LogPrintf("CASINO IsNextWinner input %s \n", data);
-    CallContract(sc::h160(ParseHex(GENESIS_CONTRACT_ADDRESS_ETH)), ParseHex(data), &output);
-    LogPrintf("CASINO IsNextWinner return %s \n", HexStr(output));
-    return ConvertHexStringToUnsignedInt(output);
+    CWallet* const pwallet = ::vpwallets[0];
+    CKey key;
+    {
+        LOCK(pwallet->cs_wallet);
+        if (!pwallet->GetKey(CKeyID(uint160(minerAddress)), key))
+            return false;
+    }
+    return SignCasinoHeader(*pblock, key);
+}
+
+static uint32_t IsActiveMiner(const CBlockIndex* pindexPrev, int currentPhase)
+{
+    // Look ourselves up among the winners the phase schedule recorded
+    LOCK(cs_main);
+    CCasinoSchedule schedule;
+    if (!GetCasinoSchedule(pindexPrev, currentPhase, schedule))
+        return 0;
+    uint32_t winner = schedule.MinerIndex(sc::h160(minerAddress));
+    LogPrintf("CASINO IsNextWinner phase %d block %s return %d \n", currentPhase, schedule.hashBlock.ToString(), winner);
+    return winner;
 }
 
-static bool IsNextMiner(int currentPhase, int currentIndex, int* checkedWinPhase)
+static bool IsNextMiner(const CBlockIndex* pindexPrev, int currentPhase, int currentIndex, int* checkedWinPhase)
 {
     //return true;
     auto winner = -1;
     if (currentPhase >= 0 && (*checkedWinPhase) < currentPhase) {
-        winner = IsActiveMiner(currentPhase);
+        winner = IsActiveMiner(pindexPrev, currentPhase);
         *checkedWinPhase = currentPhase;
         if (winner > 0) {
             minerIndex = winner - 1;
@@ -719,6 +1183,43 @@ int whenJumpAbnormal(int currentPhase, int currentIndex, int lastWinPhase, int l
     return (currentPhase - lastWinPhase) * CHAIN_PHASE_PLAYER + ((CHAIN_PHASE_PLAYER + currentIndex - lastWinIndex) % CHAIN_PHASE_PLAYER);
 }
 
+// Wakes the miner threads when the tip changes, and remembers when it did
+class CMinerTipListener final : public CValidationInterface
+{
+public:
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    const CBlockIndex* pindexTip = nullptr;
+    int64_t nTipTime = 0; //!< GetTimeMicros() when pindexTip was connected
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        {
+            boost::lock_guard<boost::mutex> lock(mutex);
+            pindexTip = pindexNew;
+            nTipTime = GetTimeMicros();
+        }
+        cond.notify_all();
+    }
+};
+
+static CMinerTipListener* pminerTipListener = nullptr;
+
+// Block until the tip moves away from pindexPrev or nDeadline (GetTimeMicros)
+// passes. Returns false if the tip moved.
+static bool WaitForSlot(const CBlockIndex* pindexPrev, int64_t nDeadline)
+{
+    boost::unique_lock<boost::mutex> lock(pminerTipListener->mutex);
+    while (pminerTipListener->pindexTip == pindexPrev) {
+        int64_t nNow = GetTimeMicros();
+        if (nNow >= nDeadline)
+            return true;
+        pminerTipListener->cond.wait_for(lock, boost::chrono::microseconds(nDeadline - nNow));
+    }
+    return false;
+}
+
 void static YbtcMiner(const CChainParams& chainparams)
 {
     LogPrintf("YbtcMiner started on CPU \n");
@@ -732,11 +1233,8 @@ void static YbtcMiner(const CChainParams& chainparams)
         GetMainSignals().ScriptForMining(coinbaseScript);
     }
 
-
-    std::mutex m_cs;
-
     // Wait for other processes ready by sleeping
-    std::this_thread::sleep_for(std::chrono::milliseconds(CHAIN_BLOCK_INTERVAL));
+    MilliSleep(CHAIN_BLOCK_INTERVAL);
     getMinerAddress();
     LogPrintf("CASINOMINER --- initial miner address is %s\n", HexStr(minerAddress));
 
@@ -747,9 +1245,6 @@ void static YbtcMiner(const CChainParams& chainparams)
         if (!coinbaseScript || coinbaseScript->reserveScript.empty())
             throw std::runtime_error("No coinbase script available (mining requires a wallet)");
 
-        auto timedHeight = -999999;
-        int64_t nTimeStart = GetTimeMicros();
-        bool abnormalSkip = false;
         auto lastInactive = -999999;
 
         auto currentPhase = 0;
@@ -759,81 +1254,110 @@ void static YbtcMiner(const CChainParams& chainparams)
         auto lastWinIndex = -1;
         auto checkedWinPhase = -1;
 
-        while (true) {
-            //
-            // Create new block
-            //
-            CBlockIndex* pindexPrev = chainActive.Tip();
-
-            // Get miner context
-            currentPhase = pindexPrev->nHeight / CHAIN_PHASE_SIZE;
-            currentIndex = pindexPrev->nHeight % CHAIN_PHASE_SIZE;
-
+        const CBlockIndex* pindexPrev = nullptr;
+        int64_t nPrevTime = 0; // when pindexPrev became the tip
+        int64_t nSlotTime = 0; // when our block on pindexPrev is due
+        bool fMine = false;
 
-            // Abnormal check
-            if (timedHeight != pindexPrev->nHeight) {
-                timedHeight = pindexPrev->nHeight;
-                nTimeStart = GetTimeMicros();
-            } else {
-                int64_t nTimeEnd = GetTimeMicros();
-                int64_t nTimeCheck = nTimeEnd - nTimeStart;
-                if (nTimeCheck * 0.000001 > 4 * CHAIN_BLOCK_INTERVAL * whenJumpAbnormal(currentPhase, currentIndex, lastWinPhase, lastWinIndex)) {
-                    abnormalSkip = true;
+        while (true) {
+            boost::this_thread::interruption_point();
+
+            // The phase, index and permission only change with the tip
+            const CBlockIndex* pindexTip;
+            int64_t nTipTime;
+            {
+                boost::lock_guard<boost::mutex> lock(pminerTipListener->mutex);
+                if (!pminerTipListener->pindexTip) {
+                    LOCK(cs_main);
+                    pminerTipListener->pindexTip = chainActive.Tip();
+                    pminerTipListener->nTipTime = GetTimeMicros();
                 }
+                pindexTip = pminerTipListener->pindexTip;
+                nTipTime = pminerTipListener->nTipTime;
             }
 
-/* jyan
-            if (lastInactive != (int)currentIndex) {
-                LogPrintf("\n\nCASINOMINER ---  phase %d tip index %d\n", currentPhase, currentIndex);
+            if (pindexTip != pindexPrev) {
+                pindexPrev = pindexTip;
+                nPrevTime = nTipTime;
+                nSlotTime = nTipTime + CHAIN_BLOCK_INTERVAL * 1000;
+
+                // Get miner context
+                currentPhase = pindexPrev->nHeight / CHAIN_PHASE_SIZE;
+                currentIndex = pindexPrev->nHeight % CHAIN_PHASE_SIZE;
+
+                if (!IsCasinoSlotEnforced(pindexPrev->nHeight + 1, chainparams.GetConsensus())) {
+                    //LogPrintf("God is creating Adam and Eve \n");
+                    minerIndex = CHAIN_PHASE_PLAYER - 1;
+                    lastWinPhase = 0;
+                    lastWinIndex = minerIndex;
+                    fMine = true;
+                } else if (IsNextMiner(pindexPrev, currentPhase, currentIndex, &checkedWinPhase)) {
+                    lastWinPhase = currentPhase;
+                    lastWinIndex = currentIndex;
+                    LogPrintf("CASINOMINER ---  moneyMe ******************** \n");
+                    fMine = true;
+                } else {
+                    if (lastInactive != (int)currentIndex) {
+                        lastInactive = currentIndex;
+                        LogPrintf("CASINOMINER --- inactive \n");
+                    }
+                    fMine = false;
+                }
             }
-*/
-
-            if (currentPhase >= 0) {
-                //LogPrintf("God is creating Adam and Eve \n");
-                minerIndex = CHAIN_PHASE_PLAYER - 1;
-                lastWinPhase = 0;
-                lastWinIndex = minerIndex;
-                std::this_thread::sleep_for(std::chrono::milliseconds(CHAIN_BLOCK_INTERVAL));
 
-            } else if (abnormalSkip) {
+            if (!fMine) {
+                // Abnormal check: if nobody mined for too long, dig anyway
+                int64_t nAbnormalTime = nPrevTime + 4 * CHAIN_BLOCK_INTERVAL * 1000000LL * whenJumpAbnormal(currentPhase, currentIndex, lastWinPhase, lastWinIndex);
+                // Someone else's slot only opens to us once it timed out, later if we are not a winner of the phase
+                if (IsCasinoSlotEnforced(pindexPrev->nHeight + 1, chainparams.GetConsensus())) {
+                    const CasinoSlotProducer producer = minerIndex < CHAIN_PHASE_PLAYER ? CASINO_PRODUCER_WINNERS : CASINO_PRODUCER_ANYONE;
+                    nAbnormalTime = std::max(nAbnormalTime, nPrevTime + (GetCasinoSlotTime(pindexPrev, producer) - pindexPrev->GetBlockTime()) * 1000000);
+                }
+                if (!WaitForSlot(pindexPrev, nAbnormalTime))
+                    continue;
                 LogPrintf("CASINOMINER ---  nobody mine. I would dig more :( :( : ( :( :) :) :) :) \n");
-                //lastWinPhase = currentPhase;
-                //lastWinIndex = currentIndex;
-                //sleep 2 seconds to leave forbiden zone
-                std::this_thread::sleep_for(std::chrono::milliseconds(2));
-                // reset abnormal status
-                abnormalSkip = false;
-
-            } else if (IsNextMiner(currentPhase, currentIndex, &checkedWinPhase)) {
-                lastWinPhase = currentPhase;
-                lastWinIndex = currentIndex;
-                LogPrintf("CASINOMINER ---  moneyMe ******************** \n");
-                std::this_thread::sleep_for(std::chrono::milliseconds(CHAIN_BLOCK_INTERVAL));
+                nSlotTime = GetTimeMicros();
+                fMine = true;
+            }
 
-            } else {
-                if (lastInactive != (int)currentIndex) {
-                    lastInactive = currentIndex;
-                    LogPrintf("CASINOMINER --- inactive \n");
-                }
-                // No permission to mine, sleep
-                std::this_thread::sleep_for(std::chrono::milliseconds(CHAIN_BLOCK_INTERVAL));
+            // Start building early enough for the template to be ready at the slot
+            CMinerSlotStats stats = GetMinerSlotStats();
+            int64_t nLead = std::min<int64_t>(CHAIN_BLOCK_INTERVAL * 1000 / 2, 2 * std::max(stats.nAvgBuildTime, stats.nLastBuildTime) + MINER_BUILD_MARGIN);
+            if (!WaitForSlot(pindexPrev, nSlotTime - nLead))
                 continue;
-            }
 
-            std::unique_ptr<CBlockTemplate> pblocktemplate(BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript));
+            int64_t nBuildStart = GetTimeMicros();
+            std::unique_ptr<CBlockTemplate> pblocktemplate(GetBuiltTemplate(coinbaseScript->reserveScript, pindexPrev));
+            if (!pblocktemplate)
+                pblocktemplate = BlockAssembler(Params()).CreateNewBlock(coinbaseScript->reserveScript);
             if (!pblocktemplate.get()) {
                 LogPrintf("Error in YbtcMiner: Keypool ran out, please call keypoolrefill before restarting the mining thread\n");
                 return;
             }
+            RecordMinerBuildTime(GetTimeMicros() - nBuildStart);
 
             CBlock* pblock = &pblocktemplate->block;
+            if (pblock->hashPrevBlock != pindexPrev->GetBlockHash())
+                continue; // the tip moved while the template was built
             IncrementExtraNonce(pblock, pindexPrev, nExtraNonce);
 
             // jyan LogPrintf("YbtcMiner mining   with %u transactions in block (%u bytes) \n", pblock->vtx.size(),
             // jyan     ::GetSerializeSize(*pblock, SER_NETWORK, PROTOCOL_VERSION));
 
+            if (!WaitForSlot(pindexPrev, nSlotTime))
+                continue; // somebody else filled the slot, build on their block
+            UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
+            if ((pblock->nVersion & BLOCK_VERSION_CASINO_SIGNED) && !SignMinerBlock(pblock)) {
+                LogPrintf("CASINOMINER --- cannot sign the block with the miner key, is the wallet locked?\n");
+                fMine = false;
+                continue;
+            }
 
-            if (ProcessBlockFound(pblock, chainparams)) {
+            bool fFound = ProcessBlockFound(pblock, chainparams);
+            RecordMinerSlot(fFound, GetTimeMicros() - nSlotTime);
+            if (!fFound) {
+                // Our slot is lost; wait for the next tip instead of retrying
+                fMine = false;
             }
 
             if (chainparams.MineBlocksOnDemand()) {
@@ -862,10 +1386,17 @@ void GenerateYbtcs(bool fGenerate, int nThreads, const CChainParams& chainparams
         delete minerThreads;
         minerThreads = NULL;
     }
+    if (pminerTipListener) {
+        UnregisterValidationInterface(pminerTipListener);
+        delete pminerTipListener;
+        pminerTipListener = nullptr;
+    }
 
     if (nThreads == 0 || !fGenerate)
         return;
 
+    pminerTipListener = new CMinerTipListener();
+    RegisterValidationInterface(pminerTipListener);
     minerThreads = new boost::thread_group();
 
     {
@@ -12,6 +12,7 @@
 
 #include <stdint.h>
 #include <memory>
+#include <set>
 #include "boost/multi_index_container.hpp"
 #include "boost/multi_index/ordered_index.hpp"
 
@@ -25,6 +26,35 @@ static const bool DEFAULT_GENERATE = false;
 static const int DEFAULT_GENERATE_THREADS = 1;
 
 static const bool DEFAULT_PRINTPRIORITY = false;
+/** Microseconds of slack on top of the expected template build time when the miner starts building ahead of its slot */
+static const int64_t MINER_BUILD_MARGIN = 100000;
+/** A block submitted this many microseconds after its slot counts as late */
+static const int64_t MINER_LATE_BLOCK = 500000;
+/** Default for -blockmaxcontracttime, in milliseconds: a third of CHAIN_BLOCK_INTERVAL */
+static const int64_t DEFAULT_BLOCK_MAX_CONTRACT_TIME = 1000;
+/** Default for -blocktemplaterefresh: milliseconds the template builder lets mempool changes pile up before extending its template */
+static const int64_t DEFAULT_BLOCK_TEMPLATE_REFRESH = 250;
+/** Assemblies of a block on a tip that moved meanwhile, before the last one holds cs_main throughout */
+static const int MAX_BLOCK_ASSEMBLY_ATTEMPTS = 3;
+
+/** What BlockAssembler needs to go on adding mempool transactions to a finished template */
+struct CBlockAssemblyState
+{
+    CMutableTransaction rewardTx;        //!< Coinbase before gas refunds
+    std::vector<CTxOut> vRefundGasFee;
+    bool fHasContract;
+    bool fIncludeWitness;
+    uint64_t nBlockWeight;
+    uint64_t nBlockSigOpsCost;
+    uint64_t nBlockGas;
+    int64_t nContractTime;
+    CAmount nFees;
+    uint256 hashParentStateRoot;         //!< Contract state the block executes on
+    std::set<uint160> setContractWrites;
+    std::shared_ptr<const sc::State> stateView; //!< State the block's transactions leave, a fork of pState
+
+    CBlockAssemblyState() : fHasContract(false), fIncludeWitness(false), nBlockWeight(0), nBlockSigOpsCost(0), nBlockGas(0), nContractTime(0), nFees(0) {}
+};
 
 struct CBlockTemplate
 {
@@ -32,6 +62,7 @@ struct CBlockTemplate
     std::vector<CAmount> vTxFees;
     std::vector<int64_t> vTxSigOpsCost;
     std::vector<unsigned char> vchCoinbaseCommitment;
+    CBlockAssemblyState assembly;
 };
 
 // Container for tracking updates to ancestor feerate as we include (parent)
@@ -43,12 +74,19 @@ struct CTxMemPoolModifiedEntry {
         nSizeWithAncestors = entry->GetSizeWithAncestors();
         nModFeesWithAncestors = entry->GetModFeesWithAncestors();
         nSigOpCostWithAncestors = entry->GetSigOpCostWithAncestors();
+        nContractGasWithAncestors = entry->GetContractGasWithAncestors();
+        nContractRefundWithAncestors = entry->GetContractRefundWithAncestors();
     }
 
+    CAmount GetMiningFeesWithAncestors() const { return nModFeesWithAncestors - nContractRefundWithAncestors; }
+    uint64_t GetMiningSizeWithAncestors() const { return nSizeWithAncestors + nContractGasWithAncestors / MINING_GAS_PER_VBYTE; }
+
     CTxMemPool::txiter iter;
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
+    uint64_t nContractGasWithAncestors;
+    CAmount nContractRefundWithAncestors;
 };
 
 /** Comparator for CTxMemPool::txiter objects.
@@ -77,8 +115,8 @@ struct modifiedentry_iter {
 struct CompareModifiedEntry {
     bool operator()(const CTxMemPoolModifiedEntry &a, const CTxMemPoolModifiedEntry &b) const
     {
-        double f1 = (double)a.nModFeesWithAncestors * b.nSizeWithAncestors;
-        double f2 = (double)b.nModFeesWithAncestors * a.nSizeWithAncestors;
+        double f1 = (double)a.GetMiningFeesWithAncestors() * b.GetMiningSizeWithAncestors();
+        double f2 = (double)b.GetMiningFeesWithAncestors() * a.GetMiningSizeWithAncestors();
         if (f1 == f2) {
             return CTxMemPool::CompareIteratorByHash()(a.iter, b.iter);
         }
@@ -127,6 +165,8 @@ struct update_for_parent_inclusion
         e.nModFeesWithAncestors -= iter->GetFee();
         e.nSizeWithAncestors -= iter->GetTxSize();
         e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
+        e.nContractGasWithAncestors -= iter->GetContractGas();
+        e.nContractRefundWithAncestors -= iter->GetContractRefund();
     }
 
     CTxMemPool::txiter iter;
@@ -145,11 +185,15 @@ private:
     bool fIncludeWitness;
     unsigned int nBlockMaxWeight;
     CFeeRate blockMinFeeRate;
+    uint64_t nBlockMaxGas;
+    int64_t nMaxContractTime;
 
     // Information on the current status of the block
     uint64_t nBlockWeight;
     uint64_t nBlockTx;
     uint64_t nBlockSigOpsCost;
+    uint64_t nBlockGas;
+    int64_t nContractTime; //!< Microseconds spent executing contracts
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
 
@@ -160,12 +204,21 @@ private:
 
     CMutableTransaction originalRewardTx; // fasc
 
+    // Contract state of the tip, which mempool pre-executions were run on
+    uint256 hashParentStateRoot;
+    // Accounts the contract executions of the block may have changed so far
+    std::set<uint160> setContractWrites;
+    // Fork of pState the block's contracts run on
+    std::shared_ptr<sc::State> stateView;
+
 public:
     struct Options {
         Options();
         size_t nBlockMaxWeight;
         size_t nBlockMaxSize;
         CFeeRate blockMinFeeRate;
+        uint64_t nBlockMaxGas;         //!< Gas budget of the contract txs taken from the mempool
+        int64_t nMaxContractTime;      //!< Milliseconds their execution may take
     };
 
     BlockAssembler(const CChainParams& params);
@@ -173,6 +226,9 @@ public:
 
     /** Construct a new block template with coinbase to scriptPubKeyIn */
     std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx=true);
+    /** Add the mempool packages base leaves out, executing only their contracts, on top of
+     *  base's contract state. Returns nullptr if the tip moved or a tx of base left the mempool. */
+    std::unique_ptr<CBlockTemplate> ExtendBlock(const CBlockTemplate& base);
 
 private:
     // utility functions
@@ -182,12 +238,31 @@ private:
     /** rebuild transaction by gas refund */
     void RebuildRefundTransaction(const std::vector<CTxOut>& vRefundGasFee );
 
+    /** Build a template on the tip into pblocktemplate; false if the tip moved or a tx it chose left the mempool meanwhile */
+    bool AssembleBlock(const CScript& scriptPubKeyIn, bool fMineWitnessTx);
+
+    /** Fill in the coinbase and header once the transactions are chosen, then test the block */
+    void FinishBlock(CBlockIndex* pindexPrev, bool hasContract, const std::vector<CTxOut>& vRefundGasFee);
+
     /** Add Casino contract to coinbase tx */
     bool GenerateCasinoList(std::vector<int>& winner, uint32_t totalPlayer, unsigned int seed);
-    bool AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransaction& coinbaseTx, int& nHeight);
+    bool AddCasinoToCoinBaseTx(SmartContract& smct, CMutableTransaction& coinbaseTx, const CBlockIndex* pindexPrev, int& nHeight);
 
-    /** Attempt to add a contract tx to the block */
-    bool AttemptToAddContractToBlock(SmartContract& smct, CTxMemPool::txiter iter, std::vector<CTxOut> &vRefundGasFee);
+    /** Whether executing a tx now would repeat its mempool pre-execution */
+    bool IsPreExecutionValid(const CContractPreExecution& preExecution) const;
+    /** Record accounts looked up by a contract execution as possibly changed */
+    void AddContractWrites(const sc::AddressHash& touched);
+
+    /** A tx of a package taken out of the mempool, so that its contracts can run without mempool.cs */
+    struct PackageTx {
+        CTransactionRef tx;
+        std::shared_ptr<const CContractPreExecution> preExecution;
+    };
+
+    /** Look the txs of the block up in the mempool again, into inBlock; false if one left it */
+    bool RefreshInBlock();
+    /** Run the contracts of a package on stateView; false if one quit abnormally */
+    bool ExecutePackageContracts(SmartContract& smct, const std::vector<PackageTx>& vPackage, std::vector<CTxOut> &vRefundGasFee);
 
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
@@ -195,22 +270,29 @@ private:
     // Methods for how to add transactions to a block.
     /** Add transactions based on feerate including unconfirmed ancestors
       * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(SmartContract& smct, int &nPackagesSelected, int &nDescendantsUpdated, bool& hasContract, std::vector<CTxOut> &vRefundGasFee);
+      * statistics from the package selection (for logging statistics).
+      * Takes mempool.cs only while selecting, not while contracts run; returns
+      * false if a tx of the block left the mempool meanwhile. */
+    bool addPackageTxs(SmartContract& smct, int &nPackagesSelected, int &nDescendantsUpdated, bool& hasContract, std::vector<CTxOut> &vRefundGasFee);
+    /** Add packages without contracts to the block until one with contracts
+      * comes up, which is returned in vPackage instead. Requires mempool.cs */
+    void SelectPackages(int &nPackagesSelected, int &nDescendantsUpdated, std::vector<PackageTx>& vPackage, const std::set<uint256>& setFailedContracts);
 
     // helper functions for addPackageTxs()
     /** Remove confirmed (inBlock) entries from given set */
     void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
-    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost);
+    bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost, uint64_t packageGas);
     /** Perform checks on each transaction in a package:
       * locktime, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
     bool TestPackageTransactions(const CTxMemPool::setEntries& package);
+    /** Test that no contract tx of the package is known to fail on the block's state */
+    bool TestPackageContracts(const CTxMemPool::setEntries& package);
     /** Return true if given transaction from mapTx has already been evaluated,
       * or if the transaction's cached data in mapTx is incorrect. */
-    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx);
+    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx, const std::set<uint256>& setFailedContracts);
     /** Sort the package in an order that is valid to appear in a block */
     void SortForBlock(const CTxMemPool::setEntries& package, CTxMemPool::txiter entry, std::vector<CTxMemPool::txiter>& sortedEntries);
     /** Add descendants of given transactions to mapModifiedTx with ancestor
@@ -225,4 +307,50 @@ int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParam
 
 void GenerateYbtcs(bool fGenerate, int nThreads, const CChainParams& chainparams);
 
+/** Slot timing of the local miner threads, reported by getmininginfo */
+struct CMinerSlotStats
+{
+    uint64_t nBlocks;       //!< Blocks submitted in our slots
+    uint64_t nLateBlocks;   //!< ... of which more than MINER_LATE_BLOCK after the slot
+    uint64_t nMissedSlots;  //!< Slots of ours whose block was not accepted
+    int64_t nLastBuildTime; //!< Microseconds the last CreateNewBlock took
+    int64_t nAvgBuildTime;  //!< ... moving average
+    int64_t nMaxBuildTime;
+    int64_t nLastLateness;  //!< Microseconds between the last slot and its block being submitted
+
+    CMinerSlotStats() : nBlocks(0), nLateBlocks(0), nMissedSlots(0), nLastBuildTime(0), nAvgBuildTime(0), nMaxBuildTime(0), nLastLateness(0) {}
+};
+
+CMinerSlotStats GetMinerSlotStats();
+void RecordMinerBuildTime(int64_t nMicros);
+void RecordMinerSlot(bool fFound, int64_t nLateness);
+
+/** Cost and freshness of the background block template, reported by getmininginfo */
+struct CTemplateBuilderStats
+{
+    bool fRunning;
+    uint64_t nBuilds;        //!< Templates built from scratch
+    uint64_t nExtensions;    //!< ... and extended with new mempool packages
+    uint64_t nFailures;
+    int64_t nLastBuildTime;  //!< Microseconds the last CreateNewBlock took
+    int64_t nAvgBuildTime;   //!< ... moving average
+    int64_t nLastExtendTime; //!< Microseconds the last ExtendBlock took
+    int64_t nAvgExtendTime;
+    int64_t nTemplateTime;   //!< GetTimeMicros() when the current template was made, 0 if there is none
+    uint64_t nTemplateTx;
+
+    CTemplateBuilderStats() : fRunning(false), nBuilds(0), nExtensions(0), nFailures(0), nLastBuildTime(0), nAvgBuildTime(0), nLastExtendTime(0), nAvgExtendTime(0), nTemplateTime(0), nTemplateTx(0) {}
+};
+
+/**
+ * Keep a block template on the tip up to date in the background: rebuild it
+ * when the tip changes, and extend it as transactions enter the mempool, so
+ * that a miner whose slot opens has one at hand.
+ */
+void StartTemplateBuilder(const CChainParams& chainparams);
+void StopTemplateBuilder();
+/** Copy of the background template paying to scriptPubKey, nullptr if there is none on pindexPrev */
+std::unique_ptr<CBlockTemplate> GetBuiltTemplate(const CScript& scriptPubKey, const CBlockIndex* pindexPrev);
+CTemplateBuilderStats GetTemplateBuilderStats();
+
 #endif // YBTC_MINER_H
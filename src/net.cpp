@@ -737,7 +737,7 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
 
             //store received bytes per message command
             //to prevent a memory DOS, only allow valid commands
-            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.pchCommand);
+            mapMsgCmdSize::iterator i = mapRecvBytesPerMsgCmd.find(msg.hdr.GetCommand());
             if (i == mapRecvBytesPerMsgCmd.end())
                 i = mapRecvBytesPerMsgCmd.find(NET_MESSAGE_COMMAND_OTHER);
             assert(i != mapRecvBytesPerMsgCmd.end());
@@ -957,6 +957,8 @@ bool CConnman::AttemptToEvictConnection()
         for (CNode *node : vNodes) {
             if (node->fWhitelisted)
                 continue;
+            if (node->fSlotMiner)
+                continue;
             if (!node->fInbound)
                 continue;
             if (node->fDisconnect)
@@ -2769,6 +2771,7 @@ CNode::CNode(NodeId idIn, ServiceFlags nLocalServicesIn, int nMyStartingHeightIn
     nextSendTimeFeeFilter = 0;
     fPauseRecv = false;
     fPauseSend = false;
+    fSlotMiner = false;
     nProcessQueueSize = 0;
 
     for (const std::string &msg : getAllNetMessageTypes())
@@ -658,6 +658,9 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv;
     std::atomic_bool fPauseSend;
+    // The peer proved to be a casino winner of this or the next phase: it is
+    // not evicted, as the blocks of the slots go through it
+    std::atomic_bool fSlotMiner;
 protected:
 
     mapMsgCmdSize mapSendBytesPerMsgCmd;
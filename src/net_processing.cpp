@@ -8,10 +8,12 @@
 #include "addrman.h"
 #include "arith_uint256.h"
 #include "blockencodings.h"
+#include "casinoschedule.h"
 #include "chainparams.h"
 #include "consensus/validation.h"
 #include "hash.h"
 #include "init.h"
+#include "key.h"
 #include "validation.h"
 #include "merkleblock.h"
 #include "net.h"
@@ -105,6 +107,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight;
 
@@ -117,6 +120,9 @@ namespace {
     /** Number of peers from which we're downloading blocks. */
     int nPeersWithValidatedDownloads = 0;
 
+    /** Blocks that peers may have in flight beyond MAX_BLOCKS_IN_TRANSIT_PER_PEER, summed over them. Protected by cs_main. */
+    int nDownloadWindowExtra = 0;
+
     /** Number of outbound peers with m_chain_sync.m_protect. */
     int g_outbound_peers_with_protect_from_disconnect = 0;
 
@@ -178,12 +184,24 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! Average time between the blocks this peer delivers while more are queued behind them (in microseconds), or 0.
+    int64_t nBlockInterval;
+    //! When the last block in flight from this peer arrived (in microseconds).
+    int64_t nLastBlockReceived;
+    //! Blocks that may be in flight from this peer, sized to its round trip and nBlockInterval.
+    int nDownloadWindow;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
     bool fPreferHeaders;
     //! Whether this peer wants invs or cmpctblocks (when possible) for block announcements.
     bool fPreferHeaderAndIDs;
+    //! Whether this peer wants headers as "cmpctheaders" rather than "headers".
+    bool fPreferCompactHeaders;
+    //! Delta encoding of the "cmpctheaders" sent to this peer.
+    CompactHeaderStream cmpctHeadersSent;
+    //! Delta encoding of the "cmpctheaders" received from this peer.
+    CompactHeaderStream cmpctHeadersReceived;
     /**
       * Whether this peer will send us cmpctblocks if we request them.
       * This is not used to gate request logic, as we really only care about fSupportsDesiredCmpctVersion,
@@ -230,6 +248,13 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Nonce of the peer's version message, which our SLOTMINER proof signs
+    uint64_t nVersionNonce;
+    //! Whether we sent our SLOTMINER proof
+    bool fSlotMinerSent;
+    //! Casino address the peer proved to mine for, null if none
+    uint160 slotMiner;
+
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
         nMisbehavior = 0;
@@ -245,15 +270,22 @@ struct CNodeState {
         nDownloadingSince = 0;
         nBlocksInFlight = 0;
         nBlocksInFlightValidHeaders = 0;
+        nBlockInterval = 0;
+        nLastBlockReceived = 0;
+        nDownloadWindow = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
         fPreferredDownload = false;
         fPreferHeaders = false;
         fPreferHeaderAndIDs = false;
+        fPreferCompactHeaders = false;
         fProvidesHeaderAndIDs = false;
         fHaveWitness = false;
         fWantsCmpctWitness = false;
         fSupportsDesiredCmpctVersion = false;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
+        nVersionNonce = 0;
+        fSlotMinerSent = false;
+        slotMiner.SetNull();
     }
 };
 
@@ -302,10 +334,21 @@ void PushNodeVersion(CNode *pnode, CConnman* connman, int64_t nTime)
 // Requires cs_main.
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another peer
-bool MarkBlockAsReceived(const uint256& hash) {
+// nodeFrom is the peer the block came from, if it was received in full.
+bool MarkBlockAsReceived(const uint256& hash, NodeId nodeFrom = -1) {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
         CNodeState *state = State(itInFlight->second.first);
+        if (itInFlight->second.first == nodeFrom) {
+            // A block that was asked for before the previous one arrived waited behind it: the time
+            // in between is what the peer takes per block, without the round trip.
+            int64_t nNow = GetTimeMicros();
+            if (state->nLastBlockReceived > itInFlight->second.second->nTimeRequested) {
+                int64_t nInterval = std::max<int64_t>(nNow - state->nLastBlockReceived, 1);
+                state->nBlockInterval = state->nBlockInterval ? (state->nBlockInterval * 7 + nInterval) / 8 : nInterval;
+            }
+            state->nLastBlockReceived = nNow;
+        }
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
         if (state->nBlocksInFlightValidHeaders == 0 && itInFlight->second.second->fValidatedHeaders) {
             // Last validated block on the queue was received.
@@ -344,7 +387,7 @@ bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex*
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -453,8 +496,57 @@ bool PeerHasHeader(CNodeState *state, const CBlockIndex *pindex)
     return false;
 }
 
+/** Size the window of blocks in flight from a peer to keep blocks coming for two round trips
+ *  (nPingUsec) at the rate it delivered them so far. Requires cs_main. */
+void UpdateDownloadWindow(CNodeState* state, int64_t nPingUsec)
+{
+    int nWindow = MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    if (state->nBlockInterval > 0 && nPingUsec < std::numeric_limits<int64_t>::max()) {
+        int64_t nBlocksPerTrip = nPingUsec / state->nBlockInterval + 1;
+        nWindow = std::max<int64_t>(nWindow, std::min<int64_t>(2 * nBlocksPerTrip, MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER));
+    }
+    nDownloadWindowExtra += nWindow - state->nDownloadWindow;
+    state->nDownloadWindow = nWindow;
+}
+
+/** How far ahead of the last block in common with a peer blocks may be fetched. Requires cs_main. */
+int GetBlockDownloadWindow()
+{
+    return std::min<int64_t>(BLOCK_DOWNLOAD_WINDOW + (int64_t)BLOCK_DOWNLOAD_WINDOW_PER_TRANSIT * nDownloadWindowExtra, MAX_BLOCK_DOWNLOAD_WINDOW);
+}
+
+/** How long a peer may hold up the block download window (in microseconds): a margin over
+ *  what the blocks in flight from it should take, at least BLOCK_STALLING_TIMEOUT and at
+ *  most MAX_BLOCK_STALLING_SLOTS block slots. Requires cs_main. */
+int64_t GetBlockStallingTimeout(const CNodeState* state, int64_t nPingUsec)
+{
+    int64_t nTimeout = 1000000 * BLOCK_STALLING_TIMEOUT;
+    if (state->nBlockInterval > 0 && nPingUsec < std::numeric_limits<int64_t>::max())
+        nTimeout = std::max(nTimeout, BLOCK_STALLING_MARGIN * (nPingUsec + state->nBlocksInFlight * state->nBlockInterval));
+    return std::min<int64_t>(nTimeout, MAX_BLOCK_STALLING_SLOTS * CHAIN_BLOCK_INTERVAL * 1000);
+}
+
+/** Most headers in one headers message exchanged with pnode */
+unsigned int GetMaxHeadersResults(const CNode* pnode)
+{
+    if ((pnode->GetLocalServices() & NODE_LARGE_HEADERS) && (pnode->nServices & NODE_LARGE_HEADERS))
+        return MAX_HEADERS_RESULTS_LARGE;
+    return MAX_HEADERS_RESULTS;
+}
+
+/** Send headers as "cmpctheaders" or "headers", whichever the peer asked for. Requires cs_main. */
+void PushHeaders(CNode* pnode, CNodeState* state, const std::vector<CBlock>& vHeaders, CConnman* connman)
+{
+    const CNetMsgMaker msgMaker(pnode->GetSendVersion());
+    if (state->fPreferCompactHeaders)
+        connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTHEADERS, CompactHeaders(state->cmpctHeadersSent, vHeaders)));
+    else
+        connman->PushMessage(pnode, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+}
+
 /** Update pindexLastCommonBlock and add not-in-flight missing successors to vBlocks, until it has
- *  at most count entries. */
+ *  at most count entries. The blocks added are a contiguous range: it ends at the first block
+ *  after them that is downloaded or in flight already. */
 void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<const CBlockIndex*>& vBlocks, NodeId& nodeStaller, const Consensus::Params& consensusParams) {
     if (count == 0)
         return;
@@ -488,7 +580,7 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
     // Never fetch further than the best block we know the peer has, or more than BLOCK_DOWNLOAD_WINDOW + 1 beyond the last
     // linked block we have in common with this peer. The +1 is so we can detect stalling, namely if we would be able to
     // download that next block if the window were 1 larger.
-    int nWindowEnd = state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_WINDOW;
+    int nWindowEnd = state->pindexLastCommonBlock->nHeight + GetBlockDownloadWindow();
     int nMaxHeight = std::min<int>(state->pindexBestKnownBlock->nHeight, nWindowEnd + 1);
     NodeId waitingfor = -1;
     while (pindexWalk->nHeight < nMaxHeight) {
@@ -517,6 +609,8 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                 return;
             }
             if (pindex->nStatus & BLOCK_HAVE_DATA || chainActive.Contains(pindex)) {
+                if (!vBlocks.empty())
+                    return;
                 if (pindex->nChainTx)
                     state->pindexLastCommonBlock = pindex;
             } else if (mapBlocksInFlight.count(pindex->GetBlockHash()) == 0) {
@@ -533,6 +627,8 @@ void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vector<con
                 if (vBlocks.size() == count) {
                     return;
                 }
+            } else if (!vBlocks.empty()) {
+                return;
             } else if (waitingfor == -1) {
                 // This is the first already-in-flight block.
                 waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
@@ -591,6 +687,8 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     nPreferredDownload -= state->fPreferredDownload;
     nPeersWithValidatedDownloads -= (state->nBlocksInFlightValidHeaders != 0);
     assert(nPeersWithValidatedDownloads >= 0);
+    nDownloadWindowExtra -= state->nDownloadWindow - MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    assert(nDownloadWindowExtra >= 0);
     g_outbound_peers_with_protect_from_disconnect -= state->m_chain_sync.m_protect;
     assert(g_outbound_peers_with_protect_from_disconnect >= 0);
 
@@ -601,6 +699,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         assert(mapBlocksInFlight.empty());
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
+        assert(nDownloadWindowExtra == 0);
         assert(g_outbound_peers_with_protect_from_disconnect == 0);
     }
     LogPrint(BCLog::NET, "Cleared nodestate for peer=%d\n", nodeid);
@@ -618,6 +717,9 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
     }
+    stats.slotMiner = state->slotMiner;
+    stats.nDownloadWindow = state->nDownloadWindow;
+    stats.nBlockInterval = state->nBlockInterval;
     return true;
 }
 
@@ -824,9 +926,90 @@ static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_bloc
 static uint256 most_recent_block_hash;
 static bool fWitnessesPresentInMostRecentCompactBlock;
 
+//////////////////////////////////////////////////////////////////////////////
+//
+// Slot relay
+//
+// A peer proves it mines for a casino address by signing the nonce of our
+// version message with the address's key. When a block passes the PoW checks
+// it is pushed as a compact block, contract txs prefilled, to the proven peers
+// that mine the next slots, before it is connected and announced to the rest.
+//
+
+/** Block arrivals kept for getslotrelayinfo */
+static const size_t SLOT_RELAY_RECORDS = 64;
+
+// All of the following are protected by cs_slot_relay
+static CCriticalSection cs_slot_relay;
+static CKey slotMinerKey;
+static CSlotRelayStats slotRelayStats;
+static std::map<uint256, int64_t> mapBlockArrivals; //!< Index in vArrivals, offset by nArrivalsPopped
+static int64_t nArrivalsPopped = 0;
+
+static uint256 SlotMinerProofHash(uint64_t nNonce)
+{
+    CHashWriter ss(SER_GETHASH, 0);
+    ss << std::string("Ybtc slot miner") << nNonce;
+    return ss.GetHash();
+}
+
+void SetSlotMinerKey(const CKey& key)
+{
+    LOCK(cs_slot_relay);
+    slotMinerKey = key;
+}
+
+CSlotRelayStats GetSlotRelayStats()
+{
+    LOCK(cs_slot_relay);
+    return slotRelayStats;
+}
+
+static CBlockArrival* FindBlockArrival(const uint256& hash)
+{
+    AssertLockHeld(cs_slot_relay);
+    std::map<uint256, int64_t>::const_iterator it = mapBlockArrivals.find(hash);
+    if (it == mapBlockArrivals.end())
+        return nullptr;
+    return &slotRelayStats.vArrivals[it->second - nArrivalsPopped];
+}
+
+/** Record when and from whom a block was first heard of */
+static void RecordBlockArrival(const uint256& hash, NodeId nPeer, const std::string& strCommand, int64_t nTimeReceived)
+{
+    {
+        LOCK(cs_main);
+        BlockMap::const_iterator mi = mapBlockIndex.find(hash);
+        if (mi != mapBlockIndex.end() && (mi->second->nStatus & BLOCK_HAVE_DATA))
+            return;
+    }
+    LOCK(cs_slot_relay);
+    if (mapBlockArrivals.count(hash))
+        return;
+    if (slotRelayStats.vArrivals.size() >= SLOT_RELAY_RECORDS) {
+        mapBlockArrivals.erase(slotRelayStats.vArrivals.front().hash);
+        slotRelayStats.vArrivals.pop_front();
+        nArrivalsPopped++;
+    }
+    mapBlockArrivals.emplace(hash, nArrivalsPopped + slotRelayStats.vArrivals.size());
+    slotRelayStats.vArrivals.push_back(CBlockArrival{hash, -1, nPeer, strCommand, nTimeReceived, 0});
+}
+
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
     const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+    uint256 hashBlock(pblock->GetHash());
+
+    {
+        // Blocks mined here are first seen now
+        RecordBlockArrival(hashBlock, -1, "", GetTimeMicros());
+        LOCK(cs_slot_relay);
+        CBlockArrival* parrival = FindBlockArrival(hashBlock);
+        if (parrival && !parrival->nAccepted) {
+            parrival->nHeight = pindex->nHeight;
+            parrival->nAccepted = GetTimeMicros();
+        }
+    }
 
     LOCK(cs_main);
 
@@ -836,7 +1019,46 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
     nHighestFastAnnounce = pindex->nHeight;
 
     bool fWitnessEnabled = IsWitnessEnabled(pindex->pprev, Params().GetConsensus());
-    uint256 hashBlock(pblock->GetHash());
+
+    if (gArgs.GetBoolArg("-slotrelay", DEFAULT_SLOT_RELAY)) {
+        // The miners of the next slots build on this block, so it goes to them
+        // first and with the contract txs, which they may not have yet, in full
+        const std::vector<sc::h160> vNext = GetUpcomingCasinoMiners(pindex, SLOT_RELAY_SLOTS);
+        const std::vector<sc::h160> vPhase = GetUpcomingCasinoMiners(pindex, CHAIN_PHASE_SIZE);
+        std::shared_ptr<const CBlockHeaderAndShortTxIDs> pslotblock;
+        unsigned int nPushes = 0;
+        std::vector<NodeId> vSlotMiners;
+        connman->ForEachNode([&](CNode* pnode) {
+            if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
+                return;
+            CNodeState &state = *State(pnode->GetId());
+            if (state.slotMiner.IsNull())
+                return;
+            const sc::h160 miner(state.slotMiner.begin(), sc::h160::ConstructFromPointer);
+            const bool fSlotMiner = std::find(vPhase.begin(), vPhase.end(), miner) != vPhase.end();
+            if (fSlotMiner && !pnode->fSlotMiner)
+                vSlotMiners.push_back(pnode->GetId());
+            pnode->fSlotMiner = fSlotMiner;
+            if (std::find(vNext.begin(), vNext.end(), miner) == vNext.end())
+                return;
+            ProcessBlockAvailability(pnode->GetId());
+            if (!state.fProvidesHeaderAndIDs || (fWitnessEnabled && !state.fWantsCmpctWitness) || PeerHasHeader(&state, pindex))
+                return;
+            if (!pslotblock)
+                pslotblock = std::make_shared<const CBlockHeaderAndShortTxIDs>(*pblock, true, true);
+            LogPrint(BCLog::NET, "pushing block %s to slot miner peer=%d\n", hashBlock.ToString(), pnode->GetId());
+            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pslotblock));
+            state.pindexBestHeaderSent = pindex;
+            nPushes++;
+        });
+        for (NodeId nodeid : vSlotMiners)
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(nodeid, connman);
+        if (nPushes) {
+            LOCK(cs_slot_relay);
+            slotRelayStats.nPushes += nPushes;
+            slotRelayStats.nBlocksPushed++;
+        }
+    }
 
     {
         LOCK(cs_most_recent_block);
@@ -1087,9 +1309,10 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                 if (send && (mi->second->nStatus & BLOCK_HAVE_DATA))
                 {
                     std::shared_ptr<const CBlock> pblock;
+                    std::vector<unsigned char> vchRawBlock;
                     if (a_recent_block && a_recent_block->GetHash() == (*mi).second->GetBlockHash()) {
                         pblock = a_recent_block;
-                    } else {
+                    } else if (inv.type != MSG_WITNESS_BLOCK || !ReadRawBlockFromDisk(vchRawBlock, (*mi).second, Params().MessageStart())) {
                         // Send block from disk
                         std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
                         if (!ReadBlockFromDisk(*pblockRead, (*mi).second, consensusParams))
@@ -1098,6 +1321,9 @@ void static ProcessGetData(CNode* pfrom, const Consensus::Params& consensusParam
                     }
                     if (inv.type == MSG_BLOCK)
                         connman->PushMessage(pfrom, msgMaker.Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, *pblock));
+                    else if (inv.type == MSG_WITNESS_BLOCK && !pblock)
+                        // The block as it is stored is what it serializes to with witness data
+                        connman->PushMessage(pfrom, msgMaker.MakeRaw(NetMsgType::BLOCK, std::move(vchRawBlock)));
                     else if (inv.type == MSG_WITNESS_BLOCK)
                         connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, *pblock));
                     else if (inv.type == MSG_FILTERED_BLOCK)
@@ -1354,7 +1580,7 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
             nodestate->m_last_block_announcement = GetTime();
         }
 
-        if (nCount == MAX_HEADERS_RESULTS) {
+        if (nCount == GetMaxHeadersResults(pfrom)) {
             // Headers message had its maximum size; the peer may have more headers.
             // TODO: optimize: if pindexLast is an ancestor of chainActive.Tip or pindexBestHeader, continue
             // from there instead.
@@ -1415,8 +1641,8 @@ bool static ProcessHeadersMessage(CNode *pfrom, CConnman *connman, const std::ve
         }
         // If we're in IBD, we want outbound peers that will serve us a useful
         // chain. Disconnect peers that are on chains with insufficient work.
-        if (IsInitialBlockDownload() && nCount != MAX_HEADERS_RESULTS) {
-            // When nCount < MAX_HEADERS_RESULTS, we know we have no more
+        if (IsInitialBlockDownload() && nCount != GetMaxHeadersResults(pfrom)) {
+            // When nCount < GetMaxHeadersResults(), we know we have no more
             // headers to fetch from this peer.
             if (nodestate->pindexBestKnownBlock && nodestate->pindexBestKnownBlock->nChainWork < nMinimumChainWork) {
                 // This peer has too little work on their headers chain to help
@@ -1613,6 +1839,11 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             State(pfrom->GetId())->fHaveWitness = true;
         }
 
+        {
+            LOCK(cs_main);
+            State(pfrom->GetId())->nVersionNonce = nNonce;
+        }
+
         // Potentially mark this peer as a preferred download peer.
         {
         LOCK(cs_main);
@@ -1702,6 +1933,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             // nodes)
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDHEADERS));
         }
+        if (pfrom->nVersion >= COMPACT_HEADERS_VERSION && gArgs.GetBoolArg("-compactheaders", DEFAULT_COMPACT_HEADERS)) {
+            // Ask for headers, announced or requested, delta encoded
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCTHDR));
+        }
         if (pfrom->nVersion >= SHORT_IDS_BLOCKS_VERSION) {
             // Tell our peer we are willing to provide version 1 or 2 cmpctblocks
             // However, we do not request new block announcements using
@@ -1779,6 +2014,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         State(pfrom->GetId())->fPreferHeaders = true;
     }
 
+    else if (strCommand == NetMsgType::SENDCMPCTHDR)
+    {
+        LOCK(cs_main);
+        State(pfrom->GetId())->fPreferCompactHeaders = true;
+    }
+
     else if (strCommand == NetMsgType::SENDCMPCT)
     {
         bool fAnnounceUsingCMPCTBLOCK = false;
@@ -1837,6 +2078,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             }
 
             if (inv.type == MSG_BLOCK) {
+                RecordBlockArrival(inv.hash, pfrom->GetId(), strCommand, nTimeReceived);
                 UpdateBlockAvailability(pfrom->GetId(), inv.hash);
                 if (!fAlreadyHave && !fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash)) {
                     // We used to request the full block here, but since headers-announcements are now the
@@ -2029,7 +2271,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         std::vector<CBlock> vHeaders;
-        int nLimit = MAX_HEADERS_RESULTS;
+        int nLimit = GetMaxHeadersResults(pfrom);
         LogPrint(BCLog::NET, "getheaders %d to %s from peer=%d\n", (pindex ? pindex->nHeight : -1), hashStop.IsNull() ? "end" : hashStop.ToString(), pfrom->GetId());
         for (; pindex; pindex = chainActive.Next(pindex))
         {
@@ -2050,7 +2292,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         // will re-announce the new block via headers (or compact blocks again)
         // in the SendMessages logic.
         nodestate->pindexBestHeaderSent = pindex ? pindex : chainActive.Tip();
-        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+        PushHeaders(pfrom, nodestate, vHeaders, connman);
     }
 
 
@@ -2244,6 +2486,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     {
         CBlockHeaderAndShortTxIDs cmpctblock;
         vRecv >> cmpctblock;
+        RecordBlockArrival(cmpctblock.header.GetHash(), pfrom->GetId(), strCommand, nTimeReceived);
 
         bool received_new_header = false;
 
@@ -2537,22 +2780,55 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     }
 
 
-    else if (strCommand == NetMsgType::HEADERS && !fImporting && !fReindex) // Ignore headers received while importing
+    else if (strCommand == NetMsgType::HEADERS || strCommand == NetMsgType::CMPCTHEADERS)
     {
+        // A cmpctheaders is decoded even while importing, as the peer encodes
+        // the headers it sends next against it
+        if (strCommand == NetMsgType::HEADERS && (fImporting || fReindex)) // Ignore headers received while importing
+            return true;
+
         std::vector<CBlockHeader> headers;
 
         // Bypass the normal CBlock deserialization, as we don't want to risk deserializing 2000 full blocks.
         unsigned int nCount = ReadCompactSize(vRecv);
-        if (nCount > MAX_HEADERS_RESULTS) {
+        if (nCount > GetMaxHeadersResults(pfrom)) {
             LOCK(cs_main);
             Misbehaving(pfrom->GetId(), 20);
+            // The headers after a dropped cmpctheaders could not be decoded
+            if (strCommand == NetMsgType::CMPCTHEADERS)
+                pfrom->fDisconnect = true;
             return error("headers message size = %u", nCount);
         }
         headers.resize(nCount);
-        for (unsigned int n = 0; n < nCount; n++) {
-            vRecv >> headers[n];
-            ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+        if (strCommand == NetMsgType::CMPCTHEADERS) {
+            // Only move the stream on once the whole message decoded
+            CompactHeaderStream stream;
+            {
+                LOCK(cs_main);
+                stream = State(pfrom->GetId())->cmpctHeadersReceived;
+            }
+            try {
+                for (unsigned int n = 0; n < nCount; n++)
+                    stream.Read(vRecv, headers[n]);
+            } catch (const std::exception& e) {
+                LogPrint(BCLog::NET, "undecodable cmpctheaders (%s) from peer=%d, disconnecting\n", e.what(), pfrom->GetId());
+                pfrom->fDisconnect = true;
+                return true;
+            }
+            LOCK(cs_main);
+            State(pfrom->GetId())->cmpctHeadersReceived = stream;
+        } else {
+            for (unsigned int n = 0; n < nCount; n++) {
+                vRecv >> headers[n];
+                ReadCompactSize(vRecv); // ignore tx count; assume it is 0.
+            }
         }
+        if (fImporting || fReindex)
+            return true;
+
+        // Only the tip of an announcement, not of a sync, is a new block
+        if (!headers.empty() && nCount <= MAX_BLOCKS_TO_ANNOUNCE)
+            RecordBlockArrival(headers.back().GetHash(), pfrom->GetId(), strCommand, nTimeReceived);
 
         // Headers received via a HEADERS message should be valid, and reflect
         // the chain the peer is on. If we receive a known-invalid header,
@@ -2571,11 +2847,12 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
 
         bool forceProcessing = false;
         const uint256 hash(pblock->GetHash());
+        RecordBlockArrival(hash, pfrom->GetId(), strCommand, nTimeReceived);
         {
             LOCK(cs_main);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
-            forceProcessing |= MarkBlockAsReceived(hash);
+            forceProcessing |= MarkBlockAsReceived(hash, pfrom->GetId());
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
@@ -2790,6 +3067,27 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
     }
 
+    else if (strCommand == NetMsgType::SLOTMINER) {
+        std::vector<unsigned char> vchSig;
+        vRecv >> vchSig;
+        CPubKey pubkey;
+        if (!pubkey.RecoverCompact(SlotMinerProofHash(pfrom->GetLocalNonce()), vchSig)) {
+            LOCK(cs_main);
+            Misbehaving(pfrom->GetId(), 10);
+            return false;
+        }
+        const CKeyID keyID = pubkey.GetID();
+        LOCK(cs_main);
+        State(pfrom->GetId())->slotMiner = keyID;
+        // Winners of this or the next phase keep a compact block connection
+        const std::vector<sc::h160> vPhase = GetUpcomingCasinoMiners(chainActive.Tip(), CHAIN_PHASE_SIZE);
+        const sc::h160 miner(keyID.begin(), sc::h160::ConstructFromPointer);
+        pfrom->fSlotMiner = std::find(vPhase.begin(), vPhase.end(), miner) != vPhase.end();
+        LogPrint(BCLog::NET, "peer=%d mines for %s%s\n", pfrom->GetId(), keyID.GetHex(), pfrom->fSlotMiner ? ", a winner of the next slots" : "");
+        if (pfrom->fSlotMiner)
+            MaybeSetPeerAsAnnouncingHeaderAndIDs(pfrom->GetId(), connman);
+    }
+
     else if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown Command
         // message would be undesirable as we transmit it ourselves.
@@ -3149,6 +3447,18 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             return true;
         CNodeState &state = *State(pto->GetId());
 
+        //
+        // Message: slotminer
+        //
+        if (!state.fSlotMinerSent && gArgs.GetBoolArg("-slotrelay", DEFAULT_SLOT_RELAY)) {
+            LOCK(cs_slot_relay);
+            std::vector<unsigned char> vchSig;
+            if (slotMinerKey.IsValid() && slotMinerKey.SignCompact(SlotMinerProofHash(state.nVersionNonce), vchSig)) {
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::SLOTMINER, vchSig));
+                state.fSlotMinerSent = true;
+            }
+        }
+
         // Address refresh broadcast
         int64_t nNow = GetTimeMicros();
         if (!IsInitialBlockDownload() && pto->nNextLocalAddrSend < nNow) {
@@ -3325,7 +3635,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
                         //TODO_J LogPrint(BCLog::NET, "%s: sending header %s to peer=%d\n", __func__,
                         //        vHeaders.front().GetHash().ToString(), pto->GetId());
                     }
-                    connman->PushMessage(pto, msgMaker.Make(NetMsgType::HEADERS, vHeaders));
+                    PushHeaders(pto, &state, vHeaders, connman);
                     state.pindexBestHeaderSent = pBestIndex;
                 } else
                     fRevertToInv = true;
@@ -3495,7 +3805,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
 
         // Detect whether we're stalling
         nNow = GetTimeMicros();
-        if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
+        if (state.nStallingSince && state.nStallingSince < nNow - GetBlockStallingTimeout(&state, pto->nMinPingUsecTime)) {
             // Stalling only triggers when the block download window cannot move. During normal steady state,
             // the download window should be much larger than the to-be-downloaded set of blocks, so disconnection
             // should only happen during initial block download.
@@ -3503,7 +3813,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
             pto->fDisconnect = true;
             return true;
         }
-        // In case there is a block that has been in flight from this peer for 2 + 0.5 * N times the block interval
+        // In case there is a block that has been in flight from this peer for 10 + 5 * N block slots
         // (with N the number of peers from which we're downloading validated blocks), disconnect due to timeout.
         // We compensate for other peers to prevent killing off peers due to our own downstream link
         // being saturated. We only count validated in-flight blocks so peers can't advertise non-existing block hashes
@@ -3511,7 +3821,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         if (state.vBlocksInFlight.size() > 0) {
             QueuedBlock &queuedBlock = state.vBlocksInFlight.front();
             int nOtherPeersWithValidatedDownloads = nPeersWithValidatedDownloads - (state.nBlocksInFlightValidHeaders > 0);
-            if (nNow > state.nDownloadingSince + consensusParams.nPowTargetSpacing * (BLOCK_DOWNLOAD_TIMEOUT_BASE + BLOCK_DOWNLOAD_TIMEOUT_PER_PEER * nOtherPeersWithValidatedDownloads)) {
+            if (nNow > state.nDownloadingSince + CHAIN_BLOCK_INTERVAL * 1000 * (BLOCK_DOWNLOAD_TIMEOUT_BASE + BLOCK_DOWNLOAD_TIMEOUT_PER_PEER * nOtherPeersWithValidatedDownloads)) {
                 LogPrintf("Timeout downloading block %s from peer=%d, disconnecting\n", queuedBlock.hash.ToString(), pto->GetId());
                 pto->fDisconnect = true;
                 return true;
@@ -3558,10 +3868,12 @@ bool PeerLogicValidation::SendMessages(CNode* pto, std::atomic<bool>& interruptM
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        UpdateDownloadWindow(&state, pto->nMinPingUsecTime);
+        const int nFree = state.nDownloadWindow - state.nBlocksInFlight;
+        if (!pto->fClient && (fFetch || !IsInitialBlockDownload()) && nFree > 0 && nFree >= state.nDownloadWindow / BLOCK_DOWNLOAD_RANGE_FRACTION) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), nFree, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
@@ -9,6 +9,11 @@
 #include "net.h"
 #include "validationinterface.h"
 #include "consensus/params.h"
+#include "uint256.h"
+
+#include <deque>
+
+class CKey;
 
 /** Default for -maxorphantx, maximum number of orphan transactions kept in memory */
 static const unsigned int DEFAULT_MAX_ORPHAN_TRANSACTIONS = 100;
@@ -34,6 +39,12 @@ static constexpr int64_t STALE_CHECK_INTERVAL = 10 * 60; // 10 minutes
 static constexpr int64_t EXTRA_PEER_CHECK_INTERVAL = 45;
 /** Minimum time an outbound-peer-eviction candidate must be connected for, in order to evict, in seconds */
 static constexpr int64_t MINIMUM_CONNECT_TIME = 30;
+/** Default for -slotrelay, pushing new blocks to the miners of the next casino slots */
+static const bool DEFAULT_SLOT_RELAY = true;
+/** Slots ahead of a new block whose miners get it pushed */
+static const int SLOT_RELAY_SLOTS = 3;
+/** Default for -compactheaders, asking peers for delta encoded "cmpctheaders" */
+static const bool DEFAULT_COMPACT_HEADERS = true;
 
 class PeerLogicValidation : public CValidationInterface, public NetEventsInterface {
 private:
@@ -74,10 +85,35 @@ struct CNodeStateStats {
     int nSyncHeight;
     int nCommonHeight;
     std::vector<int> vHeightInFlight;
+    uint160 slotMiner; //!< Casino address the peer proved to mine for, null if none
+    int nDownloadWindow;    //!< Blocks that may be in flight from the peer
+    int64_t nBlockInterval; //!< Microseconds the peer takes per block when more are queued, 0 until measured
 };
 
 /** Get statistics from node state */
 bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats);
+
+/** First time a block was heard of, and how */
+struct CBlockArrival {
+    uint256 hash;
+    int nHeight;
+    NodeId nPeer;            //!< Peer that announced it first, -1 if it was mined here
+    std::string strCommand;  //!< Message that announced it
+    int64_t nFirstSeen;      //!< Wall clock in microseconds
+    int64_t nAccepted;       //!< When it passed the PoW checks, 0 if it did not yet
+};
+
+struct CSlotRelayStats {
+    uint64_t nPushes;        //!< Compact blocks pushed to slot miners
+    uint64_t nBlocksPushed;  //!< Blocks that were pushed to at least one
+    std::deque<CBlockArrival> vArrivals; //!< Most recent blocks, oldest first
+};
+
+/** Key whose address this node proves to its peers it mines the casino slots of */
+void SetSlotMinerKey(const CKey& key);
+
+/** Get statistics of the pushes to slot miners and of the block arrivals */
+CSlotRelayStats GetSlotRelayStats();
 /** Increase a node's misbehavior score. */
 void Misbehaving(NodeId nodeid, int howmuch);
 
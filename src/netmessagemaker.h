@@ -29,6 +29,15 @@ public:
         return Make(0, std::move(sCommand), std::forward<Args>(args)...);
     }
 
+    /** A message whose payload is already serialized, such as a block as it is stored */
+    CSerializedNetMsg MakeRaw(std::string sCommand, std::vector<unsigned char>&& data) const
+    {
+        CSerializedNetMsg msg;
+        msg.command = std::move(sCommand);
+        msg.data = std::move(data);
+        return msg;
+    }
+
 private:
     const int nVersion;
 };
@@ -15,6 +15,13 @@ uint256 CBlockHeader::GetHash() const
     return SerializeHash(*this);
 }
 
+uint256 CBlockHeader::GetSignatureHash() const
+{
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << nVersion << hashPrevBlock << hashMerkleRoot << hashStateRoot << nTime << nBits << nHeight;
+    return ss.GetHash();
+}
+
 std::string CBlock::ToString() const
 {
     std::stringstream s;
@@ -10,6 +10,15 @@
 #include "serialize.h"
 #include "uint256.h"
 
+/**
+ * nVersion bit of headers that carry their producer's signature in vchBlockSig.
+ * It is one of the top bits that versionbits reserves, not one of the 29
+ * deployment bits, so no deployment or unknown-rule warning can ever read it.
+ */
+static const int32_t BLOCK_VERSION_CASINO_SIGNED = 1 << 30;
+/** Largest vchBlockSig a header may carry, enforced or not: a compact signature */
+static const size_t MAX_BLOCK_SIG_SIZE = 65;
+
 /** Nodes collect new transactions into a block, hash them into a hash tree,
  * and scan through nonce values to make the block's hash satisfy proof-of-work
  * requirements.  When they solve the proof-of-work, they broadcast the block
@@ -28,6 +37,7 @@ public:
     uint32_t nTime;
     uint32_t nBits;
     uint32_t nHeight;
+    std::vector<unsigned char> vchBlockSig; //!< Compact signature of GetSignatureHash(), with BLOCK_VERSION_CASINO_SIGNED
 
     CBlockHeader()
     {
@@ -45,6 +55,8 @@ public:
         READWRITE(nTime);
         READWRITE(nBits);
         READWRITE(nHeight);
+        if (this->nVersion & BLOCK_VERSION_CASINO_SIGNED)
+            READWRITE(vchBlockSig);
     }
 
     void SetNull()
@@ -56,6 +68,7 @@ public:
         nTime = 0;
         nBits = 0;
         nHeight = 0;
+        vchBlockSig.clear();
     }
 
     bool IsNull() const
@@ -64,6 +77,8 @@ public:
     }
 
     uint256 GetHash() const;
+    //! Hash of the header without vchBlockSig, which is what the producer signs
+    uint256 GetSignatureHash() const;
 
     int64_t GetBlockTime() const
     {
@@ -117,6 +132,7 @@ public:
         block.nTime          = nTime;
         block.nBits          = nBits;
         block.nHeight        = nHeight;
+        block.vchBlockSig    = vchBlockSig;
         return block;
     }
 
@@ -240,6 +240,25 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a compact signature, by the key of the sender's casino miner
+ * address, of the nonce of the receiver's version message. Receivers push
+ * new blocks to the senders that mine the next slots (-slotrelay).
+ */
+extern const char *SLOTMINER;
+/**
+ * Indicates that a node prefers to receive headers, both getheaders
+ * responses and announcements, via "cmpctheaders" rather than "headers".
+ * @since protocol version 70016
+ */
+extern const char *SENDCMPCTHDR;
+/**
+ * Contains a compact size count and that many headers, each delta encoded
+ * against the header sent before it on the connection (CompactHeaderStream).
+ * Sent instead of "headers" to nodes that sent "sendcmpcthdr".
+ * @since protocol version 70016
+ */
+extern const char *CMPCTHEADERS;
 };
 
 /* Get a vector of all valid message types (see above) */
@@ -267,6 +286,9 @@ enum ServiceFlags : uint64_t {
     // NODE_XTHIN means the node supports Xtreme Thinblocks
     // If this is turned off then the node will not service nor make xthin requests
     NODE_XTHIN = (1 << 4),
+    // NODE_LARGE_HEADERS means the node sends up to MAX_HEADERS_RESULTS_LARGE headers at once
+    // in reply to getheaders from peers that advertise it as well, and accepts as many.
+    NODE_LARGE_HEADERS = (1 << 5),
 
     // Bits 24-31 are reserved for temporary experiments. Just pick a bit that
     // isn't getting used, or one not being used much, and notify the
@@ -277,6 +277,18 @@ bool CExtPubKey::Derive(CExtPubKey &out, unsigned int _nChild) const {
     return (!secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, nullptr, &sig));
 }
 
+/* static */ bool CPubKey::CheckLowSCompact(const std::vector<unsigned char>& vchSig) {
+    if (vchSig.size() != 65)
+        return false;
+    secp256k1_ecdsa_recoverable_signature rsig;
+    if (!secp256k1_ecdsa_recoverable_signature_parse_compact(secp256k1_context_verify, &rsig, &vchSig[1], (vchSig[0] - 27) & 3)) {
+        return false;
+    }
+    secp256k1_ecdsa_signature sig;
+    secp256k1_ecdsa_recoverable_signature_convert(secp256k1_context_verify, &sig, &rsig);
+    return (!secp256k1_ecdsa_signature_normalize(secp256k1_context_verify, nullptr, &sig));
+}
+
 /* static */ int ECCVerifyHandle::refcount = 0;
 
 ECCVerifyHandle::ECCVerifyHandle()
@@ -180,6 +180,11 @@ public:
      */
     static bool CheckLowS(const std::vector<unsigned char>& vchSig);
 
+    /**
+     * Check whether a compact signature (65 bytes) is normalized (lower-S).
+     */
+    static bool CheckLowSCompact(const std::vector<unsigned char>& vchSig);
+
     //! Recover a public key from a compact signature.
     bool RecoverCompact(const uint256& hash, const std::vector<unsigned char>& vchSig);
 
@@ -209,7 +209,11 @@ static bool rest_block(HTTPRequest* req,
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
     CBlock block;
+    std::vector<unsigned char> vchBlock;
     CBlockIndex* pblockindex = nullptr;
+    // Binary and hex replies with witness data are the block as it is stored
+    const bool fSerialized = rf == RF_BINARY || rf == RF_HEX;
+    const bool fRaw = fSerialized && RPCSerializationFlags() == 0;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -219,23 +223,24 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+        if (!(fRaw && ReadRawBlockFromDisk(vchBlock, pblockindex, Params().MessageStart())) &&
+            !ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
     }
 
-    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags());
-    ssBlock << block;
+    if (fSerialized && vchBlock.empty())
+        CVectorWriter(SER_NETWORK, PROTOCOL_VERSION | RPCSerializationFlags(), vchBlock, 0, block);
 
     switch (rf) {
     case RF_BINARY: {
-        std::string binaryBlock = ssBlock.str();
+        std::string binaryBlock(vchBlock.begin(), vchBlock.end());
         req->WriteHeader("Content-Type", "application/octet-stream");
         req->WriteReply(HTTP_OK, binaryBlock);
         return true;
     }
 
     case RF_HEX: {
-        std::string strHex = HexStr(ssBlock.begin(), ssBlock.end()) + "\n";
+        std::string strHex = HexStr(vchBlock.begin(), vchBlock.end()) + "\n";
         req->WriteHeader("Content-Type", "text/plain");
         req->WriteReply(HTTP_OK, strHex);
         return true;
@@ -297,6 +302,52 @@ static bool rest_chaininfo(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+UniValue getcontractcalls(const JSONRPCRequest& request);
+UniValue getsendercalls(const JSONRPCRequest& request);
+
+// /rest/contractcalls/<count>/<address>[/<cursor>].json and the same for /rest/sendercalls/
+static bool rest_calls(HTTPRequest* req, const std::string& strURIPart, UniValue (*actor)(const JSONRPCRequest&), const std::string& strPrefix)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    if (rf != RF_JSON)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: json)");
+
+    std::vector<std::string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+    if (path.size() < 2 || path.size() > 3)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Use " + strPrefix + "<count>/<address>[/<cursor>].json.");
+
+    JSONRPCRequest jsonRequest;
+    jsonRequest.params = UniValue(UniValue::VARR);
+    jsonRequest.params.push_back(path[1]);
+    jsonRequest.params.push_back((int)strtol(path[0].c_str(), nullptr, 10));
+    if (path.size() == 3)
+        jsonRequest.params.push_back(path[2]);
+    UniValue calls;
+    try {
+        calls = actor(jsonRequest);
+    } catch (const UniValue& objError) {
+        return RESTERR(req, HTTP_BAD_REQUEST, find_value(objError, "message").get_str());
+    }
+    std::string strJSON = calls.write() + "\n";
+    req->WriteHeader("Content-Type", "application/json");
+    req->WriteReply(HTTP_OK, strJSON);
+    return true;
+}
+
+static bool rest_contractcalls(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_calls(req, strURIPart, &getcontractcalls, "/rest/contractcalls/");
+}
+
+static bool rest_sendercalls(HTTPRequest* req, const std::string& strURIPart)
+{
+    return rest_calls(req, strURIPart, &getsendercalls, "/rest/sendercalls/");
+}
+
 static bool rest_mempool_info(HTTPRequest* req, const std::string& strURIPart)
 {
     if (!CheckWarmup(req))
@@ -598,6 +649,8 @@ static const struct {
       {"/rest/mempool/contents", rest_mempool_contents},
       {"/rest/headers/", rest_headers},
       {"/rest/getutxos", rest_getutxos},
+      {"/rest/contractcalls/", rest_contractcalls},
+      {"/rest/sendercalls/", rest_sendercalls},
 };
 
 bool StartREST()
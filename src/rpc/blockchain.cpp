@@ -24,6 +24,10 @@
 #include "util.h"
 #include "utilstrencodings.h"
 #include "hash.h"
+#include "sccallindex.h"
+#include "screceipt.h"
+#include "statelayers.h"
+#include "scsha3.h"
 
 #include <stdint.h>
 
@@ -320,7 +324,14 @@ std::string EntryDescriptionString()
            "    \"ancestorfees\" : n,     (numeric) modified fees (see above) of in-mempool ancestors (including this one)\n"
            "    \"depends\" : [           (array) unconfirmed transactions used as inputs for this transaction\n"
            "        \"transactionid\",    (string) parent transaction id\n"
-           "       ... ]\n";
+           "       ... ],\n"
+           "    \"contract\" : {         (json object, optional) dry-run of the contract outputs when the transaction was accepted\n"
+           "        \"gasused\" : n,      (numeric) gas used by all contract outputs\n"
+           "        \"success\" : true|false, (boolean) no contract output raised an exception\n"
+           "        \"stateroot\" : \"hash\", (string) contract state root it was executed on\n"
+           "        \"read\" : n,         (numeric) number of accounts looked up\n"
+           "        \"written\" : n       (numeric) number of accounts changed\n"
+           "    }\n";
 }
 
 void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
@@ -353,6 +364,17 @@ void entryToJSON(UniValue &info, const CTxMemPoolEntry &e)
     }
 
     info.push_back(Pair("depends", depends));
+
+    const CContractPreExecution* preExecution = e.GetContractPreExecution();
+    if (preExecution) {
+        UniValue contract(UniValue::VOBJ);
+        contract.push_back(Pair("gasused", preExecution->nGasUsed));
+        contract.push_back(Pair("success", preExecution->fSuccess));
+        contract.push_back(Pair("stateroot", preExecution->hashStateRoot.GetHex()));
+        contract.push_back(Pair("read", (uint64_t)preExecution->vRead.size()));
+        contract.push_back(Pair("written", (uint64_t)preExecution->vWrite.size()));
+        info.push_back(Pair("contract", contract));
+    }
 }
 
 UniValue mempoolToJSON(bool fVerbose)
@@ -601,6 +623,229 @@ UniValue getblockhash(const JSONRPCRequest& request)
     return pblockindex->GetBlockHash().GetHex();
 }
 
+template <class Hash>
+static Hash ParseContractHash(const UniValue& v, const std::string& strName)
+{
+    std::string strHex = v.get_str();
+    if (strHex.size() != Hash::size * 2 || !IsHex(strHex))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("%s must be %d hex characters", strName, Hash::size * 2));
+    return Hash(ParseHex(strHex));
+}
+
+UniValue getlogs(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getlogs fromblock ( toblock filter )\n"
+            "\nReturns the contract logs of the blocks fromblock..toblock of the active chain that match filter.\n"
+            "Requires -receiptindex. Blocks whose log bloom cannot match the filter are skipped without reading their receipts.\n"
+            "\nArguments:\n"
+            "1. fromblock      (numeric, required) The first block height\n"
+            "2. toblock        (numeric, optional, default=-1) The last block height, -1 for the tip\n"
+            "3. filter         (json object, optional)\n"
+            "    {\n"
+            "      \"addresses\": [\"address\",...] (array, optional) Contract addresses (40 hex characters), any of which may match\n"
+            "      \"topics\": [\"topic\"|null,...]   (array, optional) Topic (64 hex characters) required at each position, null for any\n"
+            "    }\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"blockhash\": \"hash\",   (string) The block hash\n"
+            "    \"blockheight\": n,      (numeric) The block height\n"
+            "    \"txid\": \"id\",          (string) The transaction id\n"
+            "    \"vout\": n,             (numeric) The contract output of the transaction\n"
+            "    \"address\": \"address\",  (string) The contract that emitted the log\n"
+            "    \"topics\": [\"topic\",...], (array) The log topics\n"
+            "    \"data\": \"hex\"          (string) The log data\n"
+            "  },...\n"
+            "]\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getlogs", "1000 2000 '{\"addresses\": [\"0000000000000000000000000000000000000099\"]}'")
+            + HelpExampleRpc("getlogs", "1000, 2000, {\"addresses\": [\"0000000000000000000000000000000000000099\"]}")
+        );
+
+    std::vector<const CBlockIndex*> vBlocks;
+    {
+        LOCK(cs_main);
+        if (!preceiptdb)
+            throw JSONRPCError(RPC_MISC_ERROR, "Contract receipts are not indexed, use -receiptindex");
+        if (!fReceiptIndexSynced)
+            throw JSONRPCError(RPC_MISC_ERROR, "The receipt index is still being built, see debug.log");
+
+        int nFrom = request.params[0].get_int();
+        int nTo = request.params.size() > 1 && !request.params[1].isNull() ? request.params[1].get_int() : -1;
+        if (nTo < 0)
+            nTo = chainActive.Height();
+        if (nFrom < 0 || nFrom > nTo || nTo > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        for (int nHeight = nFrom; nHeight <= nTo; nHeight++)
+            vBlocks.push_back(chainActive[nHeight]);
+    }
+
+    std::vector<sc::h160> vAddresses;
+    std::vector<boost::optional<sc::h256>> vTopics;
+    if (request.params.size() > 2 && !request.params[2].isNull()) {
+        const UniValue& filter = request.params[2].get_obj();
+        RPCTypeCheckObj(filter, {{"addresses", UniValueType(UniValue::VARR)}, {"topics", UniValueType(UniValue::VARR)}}, true, true);
+        const UniValue& addresses = find_value(filter, "addresses");
+        if (!addresses.isNull())
+            for (size_t i = 0; i < addresses.size(); i++)
+                vAddresses.push_back(ParseContractHash<sc::h160>(addresses[i], "address"));
+        const UniValue& topics = find_value(filter, "topics");
+        if (!topics.isNull())
+            for (size_t i = 0; i < topics.size(); i++)
+                vTopics.push_back(topics[i].isNull() ? boost::optional<sc::h256>() : ParseContractHash<sc::h256>(topics[i], "topic"));
+    }
+
+    // Bloom bits each matching block must have: one of the addresses, and every topic.
+    std::vector<sc::h2048> vAddressBlooms;
+    for (const sc::h160& address : vAddresses)
+        vAddressBlooms.push_back(sc::h2048().shiftBloom<3>(sc::sha3(address.ref())));
+    sc::h2048 topicBloom;
+    for (const auto& topic : vTopics)
+        if (topic)
+            topicBloom.shiftBloom<3>(sc::sha3(topic->ref()));
+
+    UniValue result(UniValue::VARR);
+    for (const CBlockIndex* pindex : vBlocks) {
+        sc::h2048 bloom;
+        if (!preceiptdb->ReadBloom(pindex->GetBlockHash(), bloom))
+            continue;
+        if (!bloom.contains(topicBloom))
+            continue;
+        if (!vAddressBlooms.empty() && std::none_of(vAddressBlooms.begin(), vAddressBlooms.end(), [&bloom](const sc::h2048& b) { return bloom.contains(b); }))
+            continue;
+
+        CBlockReceipts receipts;
+        if (!preceiptdb->ReadReceipts(pindex->GetBlockHash(), receipts))
+            continue;
+        for (const CContractReceipt& receipt : receipts.receipts) {
+            for (const CContractLog& log : receipt.logs) {
+                if (!vAddresses.empty() && std::find(vAddresses.begin(), vAddresses.end(), log.address) == vAddresses.end())
+                    continue;
+                bool fMatch = true;
+                for (size_t i = 0; i < vTopics.size() && fMatch; i++)
+                    fMatch = !vTopics[i] || (i < log.topics.size() && log.topics[i] == *vTopics[i]);
+                if (!fMatch)
+                    continue;
+
+                UniValue entry(UniValue::VOBJ);
+                entry.push_back(Pair("blockhash", pindex->GetBlockHash().GetHex()));
+                entry.push_back(Pair("blockheight", pindex->nHeight));
+                entry.push_back(Pair("txid", receipt.txid.GetHex()));
+                entry.push_back(Pair("vout", (int)receipt.nOut));
+                entry.push_back(Pair("address", log.address.hex()));
+                UniValue topics(UniValue::VARR);
+                for (const sc::h256& topic : log.topics)
+                    topics.push_back(topic.hex());
+                entry.push_back(Pair("topics", topics));
+                entry.push_back(Pair("data", HexStr(log.data)));
+                result.push_back(entry);
+            }
+        }
+    }
+    return result;
+}
+
+static UniValue ListContractCalls(const JSONRPCRequest& request, CContractCallIndex::Role role)
+{
+    if (!pcontractcallindex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Contract calls are not indexed, use -contractindex");
+    if (!pcontractcallindex->IsSynced())
+        throw JSONRPCError(RPC_MISC_ERROR, "The contract call index is still being built, see debug.log");
+
+    const sc::h160 address = ParseContractHash<sc::h160>(request.params[0], "address");
+    int nCount = 100;
+    if (request.params.size() > 1 && !request.params[1].isNull())
+        nCount = request.params[1].get_int();
+    if (nCount < 1 || nCount > (int)MAX_CONTRACT_CALLS_PAGE)
+        throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("count must be between 1 and %u", MAX_CONTRACT_CALLS_PAGE));
+    std::string strCursor;
+    if (request.params.size() > 2 && !request.params[2].isNull())
+        strCursor = request.params[2].get_str();
+
+    std::vector<CContractCall> vCalls;
+    std::string strNextCursor;
+    if (!pcontractcallindex->ListCalls(role, address, nCount, strCursor, vCalls, strNextCursor))
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+
+    UniValue calls(UniValue::VARR);
+    for (const CContractCall& call : vCalls) {
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("height", call.nHeight));
+        entry.push_back(Pair("txid", call.txid.GetHex()));
+        entry.push_back(Pair("vout", (int)call.nOut));
+        entry.push_back(Pair("contract", call.contract.hex()));
+        entry.push_back(Pair("sender", call.sender.hex()));
+        entry.push_back(Pair("create", call.fCreate));
+        if (!call.fCreate)
+            entry.push_back(Pair("selector", HexStr(call.selector)));
+        calls.push_back(entry);
+    }
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("calls", calls));
+    if (!strNextCursor.empty())
+        result.push_back(Pair("next", strNextCursor));
+    return result;
+}
+
+static const std::string strContractCallsResultHelp =
+    "\nResult:\n"
+    "{\n"
+    "  \"calls\": [                 (array) Calls in chain order\n"
+    "    {\n"
+    "      \"height\": n,           (numeric) The block height\n"
+    "      \"txid\": \"id\",          (string) The transaction id\n"
+    "      \"vout\": n,             (numeric) The OP_CREATE/OP_CALL output\n"
+    "      \"contract\": \"address\", (string) The contract\n"
+    "      \"sender\": \"address\",   (string) The VM address of the sender\n"
+    "      \"create\": true|false,  (boolean) Whether the output is an OP_CREATE\n"
+    "      \"selector\": \"hex\"      (string) The first 4 bytes of the call data, for OP_CALL\n"
+    "    },...\n"
+    "  ],\n"
+    "  \"next\": \"cursor\"          (string) Pass as cursor to get the next page; absent on the last page\n"
+    "}\n";
+
+UniValue getcontractcalls(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getcontractcalls \"address\" ( count \"cursor\" )\n"
+            "\nReturns the OP_CREATE/OP_CALL outputs of the active chain that created or called a contract.\n"
+            "Requires -contractindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The contract address (40 hex characters)\n"
+            "2. count          (numeric, optional, default=100) The maximum number of calls to return\n"
+            "3. \"cursor\"       (string, optional) The \"next\" value of the previous page\n"
+            + strContractCallsResultHelp +
+            "\nExamples:\n"
+            + HelpExampleCli("getcontractcalls", "\"0000000000000000000000000000000000000099\" 10")
+            + HelpExampleRpc("getcontractcalls", "\"0000000000000000000000000000000000000099\", 10")
+        );
+
+    return ListContractCalls(request, CContractCallIndex::Role::Contract);
+}
+
+UniValue getsendercalls(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() < 1 || request.params.size() > 3)
+        throw std::runtime_error(
+            "getsendercalls \"address\" ( count \"cursor\" )\n"
+            "\nReturns the OP_CREATE/OP_CALL outputs of the active chain sent by a VM address.\n"
+            "Requires -contractindex.\n"
+            "\nArguments:\n"
+            "1. \"address\"      (string, required) The sender's VM address (40 hex characters)\n"
+            "2. count          (numeric, optional, default=100) The maximum number of calls to return\n"
+            "3. \"cursor\"       (string, optional) The \"next\" value of the previous page\n"
+            + strContractCallsResultHelp +
+            "\nExamples:\n"
+            + HelpExampleCli("getsendercalls", "\"0000000000000000000000000000000000000042\" 10")
+            + HelpExampleRpc("getsendercalls", "\"0000000000000000000000000000000000000042\", 10")
+        );
+
+    return ListContractCalls(request, CContractCallIndex::Role::Sender);
+}
+
 UniValue getblockheader(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() < 1 || request.params.size() > 2)
@@ -730,6 +975,11 @@ UniValue getblock(const JSONRPCRequest& request)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_MISC_ERROR, "Block not available (pruned data)");
 
+    // With witness data, the serialized block is the block as it is stored
+    std::vector<unsigned char> vchBlock;
+    if (verbosity <= 0 && RPCSerializationFlags() == 0 && ReadRawBlockFromDisk(vchBlock, pblockindex, Params().MessageStart()))
+        return HexStr(vchBlock.begin(), vchBlock.end());
+
     if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         // Block not found on disk. This could be because we have the block
         // header in our index but don't have the block (for example if a
@@ -1290,6 +1540,56 @@ UniValue getchaintips(const JSONRPCRequest& request)
     return res;
 }
 
+UniValue getreorginfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getreorginfo\n"
+            "Returns statistics about chain reorganizations and the contract state layers that make them cheaper.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"reorgs\": xxxxx,           (numeric) Reorganizations since startup\n"
+            "  \"lastdepth\": xxxxx,        (numeric) Blocks disconnected by the last one\n"
+            "  \"maxdepth\": xxxxx,         (numeric) Most blocks disconnected by one\n"
+            "  \"lasttime\": x.xxx,         (numeric) Milliseconds the last one took, from its first disconnect to its new tip\n"
+            "  \"maxtime\": x.xxx,          (numeric) Milliseconds the slowest one took\n"
+            "  \"totaltime\": x.xxx,        (numeric) Milliseconds all of them took\n"
+            "  \"totaldisconnecttime\": x.xxx, (numeric) Milliseconds of that spent disconnecting blocks\n"
+            "  \"layers\": {                (json object) Contract state results of recent blocks\n"
+            "    \"count\": xxxxx,          (numeric) Layers kept\n"
+            "    \"max\": xxxxx,            (numeric) Most layers kept (see -statelayers)\n"
+            "    \"usage\": xxxxx,          (numeric) Memory they use, in bytes\n"
+            "    \"applied\": xxxxx,        (numeric) Blocks connected from their layer\n"
+            "    \"executed\": xxxxx         (numeric) Blocks connected by executing their contracts\n"
+            "  }\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getreorginfo", "")
+            + HelpExampleRpc("getreorginfo", "")
+        );
+
+    LOCK(cs_main);
+    const CReorgStats stats = GetReorgStats();
+
+    UniValue layers(UniValue::VOBJ);
+    layers.push_back(Pair("count", (uint64_t)stats.nLayers));
+    layers.push_back(Pair("max", (uint64_t)stats.nMaxLayers));
+    layers.push_back(Pair("usage", (uint64_t)stats.nLayerUsage));
+    layers.push_back(Pair("applied", stats.nApplied));
+    layers.push_back(Pair("executed", stats.nExecuted));
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("reorgs", stats.nReorgs));
+    obj.push_back(Pair("lastdepth", stats.nLastDepth));
+    obj.push_back(Pair("maxdepth", stats.nMaxDepth));
+    obj.push_back(Pair("lasttime", stats.nLastTime * 0.001));
+    obj.push_back(Pair("maxtime", stats.nMaxTime * 0.001));
+    obj.push_back(Pair("totaltime", stats.nTotalTime * 0.001));
+    obj.push_back(Pair("totaldisconnecttime", stats.nTotalDisconnectTime * 0.001));
+    obj.push_back(Pair("layers", layers));
+    return obj;
+}
+
 UniValue mempoolInfoToJSON()
 {
     UniValue ret(UniValue::VOBJ);
@@ -1514,12 +1814,16 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockhash",           &getblockhash,           true,  {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         true,  {"blockhash","verbose"} },
     { "blockchain",         "getchaintips",           &getchaintips,           true,  {} },
+    { "blockchain",         "getcontractcalls",       &getcontractcalls,       true,  {"address","count","cursor"} },
     { "blockchain",         "getdifficulty",          &getdifficulty,          true,  {} },
+    { "blockchain",         "getlogs",                &getlogs,                true,  {"fromblock","toblock","filter"} },
     { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  {"txid","verbose"} },
     { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  {"txid","verbose"} },
     { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  {"txid"} },
     { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  {} },
     { "blockchain",         "getrawmempool",          &getrawmempool,          true,  {"verbose"} },
+    { "blockchain",         "getreorginfo",           &getreorginfo,           true,  {} },
+    { "blockchain",         "getsendercalls",         &getsendercalls,         true,  {"address","count","cursor"} },
     { "blockchain",         "gettxout",               &gettxout,               true,  {"txid","n","include_mempool"} },
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        true,  {"height"} },
@@ -118,6 +118,7 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "estimatesmartfee", 0, "conf_target" },
     { "estimaterawfee", 0, "conf_target" },
     { "estimaterawfee", 1, "threshold" },
+    { "getcasinoschedule", 0, "phase" },
     { "prioritisetransaction", 1, "dummy" },
     { "prioritisetransaction", 2, "fee_delta" },
     { "setban", 2, "bantime" },
@@ -144,6 +145,11 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "createcontract", 4, "gasPrice" },
     { "sendtocontract", 3, "gasLimit" },
     { "sendtocontract", 4, "gasPrice" },
+    { "getlogs", 0, "fromblock" },
+    { "getlogs", 1, "toblock" },
+    { "getlogs", 2, "filter" },
+    { "getcontractcalls", 1, "count" },
+    { "getsendercalls", 1, "count" },
 };
 
 class CRPCConvertTable
@@ -17,6 +17,7 @@
 #include "net.h"
 #include "policy/fees.h"
 #include "casino.h"
+#include "casinoschedule.h"
 #include "rpc/blockchain.h"
 #include "rpc/mining.h"
 #include "rpc/server.h"
@@ -197,6 +198,27 @@ UniValue getmininginfo(const JSONRPCRequest& request)
             "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
             "  \"pooledtx\": n              (numeric) The size of the mempool\n"
             "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
+            "  \"slots\": {                 (json object) slot timing of the local miner\n"
+            "    \"blocks\": n,              (numeric) blocks submitted in our slots\n"
+            "    \"lateblocks\": n,          (numeric) of which submitted late\n"
+            "    \"missedslots\": n,         (numeric) slots whose block was not accepted\n"
+            "    \"lastbuildtime\": n,       (numeric) milliseconds the last block template took to build\n"
+            "    \"avgbuildtime\": n,        (numeric) moving average of the build time, in milliseconds\n"
+            "    \"maxbuildtime\": n,        (numeric) longest build time, in milliseconds\n"
+            "    \"lastlateness\": n         (numeric) milliseconds between the last slot and submitting its block\n"
+            "  },\n"
+            "  \"template\": {              (json object) background block template (-blocktemplatebuilder)\n"
+            "    \"running\": true|false,   (boolean) whether the builder runs\n"
+            "    \"age\": n,                 (numeric) milliseconds since the template on the tip was last brought up to date, -1 if there is none\n"
+            "    \"txs\": n,                 (numeric) transactions in it, coinbase excluded\n"
+            "    \"builds\": n,              (numeric) templates built from scratch\n"
+            "    \"extensions\": n,          (numeric) templates extended with new mempool transactions\n"
+            "    \"failures\": n,            (numeric) builds that failed\n"
+            "    \"lastbuildtime\": n,       (numeric) milliseconds the last build took\n"
+            "    \"avgbuildtime\": n,        (numeric) moving average of the build time, in milliseconds\n"
+            "    \"lastextendtime\": n,      (numeric) milliseconds the last extension took\n"
+            "    \"avgextendtime\": n        (numeric) moving average of the extension time, in milliseconds\n"
+            "  }\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getmininginfo", "")
@@ -215,9 +237,100 @@ UniValue getmininginfo(const JSONRPCRequest& request)
     obj.push_back(Pair("networkhashps",    getnetworkhashps(request)));
     obj.push_back(Pair("pooledtx",         (uint64_t)mempool.size()));
     obj.push_back(Pair("chain",            Params().NetworkIDString()));
+
+    CMinerSlotStats stats = GetMinerSlotStats();
+    UniValue slots(UniValue::VOBJ);
+    slots.push_back(Pair("blocks", stats.nBlocks));
+    slots.push_back(Pair("lateblocks", stats.nLateBlocks));
+    slots.push_back(Pair("missedslots", stats.nMissedSlots));
+    slots.push_back(Pair("lastbuildtime", stats.nLastBuildTime * 0.001));
+    slots.push_back(Pair("avgbuildtime", stats.nAvgBuildTime * 0.001));
+    slots.push_back(Pair("maxbuildtime", stats.nMaxBuildTime * 0.001));
+    slots.push_back(Pair("lastlateness", stats.nLastLateness * 0.001));
+    obj.push_back(Pair("slots", slots));
+
+    CTemplateBuilderStats builder = GetTemplateBuilderStats();
+    UniValue tmpl(UniValue::VOBJ);
+    tmpl.push_back(Pair("running", builder.fRunning));
+    tmpl.push_back(Pair("age", builder.nTemplateTime ? (GetTimeMicros() - builder.nTemplateTime) * 0.001 : -1));
+    tmpl.push_back(Pair("txs", builder.nTemplateTx));
+    tmpl.push_back(Pair("builds", builder.nBuilds));
+    tmpl.push_back(Pair("extensions", builder.nExtensions));
+    tmpl.push_back(Pair("failures", builder.nFailures));
+    tmpl.push_back(Pair("lastbuildtime", builder.nLastBuildTime * 0.001));
+    tmpl.push_back(Pair("avgbuildtime", builder.nAvgBuildTime * 0.001));
+    tmpl.push_back(Pair("lastextendtime", builder.nLastExtendTime * 0.001));
+    tmpl.push_back(Pair("avgextendtime", builder.nAvgExtendTime * 0.001));
+    obj.push_back(Pair("template", tmpl));
     return obj;
 }
 
+UniValue getcasinoschedule(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            "getcasinoschedule ( phase )\n"
+            "\nReturns the miners of a casino phase of the active chain, as set by the block that closed the phase before it.\n"
+            "\nArguments:\n"
+            "1. phase          (numeric, optional) The phase, default the phase of the next block\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"phase\": n,                (numeric) The phase\n"
+            "  \"blockhash\": \"hash\",       (string) The block that set the winners of the phase\n"
+            "  \"height\": n,               (numeric) Its height\n"
+            "  \"seed\": n,                 (numeric) The winner seed of the phase\n"
+            "  \"miners\": [                (array) The winners, in winner order; empty if the phase has none\n"
+            "    {\n"
+            "      \"player\": n,           (numeric) The player slot in the casino contract\n"
+            "      \"address\": \"address\"   (string) The VM address of the player\n"
+            "    },...\n"
+            "  ],\n"
+            "  \"nextheight\": n,           (numeric) For the current phase, the height of the next block\n"
+            "  \"nextminer\": \"address\"     (string) For the current phase, the miner whose turn it is\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getcasinoschedule", "")
+            + HelpExampleRpc("getcasinoschedule", "3")
+        );
+
+    LOCK(cs_main);
+
+    const CBlockIndex* pindexTip = chainActive.Tip();
+    uint32_t nCurrentPhase = GetCasinoPhase(pindexTip);
+    uint32_t nPhase = nCurrentPhase;
+    if (request.params.size() > 0 && !request.params[0].isNull()) {
+        int nParam = request.params[0].get_int();
+        if (nParam < 0 || (uint32_t)nParam > nCurrentPhase)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("phase must be between 0 and %u", nCurrentPhase));
+        nPhase = nParam;
+    }
+
+    CCasinoSchedule schedule;
+    if (!GetCasinoSchedule(pindexTip, nPhase, schedule))
+        throw JSONRPCError(RPC_MISC_ERROR, strprintf("The winners of phase %u are not known", nPhase));
+
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("phase", (uint64_t)schedule.nPhase));
+    result.push_back(Pair("blockhash", schedule.hashBlock.GetHex()));
+    result.push_back(Pair("height", GetCasinoScheduleHeight(nPhase)));
+    result.push_back(Pair("seed", (uint64_t)schedule.nSeed));
+    UniValue miners(UniValue::VARR);
+    for (size_t i = 0; i < schedule.vMiners.size(); i++) {
+        UniValue miner(UniValue::VOBJ);
+        miner.push_back(Pair("player", (uint64_t)schedule.vPlayers[i]));
+        miner.push_back(Pair("address", schedule.vMiners[i].hex()));
+        miners.push_back(miner);
+    }
+    result.push_back(Pair("miners", miners));
+    if (nPhase == nCurrentPhase) {
+        result.push_back(Pair("nextheight", pindexTip->nHeight + 1));
+        const sc::h160* pminer = schedule.SlotMiner(pindexTip->nHeight + 1);
+        if (pminer)
+            result.push_back(Pair("nextminer", pminer->hex()));
+    }
+    return result;
+}
+
 
 // NOTE: Unlike wallet RPC (which use BTC values), mining RPCs follow GBT (BIP 22) in using satoshi amounts
 UniValue prioritisetransaction(const JSONRPCRequest& request)
@@ -514,7 +627,11 @@ UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
+        // The background template selects witness transactions
+        if (fSupportsSegwit)
+            pblocktemplate = GetBuiltTemplate(scriptDummy, pindexPrevNew);
+        if (!pblocktemplate)
+            pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy, fSupportsSegwit);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -964,6 +1081,7 @@ static const CRPCCommand commands[] =
   //  --------------------- ------------------------  -----------------------  ----------
     { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  {"nblocks","height"} },
     { "mining",             "getmininginfo",          &getmininginfo,          true,  {} },
+    { "mining",             "getcasinoschedule",      &getcasinoschedule,      true,  {"phase"} },
     { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  {"txid","dummy","fee_delta"} },
     { "mining",             "getblocktemplate",       &getblocktemplate,       true,  {"template_request"} },
     { "mining",             "submitblock",            &submitblock,            true,  {"hexdata","dummy"} },
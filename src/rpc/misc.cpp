@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "base58.h"
+#include "blockwriter.h"
 #include "chain.h"
 #include "clientversion.h"
 #include "core_io.h"
@@ -500,6 +501,72 @@ static UniValue RPCLockedMemoryInfo()
     return obj;
 }
 
+static UniValue RPCContractCodeInfo()
+{
+    sc::CodeCache::Stats stats = sc::CodeCache::instance().stats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("entries", uint64_t(stats.entries)));
+    obj.push_back(Pair("analyses", uint64_t(stats.analyses)));
+    obj.push_back(Pair("usage", uint64_t(stats.memory)));
+    obj.push_back(Pair("max", uint64_t(stats.maxMemory)));
+    obj.push_back(Pair("hits", stats.hits));
+    obj.push_back(Pair("misses", stats.misses));
+    obj.push_back(Pair("evictions", stats.evictions));
+    return obj;
+}
+
+static UniValue RPCContractStateInfo()
+{
+    sc::OverlayDB::Stats stats;
+    {
+        LOCK(cs_main);
+        if (pState)
+            stats = pState->db().stats();
+    }
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("nodes", uint64_t(stats.nodes)));
+    obj.push_back(Pair("usage", uint64_t(stats.memory)));
+    obj.push_back(Pair("flushes", stats.commits));
+    obj.push_back(Pair("flushednodes", stats.committedNodes));
+    obj.push_back(Pair("flushedbytes", stats.committedBytes));
+    obj.push_back(Pair("frozennodes", uint64_t(stats.frozenNodes)));
+    return obj;
+}
+
+static UniValue RPCChainstateFlushInfo()
+{
+    CChainstateFlushStats stats = GetChainstateFlushStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("async", stats.fAsync));
+    obj.push_back(Pair("writing", stats.fWriting));
+    obj.push_back(Pair("flushes", stats.nFlushes));
+    obj.push_back(Pair("asyncflushes", stats.nAsyncFlushes));
+    obj.push_back(Pair("pendingusage", stats.nPendingUsage));
+    obj.push_back(Pair("lastwritetime", stats.nLastWriteTime * 0.001));
+    obj.push_back(Pair("totalwritetime", stats.nTotalWriteTime * 0.001));
+    obj.push_back(Pair("laststalltime", stats.nLastStallTime * 0.001));
+    obj.push_back(Pair("totalstalltime", stats.nTotalStallTime * 0.001));
+    obj.push_back(Pair("totalwaittime", stats.nTotalWaitTime * 0.001));
+    return obj;
+}
+
+static UniValue RPCBlockWriterInfo()
+{
+    CBlockWriterStats stats = GetBlockWriterStats();
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("async", stats.fAsync));
+    obj.push_back(Pair("appends", stats.nAppends));
+    obj.push_back(Pair("bytes", stats.nBytes));
+    obj.push_back(Pair("writes", stats.nGroups));
+    obj.push_back(Pair("syncs", stats.nSyncs));
+    obj.push_back(Pair("filessynced", stats.nFilesSynced));
+    obj.push_back(Pair("pending", uint64_t(stats.nPending)));
+    obj.push_back(Pair("writetime", stats.nWriteTime * 0.001));
+    obj.push_back(Pair("synctime", stats.nSyncTime * 0.001));
+    obj.push_back(Pair("waittime", stats.nWaitTime * 0.001));
+    return obj;
+}
+
 #ifdef HAVE_MALLOC_INFO
 static std::string RPCMallocInfo()
 {
@@ -541,6 +608,47 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
             "    \"locked\": xxxxxx,       (numeric) Amount of bytes that succeeded locking. If this number is smaller than total, locking pages failed at some point and key data could be swapped to disk.\n"
             "    \"chunks_used\": xxxxx,   (numeric) Number allocated chunks\n"
             "    \"chunks_free\": xxxxx,   (numeric) Number unused chunks\n"
+            "  },\n"
+            "  \"contractcode\": {         (json object) Information about the shared contract code cache\n"
+            "    \"entries\": xxxxx,       (numeric) Number of cached code hashes\n"
+            "    \"analyses\": xxxxx,      (numeric) Number of code hashes with a cached VM analysis\n"
+            "    \"usage\": xxxxx,         (numeric) Estimated bytes used\n"
+            "    \"max\": xxxxx,           (numeric) Maximum bytes used (see -contractcodecache)\n"
+            "    \"hits\": xxxxx,          (numeric) Code lookups served from the cache\n"
+            "    \"misses\": xxxxx,        (numeric) Code lookups that went to the state database\n"
+            "    \"evictions\": xxxxx,     (numeric) Entries dropped to stay below the maximum\n"
+            "  },\n"
+            "  \"contractstate\": {        (json object) Information about the contract state trie nodes not yet on disk\n"
+            "    \"nodes\": xxxxx,         (numeric) Number of nodes held in memory\n"
+            "    \"usage\": xxxxx,         (numeric) Estimated bytes used, counted against -dbcache\n"
+            "    \"flushes\": xxxxx,       (numeric) Writes of the nodes to the state database\n"
+            "    \"flushednodes\": xxxxx,  (numeric) Nodes written\n"
+            "    \"flushedbytes\": xxxxx,  (numeric) Bytes written\n"
+            "    \"frozennodes\": xxxxx,   (numeric) Nodes being written in the background\n"
+            "  },\n"
+            "  \"flush\": {                (json object) Information about the full flushes of the chainstate and contract state\n"
+            "    \"async\": true|false,    (boolean) Whether they are written in the background (see -asyncflush)\n"
+            "    \"writing\": true|false,  (boolean) Whether a write is in progress\n"
+            "    \"flushes\": xxxxx,       (numeric) Number of full flushes\n"
+            "    \"asyncflushes\": xxxxx,  (numeric) Number of them written in the background\n"
+            "    \"pendingusage\": xxxxx,  (numeric) Bytes of coins being written\n"
+            "    \"lastwritetime\": x.xxx, (numeric) Milliseconds the last write took\n"
+            "    \"totalwritetime\": x.xxx,(numeric) Milliseconds all writes took\n"
+            "    \"laststalltime\": x.xxx, (numeric) Milliseconds the last full flush held up block connection\n"
+            "    \"totalstalltime\": x.xxx,(numeric) Milliseconds all full flushes held up block connection\n"
+            "    \"totalwaittime\": x.xxx, (numeric) Milliseconds of those spent waiting for the previous write\n"
+            "  },\n"
+            "  \"blockwrites\": {          (json object) Information about the writes of block and undo data\n"
+            "    \"async\": true|false,    (boolean) Whether they are written in the background (see -blockwriter)\n"
+            "    \"appends\": xxxxx,       (numeric) Blocks and undo records appended\n"
+            "    \"bytes\": xxxxx,         (numeric) Bytes of them\n"
+            "    \"writes\": xxxxx,        (numeric) Vectored writes they took\n"
+            "    \"syncs\": xxxxx,         (numeric) Times the block files were made durable\n"
+            "    \"filessynced\": xxxxx,   (numeric) Files synced by them\n"
+            "    \"pending\": xxxxx,       (numeric) Bytes queued and not yet written\n"
+            "    \"writetime\": x.xxx,     (numeric) Milliseconds spent writing\n"
+            "    \"synctime\": x.xxx,      (numeric) Milliseconds spent syncing\n"
+            "    \"waittime\": x.xxx,      (numeric) Milliseconds appends and reads waited for the writer\n"
             "  }\n"
             "}\n"
             "\nResult (mode \"mallocinfo\"):\n"
@@ -554,6 +662,10 @@ UniValue getmemoryinfo(const JSONRPCRequest& request)
     if (mode == "stats") {
         UniValue obj(UniValue::VOBJ);
         obj.push_back(Pair("locked", RPCLockedMemoryInfo()));
+        obj.push_back(Pair("contractcode", RPCContractCodeInfo()));
+        obj.push_back(Pair("contractstate", RPCContractStateInfo()));
+        obj.push_back(Pair("flush", RPCChainstateFlushInfo()));
+        obj.push_back(Pair("blockwrites", RPCBlockWriterInfo()));
         return obj;
     } else if (mode == "mallocinfo") {
 #ifdef HAVE_MALLOC_INFO
@@ -4,6 +4,8 @@
 
 #include "rpc/server.h"
 
+#include "base58.h"
+#include "casinoschedule.h"
 #include "chainparams.h"
 #include "clientversion.h"
 #include "core_io.h"
@@ -101,7 +103,10 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"download_window\": n,      (numeric) How many blocks we may ask from this peer at once\n"
+            "    \"block_interval\": n,       (numeric, optional) The time in seconds the peer takes per block when more are queued\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
+            "    \"slotminer\": \"address\",    (string, optional) The casino address the peer proved to mine for\n"
             "    \"bytessent_per_msg\": {\n"
             "       \"addr\": n,              (numeric) The total bytes sent aggregated by message type\n"
             "       ...\n"
@@ -167,8 +172,13 @@ UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.push_back(Pair("inflight", heights));
+            obj.push_back(Pair("download_window", statestats.nDownloadWindow));
+            if (statestats.nBlockInterval > 0)
+                obj.push_back(Pair("block_interval", statestats.nBlockInterval * 0.000001));
         }
         obj.push_back(Pair("whitelisted", stats.fWhitelisted));
+        if (fStateStats && !statestats.slotMiner.IsNull())
+            obj.push_back(Pair("slotminer", CYbtcAddress(CKeyID(statestats.slotMiner)).ToString()));
 
         UniValue sendPerMsgCmd(UniValue::VOBJ);
         for (const mapMsgCmdSize::value_type &i : stats.mapSendBytesPerMsgCmd) {
@@ -622,6 +632,73 @@ UniValue setnetworkactive(const JSONRPCRequest& request)
     return g_connman->GetNetworkActive();
 }
 
+UniValue getslotrelayinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            "getslotrelayinfo\n"
+            "\nReturns the pushes of new blocks to the miners of the next casino slots, and when\n"
+            "the most recent blocks were first heard of. The times are wall clock, so that they\n"
+            "compare across the nodes of a local network to give the latency of each hop.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"enabled\": true|false,       (boolean) Whether -slotrelay is on\n"
+            "  \"upcoming\": [               (array) The miners of the next slots, in slot order\n"
+            "     \"address\",\n"
+            "     ...\n"
+            "  ],\n"
+            "  \"pushes\": n,                (numeric) Compact blocks pushed to slot miners\n"
+            "  \"blockspushed\": n,          (numeric) Blocks pushed to at least one slot miner\n"
+            "  \"blocks\": [\n"
+            "    {\n"
+            "      \"hash\": \"hash\",          (string) The block hash\n"
+            "      \"height\": n,            (numeric) The block height, -1 if it was not accepted yet\n"
+            "      \"peer\": n,              (numeric) The peer that announced it first, -1 if it was mined here\n"
+            "      \"via\": \"command\",       (string) The message that announced it\n"
+            "      \"firstseen\": n,         (numeric) When it was first heard of, in microseconds since epoch\n"
+            "      \"accepted\": n,          (numeric) When it passed the proof of work checks, in microseconds since epoch\n"
+            "      \"hoplatency\": x.xxx     (numeric) Milliseconds from first seen to accepted\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getslotrelayinfo", "")
+            + HelpExampleRpc("getslotrelayinfo", "")
+        );
+
+    UniValue upcoming(UniValue::VARR);
+    {
+        LOCK(cs_main);
+        for (const sc::h160& miner : GetUpcomingCasinoMiners(chainActive.Tip(), SLOT_RELAY_SLOTS))
+            upcoming.push_back(CYbtcAddress(CKeyID(uint160(miner.asBytes()))).ToString());
+    }
+
+    const CSlotRelayStats stats = GetSlotRelayStats();
+    UniValue blocks(UniValue::VARR);
+    for (const CBlockArrival& arrival : stats.vArrivals) {
+        UniValue obj(UniValue::VOBJ);
+        obj.push_back(Pair("hash", arrival.hash.GetHex()));
+        obj.push_back(Pair("height", arrival.nHeight));
+        obj.push_back(Pair("peer", arrival.nPeer));
+        obj.push_back(Pair("via", arrival.strCommand));
+        obj.push_back(Pair("firstseen", arrival.nFirstSeen));
+        if (arrival.nAccepted) {
+            obj.push_back(Pair("accepted", arrival.nAccepted));
+            obj.push_back(Pair("hoplatency", (arrival.nAccepted - arrival.nFirstSeen) * 0.001));
+        }
+        blocks.push_back(obj);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.push_back(Pair("enabled", gArgs.GetBoolArg("-slotrelay", DEFAULT_SLOT_RELAY)));
+    ret.push_back(Pair("upcoming", upcoming));
+    ret.push_back(Pair("pushes", stats.nPushes));
+    ret.push_back(Pair("blockspushed", stats.nBlocksPushed));
+    ret.push_back(Pair("blocks", blocks));
+    return ret;
+}
+
 static const CRPCCommand commands[] =
 { //  category              name                      actor (function)         okSafeMode
   //  --------------------- ------------------------  -----------------------  ----------
@@ -637,6 +714,7 @@ static const CRPCCommand commands[] =
     { "network",            "listbanned",             &listbanned,             true,  {} },
     { "network",            "clearbanned",            &clearbanned,            true,  {} },
     { "network",            "setnetworkactive",       &setnetworkactive,       true,  {"state"} },
+    { "network",            "getslotrelayinfo",       &getslotrelayinfo,       true,  {} },
 };
 
 void RegisterNetRPCCommands(CRPCTable &t)
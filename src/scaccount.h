@@ -3,6 +3,7 @@
 #define FABCOIN_SCACCOUNT_HPP
 
 #include "sccommon.h"
+#include "scflatmap.h"
 #include "scsha3.h"
 
 namespace sc
@@ -96,7 +97,7 @@ public:
     }
 
     /// @returns the storage overlay as a simple hash map.
-    std::unordered_map<u256, u256> const& storageOverlay() const { return m_storageOverlay; }
+    FlatHashMap<u256, u256> const& storageOverlay() const { return m_storageOverlay; }
 
     /// Set a key/value pair in the account's storage. This actually goes into the overlay, for committing
     /// to the trie later.
@@ -120,16 +121,16 @@ public:
 
     void setNewCode(bytes&& _code)
     {
-        m_codeCache = std::move(_code);
+        m_codeCache = std::make_shared<bytes const>(std::move(_code));
         m_hasNewCode = true;
-        m_codeHash = sha3(m_codeCache);
+        m_codeHash = sha3(*m_codeCache);
     }
 
 
     /// Reset the code set by previous CREATE message.
     void resetCode()
     {
-        m_codeCache.clear();
+        m_codeCache.reset();
         m_hasNewCode = false;
         m_codeHash = EmptySHA3;
     }
@@ -139,11 +140,22 @@ public:
     void noteCode(bytesConstRef _code)
     {
         assert(sha3(_code) == m_codeHash);
-        m_codeCache = _code.toBytes();
+        m_codeCache = std::make_shared<bytes const>(_code.toBytes());
+    }
+
+    /// Same as above, sharing @a _code instead of copying it. @a _code comes from CodeCache, which is
+    /// keyed by the hash, so it is not hashed again here.
+    void noteCode(std::shared_ptr<bytes const> const& _code)
+    {
+        assert(_code);
+        m_codeCache = _code;
     }
 
     /// @returns the account's code.
-    bytes const& code() const { return m_codeCache; }
+    bytes const& code() const { return m_codeCache ? *m_codeCache : NullBytes; }
+
+    /// @returns the account's code as held by the account; null if it has none or it is not loaded yet.
+    std::shared_ptr<bytes const> const& sharedCode() const { return m_codeCache; }
 
 private:
     /// Note that we've altered the account.
@@ -177,11 +189,11 @@ private:
     h256 m_codeHash = EmptySHA3;
 
     /// The map with is overlaid onto whatever storage is implied by the m_storageRoot in the trie.
-    std::unordered_map<u256, u256> m_storageOverlay;
+    FlatHashMap<u256, u256> m_storageOverlay;
 
     /// The associated code for this account. The SHA3 of this should be equal to m_codeHash unless m_codeHash
-    /// equals c_contractConceptionCodeHash.
-    bytes m_codeCache;
+    /// equals c_contractConceptionCodeHash. Immutable and shared with CodeCache and copies of the account.
+    std::shared_ptr<bytes const> m_codeCache;
 
     /// Value for m_codeHash when this account is having its code determined.
     static const h256 c_contractConceptionCodeHash;
@@ -225,7 +237,7 @@ private:
     bool m_shouldNotExist = false;
 };
 
-using AccountMap = std::unordered_map<Address, Account>;
+using AccountMap = FlatHashMap<Address, Account>;
 } // namespace sc
 
 #endif // FABCOIN_SCACCOUNT_HPP
@@ -0,0 +1,267 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "sccallindex.h"
+
+#include "chainparams.h"
+#include "init.h"
+#include "streams.h"
+#include "util.h"
+#include "utilstrencodings.h"
+#include "validation.h"
+#include "scface.h"
+
+#include <boost/thread.hpp>
+
+static const char DB_CONTRACT_CALL = 'c';
+static const char DB_SENDER_CALL = 's';
+static const char DB_BEST_BLOCK = 'B';
+
+CContractCallIndex* pcontractcallindex = nullptr;
+
+namespace {
+
+/** Position of a call in the chain. The height is big endian so LevelDB keeps an address' calls in chain order. */
+struct CallPos
+{
+    uint32_t nHeight;
+    uint256 txid;
+    uint32_t nOut;
+
+    CallPos() : nHeight(0), nOut(0) {}
+    CallPos(uint32_t nHeightIn, const uint256& txidIn, uint32_t nOutIn) : nHeight(nHeightIn), txid(txidIn), nOut(nOutIn) {}
+
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        ser_writedata32be(s, nHeight);
+        s << txid;
+        ser_writedata32be(s, nOut);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        nHeight = ser_readdata32be(s);
+        s >> txid;
+        nOut = ser_readdata32be(s);
+    }
+};
+
+struct CallKey
+{
+    char prefix;
+    sc::h160 address;
+    CallPos pos;
+
+    CallKey() : prefix(0) {}
+    CallKey(char prefixIn, const sc::h160& addressIn, const CallPos& posIn) : prefix(prefixIn), address(addressIn), pos(posIn) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(prefix);
+        READWRITE(address);
+        READWRITE(pos);
+    }
+};
+
+struct CallValue
+{
+    sc::h160 other; //!< The sender under DB_CONTRACT_CALL, the contract under DB_SENDER_CALL
+    std::vector<unsigned char> selector;
+    bool fCreate;
+
+    CallValue() : fCreate(false) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(other);
+        READWRITE(selector);
+        READWRITE(fCreate);
+    }
+};
+
+std::string EncodeCursor(const CallPos& pos)
+{
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << pos;
+    return HexStr(ss.begin(), ss.end());
+}
+
+bool DecodeCursor(const std::string& strCursor, CallPos& pos)
+{
+    if (!IsHex(strCursor))
+        return false;
+    std::vector<unsigned char> data = ParseHex(strCursor);
+    CDataStream ss(data, SER_DISK, CLIENT_VERSION);
+    try {
+        ss >> pos;
+    } catch (const std::exception&) {
+        return false;
+    }
+    return ss.empty();
+}
+
+} // namespace
+
+CContractCallIndex::CContractCallIndex(size_t nCacheSize, bool fMemory, bool fWipe) : m_db(GetDataDir() / "contracts", nCacheSize, fMemory, fWipe), m_synced(false)
+{
+}
+
+bool CContractCallIndex::WriteBlock(const CBlock& block, const CBlockIndex* pindex, bool fConnect)
+{
+    CDBBatch batch(m_db);
+    SmartContract smct;
+    for (const auto& tx : block.vtx) {
+        if (!tx->HasCreateOrCall())
+            continue;
+        const uint256 txid = tx->GetHash();
+        for (uint32_t n = 0; n < tx->vout.size(); n++) {
+            if (!smct.ParseContractOutput(tx->vout[n].scriptPubKey))
+                continue;
+            const CallPos pos(pindex->nHeight, txid, n);
+            const CallKey contractKey(DB_CONTRACT_CALL, smct.contractAddress, pos);
+            const CallKey senderKey(DB_SENDER_CALL, smct.callerAddress, pos);
+            if (!fConnect) {
+                batch.Erase(contractKey);
+                batch.Erase(senderKey);
+                continue;
+            }
+            CallValue value;
+            value.fCreate = smct.flag == ISCREATE;
+            if (!value.fCreate)
+                value.selector.assign(smct.datahex.begin(), smct.datahex.begin() + std::min<size_t>(4, smct.datahex.size()));
+            value.other = smct.callerAddress;
+            batch.Write(contractKey, value);
+            value.other = smct.contractAddress;
+            batch.Write(senderKey, value);
+        }
+    }
+    const CBlockIndex* pindexBest = fConnect ? pindex : pindex->pprev;
+    if (pindexBest)
+        batch.Write(DB_BEST_BLOCK, pindexBest->GetBlockHash());
+    else
+        batch.Erase(DB_BEST_BLOCK);
+    return m_db.WriteBatch(batch);
+}
+
+bool CContractCallIndex::ListCalls(Role role, const sc::h160& address, unsigned int nCount, const std::string& strCursor,
+    std::vector<CContractCall>& vCalls, std::string& strNextCursor) const
+{
+    const char prefix = role == Role::Contract ? DB_CONTRACT_CALL : DB_SENDER_CALL;
+    CallPos start;
+    if (!strCursor.empty() && !DecodeCursor(strCursor, start))
+        return false;
+
+    strNextCursor.clear();
+    std::unique_ptr<CDBIterator> pcursor(const_cast<CDBWrapper&>(m_db).NewIterator());
+    for (pcursor->Seek(CallKey(prefix, address, start)); pcursor->Valid(); pcursor->Next()) {
+        CallKey key;
+        if (!pcursor->GetKey(key) || key.prefix != prefix || key.address != address)
+            break;
+        if (vCalls.size() == nCount) {
+            strNextCursor = EncodeCursor(key.pos);
+            break;
+        }
+        CallValue value;
+        if (!pcursor->GetValue(value))
+            return error("%s: failed to read call %s:%u", __func__, key.pos.txid.ToString(), key.pos.nOut);
+
+        CContractCall call;
+        call.nHeight = key.pos.nHeight;
+        call.txid = key.pos.txid;
+        call.nOut = key.pos.nOut;
+        call.contract = role == Role::Contract ? address : value.other;
+        call.sender = role == Role::Contract ? value.other : address;
+        call.selector = std::move(value.selector);
+        call.fCreate = value.fCreate;
+        vCalls.push_back(std::move(call));
+    }
+    return true;
+}
+
+void CContractCallIndex::BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted)
+{
+    if (m_synced && !WriteBlock(*block, pindex, true))
+        LogPrintf("%s: failed to index contract calls of block %s\n", __func__, pindex->GetBlockHash().ToString());
+}
+
+void CContractCallIndex::BlockDisconnected(const std::shared_ptr<const CBlock>& block)
+{
+    if (!m_synced)
+        return;
+    LOCK(cs_main);
+    BlockMap::const_iterator it = mapBlockIndex.find(block->GetHash());
+    if (it == mapBlockIndex.end() || !WriteBlock(*block, it->second, false))
+        LogPrintf("%s: failed to remove contract calls of block %s\n", __func__, block->GetHash().ToString());
+}
+
+void CContractCallIndex::ThreadSync()
+{
+    RenameThread("ybtc-callindex");
+    const CChainParams& chainparams = Params();
+
+    const CBlockIndex* pindex = nullptr;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (m_db.Read(DB_BEST_BLOCK, hashBest)) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it != mapBlockIndex.end())
+                pindex = it->second;
+        }
+        LogPrintf("Building contract call index from height %d\n", pindex ? pindex->nHeight + 1 : 0);
+    }
+
+    int64_t nLastLog = GetTime();
+    while (true) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return;
+
+        const CBlockIndex* pnext;
+        bool fConnect = true;
+        {
+            LOCK(cs_main);
+            if (pindex && !chainActive.Contains(pindex)) {
+                // The last indexed block was reorganized away; take its calls out first.
+                pnext = pindex;
+                fConnect = false;
+            } else {
+                pnext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+                if (!pnext) {
+                    // Caught up; the validation interface callbacks take it from here.
+                    m_synced = true;
+                    LogPrintf("Contract call index is synced at height %d\n", pindex ? pindex->nHeight : -1);
+                    return;
+                }
+            }
+        }
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pnext, chainparams.GetConsensus())) {
+            LogPrintf("%s: failed to read block %s, contract call index not built\n", __func__, pnext->GetBlockHash().ToString());
+            return;
+        }
+        if (!WriteBlock(block, pnext, fConnect)) {
+            LogPrintf("%s: failed to write contract calls of block %s\n", __func__, pnext->GetBlockHash().ToString());
+            return;
+        }
+        pindex = fConnect ? pnext : pnext->pprev;
+
+        if (GetTime() - nLastLog >= 30) {
+            LogPrintf("Contract call index built up to height %d\n", pindex ? pindex->nHeight : -1);
+            nLastLog = GetTime();
+        }
+    }
+}
+
+void CContractCallIndex::Start(boost::thread_group& threadGroup)
+{
+    threadGroup.create_thread(boost::bind(&CContractCallIndex::ThreadSync, this));
+}
@@ -0,0 +1,88 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef FABCOIN_SCCALLINDEX_HPP
+#define FABCOIN_SCCALLINDEX_HPP
+
+#include "dbwrapper.h"
+#include "scfixedhash.h"
+#include "uint256.h"
+#include "validationinterface.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+class CBlock;
+
+namespace boost {
+class thread_group;
+} // namespace boost
+
+//! Maximum number of calls returned per page by getcontractcalls and /rest/contractcalls
+static const unsigned int MAX_CONTRACT_CALLS_PAGE = 1000;
+
+/** One OP_CREATE or OP_CALL output of the active chain */
+struct CContractCall
+{
+    int nHeight;
+    uint256 txid;
+    uint32_t nOut;
+    sc::h160 contract;
+    sc::h160 sender;
+    std::vector<unsigned char> selector; //!< First 4 bytes of the call data, empty for OP_CREATE
+    bool fCreate;
+
+    CContractCall() : nHeight(0), nOut(0), fCreate(false) {}
+};
+
+/**
+ * Optional index of contract calls (-contractindex), stored under contracts/.
+ *
+ * Every call is indexed twice: by contract and by sender, each time under a key
+ * of address, big endian height, txid and output, so the calls of one address
+ * are adjacent and in chain order and can be paged through with a cursor.
+ * Blocks connected before the index was enabled are indexed by a background
+ * thread; once it has caught up, BlockConnected/BlockDisconnected keep it in
+ * step with chainActive.
+ */
+class CContractCallIndex final : public CValidationInterface
+{
+public:
+    enum class Role {
+        Contract,
+        Sender
+    };
+
+    explicit CContractCallIndex(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    /**
+     * Up to nCount calls of address in the given role, oldest first, starting at
+     * strCursor (empty for the first page). strNextCursor is set to resume after
+     * the last returned call, or cleared if there are no more.
+     */
+    bool ListCalls(Role role, const sc::h160& address, unsigned int nCount, const std::string& strCursor,
+        std::vector<CContractCall>& vCalls, std::string& strNextCursor) const;
+
+    bool IsSynced() const { return m_synced; }
+
+    /** Start the thread that indexes the blocks connected before -contractindex was enabled */
+    void Start(boost::thread_group& threadGroup);
+
+protected:
+    void BlockConnected(const std::shared_ptr<const CBlock>& block, const CBlockIndex* pindex, const std::vector<CTransactionRef>& txnConflicted) override;
+    void BlockDisconnected(const std::shared_ptr<const CBlock>& block) override;
+
+private:
+    void ThreadSync();
+    bool WriteBlock(const CBlock& block, const CBlockIndex* pindex, bool fConnect);
+
+    CDBWrapper m_db;
+    std::atomic<bool> m_synced;
+};
+
+/** The contract call index, null unless -contractindex is set */
+extern CContractCallIndex* pcontractcallindex;
+
+#endif // FABCOIN_SCCALLINDEX_HPP
@@ -59,4 +59,121 @@ u256 fromAddress(Address _a)
     return (u160)_a;
 }
 
+// ============= CodeCache ==============
+
+size_t CodeCache::memoryOf(Entry const& _e)
+{
+    return c_entryOverhead + (_e.code ? _e.code->size() : 0) + _e.analysisSize;
+}
+
+std::shared_ptr<bytes const> CodeCache::code(h256 const& _hash)
+{
+    Shard& s = shard(_hash);
+    UniqueGuard g(s.x_shard);
+    auto it = s.entries.find(_hash);
+    if (it == s.entries.end() || !it->second.code) {
+        ++s.misses;
+        return nullptr;
+    }
+    ++s.hits;
+    return it->second.code;
+}
+
+bool CodeCache::size(h256 const& _hash, size_t& o_size)
+{
+    Shard& s = shard(_hash);
+    UniqueGuard g(s.x_shard);
+    auto it = s.entries.find(_hash);
+    if (it == s.entries.end() || !it->second.code)
+        return false;
+    o_size = it->second.code->size();
+    return true;
+}
+
+void CodeCache::storeCode(h256 const& _hash, std::shared_ptr<bytes const> const& _code)
+{
+    Shard& s = shard(_hash);
+    UniqueGuard g(s.x_shard);
+    auto it = s.entries.emplace(_hash, Entry()).first;
+    if (it->second.code)
+        return;
+    s.memory -= std::min(s.memory, memoryOf(it->second));
+    it->second.code = _code;
+    s.memory += memoryOf(it->second);
+    shrink(s, it);
+}
+
+std::shared_ptr<CodeAnalysis const> CodeCache::analysis(h256 const& _hash)
+{
+    Shard& s = shard(_hash);
+    UniqueGuard g(s.x_shard);
+    auto it = s.entries.find(_hash);
+    if (it == s.entries.end()) {
+        it = s.entries.emplace(_hash, Entry()).first;
+        s.memory += memoryOf(it->second);
+        shrink(s, it);
+    }
+    if (it->second.analysis)
+        return it->second.analysis;
+    ++it->second.executions;
+    return nullptr;
+}
+
+void CodeCache::storeAnalysis(h256 const& _hash, std::shared_ptr<CodeAnalysis const> const& _analysis, size_t _size)
+{
+    Shard& s = shard(_hash);
+    UniqueGuard g(s.x_shard);
+    auto it = s.entries.find(_hash);
+    if (it == s.entries.end() || it->second.analysis || it->second.executions < c_hotThreshold)
+        return;
+    it->second.analysis = _analysis;
+    it->second.analysisSize = _size;
+    s.memory += _size;
+    shrink(s, it);
+}
+
+void CodeCache::shrink(Shard& _shard, std::map<h256, Entry>::iterator _keep)
+{
+    size_t const cap = m_maxMemory / c_shards;
+    auto it = std::next(_keep);
+    while (_shard.memory > cap && _shard.entries.size() > 1) {
+        if (it == _shard.entries.end())
+            it = _shard.entries.begin();
+        if (it == _keep) {
+            ++it;
+            continue;
+        }
+        _shard.memory -= std::min(_shard.memory, memoryOf(it->second));
+        it = _shard.entries.erase(it);
+        ++_shard.evictions;
+    }
+}
+
+void CodeCache::setMaxMemory(size_t _bytes)
+{
+    m_maxMemory = _bytes;
+    for (Shard& s : m_shards) {
+        UniqueGuard g(s.x_shard);
+        if (!s.entries.empty())
+            shrink(s, s.entries.begin());
+    }
+}
+
+CodeCache::Stats CodeCache::stats() const
+{
+    Stats ret;
+    ret.maxMemory = m_maxMemory;
+    for (Shard const& s : m_shards) {
+        UniqueGuard g(s.x_shard);
+        ret.entries += s.entries.size();
+        for (auto const& i : s.entries)
+            ret.analyses += i.second.analysis ? 1 : 0;
+        ret.memory += s.memory;
+        ret.hits += s.hits;
+        ret.misses += s.misses;
+        ret.evictions += s.evictions;
+    }
+    return ret;
+}
+
 } // namespace sc
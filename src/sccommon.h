@@ -9,6 +9,8 @@
 #include "uint256.h"
 #include "scfixedhash.h"
 
+#include <array>
+
 namespace sc
 {
 
@@ -217,54 +219,83 @@ private:
     for (GenericUnguardBool<SharedMutex> __eth_l(MUTEX); __eth_l.b; __eth_l.b = false)
 
 
-// =========== CodeSizeCache =========
+// =========== CodeCache =========
+struct CodeAnalysis;
+
 /**
- * @brief Simple thread-safe cache to store a mapping from code hash to code size.
- * If the cache is full, a random element is removed.
+ * @brief Process-wide cache of contract code keyed by code hash.
+ * Holds the immutable code bytes and, once a code hash is hot, its VM analysis
+ * (see VM::initEntry). Both are reference-counted, so Accounts in different
+ * State instances and concurrent VMs share one copy.
+ * Entries are spread over c_shards shards with a lock each; a shard that goes
+ * over its part of the memory cap evicts entries next to the one being added,
+ * which is as good as random since the keys are hashes.
  */
-class CodeSizeCache
+class CodeCache
 {
 public:
-    void store(h256 const& _hash, size_t size)
-    {
-        UniqueGuard g(x_cache);
-        if (m_cache.size() >= c_maxSize)
-            removeRandomElement();
-        m_cache[_hash] = size;
-    }
-    bool contains(h256 const& _hash) const
+    struct Stats {
+        size_t entries = 0;
+        size_t analyses = 0;
+        size_t memory = 0;
+        size_t maxMemory = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    /// @returns the code with hash @a _hash or null.
+    std::shared_ptr<bytes const> code(h256 const& _hash);
+    /// @returns true and sets @a o_size if the code with hash @a _hash is cached.
+    bool size(h256 const& _hash, size_t& o_size);
+    void storeCode(h256 const& _hash, std::shared_ptr<bytes const> const& _code);
+
+    /// @returns the analysis of @a _hash or null, and counts the execution.
+    std::shared_ptr<CodeAnalysis const> analysis(h256 const& _hash);
+    /// Keep @a _analysis of @a _hash, taking @a _size bytes, if the code hash is hot.
+    void storeAnalysis(h256 const& _hash, std::shared_ptr<CodeAnalysis const> const& _analysis, size_t _size);
+
+    void setMaxMemory(size_t _bytes);
+    Stats stats() const;
+
+    static CodeCache& instance()
     {
-        UniqueGuard g(x_cache);
-        return m_cache.count(_hash);
-    }
-    size_t get(h256 const& _hash) const
-    {
-        UniqueGuard g(x_cache);
-        return m_cache.at(_hash);
-    }
-
-    static CodeSizeCache& instance()
-    {
-        static CodeSizeCache cache;
+        static CodeCache cache;
         return cache;
     }
 
-private:
-    /// Removes a random element from the cache.
-    void removeRandomElement()
-    {
-        if (!m_cache.empty()) {
-            auto it = m_cache.lower_bound(h256::random());
-            if (it == m_cache.end())
-                it = m_cache.begin();
-            m_cache.erase(it);
-        }
-    }
+    static const size_t c_defaultMaxMemory = 32 << 20;
 
-    static const size_t c_maxSize = 50000;
-    mutable Mutex x_cache;
-    std::map<h256, size_t> m_cache;
+private:
+    struct Entry {
+        std::shared_ptr<bytes const> code;
+        std::shared_ptr<CodeAnalysis const> analysis;
+        size_t analysisSize = 0;
+        unsigned executions = 0;
+    };
+    struct Shard {
+        mutable Mutex x_shard;
+        std::map<h256, Entry> entries;
+        size_t memory = 0;
+        uint64_t hits = 0;
+        uint64_t misses = 0;
+        uint64_t evictions = 0;
+    };
+
+    Shard& shard(h256 const& _hash) { return m_shards[_hash[0] % c_shards]; }
+    /// Evicts entries of @a _shard other than @a _keep until it fits its part of the cap.
+    void shrink(Shard& _shard, std::map<h256, Entry>::iterator _keep);
+    static size_t memoryOf(Entry const& _e);
+
+    static const unsigned c_shards = 16;
+    static const unsigned c_hotThreshold = 2;
+    /// Map node and control block overhead per entry.
+    static const size_t c_entryOverhead = 128;
+
+    std::array<Shard, c_shards> m_shards;
+    std::atomic<size_t> m_maxMemory{c_defaultMaxMemory};
 };
+
 /// Interprets @a _u as a two's complement signed number and returns the resulting s256.
 inline s256 u2s(u256 _u)
 {
@@ -252,6 +252,7 @@ MemoryDB& MemoryDB::operator=(MemoryDB const& _c)
 #endif
     m_main = _c.m_main;
     m_aux = _c.m_aux;
+    m_memory = _c.m_memory;
     return *this;
 }
 
@@ -288,10 +289,14 @@ void MemoryDB::insert(h256 const& _h, bytesConstRef _v)
 #endif
     auto it = m_main.find(_h);
     if (it != m_main.end()) {
+        m_memory -= it->second.first.size();
         it->second.first = _v.toString();
         it->second.second++;
-    } else
+    } else {
         m_main[_h] = make_pair(_v.toString(), 1);
+        m_memory += sizeof(void*) + sizeof(std::pair<h256 const, std::pair<std::string, unsigned>>);
+    }
+    m_memory += _v.size();
 #if ETH_PARANOIA
     dbdebug << "INST" << _h << "=>" << m_main[_h].second;
 #endif
@@ -300,7 +305,7 @@ void MemoryDB::insert(h256 const& _h, bytesConstRef _v)
 bool MemoryDB::kill(h256 const& _h)
 {
 #if DEV_GUARDED_DB
-    ReadGuard l(x_this);
+    WriteGuard l(x_this);
 #endif
     if (m_main.count(_h)) {
         if (m_main[_h].second > 0) {
@@ -345,7 +350,13 @@ void MemoryDB::insertAux(h256 const& _h, bytesConstRef _v)
 #if DEV_GUARDED_DB
     WriteGuard l(x_this);
 #endif
+    auto it = m_aux.find(_h);
+    if (it != m_aux.end())
+        m_memory -= it->second.first.size();
+    else
+        m_memory += sizeof(void*) + sizeof(std::pair<h256 const, std::pair<bytes, bool>>);
     m_aux[_h] = make_pair(_v.toBytes(), true);
+    m_memory += _v.size();
 }
 
 void MemoryDB::purge()
@@ -357,15 +368,19 @@ void MemoryDB::purge()
     for (auto it = m_main.begin(); it != m_main.end();)
         if (it->second.second)
             ++it;
-        else
+        else {
+            m_memory -= sizeof(void*) + sizeof(*it) + it->second.first.size();
             it = m_main.erase(it);
+        }
 
     // purge m_aux
     for (auto it = m_aux.begin(); it != m_aux.end();)
         if (it->second.second)
             ++it;
-        else
+        else {
+            m_memory -= sizeof(void*) + sizeof(*it) + it->second.first.size();
             it = m_aux.erase(it);
+        }
 }
 
 h256Hash MemoryDB::keys() const
@@ -380,6 +395,22 @@ h256Hash MemoryDB::keys() const
     return ret;
 }
 
+size_t MemoryDB::size() const
+{
+#if DEV_GUARDED_DB
+    ReadGuard l(x_this);
+#endif
+    return m_main.size() + m_aux.size();
+}
+
+size_t MemoryDB::memoryUsage() const
+{
+#if DEV_GUARDED_DB
+    ReadGuard l(x_this);
+#endif
+    return m_memory + (m_main.bucket_count() + m_aux.bucket_count()) * sizeof(void*);
+}
+
 // ====== OverlayDB  =======
 
 
@@ -389,63 +420,143 @@ OverlayDB::~OverlayDB()
         ctrace << "Closing state DB";
 }
 
-class WriteBatchNoter : public ldb::WriteBatch::Handler
+OverlayDB OverlayDB::fork(OverlayDB const& _base)
 {
-    virtual void Put(ldb::Slice const& _key, ldb::Slice const& _value) { cnote << "Put" << toHex(bytesConstRef(_key)) << "=>" << toHex(bytesConstRef(_value)); }
-    virtual void Delete(ldb::Slice const& _key) {  cnote << "Delete" << toHex(bytesConstRef(_key));}
-};
+    OverlayDB ret;
+    ret.m_base = &_base;
+    return ret;
+}
 
-void OverlayDB::commit()
+OverlayDB::Stats OverlayDB::stats() const
 {
-    if (m_db) {
-        ldb::WriteBatch batch;
-        //		cnote << "Committing nodes to disk DB:";
+    Stats ret;
+    ret.nodes = size();
+    ret.memory = memoryUsage();
+    if (std::shared_ptr<Frozen const> frozen = this->frozen())
+        ret.frozenNodes = frozen->main.size() + frozen->aux.size();
 #if DEV_GUARDED_DB
-        DEV_READ_GUARDED(x_this)
+    ReadGuard l(x_this);
 #endif
-        {
-            for (auto const& i : m_main) {
-                if (i.second.second)
-                    batch.Put(ldb::Slice((char const*)i.first.data(), i.first.size), ldb::Slice(i.second.first.data(), i.second.first.size()));
-                //				cnote << i.first << "#" << m_main[i.first].second;
-            }
-            for (auto const& i : m_aux)
-                if (i.second.second) {
-                    bytes b = i.first.asBytes();
-                    b.push_back(255); // for aux
-                    batch.Put(bytesConstRef(&b), bytesConstRef(&i.second.first));
-                }
-        }
+    ret.commits = m_commits;
+    ret.committedNodes = m_committedNodes;
+    ret.committedBytes = m_committedBytes;
+    return ret;
+}
 
-        for (unsigned i = 0; i < 10; ++i) {
-            ldb::Status o = m_db->Write(m_writeOptions, &batch);
-            if (o.ok())
-                break;
-            if (i == 9) {
-                cwarn << "Fail writing to state database. Bombing out.";
-                exit(-1);
-            }
-            cwarn << "Error writing to state database: " << o.ToString();
-            WriteBatchNoter n;
-            batch.Iterate(&n);
-            cwarn << "Sleeping for" << (i + 1) << "seconds, then retrying.";
-            std::this_thread::sleep_for(std::chrono::seconds(i + 1));
-        }
+size_t OverlayDB::memoryUsage() const
+{
+    std::shared_ptr<Frozen const> frozen = this->frozen();
+    return MemoryDB::memoryUsage() + (frozen ? frozen->memory : 0);
+}
+
+bool OverlayDB::commit()
+{
+    if (!m_db)
+        return true;
+    freeze();
+    if (!writeFrozen())
+        return false;
+    releaseFrozen();
+    return true;
+}
+
+void OverlayDB::freeze()
+{
+    if (!m_db)
+        return;
+    auto frozen = std::make_shared<Frozen>();
 #if DEV_GUARDED_DB
-        DEV_WRITE_GUARDED(x_this)
+    WriteGuard l(x_this);
 #endif
-        {
-            m_aux.clear();
-            m_main.clear();
+    assert(!m_frozen);
+    if (m_main.empty() && m_aux.empty())
+        return;
+    frozen->main.swap(m_main);
+    frozen->aux.swap(m_aux);
+    frozen->memory = m_memory + (frozen->main.bucket_count() + frozen->aux.bucket_count()) * sizeof(void*);
+    m_memory = 0;
+    m_frozen = frozen;
+}
+
+bool OverlayDB::writeFrozen()
+{
+    std::shared_ptr<Frozen const> frozen = this->frozen();
+    if (!frozen)
+        return true;
+    ldb::WriteBatch batch;
+    uint64_t nodes = 0;
+    uint64_t size = 0;
+    // Nodes whose refcount dropped to zero are written too: lookups still serve
+    // them, and the root of a block a reorg goes back to can need them
+    for (auto const& i : frozen->main) {
+        batch.Put(ldb::Slice((char const*)i.first.data(), i.first.size), ldb::Slice(i.second.first.data(), i.second.first.size()));
+        size += i.first.size + i.second.first.size();
+        nodes++;
+    }
+    for (auto const& i : frozen->aux)
+        if (i.second.second) {
+            bytes b = i.first.asBytes();
+            b.push_back(255); // for aux
+            batch.Put(bytesConstRef(&b), bytesConstRef(&i.second.first));
+            size += b.size() + i.second.first.size();
+            nodes++;
         }
+
+    // Synced, so that whatever is written after it (the best block of the
+    // coins DB) never names a state root that is not on disk
+    ldb::WriteOptions o = m_writeOptions;
+    o.sync = true;
+    ldb::Status status = m_db->Write(o, &batch);
+    if (!status.ok()) {
+        cwarn << "Error writing to state database: " << status.ToString();
+        return false;
+    }
+#if DEV_GUARDED_DB
+    WriteGuard l(x_this);
+#endif
+    m_commits++;
+    m_committedNodes += nodes;
+    m_committedBytes += size;
+    return true;
+}
+
+void OverlayDB::releaseFrozen()
+{
+    std::shared_ptr<Frozen const> frozen;
+    {
+#if DEV_GUARDED_DB
+        WriteGuard l(x_this);
+#endif
+        frozen.swap(m_frozen);
     }
+    // The nodes are freed here, outside the guard
+}
+
+bool OverlayDB::hasFrozen() const
+{
+    return !!frozen();
+}
+
+std::shared_ptr<OverlayDB::Frozen const> OverlayDB::frozen() const
+{
+#if DEV_GUARDED_DB
+    ReadGuard l(x_this);
+#endif
+    return m_frozen;
 }
 
 bytes OverlayDB::lookupAux(h256 const& _h) const
 {
     bytes ret = MemoryDB::lookupAux(_h);
+    if (ret.empty() && m_base)
+        return m_base->lookupAux(_h);
     if (!ret.empty() || !m_db)
         return ret;
+    if (std::shared_ptr<Frozen const> frozen = this->frozen()) {
+        auto it = frozen->aux.find(_h);
+        if (it != frozen->aux.end() && it->second.second)
+            return it->second.first;
+    }
     std::string v;
     
     bytes b = _h.asBytes();
@@ -461,12 +572,23 @@ void OverlayDB::rollback()
 #if DEV_GUARDED_DB
     WriteGuard l(x_this);
 #endif
+    for (auto const& i : m_main)
+        m_memory -= sizeof(void*) + sizeof(i) + i.second.first.size();
     m_main.clear();
 }
 
 std::string OverlayDB::lookup(h256 const& _h) const
 {
     std::string ret = MemoryDB::lookup(_h);
+    if (ret.empty() && m_base)
+        return m_base->lookup(_h);
+    if (ret.empty()) {
+        if (std::shared_ptr<Frozen const> frozen = this->frozen()) {
+            auto it = frozen->main.find(_h);
+            if (it != frozen->main.end())
+                return it->second.first;
+        }
+    }
     if (ret.empty() && m_db)
         m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
     return ret;
@@ -476,6 +598,11 @@ bool OverlayDB::exists(h256 const& _h) const
 {
     if (MemoryDB::exists(_h))
         return true;
+    if (m_base)
+        return m_base->exists(_h);
+    if (std::shared_ptr<Frozen const> frozen = this->frozen())
+        if (frozen->main.count(_h))
+            return true;
     std::string ret;
     if (m_db)
         m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
@@ -484,21 +611,10 @@ bool OverlayDB::exists(h256 const& _h) const
 
 void OverlayDB::kill(h256 const& _h)
 {
-#if ETH_PARANOIA || 1
-    if (!MemoryDB::kill(_h)) {
-        std::string ret;
-        if (m_db)
-            m_db->Get(m_readOptions, ldb::Slice((char const*)_h.data(), 32), &ret);
-        // No point node ref decreasing for EmptyTrie since we never bother incrementing it in the first place for
-        // empty storage tries.
-        if (ret.empty() && _h != EmptyTrie)
-            cnote << "Decreasing DB node ref count below zero with no DB node. Probably have a corrupt Trie." << _h;
-
-        // TODO: for 1.1: ref-counted triedb.
-    }
-#else
+    // Only the refcount of a node held in memory drops. Nodes of the base and
+    // on disk are kept: commit never deletes, so the state roots of the blocks
+    // a reorg goes back to stay readable.
     MemoryDB::kill(_h);
-#endif
 }
 
 bool OverlayDB::deepkill(h256 const& _h)
@@ -5,6 +5,12 @@
 #include "scrlp.h"
 #include "scsha3.h"
 
+// The node maps are locked: block assembly reads the nodes of pState through a
+// fork (OverlayDB::fork) while block validation adds to them
+#ifndef DEV_GUARDED_DB
+#define DEV_GUARDED_DB 1
+#endif
+
 namespace sc
 {
 
@@ -493,6 +499,7 @@ public:
     {
         m_main.clear();
         m_aux.clear();
+        m_memory = 0;
     } // WARNING !!!! didn't originally clear m_refCount!!!
     std::unordered_map<h256, std::string> get() const;
 
@@ -508,12 +515,18 @@ public:
 
     h256Hash keys() const;
 
+    /// Number of nodes and aux entries held in memory.
+    size_t size() const;
+    /// Estimated bytes used by the nodes and aux entries held in memory.
+    size_t memoryUsage() const;
+
 protected:
 #if DEV_GUARDED_DB
     mutable SharedMutex x_this;
 #endif
     std::unordered_map<h256, std::pair<std::string, unsigned>> m_main;
     std::unordered_map<h256, std::pair<bytes, bool>> m_aux;
+    size_t m_memory = 0; ///< Bytes of the entries of m_main and m_aux, without the buckets
 
     mutable bool m_enforceRefs = false;
 };
@@ -549,11 +562,40 @@ public:
     OverlayDB(ldb::DB* _db = nullptr) : m_db(_db) {}
     ~OverlayDB();
 
+    /// An empty overlay whose lookups fall through to _base, which must outlive it.
+    /// Nodes inserted into the fork stay in it: committing it writes nothing.
+    static OverlayDB fork(OverlayDB const& _base);
+
     ldb::DB* db() const { return m_db.get(); }
 
-    void commit();
+    struct Stats {
+        size_t nodes = 0;           ///< Nodes and aux entries held in memory
+        size_t memory = 0;          ///< Estimated bytes they use, frozen ones included
+        size_t frozenNodes = 0;     ///< Nodes and aux entries frozen for a write
+        uint64_t commits = 0;       ///< Writes to the disk DB
+        uint64_t committedNodes = 0;
+        uint64_t committedBytes = 0;
+    };
+    Stats stats() const;
+    /// Estimated bytes used by the nodes in memory, frozen ones included.
+    size_t memoryUsage() const;
+
+    /// Writes every node held in memory to the disk DB as one synced batch, then
+    /// drops them from memory. Nothing is ever deleted from the disk DB, so the
+    /// root of each block committed so far stays readable. @returns false if the
+    /// write failed, in which case the nodes stay in memory.
+    bool commit();
     void rollback();
 
+    /// commit() in three steps, so that the write runs while new nodes come in:
+    /// freeze() moves the nodes held in memory to a frozen layer that lookups
+    /// still read, writeFrozen() writes that layer and releaseFrozen() drops it
+    /// once written. Only one layer can be frozen at a time.
+    void freeze();
+    bool writeFrozen();
+    void releaseFrozen();
+    bool hasFrozen() const;
+
     std::string lookup(h256 const& _h) const;
     bool exists(h256 const& _h) const;
     void kill(h256 const& _h);
@@ -564,7 +606,20 @@ public:
 private:
     using MemoryDB::clear;
 
+    struct Frozen {
+        std::unordered_map<h256, std::pair<std::string, unsigned>> main;
+        std::unordered_map<h256, std::pair<bytes, bool>> aux;
+        size_t memory = 0;
+    };
+    std::shared_ptr<Frozen const> frozen() const;
+
     std::shared_ptr<ldb::DB> m_db;
+    OverlayDB const* m_base = nullptr;
+    std::shared_ptr<Frozen const> m_frozen; ///< Guarded by x_this
+
+    uint64_t m_commits = 0;
+    uint64_t m_committedNodes = 0;
+    uint64_t m_committedBytes = 0;
 
     ldb::ReadOptions m_readOptions;
     ldb::WriteOptions m_writeOptions;
@@ -716,6 +771,9 @@ enum class Verification {
     Normal
 };
 
+/// Upper bound of an encoded branch node: 16 child hashes, a value hash and the list header.
+static const size_t c_trieBranchReserve = 17 * 33 + 3;
+
 /**
  * @brief Merkle Patricia Tree "Trie": a modifed base-16 Radix tree.
  * This version uses a database backend.
@@ -1518,7 +1576,7 @@ bytes GenericTrieDB<DB>::mergeAt(RLP const& _orig, h256 const& _origHash, Nibble
             RLPStream s(2);
             s.append(_orig[0]);
             mergeAtAux(s, _orig[1], _k.mid(k.size()), _v);
-            return s.out();
+            return s.invalidate();
         }
 
         auto sh = _k.shared(k);
@@ -1545,13 +1603,13 @@ bytes GenericTrieDB<DB>::mergeAt(RLP const& _orig, h256 const& _origHash, Nibble
 
         // not exactly our node - delve to next level at the correct index.
         byte n = _k[0];
-        RLPStream r(17);
+        RLPStream r(17, c_trieBranchReserve);
         for (byte i = 0; i < 17; ++i)
             if (i == n)
                 mergeAtAux(r, _orig[i], _k.mid(1), _v);
             else
                 r.append(_orig[i]);
-        return r.out();
+        return r.invalidate();
     }
 }
 
@@ -1636,7 +1694,7 @@ bytes GenericTrieDB<DB>::deleteAt(RLP const& _orig, NibbleSlice _k)
             RLP r(s.out());
             if (isTwoItemNode(r[1]))
                 return graft(r);
-            return s.out();
+            return s.invalidate();
         } else
             // not found - no change.
             return bytes();
@@ -1656,15 +1714,15 @@ bytes GenericTrieDB<DB>::deleteAt(RLP const& _orig, NibbleSlice _k)
                 } else
                     return merge(_orig, used);
             else {
-                RLPStream r(17);
+                RLPStream r(17, c_trieBranchReserve);
                 for (byte i = 0; i < 16; ++i)
                     r << _orig[i];
                 r << "";
-                return r.out();
+                return r.invalidate();
             }
         } else {
             // not exactly our node - delve to next level at the correct index.
-            RLPStream r(17);
+            RLPStream r(17, c_trieBranchReserve);
             byte n = _k[0];
             for (byte i = 0; i < 17; ++i)
                 if (i == n)
@@ -1682,7 +1740,7 @@ bytes GenericTrieDB<DB>::deleteAt(RLP const& _orig, NibbleSlice _k)
             RLP rlp(r.out());
             byte used = uniqueInUse(rlp, 255);
             if (used == 255) // no - all ok.
-                return r.out();
+                return r.invalidate();
 
             // yes; merge
             if (isTwoItemNode(rlp[used])) {
@@ -1726,11 +1784,11 @@ bytes GenericTrieDB<DB>::place(RLP const& _orig, NibbleSlice _k, bytesConstRef _
     if (_orig.itemCount() == 2)
         return rlpList(_orig[0], _s);
 
-    auto s = RLPStream(17);
+    auto s = RLPStream(17, c_trieBranchReserve);
     for (unsigned i = 0; i < 16; ++i)
         s << _orig[i];
     s << _s;
-    return s.out();
+    return s.invalidate();
 }
 
 // in1: [K, S] (DEL)
@@ -1749,11 +1807,11 @@ bytes GenericTrieDB<DB>::remove(RLP const& _orig)
     assert(_orig.isList() && (_orig.itemCount() == 2 || _orig.itemCount() == 17));
     if (_orig.itemCount() == 2)
         return RLPNull;
-    RLPStream r(17);
+    RLPStream r(17, c_trieBranchReserve);
     for (unsigned i = 0; i < 16; ++i)
         r << _orig[i];
     r << "";
-    return r.out();
+    return r.invalidate();
 }
 
 template <class DB>
@@ -1785,7 +1843,7 @@ bytes GenericTrieDB<DB>::cleve(RLP const& _orig, unsigned _s)
     top << hexPrefixEncode(k, false, 0, /*ugh*/ (int)_s);
     streamNode(top, bottom.out());
 
-    return top.out();
+    return top.invalidate();
 }
 
 template <class DB>
@@ -1830,7 +1888,7 @@ bytes GenericTrieDB<DB>::merge(RLP const& _orig, byte _i)
     } else
         s << hexPrefixEncode(bytes(), true);
     s << _orig[_i];
-    return s.out();
+    return s.invalidate();
 }
 
 template <class DB>
@@ -1844,7 +1902,7 @@ bytes GenericTrieDB<DB>::branch(RLP const& _orig)
     killNode(_orig);
 
     auto k = keyOf(_orig);
-    RLPStream r(17);
+    RLPStream r(17, c_trieBranchReserve);
     if (k.size() == 0) {
         assert(isLeaf(_orig));
         for (unsigned i = 0; i < 16; ++i)
@@ -1862,7 +1920,7 @@ bytes GenericTrieDB<DB>::branch(RLP const& _orig)
                 r << "";
         r << "";
     }
-    return r.out();
+    return r.invalidate();
 }
 
 
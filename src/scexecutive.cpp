@@ -56,7 +56,7 @@ u256 Executive::gasUsed() const
 void Executive::accrueSubState(SubState& _parentContext)
 {
     if (m_ext)
-        _parentContext += m_ext->sub;
+        _parentContext += std::move(m_ext->sub);
 }
 
 void Executive::initialize(Transaction const& _transaction)
@@ -192,14 +192,14 @@ bool Executive::go(OnOpFunc const& _onOp)
                     m_res->depositSize = out.size();
                 }
                 if (out.size() > m_ext->evmSchedule().maxCodeSize)
-                    BOOST_THROW_EXCEPTION(std::range_error("Out Of Gas"));
+                    BOOST_THROW_EXCEPTION(OutOfGas());
                 else if (out.size() * m_ext->evmSchedule().createDataGas <= m_gas) {
                     if (m_res)
                         m_res->codeDeposit = CodeDeposit::Success;
                     m_gas -= out.size() * m_ext->evmSchedule().createDataGas;
                 } else {
                     if (m_ext->evmSchedule().exceptionalFailedCodeDeposit)
-                        BOOST_THROW_EXCEPTION(std::range_error("Out Of Gas"));
+                        BOOST_THROW_EXCEPTION(OutOfGas());
                     else {
                         if (m_res)
                             m_res->codeDeposit = CodeDeposit::Failed;
@@ -245,8 +245,8 @@ void Executive::finalize()
 
     // SSTORE refunds...
     // must be done before the miner gets the fees.
-    auto a = (m_t.gas() - m_gas) / 2 < m_ext->sub.refunds ? (m_t.gas() - m_gas) / 2 : m_ext->sub.refunds;
-    m_refunded = m_ext ? a : 0;
+    // A call to an account without code has no m_ext
+    m_refunded = m_ext ? std::min<u256>((m_t.gas() - m_gas) / 2, m_ext->sub.refunds) : 0;
     m_gas += m_refunded;
 
     if (m_t) {
@@ -260,7 +260,7 @@ void Executive::finalize()
 
     // Logs..
     if (m_ext)
-        m_logs = m_ext->sub.logs;
+        m_logs = std::move(m_ext->sub.logs);
 
     if (m_res) // Collect results
     {
@@ -268,6 +268,7 @@ void Executive::finalize()
         m_res->excepted = m_excepted; // TODO: m_except is used only in ExtVM::call
         m_res->newAddress = m_newAddress;
         m_res->gasRefunded = m_ext ? m_ext->sub.refunds : 0;
+        m_res->logs = std::move(m_logs);
     }
 }
 
@@ -112,6 +112,7 @@ public:
     Transaction const& t() const { return m_t; }
     /// @returns the log entries created by this operation.
     /// @warning Only valid after finalise().
+    /// Empty if a result recipient was set; finalize() moves the logs into it.
     LogEntries const& logs() const { return m_logs; }
     /// @returns total gas used in the transaction/operation.
     /// @warning Only valid after finalise().
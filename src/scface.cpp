@@ -1,5 +1,6 @@
 #include "scface.h"
 #include "scvm.h"
+#include "txmempool.h"
 
 
 // =================== Smart Contract ===========================
@@ -42,41 +43,155 @@ bool SmartContract::ParseStack(std::vector<std::vector<unsigned char>>& stack)
 
 
 
-bool SmartContract::TxContractExec(const CTransaction& tx, sc::u256& refundGasAmount, std::vector<CTxOut>& vRefundGasFee, std::vector<unsigned char>& output)
+SmartContract::SmartContract() : state(pState.get())
 {
-    for (const auto& vout : tx.vout) {
+}
+
+bool SmartContract::ParseContractOutput(const CScript& script)
+{
+    if (!script.HasOpCreate() && !script.HasOpCall())
+        return false;
+    std::vector<std::vector<unsigned char>> stack;
+    EvalScript(stack, script, SCRIPT_EXEC_BYTE_CODE, BaseSignatureChecker(), SIGVERSION_BASE, nullptr);
+    flag = script.HasOpCreate() ? ISCREATE : ISMESSAGECALL;
+    return ParseStack(stack);
+}
 
-        if (vout.scriptPubKey.HasOpCreate() || vout.scriptPubKey.HasOpCall()) {
-            std::vector<std::vector<unsigned char>> stack;
-            EvalScript(stack, vout.scriptPubKey, SCRIPT_EXEC_BYTE_CODE, BaseSignatureChecker(), SIGVERSION_BASE, nullptr);
+bool SmartContract::TxContractExec(const CTransaction& tx, sc::u256& refundGasAmount, std::vector<CTxOut>& vRefundGasFee, std::vector<unsigned char>& output, CBlockReceipts* pReceipts)
+{
+    for (uint32_t n = 0; n < tx.vout.size(); n++) {
+        const CTxOut& vout = tx.vout[n];
+
+        if (ParseContractOutput(vout.scriptPubKey)) {
             sc::Transaction scTx;
-            flag = vout.scriptPubKey.HasOpCreate() ? ISCREATE : ISMESSAGECALL;
-            // parse stack
-            if (!ParseStack(stack)) {
-                continue;
-            }
 
             bool _isCreation = (flag == ISCREATE);
             scTx = std::move(sc::Transaction(_isCreation, value, gasPrice, gasLimit, contractAddress, datahex));
             scTx.forceSender(callerAddress);
-            sc::h256 oldHashStateRoot(pState->rootHash());
+            sc::h256 oldHashStateRoot(state->rootHash());
+            CContractReceipt receipt;
+            receipt.txid = tx.GetHash();
+            receipt.nOut = n;
+            receipt.contractAddress = contractAddress;
             try {
-                auto res = pState->execute(scTx);
+                auto res = state->execute(scTx);
                 refundGasAmount = (gasLimit - res.gasUsed) * gasPrice;
                 if (refundGasAmount > 0) {
                     CScript script(CScript() << OP_DUP << OP_HASH160 << fabCallerAddress << OP_EQUALVERIFY << OP_CHECKSIG);
                     vRefundGasFee.emplace_back(CTxOut(CAmount(refundGasAmount), script));
                 }
+                if (pReceipts) {
+                    receipt.nGasUsed = static_cast<uint64_t>(res.gasUsed);
+                    receipt.nStatus = static_cast<int32_t>(res.excepted);
+                    if (_isCreation)
+                        receipt.contractAddress = res.newAddress;
+                    receipt.output = std::move(res.output);
+                    for (sc::LogEntry& log : res.logs) {
+                        receipt.logs.emplace_back();
+                        receipt.logs.back().address = log.address;
+                        receipt.logs.back().topics = std::move(log.topics);
+                        receipt.logs.back().data = std::move(log.data);
+                    }
+                }
             } catch (...) {
-                pState->setRoot(oldHashStateRoot);
+                state->setRoot(oldHashStateRoot);
+                receipt.nGasUsed = static_cast<uint64_t>(gasLimit);
+                receipt.nStatus = static_cast<int32_t>(sc::TransactionException::Unknown);
             }
+            if (pReceipts)
+                pReceipts->receipts.push_back(std::move(receipt));
         }
     }
 
     return true;
 };
 
-bool SmartContract::GetBlockContract(const CBlock& block, std::vector<CTxOut>& vRefundGasFee)
+//! Thrown into the VM when a dry run runs out of time; a VM error, so Executive::go reverts the frame
+struct DryRunTimeout : virtual sc::VMException {};
+
+bool SmartContract::PreExecuteTx(const CTransaction& tx, CContractPreExecution& result, bool& fFinalFailure, uint64_t nMaxGas, int64_t nMaxTime)
+{
+    sc::u256 nGasLimit = 0;
+    for (const CTxOut& vout : tx.vout)
+        if (ParseContractOutput(vout.scriptPubKey))
+            nGasLimit += gasLimit;
+    if (nGasLimit > nMaxGas)
+        return false;
+
+    // Checking the clock every few hundred instructions bounds the run; once
+    // late, each frame is failed as it resumes so the whole call stack unwinds
+    const int64_t nDeadline = GetTimeMicros() + nMaxTime;
+    uint64_t nSteps = 0;
+    bool fTimedOut = false;
+    const sc::OnOpFunc onOp = [&](uint64_t, uint64_t, sc::Instruction, sc::bigint, sc::bigint, sc::bigint, sc::VM*, sc::ExtVMFace const*) {
+        if (!fTimedOut && ++nSteps % 256 == 0 && GetTimeMicros() > nDeadline)
+            fTimedOut = true;
+        if (fTimedOut)
+            BOOST_THROW_EXCEPTION(DryRunTimeout());
+    };
+
+    // A fork keeps the dry run and its cache misses out of state and its caches
+    sc::State view = sc::State::fork(*state, state->rootHash());
+    result.hashStateRoot = sc::h256Touint(view.rootHash());
+    result.nGasUsed = 0;
+    result.nRefund = 0;
+    result.fSuccess = true;
+    fFinalFailure = true;
+
+    sc::AddressHash read;
+    sc::AddressHash expected;
+    bool fEnvironmentRead = false;
+    view.setAccessLog(&read);
+    view.setEnvironmentLog(&fEnvironmentRead);
+    for (const CTxOut& vout : tx.vout) {
+        if (!ParseContractOutput(vout.scriptPubKey))
+            continue;
+        if (flag != ISCREATE || view.addressInUse(contractAddress))
+            fFinalFailure = false;
+        expected.insert(callerAddress);
+        expected.insert(contractAddress);
+
+        sc::Transaction scTx(flag == ISCREATE, value, gasPrice, gasLimit, contractAddress, datahex);
+        scTx.forceSender(callerAddress);
+        uint64_t nGasUsed = static_cast<uint64_t>(gasLimit);
+        try {
+            // Uncommitted keeps the changes of earlier outputs visible to later
+            // ones without writing trie nodes
+            auto res = view.execute(scTx, sc::Permanence::Uncommitted, onOp);
+            nGasUsed = static_cast<uint64_t>(res.gasUsed);
+            // Refunded the way TxContractExec does, capped so a bogus price cannot overflow the sum
+            sc::u256 refund = (gasLimit - res.gasUsed) * gasPrice;
+            result.nRefund += CAmount(std::min<sc::u256>(refund, MAX_MONEY));
+            if (res.excepted != sc::TransactionException::None)
+                result.fSuccess = false;
+        } catch (...) {
+            result.fSuccess = false;
+        }
+        const uint64_t nMaxGas = std::numeric_limits<uint64_t>::max();
+        result.nGasUsed = nGasUsed > nMaxGas - result.nGasUsed ? nMaxGas : result.nGasUsed + nGasUsed;
+    }
+    view.setAccessLog(nullptr);
+    view.setEnvironmentLog(nullptr);
+    if (fTimedOut)
+        return false;
+
+    for (const sc::h160& address : read) {
+        result.vRead.push_back(uint160(address.asBytes()));
+        if (!expected.count(address))
+            fFinalFailure = false;
+    }
+    for (const sc::h160& address : view.changedAddresses())
+        result.vWrite.push_back(uint160(address.asBytes()));
+    std::sort(result.vRead.begin(), result.vRead.end());
+    std::sort(result.vWrite.begin(), result.vWrite.end());
+    // The block it lands in, or funds the sender or the new contract receive
+    // meanwhile, may make it succeed
+    if (result.fSuccess || fEnvironmentRead)
+        fFinalFailure = false;
+    return true;
+}
+
+bool SmartContract::GetBlockContract(const CBlock& block, std::vector<CTxOut>& vRefundGasFee, CBlockReceipts* pReceipts)
 {
     
     // loop through transaction list,check if there is contract transaction
@@ -86,13 +201,13 @@ bool SmartContract::GetBlockContract(const CBlock& block, std::vector<CTxOut>& v
         if (tx.HasCreateOrCall()) {
             sc::u256 gasUsed = sc::h256(); 
             std::vector<unsigned char> txOutput;
-            sc::h256 oldHashStateRoot(pState->rootHash());
-            if (!TxContractExec(tx, gasUsed, vRefundGasFee, txOutput)) {
-                pState->setRoot(oldHashStateRoot);
+            sc::h256 oldHashStateRoot(state->rootHash());
+            if (!TxContractExec(tx, gasUsed, vRefundGasFee, txOutput, pReceipts)) {
+                state->setRoot(oldHashStateRoot);
             };
         }
     }
-    pState->commit(sc::State::CommitBehaviour::RemoveEmptyAccounts);
+    state->commit(sc::State::CommitBehaviour::RemoveEmptyAccounts);
     return true;
 };
 
@@ -11,8 +11,10 @@
 #include "chainparams.h"
 #include "script/standard.h"
 #include "sccommon.h"
+#include "screceipt.h"
 #include "sctransaction.h"
 
+struct CContractPreExecution;
 
 enum SmartContractFlags {
     ISCREATE,
@@ -23,14 +25,33 @@ class SmartContract {
 private:
    
     bool ParseStack(std::vector<std::vector<unsigned char>>& stack);
-   
+
+    sc::State* state;
 
 public:
-    SmartContract()  {};
+    //! Execute on pState
+    SmartContract();
+    //! Execute on stateIn instead of pState, e.g. a fork of it
+    explicit SmartContract(sc::State* stateIn) : state(stateIn) {};
+
+    //! Parse an OP_CREATE/OP_CALL script into the fields below; false if script is not a contract output
+    bool ParseContractOutput(const CScript& script);
+
+    bool TxContractExec(const CTransaction& tx, sc::u256& refundGasAmount, std::vector<CTxOut>& vRefundGasFee, std::vector<unsigned char>& output, CBlockReceipts* pReceipts = nullptr);
 
-    bool TxContractExec(const CTransaction& tx, sc::u256& refundGasAmount, std::vector<CTxOut>& vRefundGasFee, std::vector<unsigned char>& output);
+    /**
+     * Dry-run the contract outputs of tx on a fork of the state, which is left
+     * as it was. fFinalFailure is set if the transaction fails in a way no other
+     * transaction or block can change: it only creates contracts at unused
+     * addresses, and their init code looked up no account other than the sender
+     * and read neither the block environment nor a balance. Returns false, with
+     * nothing concluded, if the outputs' gas limits add up to more than nMaxGas
+     * or the run takes longer than nMaxTime microseconds.
+     */
+    bool PreExecuteTx(const CTransaction& tx, CContractPreExecution& result, bool& fFinalFailure, uint64_t nMaxGas, int64_t nMaxTime);
 
-    bool GetBlockContract(const CBlock& block, std::vector<CTxOut>& vRefundGasFee);
+    //! Execute the contract outputs of block on the state; if pReceipts is set, their receipts are appended to it
+    bool GetBlockContract(const CBlock& block, std::vector<CTxOut>& vRefundGasFee, CBlockReceipts* pReceipts = nullptr);
 
 public:
     SmartContractFlags flag;
@@ -554,6 +554,31 @@ public:
         size_t operator()(FixedHash const& _value) const { return boost::hash_range(_value.m_data.cbegin(), _value.m_data.cend()); }
     };
 
+    /// @returns an M-byte bloom with P bits set, each selected by the next log2(M * 8) bits of this hash.
+    template <unsigned P, unsigned M>
+    inline FixedHash<M> bloomPart() const
+    {
+        static_assert((M & (M - 1)) == 0, "M must be power-of-two");
+        unsigned const c_bloomBits = M * 8;
+        unsigned const c_mask = c_bloomBits - 1;
+        unsigned c_log2 = 0;
+        while ((1u << c_log2) < c_bloomBits)
+            ++c_log2;
+        unsigned const c_bloomBytes = (c_log2 + 7) / 8;
+        assert(P * c_bloomBytes <= N);
+
+        FixedHash<M> ret;
+        byte const* p = data();
+        for (unsigned i = 0; i < P; ++i) {
+            unsigned index = 0;
+            for (unsigned j = 0; j < c_bloomBytes; ++j, ++p)
+                index = (index << 8) | *p;
+            index &= c_mask;
+            ret[M - 1 - index / 8] |= (1 << (index % 8));
+        }
+        return ret;
+    }
+
     template <unsigned P, unsigned M>
     inline FixedHash& shiftBloom(FixedHash<M> const& _h)
     {
@@ -566,6 +591,19 @@ public:
         return contains(_h.template bloomPart<P, N>());
     }
 
+    /// Raw serialization of the N bytes, for CDataStream and the LevelDB indexes.
+    template <typename Stream>
+    void Serialize(Stream& s) const
+    {
+        s.write((char const*)m_data.data(), N);
+    }
+
+    template <typename Stream>
+    void Unserialize(Stream& s)
+    {
+        s.read((char*)m_data.data(), N);
+    }
+
 
     /// Returns the index of the first bit set to one, or size() * 8 if no bits are set.
     inline unsigned firstBitSet() const
@@ -0,0 +1,534 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef FABCOIN_SCFLATMAP_HPP
+#define FABCOIN_SCFLATMAP_HPP
+
+#include <assert.h>
+#include <cstddef>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <stdint.h>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace sc
+{
+
+namespace detail
+{
+/// Spread a std::hash value over the upper bits, which the flat tables index with
+/// (Fibonacci hashing). FixedHash::hash is a plain byte combine and its low bits
+/// are not good enough for a power-of-two table on their own.
+inline uint64_t flatHashMix(size_t _h)
+{
+    return uint64_t(_h) * 0x9E3779B97F4A7C15ull;
+}
+
+/// Smallest table size and maximum load factor (3/4) shared by the flat tables.
+static const size_t c_flatMinCapacity = 8;
+inline bool flatNeedsGrow(size_t _size, size_t _capacity)
+{
+    return (_size + 1) * 4 > _capacity * 3;
+}
+} // namespace detail
+
+// =========== FlatHashMap =========
+/**
+ * @brief Open-addressing hash map with linear probing and backward-shift deletion.
+ *
+ * The probe table only holds the mixed hash and a pointer per slot, so a lookup
+ * touches one or two cache lines instead of walking bucket lists. The key/value
+ * pairs themselves are bump-allocated from chunks owned by the map; references to
+ * elements therefore stay valid across inserts and rehashes like they do for
+ * std::unordered_map, which State::account() relies on. Erased pairs are recycled
+ * through a free list, and clear() keeps the chunks for the next round of use.
+ *
+ * Unlike std::unordered_map, erase() invalidates iterators (but not references to
+ * other elements); do not erase while iterating.
+ */
+template <class K, class V, class H = std::hash<K>>
+class FlatHashMap
+{
+public:
+    using key_type = K;
+    using mapped_type = V;
+    using value_type = std::pair<K const, V>;
+    using size_type = size_t;
+    using hasher = H;
+
+private:
+    struct Slot {
+        uint64_t hash;
+        value_type* node;
+    };
+
+    template <bool Const>
+    class Iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename FlatHashMap::value_type;
+        using difference_type = std::ptrdiff_t;
+        using reference = typename std::conditional<Const, value_type const&, value_type&>::type;
+        using pointer = typename std::conditional<Const, value_type const*, value_type*>::type;
+
+        Iterator() = default;
+        Iterator(Slot const* _pos, Slot const* _end) : m_pos(_pos), m_end(_end) { skip(); }
+        /// iterator -> const_iterator
+        template <bool C = Const, class = typename std::enable_if<C>::type>
+        Iterator(Iterator<false> const& _it) : m_pos(_it.m_pos), m_end(_it.m_end) {}
+
+        reference operator*() const { return *m_pos->node; }
+        pointer operator->() const { return m_pos->node; }
+        Iterator& operator++()
+        {
+            ++m_pos;
+            skip();
+            return *this;
+        }
+        Iterator operator++(int)
+        {
+            Iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(Iterator const& _c) const { return m_pos == _c.m_pos; }
+        bool operator!=(Iterator const& _c) const { return m_pos != _c.m_pos; }
+
+    private:
+        friend class FlatHashMap;
+        friend class Iterator<!Const>;
+
+        void skip()
+        {
+            while (m_pos != m_end && !m_pos->node)
+                ++m_pos;
+        }
+
+        Slot const* m_pos = nullptr;
+        Slot const* m_end = nullptr;
+    };
+
+public:
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    FlatHashMap() = default;
+    FlatHashMap(FlatHashMap const& _s) { *this = _s; }
+    FlatHashMap(FlatHashMap&& _s) noexcept { swap(_s); }
+    ~FlatHashMap() { destroyNodes(); }
+
+    FlatHashMap& operator=(FlatHashMap const& _s)
+    {
+        if (&_s == this)
+            return *this;
+        clear();
+        reserve(_s.size());
+        for (auto const& i : _s)
+            insertNode(hashOf(i.first), new (allocate()) value_type(i));
+        return *this;
+    }
+    FlatHashMap& operator=(FlatHashMap&& _s) noexcept
+    {
+        FlatHashMap tmp(std::move(_s));
+        swap(tmp);
+        return *this;
+    }
+
+    void swap(FlatHashMap& _s) noexcept
+    {
+        m_slots.swap(_s.m_slots);
+        std::swap(m_size, _s.m_size);
+        std::swap(m_shift, _s.m_shift);
+        m_chunks.swap(_s.m_chunks);
+        std::swap(m_chunk, _s.m_chunk);
+        std::swap(m_chunkUsed, _s.m_chunkUsed);
+        m_free.swap(_s.m_free);
+    }
+
+    iterator begin() { return iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+    iterator end() { return iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+    const_iterator begin() const { return const_iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+    const_iterator end() const { return const_iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+
+    iterator find(K const& _k) { return iteratorAt(findSlot(_k)); }
+    const_iterator find(K const& _k) const { return const_iterator(const_cast<FlatHashMap*>(this)->find(_k)); }
+    size_t count(K const& _k) const { return findSlot(_k) == npos ? 0 : 1; }
+
+    V& at(K const& _k)
+    {
+        size_t i = findSlot(_k);
+        if (i == npos)
+            throw std::out_of_range("FlatHashMap::at");
+        return m_slots[i].node->second;
+    }
+    V const& at(K const& _k) const { return const_cast<FlatHashMap*>(this)->at(_k); }
+
+    V& operator[](K const& _k)
+    {
+        uint64_t h = hashOf(_k);
+        size_t i = findSlot(_k, h);
+        if (i != npos)
+            return m_slots[i].node->second;
+        value_type* node = allocate();
+        try {
+            new (node) value_type(std::piecewise_construct, std::forward_as_tuple(_k), std::forward_as_tuple());
+        } catch (...) {
+            m_free.push_back(node);
+            throw;
+        }
+        insertNode(h, node);
+        return node->second;
+    }
+
+    /// Same contract as std::unordered_map::emplace: the pair is constructed first
+    /// and dropped again if the key is already present.
+    template <class... Args>
+    std::pair<iterator, bool> emplace(Args&&... _args)
+    {
+        value_type* node = allocate();
+        try {
+            new (node) value_type(std::forward<Args>(_args)...);
+        } catch (...) {
+            m_free.push_back(node);
+            throw;
+        }
+        uint64_t h = hashOf(node->first);
+        size_t i = findSlot(node->first, h);
+        if (i != npos) {
+            releaseNode(node);
+            return std::make_pair(iteratorAt(i), false);
+        }
+        return std::make_pair(iteratorAt(insertNode(h, node)), true);
+    }
+    std::pair<iterator, bool> insert(value_type const& _v) { return emplace(_v); }
+
+    size_t erase(K const& _k)
+    {
+        size_t i = findSlot(_k);
+        if (i == npos)
+            return 0;
+        eraseSlot(i);
+        return 1;
+    }
+    void erase(const_iterator _it) { eraseSlot(_it.m_pos - m_slots.data()); }
+    void erase(iterator _it) { eraseSlot(_it.m_pos - m_slots.data()); }
+
+    /// Remove all elements. The probe table and the node chunks are kept for reuse.
+    void clear()
+    {
+        if (!m_size)
+            return;
+        destroyNodes();
+        for (auto& s : m_slots)
+            s = Slot{0, nullptr};
+        m_size = 0;
+        m_chunk = 0;
+        m_chunkUsed = 0;
+        m_free.clear();
+    }
+
+    void reserve(size_t _n)
+    {
+        size_t cap = m_slots.empty() ? detail::c_flatMinCapacity : m_slots.size();
+        while (detail::flatNeedsGrow(_n, cap))
+            cap *= 2;
+        if (cap > m_slots.size())
+            rehash(cap);
+    }
+
+private:
+    using Storage = typename std::aligned_storage<sizeof(value_type), alignof(value_type)>::type;
+
+    static const size_t npos = size_t(-1);
+    static const size_t c_firstChunk = 4;
+    static const size_t c_maxChunk = 256;
+
+    static uint64_t hashOf(K const& _k) { return detail::flatHashMix(H()(_k)); }
+    static size_t chunkSize(size_t _i) { return _i < 6 ? c_firstChunk << _i : c_maxChunk; }
+
+    size_t mask() const { return m_slots.size() - 1; }
+    size_t home(uint64_t _h) const { return size_t(_h >> m_shift); }
+
+    iterator iteratorAt(size_t _i)
+    {
+        Slot const* e = m_slots.data() + m_slots.size();
+        return _i == npos ? iterator(e, e) : iterator(m_slots.data() + _i, e);
+    }
+
+    size_t findSlot(K const& _k) const { return findSlot(_k, hashOf(_k)); }
+    size_t findSlot(K const& _k, uint64_t _h) const
+    {
+        if (m_slots.empty())
+            return npos;
+        for (size_t i = home(_h);; i = (i + 1) & mask()) {
+            Slot const& s = m_slots[i];
+            if (!s.node)
+                return npos;
+            if (s.hash == _h && s.node->first == _k)
+                return i;
+        }
+    }
+
+    size_t insertNode(uint64_t _h, value_type* _node)
+    {
+        if (m_slots.empty() || detail::flatNeedsGrow(m_size, m_slots.size()))
+            rehash(m_slots.empty() ? detail::c_flatMinCapacity : m_slots.size() * 2);
+        size_t i = home(_h);
+        while (m_slots[i].node)
+            i = (i + 1) & mask();
+        m_slots[i] = Slot{_h, _node};
+        ++m_size;
+        return i;
+    }
+
+    void eraseSlot(size_t _i)
+    {
+        assert(_i < m_slots.size() && m_slots[_i].node);
+        releaseNode(m_slots[_i].node);
+        --m_size;
+        // Shift back the following entries of the cluster that may move closer to their home slot.
+        for (size_t j = _i;;) {
+            j = (j + 1) & mask();
+            if (!m_slots[j].node)
+                break;
+            size_t k = home(m_slots[j].hash);
+            if (_i <= j ? (_i < k && k <= j) : (_i < k || k <= j))
+                continue;
+            m_slots[_i] = m_slots[j];
+            _i = j;
+        }
+        m_slots[_i] = Slot{0, nullptr};
+    }
+
+    void rehash(size_t _capacity)
+    {
+        assert((_capacity & (_capacity - 1)) == 0);
+        std::vector<Slot> old(_capacity, Slot{0, nullptr});
+        old.swap(m_slots);
+        m_shift = 64;
+        for (size_t c = _capacity; c > 1; c >>= 1)
+            --m_shift;
+        for (auto const& s : old)
+            if (s.node) {
+                size_t i = home(s.hash);
+                while (m_slots[i].node)
+                    i = (i + 1) & mask();
+                m_slots[i] = s;
+            }
+    }
+
+    value_type* allocate()
+    {
+        if (!m_free.empty()) {
+            value_type* p = m_free.back();
+            m_free.pop_back();
+            return p;
+        }
+        if (m_chunks.empty() || m_chunkUsed == chunkSize(m_chunk)) {
+            if (!m_chunks.empty())
+                ++m_chunk;
+            if (m_chunk == m_chunks.size())
+                m_chunks.emplace_back(new Storage[chunkSize(m_chunk)]);
+            m_chunkUsed = 0;
+        }
+        return reinterpret_cast<value_type*>(&m_chunks[m_chunk][m_chunkUsed++]);
+    }
+
+    void releaseNode(value_type* _node)
+    {
+        _node->~value_type();
+        m_free.push_back(_node);
+    }
+
+    void destroyNodes()
+    {
+        for (auto const& s : m_slots)
+            if (s.node)
+                s.node->~value_type();
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_size = 0;
+    unsigned m_shift = 64;
+
+    std::vector<std::unique_ptr<Storage[]>> m_chunks; ///< Node arena; chunk i holds chunkSize(i) pairs.
+    size_t m_chunk = 0;                               ///< Chunk currently bump-allocated from.
+    size_t m_chunkUsed = 0;                           ///< Pairs handed out from m_chunks[m_chunk].
+    std::vector<value_type*> m_free;                  ///< Erased pairs available for reuse.
+};
+
+// =========== FlatHashSet =========
+/**
+ * @brief Open-addressing hash set with linear probing; keys are stored inline.
+ * Intended for small trivially copyable keys such as Address. erase()
+ * invalidates iterators.
+ */
+template <class K, class H = std::hash<K>>
+class FlatHashSet
+{
+    struct Slot {
+        uint64_t hash;
+        bool used;
+        K key;
+    };
+
+public:
+    using key_type = K;
+    using value_type = K;
+    using size_type = size_t;
+
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = K;
+        using difference_type = std::ptrdiff_t;
+        using reference = K const&;
+        using pointer = K const*;
+
+        const_iterator() = default;
+        const_iterator(Slot const* _pos, Slot const* _end) : m_pos(_pos), m_end(_end) { skip(); }
+
+        K const& operator*() const { return m_pos->key; }
+        K const* operator->() const { return &m_pos->key; }
+        const_iterator& operator++()
+        {
+            ++m_pos;
+            skip();
+            return *this;
+        }
+        const_iterator operator++(int)
+        {
+            const_iterator ret = *this;
+            ++*this;
+            return ret;
+        }
+        bool operator==(const_iterator const& _c) const { return m_pos == _c.m_pos; }
+        bool operator!=(const_iterator const& _c) const { return m_pos != _c.m_pos; }
+
+    private:
+        void skip()
+        {
+            while (m_pos != m_end && !m_pos->used)
+                ++m_pos;
+        }
+
+        Slot const* m_pos = nullptr;
+        Slot const* m_end = nullptr;
+    };
+    using iterator = const_iterator;
+
+    const_iterator begin() const { return const_iterator(m_slots.data(), m_slots.data() + m_slots.size()); }
+    const_iterator end() const { return const_iterator(m_slots.data() + m_slots.size(), m_slots.data() + m_slots.size()); }
+
+    size_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    size_t count(K const& _k) const { return findSlot(_k, hashOf(_k)) == npos ? 0 : 1; }
+
+    /// @returns true if @a _k was not present yet.
+    bool insert(K const& _k)
+    {
+        uint64_t h = hashOf(_k);
+        if (findSlot(_k, h) != npos)
+            return false;
+        if (m_slots.empty() || detail::flatNeedsGrow(m_size, m_slots.size()))
+            rehash(m_slots.empty() ? detail::c_flatMinCapacity : m_slots.size() * 2);
+        size_t i = home(h);
+        while (m_slots[i].used)
+            i = (i + 1) & mask();
+        m_slots[i].hash = h;
+        m_slots[i].used = true;
+        m_slots[i].key = _k;
+        ++m_size;
+        return true;
+    }
+    template <class It>
+    void insert(It _first, It _last)
+    {
+        for (; _first != _last; ++_first)
+            insert(*_first);
+    }
+
+    size_t erase(K const& _k)
+    {
+        size_t i = findSlot(_k, hashOf(_k));
+        if (i == npos)
+            return 0;
+        --m_size;
+        for (size_t j = i;;) {
+            j = (j + 1) & mask();
+            if (!m_slots[j].used)
+                break;
+            size_t k = home(m_slots[j].hash);
+            if (i <= j ? (i < k && k <= j) : (i < k || k <= j))
+                continue;
+            m_slots[i] = m_slots[j];
+            i = j;
+        }
+        m_slots[i].used = false;
+        return 1;
+    }
+
+    void clear()
+    {
+        if (!m_size)
+            return;
+        for (auto& s : m_slots)
+            s.used = false;
+        m_size = 0;
+    }
+
+private:
+    static const size_t npos = size_t(-1);
+
+    static uint64_t hashOf(K const& _k) { return detail::flatHashMix(H()(_k)); }
+    size_t mask() const { return m_slots.size() - 1; }
+    size_t home(uint64_t _h) const { return size_t(_h >> m_shift); }
+
+    size_t findSlot(K const& _k, uint64_t _h) const
+    {
+        if (m_slots.empty())
+            return npos;
+        for (size_t i = home(_h);; i = (i + 1) & mask()) {
+            Slot const& s = m_slots[i];
+            if (!s.used)
+                return npos;
+            if (s.hash == _h && s.key == _k)
+                return i;
+        }
+    }
+
+    void rehash(size_t _capacity)
+    {
+        std::vector<Slot> old(_capacity, Slot{0, false, K()});
+        old.swap(m_slots);
+        m_shift = 64;
+        for (size_t c = _capacity; c > 1; c >>= 1)
+            --m_shift;
+        for (auto const& s : old)
+            if (s.used) {
+                size_t i = home(s.hash);
+                while (m_slots[i].used)
+                    i = (i + 1) & mask();
+                m_slots[i] = s;
+            }
+    }
+
+    std::vector<Slot> m_slots;
+    size_t m_size = 0;
+    unsigned m_shift = 64;
+};
+
+} // namespace sc
+
+#endif // FABCOIN_SCFLATMAP_HPP
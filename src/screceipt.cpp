@@ -0,0 +1,216 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "screceipt.h"
+
+#include "chainparams.h"
+#include "init.h"
+#include "util.h"
+#include "validation.h"
+#include "scface.h"
+#include "scsha3.h"
+
+#include <boost/thread.hpp>
+
+static const char DB_RECEIPTS = 'r';
+static const char DB_BLOOM = 'l';
+static const char DB_BEST_BLOCK = 'B';
+
+//! How often the background build records its progress, in blocks
+static const int RECEIPT_INDEX_PROGRESS_INTERVAL = 1000;
+
+CContractReceiptDB* preceiptdb = nullptr;
+std::atomic<bool> fReceiptIndexSynced(false);
+
+sc::h2048 CContractLog::Bloom() const
+{
+    sc::h2048 ret;
+    ret.shiftBloom<3>(sc::sha3(address.ref()));
+    for (const sc::h256& topic : topics)
+        ret.shiftBloom<3>(sc::sha3(topic.ref()));
+    return ret;
+}
+
+sc::h2048 CBlockReceipts::Bloom() const
+{
+    sc::h2048 ret;
+    for (const CContractReceipt& receipt : receipts)
+        for (const CContractLog& log : receipt.logs)
+            ret |= log.Bloom();
+    return ret;
+}
+
+CContractReceiptDB::CContractReceiptDB(size_t nCacheSize, bool fMemory, bool fWipe) : CDBWrapper(GetDataDir() / "receipts", nCacheSize, fMemory, fWipe)
+{
+}
+
+bool CContractReceiptDB::WriteReceipts(const uint256& hashBlock, const CBlockReceipts& receipts)
+{
+    CDBBatch batch(*this);
+    batch.Write(std::make_pair(DB_RECEIPTS, hashBlock), receipts);
+    sc::h2048 bloom = receipts.Bloom();
+    if (bloom)
+        batch.Write(std::make_pair(DB_BLOOM, hashBlock), bloom);
+    else
+        batch.Erase(std::make_pair(DB_BLOOM, hashBlock));
+    return WriteBatch(batch);
+}
+
+bool CContractReceiptDB::EraseReceipts(const uint256& hashBlock)
+{
+    CDBBatch batch(*this);
+    batch.Erase(std::make_pair(DB_RECEIPTS, hashBlock));
+    batch.Erase(std::make_pair(DB_BLOOM, hashBlock));
+    return WriteBatch(batch);
+}
+
+bool CContractReceiptDB::ReadReceipts(const uint256& hashBlock, CBlockReceipts& receipts) const
+{
+    return Read(std::make_pair(DB_RECEIPTS, hashBlock), receipts);
+}
+
+bool CContractReceiptDB::ReadBloom(const uint256& hashBlock, sc::h2048& bloom) const
+{
+    return Read(std::make_pair(DB_BLOOM, hashBlock), bloom);
+}
+
+bool CContractReceiptDB::HaveReceipts(const uint256& hashBlock) const
+{
+    return Exists(std::make_pair(DB_RECEIPTS, hashBlock));
+}
+
+bool CContractReceiptDB::WriteBestBlock(const uint256& hashBlock)
+{
+    return Write(DB_BEST_BLOCK, hashBlock);
+}
+
+bool CContractReceiptDB::ReadBestBlock(uint256& hashBlock) const
+{
+    return Read(DB_BEST_BLOCK, hashBlock);
+}
+
+bool WriteBlockReceipts(const CBlockIndex* pindex, const CBlockReceipts& receipts)
+{
+    AssertLockHeld(cs_main);
+    if (!preceiptdb || receipts.IsEmpty())
+        return true;
+    return preceiptdb->WriteReceipts(pindex->GetBlockHash(), receipts);
+}
+
+void ReceiptIndexBlockConnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (preceiptdb && fReceiptIndexSynced)
+        preceiptdb->WriteBestBlock(pindex->GetBlockHash());
+}
+
+void ReceiptIndexBlockDisconnected(const CBlockIndex* pindex)
+{
+    AssertLockHeld(cs_main);
+    if (!preceiptdb)
+        return;
+    preceiptdb->EraseReceipts(pindex->GetBlockHash());
+    if (fReceiptIndexSynced && pindex->pprev)
+        preceiptdb->WriteBestBlock(pindex->pprev->GetBlockHash());
+}
+
+// Re-execute the contract outputs of a block on view, a fork of pState at its
+// parent's state root, and collect their receipts. Needs no lock.
+static bool ExecuteBlockReceipts(const CBlock& block, sc::State& view, CBlockReceipts& receipts)
+{
+    std::vector<CTxOut> vRefundGasFee;
+    SmartContract smct(&view);
+    return smct.GetBlockContract(block, vRefundGasFee, &receipts);
+}
+
+static bool HasContractOutputs(const CBlock& block)
+{
+    for (const auto& tx : block.vtx)
+        if (tx->HasCreateOrCall())
+            return true;
+    return false;
+}
+
+static void ThreadReceiptIndex()
+{
+    RenameThread("ybtc-receiptidx");
+    const CChainParams& chainparams = Params();
+
+    const CBlockIndex* pindex = nullptr;
+    {
+        LOCK(cs_main);
+        uint256 hashBest;
+        if (preceiptdb->ReadBestBlock(hashBest)) {
+            BlockMap::const_iterator it = mapBlockIndex.find(hashBest);
+            if (it != mapBlockIndex.end())
+                pindex = chainActive.FindFork(it->second);
+        }
+        LogPrintf("Building receipt index from height %d\n", pindex ? pindex->nHeight + 1 : 0);
+    }
+
+    int nProcessed = 0;
+    while (true) {
+        boost::this_thread::interruption_point();
+        if (ShutdownRequested())
+            return;
+
+        // Take what the block needs under cs_main, then execute it without the lock
+        const CBlockIndex* pnext;
+        CBlock block;
+        std::shared_ptr<sc::State> view;
+        {
+            LOCK(cs_main);
+            if (pindex && !chainActive.Contains(pindex))
+                pindex = chainActive.FindFork(pindex);
+            pnext = pindex ? chainActive.Next(pindex) : chainActive.Genesis();
+            if (!pnext) {
+                // Caught up; ConnectTip and DisconnectTip take it from here.
+                if (pindex)
+                    preceiptdb->WriteBestBlock(pindex->GetBlockHash());
+                fReceiptIndexSynced = true;
+                LogPrintf("Receipt index is synced at height %d\n", pindex ? pindex->nHeight : -1);
+                return;
+            }
+
+            // Blocks connected since the index was enabled already have their receipts.
+            if (!preceiptdb->HaveReceipts(pnext->GetBlockHash())) {
+                if (!ReadBlockFromDisk(block, pnext, chainparams.GetConsensus())) {
+                    LogPrintf("%s: Failed to read block %s, receipt index not built\n", __func__, pnext->GetBlockHash().ToString());
+                    return;
+                }
+                if (HasContractOutputs(block)) {
+                    sc::h256 parentHashStateRoot(sc::sha3(sc::rlp("")));
+                    if (pnext->pprev && pnext->pprev->hashStateRoot != uint256())
+                        parentHashStateRoot = sc::uintToh256(pnext->pprev->hashStateRoot);
+                    view = std::make_shared<sc::State>(sc::State::fork(*pState, parentHashStateRoot));
+                }
+            }
+        }
+
+        CBlockReceipts receipts;
+        if (view && !ExecuteBlockReceipts(block, *view, receipts)) {
+            LogPrintf("%s: Failed to index receipts of block %s\n", __func__, pnext->GetBlockHash().ToString());
+            return;
+        }
+
+        LOCK(cs_main);
+        // A block disconnected meanwhile had its receipts erased, so leave it out
+        if (view && chainActive.Contains(pnext) && !WriteBlockReceipts(pnext, receipts)) {
+            LogPrintf("%s: Failed to write receipts of block %s\n", __func__, pnext->GetBlockHash().ToString());
+            return;
+        }
+        pindex = pnext;
+        if (++nProcessed % RECEIPT_INDEX_PROGRESS_INTERVAL == 0) {
+            preceiptdb->WriteBestBlock(pindex->GetBlockHash());
+            LogPrintf("Receipt index built up to height %d\n", pindex->nHeight);
+        }
+    }
+}
+
+void StartReceiptIndex(boost::thread_group& threadGroup)
+{
+    if (!preceiptdb)
+        return;
+    threadGroup.create_thread(&ThreadReceiptIndex);
+}
@@ -0,0 +1,128 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef FABCOIN_SCRECEIPT_HPP
+#define FABCOIN_SCRECEIPT_HPP
+
+#include "dbwrapper.h"
+#include "scfixedhash.h"
+#include "serialize.h"
+#include "uint256.h"
+
+#include <atomic>
+#include <vector>
+
+class CBlockIndex;
+
+namespace boost {
+class thread_group;
+} // namespace boost
+
+/** A LOG0..LOG4 entry emitted while executing a contract output */
+struct CContractLog
+{
+    sc::h160 address;
+    std::vector<sc::h256> topics;
+    std::vector<unsigned char> data;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(address);
+        READWRITE(topics);
+        READWRITE(data);
+    }
+
+    //! Bloom of the address and the topics, 3 bits each (sc::LogBloom)
+    sc::h2048 Bloom() const;
+};
+
+/** Result of executing one OP_CREATE or OP_CALL output */
+struct CContractReceipt
+{
+    uint256 txid;
+    uint32_t nOut;
+    uint64_t nGasUsed;
+    int32_t nStatus; //!< sc::TransactionException, 0 (None) on success
+    sc::h160 contractAddress; //!< Called contract, or the new one for OP_CREATE
+    std::vector<unsigned char> output;
+    std::vector<CContractLog> logs;
+
+    CContractReceipt() : nOut(0), nGasUsed(0), nStatus(0) {}
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(txid);
+        READWRITE(VARINT(nOut));
+        READWRITE(VARINT(nGasUsed));
+        READWRITE(nStatus);
+        READWRITE(contractAddress);
+        READWRITE(output);
+        READWRITE(logs);
+    }
+};
+
+/** Receipts of the contract outputs of one block, in execution order */
+struct CBlockReceipts
+{
+    std::vector<CContractReceipt> receipts;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(receipts);
+    }
+
+    bool IsEmpty() const { return receipts.empty(); }
+
+    //! OR of the blooms of all logs in the block
+    sc::h2048 Bloom() const;
+};
+
+/** Access to the contract receipt index (receipts/)
+ *
+ * Receipts and the per-block log bloom are keyed by block hash, so entries of
+ * blocks that were reorganized away are simply never reached from chainActive.
+ * The bloom is stored apart from the receipts so getlogs can skip a block by
+ * reading 256 bytes. Blocks without contract outputs have no entries.
+ */
+class CContractReceiptDB : public CDBWrapper
+{
+public:
+    explicit CContractReceiptDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
+
+    CContractReceiptDB(const CContractReceiptDB&) = delete;
+    CContractReceiptDB& operator=(const CContractReceiptDB&) = delete;
+
+    bool WriteReceipts(const uint256& hashBlock, const CBlockReceipts& receipts);
+    bool EraseReceipts(const uint256& hashBlock);
+    bool ReadReceipts(const uint256& hashBlock, CBlockReceipts& receipts) const;
+    bool ReadBloom(const uint256& hashBlock, sc::h2048& bloom) const;
+    bool HaveReceipts(const uint256& hashBlock) const;
+
+    //! Block up to which every block of the active chain has been indexed
+    bool WriteBestBlock(const uint256& hashBlock);
+    bool ReadBestBlock(uint256& hashBlock) const;
+};
+
+/** Global variable that points to the receipt index, null unless -receiptindex is set (protected by cs_main) */
+extern CContractReceiptDB* preceiptdb;
+
+/** True once the background build caught up with chainActive; from then on ConnectTip/DisconnectTip keep the best block */
+extern std::atomic<bool> fReceiptIndexSynced;
+
+/** Called by ConnectBlock with the receipts of a connected block */
+bool WriteBlockReceipts(const CBlockIndex* pindex, const CBlockReceipts& receipts);
+/** Move the index' best block along with chainActive */
+void ReceiptIndexBlockConnected(const CBlockIndex* pindex);
+void ReceiptIndexBlockDisconnected(const CBlockIndex* pindex);
+
+/** Start the thread that re-executes the contract outputs of blocks connected before -receiptindex was enabled */
+void StartReceiptIndex(boost::thread_group& threadGroup);
+
+#endif // FABCOIN_SCRECEIPT_HPP
@@ -311,6 +311,22 @@ RLPStream& RLPStream::append(bytesConstRef _s, bool _compact)
     return *this;
 }
 
+RLPStream& RLPStream::append(u256 _i)
+{
+    // At most 32 bytes, so always the short form; avoids the heap-allocating bigint path.
+    if (!_i)
+        m_out.push_back(c_rlpDataImmLenStart);
+    else if (_i < c_rlpDataImmLenStart)
+        m_out.push_back((byte)_i);
+    else {
+        unsigned br = boost::multiprecision::msb(_i) / 8 + 1;
+        m_out.push_back((byte)(br + c_rlpDataImmLenStart));
+        pushInt(_i, br);
+    }
+    noteAppended();
+    return *this;
+}
+
 RLPStream& RLPStream::append(bigint _i)
 {
     if (!_i)
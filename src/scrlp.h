@@ -500,12 +500,20 @@ public:
     /// Initializes the RLPStream as a list of @a _listItems items.
     explicit RLPStream(size_t _listItems) { appendList(_listItems); }
 
+    /// Initializes the RLPStream as a list of @a _listItems items with room for @a _reserve bytes,
+    /// for nodes whose encoded size is known up front (17-item trie branches, accounts).
+    RLPStream(size_t _listItems, size_t _reserve)
+    {
+        m_out.reserve(_reserve);
+        appendList(_listItems);
+    }
+
     ~RLPStream() {}
 
     /// Append given datum to the byte stream.
-    RLPStream& append(unsigned _s) { return append(bigint(_s)); }
-    RLPStream& append(u160 _s) { return append(bigint(_s)); }
-    RLPStream& append(u256 _s) { return append(bigint(_s)); }
+    RLPStream& append(unsigned _s) { return append(u256(_s)); }
+    RLPStream& append(u160 _s) { return append(u256(_s)); }
+    RLPStream& append(u256 _s);
     RLPStream& append(bigint _s);
     RLPStream& append(bytesConstRef _s, bool _compact = false);
     RLPStream& append(bytes const& _s) { return append(bytesConstRef(&_s)); }
@@ -584,7 +592,8 @@ public:
         return append(_data);
     }
 
-    /// Clear the output stream so far.
+    /// Clear the output stream so far. The buffer is kept, so a stream that is
+    /// cleared and reused for many items stops allocating once it has grown.
     void clear()
     {
         m_out.clear();
@@ -650,7 +659,7 @@ void rlpListAux(RLPStream& _out, _T _t, _Ts... _ts)
 template <class _T>
 bytes rlp(_T _t)
 {
-    return (RLPStream() << _t).out();
+    return (RLPStream() << _t).invalidate();
 }
 
 /// Export a list of items in RLP format, returning a byte array.
@@ -660,7 +669,7 @@ bytes rlpList(_Ts... _ts)
 {
     RLPStream out(sizeof...(_Ts));
     rlpListAux(out, _ts...);
-    return out.out();
+    return out.invalidate();
 }
 
 /// The empty string in RLP format.
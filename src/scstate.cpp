@@ -32,6 +32,13 @@ State::State(State const& _s) : m_db(_s.m_db),
 {
 }
 
+State State::fork(State const& _s, h256 const& _root)
+{
+    State ret(_s.m_accountStartNonce, OverlayDB::fork(_s.m_db));
+    ret.setRoot(_root);
+    return ret;
+}
+
 OverlayDB State::openDB(std::string const& _basePath, h256 const& _genesisHash, WithExisting _we)
 {
     std::string path = _basePath.empty() ? Defaults::get()->m_dbPath : _basePath;
@@ -115,6 +122,9 @@ Account const* State::account(Address const& _a) const
 
 Account* State::account(Address const& _addr)
 {
+    if (m_accessLog)
+        m_accessLog->insert(_addr);
+
     auto it = m_cache.find(_addr);
     if (it != m_cache.end())
         return &it->second;
@@ -186,6 +196,7 @@ void State::setRoot(h256 const& _r)
     m_unchangedCacheEntries.clear();
     m_nonExistingAccountsCache.clear();
     //	m_touched.clear();
+    m_changeLog.clear();
     m_state.setRoot(_r);
 }
 
@@ -363,10 +374,15 @@ bytes const& State::code(Address const& _addr) const
         return NullBytes;
 
     if (a->code().empty()) {
-        // Load the code from the backend.
+        // Load the code from the shared cache, or from the backend.
         Account* mutableAccount = const_cast<Account*>(a);
-        mutableAccount->noteCode(m_db.lookup(a->codeHash()));
-        CodeSizeCache::instance().store(a->codeHash(), a->code().size());
+        auto& codeCache = CodeCache::instance();
+        std::shared_ptr<bytes const> c = codeCache.code(a->codeHash());
+        if (!c) {
+            c = std::make_shared<bytes const>(asBytes(m_db.lookup(a->codeHash())));
+            codeCache.storeCode(a->codeHash(), c);
+        }
+        mutableAccount->noteCode(c);
     }
 
     return a->code();
@@ -390,17 +406,12 @@ h256 State::codeHash(Address const& _a) const
 size_t State::codeSize(Address const& _a) const
 {
     if (Account const* a = account(_a)) {
-        if (a->hasNewCode())
+        if (a->hasNewCode() || a->sharedCode())
             return a->code().size();
-        auto& codeSizeCache = CodeSizeCache::instance();
-        h256 codeHash = a->codeHash();
-        if (codeSizeCache.contains(codeHash))
-            return codeSizeCache.get(codeHash);
-        else {
-            size_t size = code(_a).size();
-            codeSizeCache.store(codeHash, size);
+        size_t size;
+        if (CodeCache::instance().size(a->codeHash(), size))
             return size;
-        }
+        return code(_a).size();
     } else
         return 0;
 }
@@ -410,6 +421,14 @@ size_t State::savepoint() const
     return m_changeLog.size();
 }
 
+AddressHash State::changedAddresses() const
+{
+    AddressHash ret;
+    for (auto const& change : m_changeLog)
+        ret.insert(change.address);
+    return ret;
+}
+
 void State::rollback(size_t _savepoint)
 {
     while (_savepoint != m_changeLog.size()) {
@@ -465,7 +484,7 @@ ExecutionResult State::execute(Transaction const& _t, Permanence _p, OnOpFunc co
 
     if (_p == Permanence::Reverted)
         m_cache.clear();
-    else {
+    else if (_p == Permanence::Committed) {
         bool removeEmptyAccounts = false; 
         commit(removeEmptyAccounts ? State::CommitBehaviour::RemoveEmptyAccounts : State::CommitBehaviour::KeepEmptyAccounts);
     }
@@ -62,7 +62,8 @@ enum class BaseState {
 
 enum class Permanence {
     Reverted,
-    Committed
+    Committed,
+    Uncommitted ///< Leave the changes in the cache until commit() or setRoot().
 };
 
 template <class KeyType, class DB>
@@ -75,7 +76,7 @@ enum class WithExisting : int {
     Kill
 };
 
-using AddressHash = std::unordered_set<h160>;
+using AddressHash = FlatHashSet<h160>;
 const u256 Invalid256 = ~(u256)0;
 
 namespace detail
@@ -167,6 +168,11 @@ public:
     /// Copy state object.
     State& operator=(State const& _s);
 
+    /// View of _s at _root with caches of its own, whose changes never reach _s.
+    /// It reads the nodes of _s, which must outlive it, and may run in another
+    /// thread than the one changing _s.
+    static State fork(State const& _s, h256 const& _root);
+
     /// Open a DB - useful for passing into the constructor & keeping for other states that are necessary.
     static OverlayDB openDB(std::string const& _path, h256 const& _genesisHash, WithExisting _we = WithExisting::Trust);
     OverlayDB const& db() const { return m_db; }
@@ -287,6 +293,17 @@ public:
     /// Revert all recent changes up to the given @p _savepoint savepoint.
     void rollback(size_t _savepoint);
 
+    /// Record the address of every account looked up into @p _log, until called again with nullptr.
+    void setAccessLog(AddressHash* _log) { m_accessLog = _log; }
+
+    /// Set *@p _log when executed code reads the block environment or a balance, until called again with nullptr.
+    /// Neither shows in the access log: the block changes with no account, and balance reads of the sender are expected.
+    void setEnvironmentLog(bool* _log) { m_environmentLog = _log; }
+    void noteEnvironmentRead() { if (m_environmentLog) *m_environmentLog = true; }
+
+    /// @returns the addresses of the accounts changed since the last commit() or setRoot().
+    AddressHash changedAddresses() const;
+
     virtual ~State() {}
 
     // private:
@@ -309,15 +326,17 @@ protected: // fasc
 
     OverlayDB m_db;                                       ///< Our overlay for the state tree.
     SecureTrieDB<Address, OverlayDB> m_state;             ///< Our state tree, as an OverlayDB DB.
-    mutable std::unordered_map<Address, Account> m_cache; ///< Our address cache. This stores the states of each address that has (or at least might have) been changed.
+    mutable AccountMap m_cache;                           ///< Our address cache. This stores the states of each address that has (or at least might have) been changed.
     mutable std::vector<Address> m_unchangedCacheEntries; ///< Tracks entries in m_cache that can potentially be purged if it grows too large.
-    mutable std::set<Address> m_nonExistingAccountsCache; ///< Tracks addresses that are known to not exist.
+    mutable AddressHash m_nonExistingAccountsCache;       ///< Tracks addresses that are known to not exist.
     AddressHash m_touched;                                ///< Tracks all addresses touched so far.
 
     u256 m_accountStartNonce;
 
     friend std::ostream& operator<<(std::ostream& _out, State const& _s);
     std::vector<detail::Change> m_changeLog;
+    AddressHash* m_accessLog = nullptr;
+    bool* m_environmentLog = nullptr;
 };
 
 std::ostream& operator<<(std::ostream& _out, State const& _s);
@@ -326,12 +345,17 @@ template <class DB>
 AddressHash commit(AccountMap const& _cache, SecureTrieDB<Address, DB>& _state)
 {
     AddressHash ret;
+    // One stream for the account records and one for storage values, reused across
+    // the whole commit so encoding stops allocating once their buffers have grown.
+    RLPStream s;
+    RLPStream v;
     for (auto const& i : _cache)
         if (i.second.isDirty()) {
             if (!i.second.isAlive())
                 _state.remove(i.first);
             else {
-                RLPStream s(4);
+                s.clear();
+                s.appendList(4);
                 s << i.second.nonce() << i.second.balance();
 
                 if (i.second.storageOverlay().empty()) {
@@ -340,9 +364,11 @@ AddressHash commit(AccountMap const& _cache, SecureTrieDB<Address, DB>& _state)
                 } else {
                     SecureTrieDB<h256, DB> storageDB(_state.db(), i.second.baseRoot());
                     for (auto const& j : i.second.storageOverlay())
-                        if (j.second)
-                            storageDB.insert(j.first, rlp(j.second));
-                        else
+                        if (j.second) {
+                            v.clear();
+                            v << j.second;
+                            storageDB.insert(j.first, &v.out());
+                        } else
                             storageDB.remove(j.first);
                     assert(storageDB.root());
                     s.append(storageDB.root());
@@ -350,8 +376,8 @@ AddressHash commit(AccountMap const& _cache, SecureTrieDB<Address, DB>& _state)
 
                 if (i.second.hasNewCode()) {
                     h256 ch = i.second.codeHash();
-                    // Store the size of the code
-                    CodeSizeCache::instance().store(ch, i.second.code().size());
+                    // Share the new code with other States and the VM
+                    CodeCache::instance().storeCode(ch, i.second.sharedCode());
                     _state.db()->insert(ch, &i.second.code());
                     s << ch;
                 } else
@@ -216,6 +216,14 @@ private:
 struct VMException : virtual Exception {
 };
 
+/// Errors that end the VM's current call frame, which Executive::go then reverts.
+struct OutOfGas : virtual VMException {};
+struct BadInstruction : virtual VMException {};
+struct BadJumpDestination : virtual VMException {};
+struct BadStack : virtual VMException {};
+struct RevertInstruction : virtual VMException {};
+struct CreateWithValue : virtual VMException {};
+
 
 TransactionException toTransactionException(boost::exception const& _e);
 std::ostream& operator<<(std::ostream& _out, TransactionException const& _er);
@@ -230,6 +238,7 @@ struct ExecutionResult {
     u256 gasRefunded = 0;
     unsigned depositSize = 0; ///< Amount of code of the creation's attempted deposit.
     u256 gasForDeposit;       ///< Amount of gas remaining for the code deposit phase.
+    LogEntries logs;          ///< Logs emitted by the transaction, moved out of the Executive's SubState.
 };
 
 
@@ -1,4 +1,5 @@
 #include <scvm.h>
+#include <sctransaction.h>
 namespace sc
 {
 
@@ -74,22 +75,22 @@ void VM::copyDataToMemory(bytesConstRef _data, u256*& _sp)
 
 void VM::throwOutOfGas()
 {
-    BOOST_THROW_EXCEPTION(std::range_error("Out Of Gas"));
+    BOOST_THROW_EXCEPTION(OutOfGas());
 }
 
 void VM::throwBadInstruction()
 {
-    BOOST_THROW_EXCEPTION(std::range_error("Bad Instruction"));
+    BOOST_THROW_EXCEPTION(BadInstruction());
 }
 
 void VM::throwBadJumpDestination()
 {
-    BOOST_THROW_EXCEPTION(std::range_error("Bad Jump Destination"));
+    BOOST_THROW_EXCEPTION(BadJumpDestination());
 }
 
 void VM::throwBadStack(unsigned _size, unsigned _removed, unsigned _added)
 {
-    BOOST_THROW_EXCEPTION(std::range_error("Bad Stack"));
+    BOOST_THROW_EXCEPTION(BadStack());
 }
 
 void VM::throwRevertInstruction(owning_bytes_ref&& _output)
@@ -98,24 +99,30 @@ void VM::throwRevertInstruction(owning_bytes_ref&& _output)
     // RevertInstruction has no copy constructor
     //throw RevertInstruction(std::move(_output));
     //TODO-J
-    BOOST_THROW_EXCEPTION(std::range_error("Revert Instruction"));
+    BOOST_THROW_EXCEPTION(RevertInstruction());
 }
 
-int64_t VM::verifyJumpDest(u256 const& _dest, bool _throw)
+int64_t VM::verifyJumpDest(std::vector<uint64_t> const& _jumpDests, u256 const& _dest)
 {
     // check for overflow
     if (_dest <= 0x7FFFFFFFFFFFFFFF) {
         // check for within bounds and to a jump destination
         // use binary search of array because hashtable collisions are exploitable
         uint64_t pc = uint64_t(_dest);
-        if (std::binary_search(m_jumpDests.begin(), m_jumpDests.end(), pc))
+        if (std::binary_search(_jumpDests.begin(), _jumpDests.end(), pc))
             return pc;
     }
-    if (_throw)
-        throwBadJumpDestination();
     return -1;
 }
 
+int64_t VM::verifyJumpDest(u256 const& _dest, bool _throw)
+{
+    int64_t pc = verifyJumpDest(m_analysis->jumpDests, _dest);
+    if (pc < 0 && _throw)
+        throwBadJumpDestination();
+    return pc;
+}
+
 
 //
 // interpreter cases that call out
@@ -134,7 +141,7 @@ void VM::caseCreate()
     uint64_t initOff = (uint64_t)*m_SP--;
     int64_t initSize = (uint64_t)*m_SP--;
 
-    if (endowment) BOOST_THROW_EXCEPTION(std::range_error("Create With Value"));
+    if (endowment) BOOST_THROW_EXCEPTION(CreateWithValue());
 
     if (m_ctx->balance(m_ctx->myAddress) >= endowment && m_ctx->depth < 1024) {
         *io_gas = m_io_gas;
@@ -263,16 +270,15 @@ void VM::initMetrics()
     done = true;
 }
 
-void VM::copyCode(int _ctxraBytes)
+void VM::copyCode(CodeAnalysis& _analysis, int _ctxraBytes)
 {
     // Copy code so that it can be safely modified and extend code by
     // _ctxraBytes zero bytes to allow reading virtual data at the end
     // of the code without bounds checks.
     auto extendedSize = m_ctx->code.size() + _ctxraBytes;
-    m_codeSpace.reserve(extendedSize);
-    m_codeSpace = m_ctx->code;
-    m_codeSpace.resize(extendedSize);
-    m_code = m_codeSpace.data();
+    _analysis.code.reserve(extendedSize);
+    _analysis.code = m_ctx->code;
+    _analysis.code.resize(extendedSize);
 }
 
 
@@ -281,9 +287,12 @@ void TRACE_STR(...){};
 void TRACE_PRE_OPT(...){};
 void TRACE_POST_OPT(...){};
 void TRACE_VAL(...){};
-void VM::optimize()
+std::shared_ptr<CodeAnalysis const> VM::optimize()
 {
-    copyCode(33);
+    auto analysis = std::make_shared<CodeAnalysis>();
+    copyCode(*analysis, 33);
+    byte* const code = analysis->code.data();
+    std::vector<uint64_t>& jumpDests = analysis->jumpDests;
 
     size_t const nBytes = m_ctx->code.size();
 
@@ -291,7 +300,7 @@ void VM::optimize()
 
     TRACE_STR(1, "Build JUMPDEST table");
     for (size_t pc = 0; pc < nBytes; ++pc) {
-        Instruction op = Instruction(m_code[pc]);
+        Instruction op = Instruction(code[pc]);
         TRACE_OP(2, pc, op);
 
         // make synthetic ops in user code trigger invalid instruction if run
@@ -300,11 +309,11 @@ void VM::optimize()
             op == Instruction::JUMPC ||
             op == Instruction::JUMPCI) {
             TRACE_OP(1, pc, op);
-            m_code[pc] = (byte)Instruction::BAD;
+            code[pc] = (byte)Instruction::BAD;
         }
 
         if (op == Instruction::JUMPDEST) {
-            m_jumpDests.push_back(pc);
+            jumpDests.push_back(pc);
         } else if (
             (byte)Instruction::PUSH1 <= (byte)op &&
             (byte)op <= (byte)Instruction::PUSH32) {
@@ -348,7 +357,7 @@ void VM::optimize()
             }
             return table[hash] == val;
         }
-    } constantPool(m_pool);
+    } constantPool(analysis->pool);
 #define CONST_POOL_HASH_INIT() constantPool.hashInit()
 #define CONST_POOL_HASH_BYTE(b) constantPool.hashByte(b)
 #define CONST_POOL_GET_HASH() constantPool.getHash()
@@ -357,7 +366,7 @@ void VM::optimize()
     TRACE_STR(1, "Do first pass optimizations");
     for (size_t pc = 0; pc < nBytes; ++pc) {
         u256 val = 0;
-        Instruction op = Instruction(m_code[pc]);
+        Instruction op = Instruction(code[pc]);
 
         if ((byte)Instruction::PUSH1 <= (byte)op && (byte)op <= (byte)Instruction::PUSH32) {
             byte nPush = (byte)op - (byte)Instruction::PUSH1 + 1;
@@ -365,10 +374,10 @@ void VM::optimize()
 
             // decode pushed bytes to integral value
             CONST_POOL_HASH_INIT();
-            val = m_code[pc + 1];
+            val = code[pc + 1];
             for (uint64_t i = pc + 2, n = nPush; --n; ++i) {
-                val = (val << 8) | m_code[i];
-                CONST_POOL_HASH_BYTE(m_code[i]);
+                val = (val << 8) | code[i];
+                CONST_POOL_HASH_BYTE(code[i]);
             }
 
             if (1 < nPush) {
@@ -377,9 +386,9 @@ void VM::optimize()
                 TRACE_PRE_OPT(1, pc, op);
                 byte hash = CONST_POOL_GET_HASH();
                 if (CONST_POOL_INSERT_VAL(hash, val)) {
-                    m_code[pc] = (byte)Instruction::PUSHC;
-                    m_code[pc + 1] = hash;
-                    m_code[pc + 2] = nPush - 1;
+                    code[pc] = (byte)Instruction::PUSHC;
+                    code[pc + 1] = hash;
+                    code[pc + 2] = nPush - 1;
                     //TRACE_VAL(1, "constant pooled", val);
                 }
                 TRACE_POST_OPT(1, pc, op);
@@ -390,21 +399,21 @@ void VM::optimize()
             // outer loop is N = number of bytes in code array
             // so complexity is N log M, worst case is N log N
             size_t i = pc + nPush + 1;
-            op = Instruction(m_code[i]);
+            op = Instruction(code[i]);
             if (op == Instruction::JUMP) {
                 TRACE_STR(1, "Replace const JUMPC");
                 TRACE_PRE_OPT(1, i, op);
 
-                if (0 <= verifyJumpDest(val, false))
-                    m_code[i] = byte(op = Instruction::JUMPC);
+                if (0 <= verifyJumpDest(jumpDests, val))
+                    code[i] = byte(op = Instruction::JUMPC);
 
                 TRACE_POST_OPT(1, i, op);
             } else if (op == Instruction::JUMPI) {
                 TRACE_STR(1, "Replace const JUMPCI");
                 TRACE_PRE_OPT(1, i, op);
 
-                if (0 <= verifyJumpDest(val, false))
-                    m_code[i] = byte(op = Instruction::JUMPCI);
+                if (0 <= verifyJumpDest(jumpDests, val))
+                    code[i] = byte(op = Instruction::JUMPCI);
 
                 TRACE_POST_OPT(1, i, op);
             }
@@ -413,6 +422,7 @@ void VM::optimize()
         }
     }
     TRACE_STR(1, "Finished optimizations");
+    return analysis;
 }
 
 void VM::initEntry()
@@ -420,7 +430,21 @@ void VM::initEntry()
     m_bounce = &VM::interpretCases;
     interpretCases(); // first call initializes jump table
     initMetrics();
-    optimize();
+
+    // The analysis depends only on the code, so hot code hashes skip the
+    // JUMPDEST scan, constant pooling and jump rewriting on later calls.
+    h256 const& codeHash = m_ctx->codeHash;
+    bool const cacheable = codeHash && codeHash != EmptySHA3;
+    if (cacheable)
+        m_analysis = CodeCache::instance().analysis(codeHash);
+    if (!m_analysis || m_analysis->code.size() != m_ctx->code.size() + 33) {
+        m_analysis = optimize();
+        if (cacheable)
+            CodeCache::instance().storeAnalysis(codeHash, m_analysis,
+                m_analysis->code.size() + m_analysis->jumpDests.size() * sizeof(uint64_t) + sizeof(m_analysis->pool));
+    }
+    m_code = m_analysis->code.data();
+    m_pool = m_analysis->pool;
 }
 
 
@@ -1173,6 +1197,7 @@ void VM::interpretCases()
         {
             onOperation();
             updateIOGas();
+            m_ctx->noteEnvironmentRead();
 
             *m_SP = (u256)m_ctx->blockHash(*m_SP);
         }
@@ -1182,6 +1207,7 @@ void VM::interpretCases()
         {
             onOperation();
             updateIOGas();
+            m_ctx->noteEnvironmentRead();
 
             //*++m_SP = *((u160 *)&m_ctx->envInfo().author());
             auto addr = Address();
@@ -1193,6 +1219,7 @@ void VM::interpretCases()
         {
             onOperation();
             updateIOGas();
+            m_ctx->noteEnvironmentRead();
 
             *++m_SP = 123456789; // m_ctx->envInfo().timestamp();
         }
@@ -1202,6 +1229,7 @@ void VM::interpretCases()
         {
             onOperation();
             updateIOGas();
+            m_ctx->noteEnvironmentRead();
 
             *++m_SP = 0; //m_ctx->envInfo().number();
         }
@@ -1211,6 +1239,7 @@ void VM::interpretCases()
         {
             onOperation();
             updateIOGas();
+            m_ctx->noteEnvironmentRead();
 
             *++m_SP = 0; //m_ctx->envInfo().difficulty();
         }
@@ -1220,6 +1249,7 @@ void VM::interpretCases()
         {
             onOperation();
             updateIOGas();
+            m_ctx->noteEnvironmentRead();
 
             *++m_SP = 400000; //m_ctx->envInfo().gasLimit();
         }
@@ -329,9 +329,17 @@ struct SubState {
         for (auto s : _s.suicides)
             suicides.insert(s);
         refunds += _s.refunds;
-        //logs += _s.logs;
-        for (auto sl : _s.logs)
-            logs.emplace_back(sl);
+        logs.insert(logs.end(), _s.logs.begin(), _s.logs.end());
+        return *this;
+    }
+
+    /// Same as above, but takes the logs of a finished child context without copying them.
+    SubState& operator+=(SubState&& _s)
+    {
+        suicides.insert(_s.suicides.begin(), _s.suicides.end());
+        refunds += _s.refunds;
+        logs.insert(logs.end(), std::make_move_iterator(_s.logs.begin()), std::make_move_iterator(_s.logs.end()));
+        _s.logs.clear();
         return *this;
     }
 
@@ -369,6 +377,18 @@ struct InstructionMetric {
 };
 
 
+// ====== CodeAnalysis =======
+
+/// Result of VM::optimize() for one piece of code: the code rewritten with
+/// PUSHC/JUMPC/JUMPCI and padded for PUSH reads past the end, the sorted
+/// JUMPDEST table and the constant pool referenced by PUSHC.
+/// Immutable once built, so one instance may be shared by concurrent VMs.
+struct CodeAnalysis {
+    bytes code;
+    std::vector<uint64_t> jumpDests;
+    u256 pool[256];
+};
+
 /**
     */
 class VMFace
@@ -407,7 +427,7 @@ private:
     static std::array<InstructionMetric, 256> c_metrics;
     static void initMetrics();
     static u256 exp256(u256 _base, u256 _exponent);
-    void copyCode(int);
+    void copyCode(CodeAnalysis&, int);
     const void* const* c_jumpTable = 0;
     bool m_caseInit = false;
 
@@ -423,9 +443,10 @@ private:
     // space for memory
     bytes m_mem;
 
-    // space for code and pointer to data
-    bytes m_codeSpace;
-    byte* m_code = nullptr;
+    // analysed code, shared through CodeCache, and pointers into it
+    std::shared_ptr<CodeAnalysis const> m_analysis;
+    byte const* m_code = nullptr;
+    u256 const* m_pool = nullptr;
 
     // space for stack and pointer to data
     u256 m_stackSpace[1025];
@@ -442,9 +463,6 @@ private:
     // mark PCs with frame size to detect cycles and stack mismatch
     std::vector<size_t> m_frameSize;
 
-    // constant pool
-    u256 m_pool[256];
-
     // interpreter state
     Instruction m_OP;              // current operator
     uint64_t m_PC = 0;             // program counter
@@ -458,7 +476,7 @@ private:
 
     // initialize interpreter
     void initEntry();
-    void optimize();
+    std::shared_ptr<CodeAnalysis const> optimize();
 
     // interpreter loop & switch
     void interpretCases();
@@ -480,8 +498,8 @@ private:
     void reportStackUse();
 
     std::vector<uint64_t> m_beginSubs;
-    std::vector<uint64_t> m_jumpDests;
     int64_t verifyJumpDest(u256 const& _dest, bool _throw = true);
+    static int64_t verifyJumpDest(std::vector<uint64_t> const& _jumpDests, u256 const& _dest);
 
     int poolConstant(const u256&);
 
@@ -894,6 +912,9 @@ public:
 
     h256 blockHash(u256 _number) { return h256(); }
 
+    /// Note that the code read the block environment (BLOCKHASH, COINBASE, TIMESTAMP, NUMBER, DIFFICULTY, GASLIMIT).
+    virtual void noteEnvironmentRead() {}
+
     /// Get the execution environment information.
 
     /// Return the EVM gas-price schedule for this execution context.
@@ -944,8 +965,9 @@ public:
     virtual bytes const& codeAt(Address _a) override final { return m_s.code(_a); }
     virtual size_t codeSizeAt(Address _a) override final { return m_s.codeSize(_a); }
     virtual bool exists(Address _a) override { return true; }
-    virtual u256 balance(Address _a) override final { return m_s.balance(_a); }
+    virtual u256 balance(Address _a) override final { m_s.noteEnvironmentRead(); return m_s.balance(_a); }
     virtual void suicide(Address _a) override final {}; //TODO-J
+    virtual void noteEnvironmentRead() override final { m_s.noteEnvironmentRead(); }
 
 
     virtual h160 create(u256 _endowment, u256& io_gas, bytesConstRef _init, OnOpFunc const&) override;
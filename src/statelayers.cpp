@@ -0,0 +1,103 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "statelayers.h"
+
+#include "primitives/block.h"
+#include "streams.h"
+#include "sync.h"
+#include "util.h"
+#include "validation.h"
+#include "version.h"
+#include "scstate.h"
+
+#include <algorithm>
+#include <deque>
+#include <map>
+
+//! Layers by block hash, and their hashes oldest first (protected by cs_main)
+static std::map<uint256, CStateLayer> mapStateLayers;
+static std::deque<uint256> dequeStateLayers;
+static size_t nMaxStateLayers = DEFAULT_STATE_LAYERS;
+static CReorgStats reorgStats = CReorgStats();
+
+static void EraseStateLayer(const uint256& hashBlock)
+{
+    std::map<uint256, CStateLayer>::iterator it = mapStateLayers.find(hashBlock);
+    if (it == mapStateLayers.end())
+        return;
+    reorgStats.nLayerUsage -= it->second.nUsage;
+    mapStateLayers.erase(it);
+    dequeStateLayers.erase(std::find(dequeStateLayers.begin(), dequeStateLayers.end(), hashBlock));
+}
+
+static void TrimStateLayers()
+{
+    while (dequeStateLayers.size() > nMaxStateLayers)
+        EraseStateLayer(dequeStateLayers.front());
+}
+
+void SetMaxStateLayers(unsigned int nMax)
+{
+    LOCK(cs_main);
+    nMaxStateLayers = nMax;
+    TrimStateLayers();
+}
+
+bool ApplyStateLayer(const CBlock& block, CBlockReceipts* pReceipts)
+{
+    AssertLockHeld(cs_main);
+    std::map<uint256, CStateLayer>::const_iterator it = mapStateLayers.find(block.GetHash());
+    if (it == mapStateLayers.end() || it->second.hashParentRoot != pState->rootHash())
+        return false;
+    pState->setRoot(it->second.hashStateRoot);
+    if (pReceipts)
+        *pReceipts = it->second.receipts;
+    reorgStats.nApplied++;
+    LogPrint(BCLog::BENCH, "    - Contract state of %s from its layer\n", it->first.ToString());
+    return true;
+}
+
+void AddStateLayer(const CBlock& block, const sc::h256& hashParentRoot, const sc::h256& hashStateRoot, const CBlockReceipts* pReceipts)
+{
+    AssertLockHeld(cs_main);
+    reorgStats.nExecuted++;
+    if (nMaxStateLayers == 0)
+        return;
+
+    const uint256 hashBlock = block.GetHash();
+    EraseStateLayer(hashBlock);
+    CStateLayer& layer = mapStateLayers[hashBlock];
+    layer.hashBlock = hashBlock;
+    layer.hashParentRoot = hashParentRoot;
+    layer.hashStateRoot = hashStateRoot;
+    if (pReceipts)
+        layer.receipts = *pReceipts;
+    layer.nUsage = sizeof(CStateLayer) + ::GetSerializeSize(layer.receipts, SER_DISK, CLIENT_VERSION);
+    reorgStats.nLayerUsage += layer.nUsage;
+    dequeStateLayers.push_back(hashBlock);
+    TrimStateLayers();
+}
+
+void StateLayersReorg(int nDepth, int64_t nTime, int64_t nDisconnectTime)
+{
+    AssertLockHeld(cs_main);
+    reorgStats.nReorgs++;
+    reorgStats.nLastDepth = nDepth;
+    reorgStats.nMaxDepth = std::max(reorgStats.nMaxDepth, nDepth);
+    reorgStats.nLastTime = nTime;
+    reorgStats.nMaxTime = std::max(reorgStats.nMaxTime, nTime);
+    reorgStats.nTotalTime += nTime;
+    reorgStats.nTotalDisconnectTime += nDisconnectTime;
+    LogPrint(BCLog::BENCH, "- Reorg of %d blocks: %.2fms (disconnect %.2fms)\n", nDepth, nTime * 0.001, nDisconnectTime * 0.001);
+}
+
+CReorgStats GetReorgStats()
+{
+    AssertLockHeld(cs_main);
+    CReorgStats stats = reorgStats;
+    stats.nLayers = mapStateLayers.size();
+    stats.nMaxLayers = nMaxStateLayers;
+    return stats;
+}
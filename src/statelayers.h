@@ -0,0 +1,75 @@
+// Copyright (c) 2018 The Ybtc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef YBTC_STATELAYERS_H
+#define YBTC_STATELAYERS_H
+
+#include "screceipt.h"
+#include "scfixedhash.h"
+#include "uint256.h"
+
+#include <stdint.h>
+
+class CBlock;
+class CBlockIndex;
+
+/** Default for -statelayers, the number of recent contract blocks whose results are kept */
+static const unsigned int DEFAULT_STATE_LAYERS = 16;
+
+/**
+ * What connecting one block did to the contract state.
+ *
+ * State trie nodes are addressed by hash and the state DB never drops them, so
+ * the state after a block stays readable once its root is known. A layer keeps
+ * that root with the root the block was executed on and the receipts it made.
+ * Contract execution depends on nothing but the block and its parent's state,
+ * so connecting the same block on the same root again, as orphan-picker reorgs
+ * of one or two blocks keep doing, can move pState to the layer's root instead
+ * of executing the block's contracts once more.
+ */
+struct CStateLayer
+{
+    uint256 hashBlock;
+    sc::h256 hashParentRoot; //!< Root the block was executed on
+    sc::h256 hashStateRoot;  //!< Root after the block
+    CBlockReceipts receipts; //!< Receipts the block made, empty if nobody asked for them
+    size_t nUsage;
+};
+
+struct CReorgStats
+{
+    size_t nLayers;          //!< Layers kept
+    size_t nMaxLayers;
+    size_t nLayerUsage;      //!< Memory of the layers kept
+    uint64_t nApplied;       //!< Blocks connected from a layer
+    uint64_t nExecuted;      //!< Contract blocks connected by executing their contracts
+    uint64_t nReorgs;
+    int nLastDepth;          //!< Blocks disconnected by the last reorg
+    int nMaxDepth;
+    int64_t nLastTime;       //!< Microseconds from the last reorg's first disconnect to its new tip
+    int64_t nMaxTime;
+    int64_t nTotalTime;
+    int64_t nTotalDisconnectTime;
+};
+
+/** Set how many layers are kept, dropping the oldest ones beyond that */
+void SetMaxStateLayers(unsigned int nMax);
+
+/**
+ * Move pState to the root block left when it was last connected on the current
+ * root, and hand back its receipts. False if no layer matches, in which case
+ * nothing changed and the contracts have to run. Requires cs_main.
+ */
+bool ApplyStateLayer(const CBlock& block, CBlockReceipts* pReceipts);
+
+/** Keep the result of executing the contracts of block. Requires cs_main. */
+void AddStateLayer(const CBlock& block, const sc::h256& hashParentRoot, const sc::h256& hashStateRoot, const CBlockReceipts* pReceipts);
+
+/** Count a reorg that disconnected nDepth blocks, in nDisconnectTime of its nTime microseconds. Requires cs_main. */
+void StateLayersReorg(int nDepth, int64_t nTime, int64_t nDisconnectTime);
+
+/** Requires cs_main */
+CReorgStats GetReorgStats();
+
+#endif // YBTC_STATELAYERS_H
@@ -9,11 +9,13 @@
 #include "hash.h"
 #include "random.h"
 #include "casino.h"
+#include "casinoschedule.h"
 #include "uint256.h"
 #include "util.h"
 #include "ui_interface.h"
 #include "init.h"
 
+#include <algorithm>
 #include <stdint.h>
 
 #include <boost/thread.hpp>
@@ -29,6 +31,8 @@ static const char DB_HEAD_BLOCKS = 'H';
 static const char DB_FLAG = 'F';
 static const char DB_REINDEX_FLAG = 'R';
 static const char DB_LAST_BLOCK = 'l';
+static const char DB_CASINO_SCHEDULE = 'S';
+static const char DB_INDEX_SNAPSHOT = 'M';
 
 namespace {
 
@@ -82,6 +86,12 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    bool ret = WriteCoins(mapCoins, hashBlock, false);
+    mapCoins.clear();
+    return ret;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, bool fSync) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -106,7 +116,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -116,8 +126,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -137,11 +145,56 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Write(DB_BEST_BLOCK, hashBlock);
 
     LogPrint(BCLog::COINDB, "Writing final batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
-    bool ret = db.WriteBatch(batch);
+    bool ret = db.WriteBatch(batch, fSync);
     LogPrint(BCLog::COINDB, "Committed %u changed transaction outputs (out of %u) to coin database...\n", (unsigned int)changed, (unsigned int)count);
     return ret;
 }
 
+bool CCoinsViewWriteBehind::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    CCoinsMap::const_iterator it;
+    if (pending && (it = pending->find(outpoint)) != pending->end()) {
+        // Newer than the database, spent or not
+        coin = it->second.coin;
+        return !coin.IsSpent();
+    }
+    return base->GetCoin(outpoint, coin);
+}
+
+bool CCoinsViewWriteBehind::HaveCoin(const COutPoint &outpoint) const {
+    Coin coin;
+    return GetCoin(outpoint, coin);
+}
+
+uint256 CCoinsViewWriteBehind::GetBestBlock() const {
+    return HasPending() ? hashPending : base->GetBestBlock();
+}
+
+bool CCoinsViewWriteBehind::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    assert(!HasPending());
+    assert(!hashBlock.IsNull());
+    // Hashers are not swappable, but the map moves as a whole
+    pending.reset(new CCoinsMap(std::move(mapCoins)));
+    mapCoins.clear();
+    hashPending = hashBlock;
+    return true;
+}
+
+CCoinsViewCursor *CCoinsViewWriteBehind::Cursor() const {
+    // Only the database is iterated; callers flush synchronously first
+    assert(!HasPending());
+    return base->Cursor();
+}
+
+bool CCoinsViewWriteBehind::WritePending() const {
+    return db->WriteCoins(*pending, hashPending, true);
+}
+
+void CCoinsViewWriteBehind::ReleasePending() {
+    pending.reset();
+    hashPending.SetNull();
+}
+
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -259,21 +312,51 @@ bool CBlockTreeDB::ReadFlag(const std::string &name, bool &fValue) {
     return true;
 }
 
-bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex)
-{
-    std::unique_ptr<CDBIterator> pcursor(NewIterator());
+bool CBlockTreeDB::WriteCasinoSchedule(const CCasinoSchedule& schedule) {
+    return Write(std::make_pair(DB_CASINO_SCHEDULE, schedule.hashBlock), schedule);
+}
 
-    pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, uint256()));
+bool CBlockTreeDB::ReadCasinoSchedule(const uint256& hashBlock, CCasinoSchedule& schedule) {
+    return Read(std::make_pair(DB_CASINO_SCHEDULE, hashBlock), schedule);
+}
 
-    // Load mapBlockIndex
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char, uint256> key;
-        if (pcursor->GetKey(key) && key.first == DB_BLOCK_INDEX) {
-            CDiskBlockIndex diskindex;
-            if (pcursor->GetValue(diskindex)) {
+bool CBlockTreeDB::WriteIndexSnapshot(const uint256& nonce) {
+    return Write(DB_INDEX_SNAPSHOT, nonce, true);
+}
+
+bool CBlockTreeDB::ReadIndexSnapshot(uint256& nonce) {
+    return Read(DB_INDEX_SNAPSHOT, nonce);
+}
+
+bool CBlockTreeDB::EraseIndexSnapshot() {
+    return Erase(DB_INDEX_SNAPSHOT, true);
+}
+
+bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, CBlockIndexArena& arena, int nThreads)
+{
+    // Deserializing the entries and hashing their headers is most of the work,
+    // so it is split by key range over nThreads. Block hashes are uniform, so
+    // each range of their first byte holds about as many entries. Each thread
+    // links what it decoded in small batches, so only those are ever held
+    // twice rather than the whole index.
+    static const size_t LINK_BATCH_SIZE = 1024;
+    const int nRanges = nThreads > 1 ? std::min(256, nThreads * 4) : 1;
+    std::vector<char> vFailed(nRanges, false);
+    CCriticalSection csLink;
+    ParallelFor(nRanges, nThreads, [&](size_t nRange) {
+        const int nFirst = nRange * 256 / nRanges;
+        const int nEnd = (nRange + 1) * 256 / nRanges;
+        uint256 hashFirst;
+        *hashFirst.begin() = nFirst;
+
+        std::vector<std::pair<uint256, CDiskBlockIndex>> vBatch;
+        vBatch.reserve(LINK_BATCH_SIZE);
+        auto linkBatch = [&]() {
+            LOCK(csLink);
+            for (const std::pair<uint256, CDiskBlockIndex>& entry : vBatch) {
+                const CDiskBlockIndex& diskindex = entry.second;
                 // Construct block index object
-                CBlockIndex* pindexNew = insertBlockIndex(diskindex.GetBlockHash());
+                CBlockIndex* pindexNew = insertBlockIndex(entry.first);
                 pindexNew->pprev          = insertBlockIndex(diskindex.hashPrev);
                 pindexNew->nHeight        = diskindex.nHeight;
                 pindexNew->nFile          = diskindex.nFile;
@@ -281,21 +364,47 @@ bool CBlockTreeDB::LoadBlockIndexGuts(const Consensus::Params& consensusParams,
                 pindexNew->nUndoPos       = diskindex.nUndoPos;
                 pindexNew->nVersion       = diskindex.nVersion;
                 pindexNew->hashMerkleRoot = diskindex.hashMerkleRoot;
+                pindexNew->hashStateRoot  = diskindex.hashStateRoot;
                 pindexNew->nTime          = diskindex.nTime;
                 pindexNew->nBits          = diskindex.nBits;
+                arena.SetBlockSig(*pindexNew, diskindex.vchBlockSig);
                 pindexNew->nStatus        = diskindex.nStatus;
                 pindexNew->nTx            = diskindex.nTx;
-
-                if (!CheckCasino(pindexNew->GetBlockHash(), pindexNew->nBits, consensusParams))
-                    return error("%s: CheckCasino failed: %s", __func__, pindexNew->ToString());
-
-                pcursor->Next();
-            } else {
-                return error("%s: failed to read value", __func__);
             }
-        } else {
-            break;
+            vBatch.clear();
+        };
+
+        std::unique_ptr<CDBIterator> pcursor(NewIterator());
+        pcursor->Seek(std::make_pair(DB_BLOCK_INDEX, hashFirst));
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            std::pair<char, uint256> key;
+            if (!pcursor->GetKey(key) || key.first != DB_BLOCK_INDEX || *key.second.begin() >= nEnd)
+                break;
+            CDiskBlockIndex diskindex;
+            if (!pcursor->GetValue(diskindex)) {
+                vFailed[nRange] = true;
+                return;
+            }
+            // The genesis header's nHeight is not its height, so its hash is
+            // the key, which LoadBlockIndex matches against the chain params.
+            const uint256 hash = diskindex.hashPrev.IsNull() ? key.second : diskindex.GetBlockHash();
+            if (!CheckCasino(hash, diskindex.nBits, consensusParams)) {
+                error("%s: CheckCasino failed: %s", __func__, diskindex.ToString());
+                vFailed[nRange] = true;
+                return;
+            }
+            vBatch.emplace_back(hash, std::move(diskindex));
+            if (vBatch.size() == LINK_BATCH_SIZE)
+                linkBatch();
+            pcursor->Next();
         }
+        linkBatch();
+    });
+
+    for (int nRange = 0; nRange < nRanges; nRange++) {
+        if (vFailed[nRange])
+            return error("%s: failed to read the block index", __func__);
     }
 
     return true;
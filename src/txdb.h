@@ -11,11 +11,13 @@
 #include "chain.h"
 
 #include <map>
+#include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
 class CBlockIndex;
+struct CCasinoSchedule;
 class CCoinsViewDBCursor;
 class uint256;
 
@@ -37,6 +39,10 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Max memory allocated to the contract receipt DB cache, if -receiptindex (MiB)
+static const int64_t nMaxReceiptDBCache = 64;
+//! Max memory allocated to the contract call index DB cache, if -contractindex (MiB)
+static const int64_t nMaxContractIndexDBCache = 64;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -78,11 +84,46 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    //! Write the dirty entries of mapCoins and hashBlock as the best block, leaving mapCoins as it is.
+    //! With fSync the best block is durable when this returns.
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock, bool fSync);
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
 };
 
+/**
+ * Coins flushed from pcoinsTip that are not on disk yet. BatchWrite freezes the
+ * flushed entries here, where reads still find them, so that WritePending can
+ * write them to the database without cs_main while pcoinsTip fills again.
+ * The pending entries only change under cs_main and while no write is running:
+ * BatchWrite requires there are none, and ReleasePending drops them once written.
+ */
+class CCoinsViewWriteBehind : public CCoinsViewBacked
+{
+private:
+    CCoinsViewDB *db;
+    std::unique_ptr<const CCoinsMap> pending;
+    uint256 hashPending;
+
+public:
+    CCoinsViewWriteBehind(CCoinsView *viewIn, CCoinsViewDB *dbIn) : CCoinsViewBacked(viewIn), db(dbIn) {}
+
+    bool GetCoin(const COutPoint &outpoint, Coin &coin) const override;
+    bool HaveCoin(const COutPoint &outpoint) const override;
+    uint256 GetBestBlock() const override;
+    bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
+    CCoinsViewCursor *Cursor() const override;
+
+    //! Whether BatchWrite froze entries that ReleasePending did not drop yet
+    bool HasPending() const { return pending != nullptr; }
+    //! Write the pending entries and their best block durably. Needs no lock.
+    bool WritePending() const;
+    //! Drop the pending entries after WritePending succeeded
+    void ReleasePending();
+};
+
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
 class CCoinsViewDBCursor: public CCoinsViewCursor
 {
@@ -123,7 +164,14 @@ public:
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    bool WriteCasinoSchedule(const CCasinoSchedule& schedule);
+    bool ReadCasinoSchedule(const uint256& hashBlock, CCasinoSchedule& schedule);
+    //! Seal of the block index snapshot that matches the entries in this DB
+    bool WriteIndexSnapshot(const uint256& nonce);
+    bool ReadIndexSnapshot(uint256& nonce);
+    bool EraseIndexSnapshot();
+    //! Read the entries of the block index on nThreads and link them with insertBlockIndex, which allocates them from arena
+    bool LoadBlockIndexGuts(const Consensus::Params& consensusParams, std::function<CBlockIndex*(const uint256&)> insertBlockIndex, CBlockIndexArena& arena, int nThreads = 1);
 };
 
 #endif // YBTC_TXDB_H
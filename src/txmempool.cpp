@@ -37,6 +37,8 @@ CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFe
     nSizeWithAncestors = GetTxSize();
     nModFeesWithAncestors = nFee;
     nSigOpCostWithAncestors = sigOpCost;
+    nContractGasWithAncestors = 0;
+    nContractRefundWithAncestors = 0;
 }
 
 CTxMemPoolEntry::CTxMemPoolEntry(const CTxMemPoolEntry& other)
@@ -56,6 +58,15 @@ void CTxMemPoolEntry::UpdateLockPoints(const LockPoints& lp)
     lockPoints = lp;
 }
 
+void CTxMemPoolEntry::SetContractPreExecution(std::shared_ptr<const CContractPreExecution> preExecution)
+{
+    assert(!contractPreExecution && preExecution);
+    contractPreExecution = std::move(preExecution);
+    nContractGasWithAncestors += GetContractGas();
+    nContractRefundWithAncestors += GetContractRefund();
+    nUsageSize += memusage::DynamicUsage(contractPreExecution) + memusage::DynamicUsage(contractPreExecution->vRead) + memusage::DynamicUsage(contractPreExecution->vWrite);
+}
+
 size_t CTxMemPoolEntry::GetTxSize() const
 {
     return GetVirtualTransactionSize(nTxWeight, sigOpCost);
@@ -100,7 +111,7 @@ void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendan
             modifyCount++;
             cachedDescendants[updateIt].insert(cit);
             // Update ancestor state for each descendant
-            mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
+            mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost(), updateIt->GetContractGas(), updateIt->GetContractRefund()));
         }
     }
     mapTx.modify(updateIt, update_descendant_state(modifySize, modifyFee, modifyCount));
@@ -239,12 +250,16 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
     int64_t updateSize = 0;
     CAmount updateFee = 0;
     int64_t updateSigOpsCost = 0;
+    int64_t updateGas = 0;
+    CAmount updateRefund = 0;
     for (txiter ancestorIt : setAncestors) {
         updateSize += ancestorIt->GetTxSize();
         updateFee += ancestorIt->GetModifiedFee();
         updateSigOpsCost += ancestorIt->GetSigOpCost();
+        updateGas += ancestorIt->GetContractGas();
+        updateRefund += ancestorIt->GetContractRefund();
     }
-    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount, updateSigOpsCost));
+    mapTx.modify(it, update_ancestor_state(updateSize, updateFee, updateCount, updateSigOpsCost, updateGas, updateRefund));
 }
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
@@ -274,8 +289,10 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCost();
+            int64_t modifyGas = -(int64_t)removeIt->GetContractGas();
+            CAmount modifyRefund = -removeIt->GetContractRefund();
             for (txiter dit : setDescendants) {
-                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
+                mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps, modifyGas, modifyRefund));
             }
         }
     }
@@ -322,7 +339,7 @@ void CTxMemPoolEntry::UpdateDescendantState(int64_t modifySize, CAmount modifyFe
     assert(int64_t(nCountWithDescendants) > 0);
 }
 
-void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps)
+void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps, int64_t modifyGas, CAmount modifyRefund)
 {
     nSizeWithAncestors += modifySize;
     assert(int64_t(nSizeWithAncestors) > 0);
@@ -331,6 +348,8 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int64_t(nCountWithAncestors) > 0);
     nSigOpCostWithAncestors += modifySigOps;
     assert(int(nSigOpCostWithAncestors) >= 0);
+    nContractGasWithAncestors += modifyGas;
+    nContractRefundWithAncestors += modifyRefund;
 }
 
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
@@ -674,17 +693,23 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         uint64_t nSizeCheck = it->GetTxSize();
         CAmount nFeesCheck = it->GetModifiedFee();
         int64_t nSigOpCheck = it->GetSigOpCost();
+        uint64_t nGasCheck = it->GetContractGas();
+        CAmount nRefundCheck = it->GetContractRefund();
 
         for (txiter ancestorIt : setAncestors) {
             nSizeCheck += ancestorIt->GetTxSize();
             nFeesCheck += ancestorIt->GetModifiedFee();
             nSigOpCheck += ancestorIt->GetSigOpCost();
+            nGasCheck += ancestorIt->GetContractGas();
+            nRefundCheck += ancestorIt->GetContractRefund();
         }
 
         assert(it->GetCountWithAncestors() == nCountCheck);
         assert(it->GetSizeWithAncestors() == nSizeCheck);
         assert(it->GetSigOpCostWithAncestors() == nSigOpCheck);
         assert(it->GetModFeesWithAncestors() == nFeesCheck);
+        assert(it->GetContractGasWithAncestors() == nGasCheck);
+        assert(it->GetContractRefundWithAncestors() == nRefundCheck);
 
         // Check children against mapNextTx
         CTxMemPool::setEntries setChildrenCheck;
@@ -857,7 +882,7 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             CalculateDescendants(it, setDescendants);
             setDescendants.erase(it);
             for (txiter descendantIt : setDescendants) {
-                mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
+                mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0, 0, 0));
             }
             ++nTransactionsUpdated;
         }
@@ -865,6 +890,26 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
 }
 
+bool CTxMemPool::SetContractPreExecution(const uint256& hash, std::shared_ptr<const CContractPreExecution> preExecution)
+{
+    LOCK(cs);
+    txiter it = mapTx.find(hash);
+    if (it == mapTx.end() || it->GetContractPreExecution())
+        return false;
+    cachedInnerUsage -= it->DynamicMemoryUsage();
+    mapTx.modify(it, set_contract_pre_execution(std::move(preExecution)));
+    cachedInnerUsage += it->DynamicMemoryUsage();
+    // Now update all descendants' contract gas and refund with ancestors
+    setEntries setDescendants;
+    CalculateDescendants(it, setDescendants);
+    setDescendants.erase(it);
+    for (txiter descendantIt : setDescendants) {
+        mapTx.modify(descendantIt, update_ancestor_state(0, 0, 0, 0, it->GetContractGas(), it->GetContractRefund()));
+    }
+    ++nTransactionsUpdated;
+    return true;
+}
+
 void CTxMemPool::ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const
 {
     LOCK(cs);
@@ -48,6 +48,35 @@ struct LockPoints
     LockPoints() : height(0), time(0), maxInputBlock(nullptr) { }
 };
 
+/**
+ * Outcome of dry-running the OP_CREATE/OP_CALL outputs of a transaction on the
+ * contract state of the tip shortly after it entered the mempool (entries that
+ * were too costly to dry-run go without). It is only meaningful
+ * while the tip state is still hashStateRoot, and for block assembly only as
+ * long as no transaction placed before it wrote to one of the accounts it read.
+ */
+struct CContractPreExecution
+{
+    uint256 hashStateRoot;       //!< Contract state the transaction was executed on
+    uint64_t nGasUsed;           //!< Gas used by all contract outputs
+    CAmount nRefund;             //!< Unused gas the coinbase pays back to the sender
+    bool fSuccess;               //!< No contract output raised an exception
+    std::vector<uint160> vRead;  //!< Accounts looked up, sorted
+    std::vector<uint160> vWrite; //!< Accounts changed, sorted
+
+    CContractPreExecution() : nGasUsed(0), nRefund(0), fSuccess(false) {}
+
+    //! True if executing the transaction on hashStateRootIn would give the same result
+    bool IsCurrent(const uint256& hashStateRootIn) const { return hashStateRoot == hashStateRootIn; }
+};
+
+/**
+ * Rate at which expected contract gas counts as block space when ranking
+ * transactions for mining; a DEFAULT_BLOCK_GAS_LIMIT budget then weighs about
+ * as much as a full block.
+ */
+static const uint64_t MINING_GAS_PER_VBYTE = 40;
+
 class CTxMemPool;
 
 /** \class CTxMemPoolEntry
@@ -75,6 +104,7 @@ private:
     int64_t sigOpCost;         //!< Total sigop cost
     int64_t feeDelta;          //!< Used for determining the priority of the transaction for mining in a block
     LockPoints lockPoints;     //!< Track the height and time at which tx was final
+    std::shared_ptr<const CContractPreExecution> contractPreExecution; //!< Set for OP_CREATE/OP_CALL transactions
 
     // Information about descendants of this transaction that are in the
     // mempool; if we remove this transaction we must remove all of these
@@ -88,6 +118,8 @@ private:
     uint64_t nSizeWithAncestors;
     CAmount nModFeesWithAncestors;
     int64_t nSigOpCostWithAncestors;
+    uint64_t nContractGasWithAncestors;
+    CAmount nContractRefundWithAncestors;
 
 public:
     CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
@@ -108,16 +140,20 @@ public:
     int64_t GetModifiedFee() const { return nFee + feeDelta; }
     size_t DynamicMemoryUsage() const { return nUsageSize; }
     const LockPoints& GetLockPoints() const { return lockPoints; }
+    const CContractPreExecution* GetContractPreExecution() const { return contractPreExecution.get(); }
+    std::shared_ptr<const CContractPreExecution> GetSharedContractPreExecution() const { return contractPreExecution; }
 
     // Adjusts the descendant state.
     void UpdateDescendantState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount);
     // Adjusts the ancestor state
-    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps);
+    void UpdateAncestorState(int64_t modifySize, CAmount modifyFee, int64_t modifyCount, int modifySigOps, int64_t modifyGas, CAmount modifyRefund);
     // Updates the fee delta used for mining priority score, and the
     // modified fees with descendants.
     void UpdateFeeDelta(int64_t feeDelta);
     // Update the LockPoints after a reorg
     void UpdateLockPoints(const LockPoints& lp);
+    // Attach the dry-run result, once, before the entry is added to the mempool
+    void SetContractPreExecution(std::shared_ptr<const CContractPreExecution> preExecution);
 
     uint64_t GetCountWithDescendants() const { return nCountWithDescendants; }
     uint64_t GetSizeWithDescendants() const { return nSizeWithDescendants; }
@@ -129,6 +165,16 @@ public:
     uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
+    uint64_t GetContractGasWithAncestors() const { return nContractGasWithAncestors; }
+    CAmount GetContractRefundWithAncestors() const { return nContractRefundWithAncestors; }
+
+    //! Expected contract gas, from the pre-execution
+    uint64_t GetContractGas() const { return contractPreExecution ? contractPreExecution->nGasUsed : 0; }
+    //! Part of the fee the block's coinbase refunds for unused gas
+    CAmount GetContractRefund() const { return contractPreExecution ? contractPreExecution->nRefund : 0; }
+    //! Fees a miner keeps and block space taken by the tx and its ancestors, counting contract gas
+    CAmount GetMiningFeesWithAncestors() const { return nModFeesWithAncestors - nContractRefundWithAncestors; }
+    uint64_t GetMiningSizeWithAncestors() const { return nSizeWithAncestors + nContractGasWithAncestors / MINING_GAS_PER_VBYTE; }
 
     mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
 };
@@ -151,18 +197,20 @@ struct update_descendant_state
 
 struct update_ancestor_state
 {
-    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount, int64_t _modifySigOpsCost) :
-        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount), modifySigOpsCost(_modifySigOpsCost)
+    update_ancestor_state(int64_t _modifySize, CAmount _modifyFee, int64_t _modifyCount, int64_t _modifySigOpsCost, int64_t _modifyGas, CAmount _modifyRefund) :
+        modifySize(_modifySize), modifyFee(_modifyFee), modifyCount(_modifyCount), modifySigOpsCost(_modifySigOpsCost), modifyGas(_modifyGas), modifyRefund(_modifyRefund)
     {}
 
     void operator() (CTxMemPoolEntry &e)
-        { e.UpdateAncestorState(modifySize, modifyFee, modifyCount, modifySigOpsCost); }
+        { e.UpdateAncestorState(modifySize, modifyFee, modifyCount, modifySigOpsCost, modifyGas, modifyRefund); }
 
     private:
         int64_t modifySize;
         CAmount modifyFee;
         int64_t modifyCount;
         int64_t modifySigOpsCost;
+        int64_t modifyGas;
+        CAmount modifyRefund;
 };
 
 struct update_fee_delta
@@ -175,6 +223,16 @@ private:
     int64_t feeDelta;
 };
 
+struct set_contract_pre_execution
+{
+    set_contract_pre_execution(std::shared_ptr<const CContractPreExecution> _preExecution) : preExecution(std::move(_preExecution)) { }
+
+    void operator() (CTxMemPoolEntry &e) { e.SetContractPreExecution(preExecution); }
+
+private:
+    std::shared_ptr<const CContractPreExecution> preExecution;
+};
+
 struct update_lock_points
 {
     update_lock_points(const LockPoints& _lp) : lp(_lp) { }
@@ -269,11 +327,11 @@ class CompareTxMemPoolEntryByAncestorFee
 public:
     bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
     {
-        double aFees = a.GetModFeesWithAncestors();
-        double aSize = a.GetSizeWithAncestors();
+        double aFees = a.GetMiningFeesWithAncestors();
+        double aSize = a.GetMiningSizeWithAncestors();
 
-        double bFees = b.GetModFeesWithAncestors();
-        double bSize = b.GetSizeWithAncestors();
+        double bFees = b.GetMiningFeesWithAncestors();
+        double bSize = b.GetMiningSizeWithAncestors();
 
         // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
         double f1 = aFees * bSize;
@@ -542,6 +600,9 @@ public:
     void ApplyDelta(const uint256 hash, CAmount &nFeeDelta) const;
     void ClearPrioritisation(const uint256 hash);
 
+    /** Attach the dry run of a contract transaction that entered without one; false if it is gone or has one */
+    bool SetContractPreExecution(const uint256& hash, std::shared_ptr<const CContractPreExecution> preExecution);
+
 public:
     /** Remove a set of transactions from the mempool.
      *  If a transaction is in this set, then all in-mempool descendants must
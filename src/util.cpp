@@ -76,6 +76,8 @@
 #include <malloc.h>
 #endif
 
+#include <mutex>
+
 #include <boost/algorithm/string/case_conv.hpp> // for to_lower()
 #include <boost/algorithm/string/predicate.hpp> // for startswith() and endswith()
 #include <boost/program_options/detail/config_file.hpp>
@@ -897,6 +899,33 @@ int GetNumCores()
 #endif
 }
 
+void ParallelFor(size_t n, int nThreads, const std::function<void(size_t)>& func)
+{
+    std::atomic<size_t> nNext(0);
+    std::exception_ptr error;
+    std::mutex mutexError;
+    auto work = [&]() {
+        for (size_t i = nNext++; i < n; i = nNext++) {
+            try {
+                func(i);
+            } catch (...) {
+                std::lock_guard<std::mutex> lock(mutexError);
+                if (!error)
+                    error = std::current_exception();
+                nNext = n;
+            }
+        }
+    };
+
+    boost::thread_group threads;
+    for (int i = 1; i < nThreads && (size_t)i < n; i++)
+        threads.create_thread(work);
+    work();
+    threads.join_all();
+    if (error)
+        std::rethrow_exception(error);
+}
+
 std::string CopyrightHolders(const std::string& strPrefix)
 {
     std::string strCopyrightHolders = strPrefix + strprintf(_(COPYRIGHT_HOLDERS), _(COPYRIGHT_HOLDERS_SUBSTITUTION));
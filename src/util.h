@@ -22,6 +22,7 @@
 
 #include <atomic>
 #include <exception>
+#include <functional>
 #include <map>
 #include <stdint.h>
 #include <string>
@@ -319,6 +320,13 @@ template <typename Callable> void TraceThread(const char* name,  Callable func)
     }
 }
 
+/**
+ * Call func(i) for each i in [0, n), spread over nThreads threads of which the
+ * calling one is one, and return once all calls are done. The first exception
+ * a call throws is thrown again here, after the other threads have finished.
+ */
+void ParallelFor(size_t n, int nThreads, const std::function<void(size_t)>& func);
+
 std::string CopyrightHolders(const std::string& strPrefix);
 
 void GenerateRandom8Char(char *s);
@@ -7,7 +7,10 @@
 
 #include "arith_uint256.h"
 #include "base58.h"
+#include "blockimport.h"
+#include "blockwriter.h"
 #include "casino.h"
+#include "casinoschedule.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -17,8 +20,10 @@
 #include "consensus/tx_verify.h"
 #include "consensus/validation.h"
 #include "cuckoocache.h"
+#include "filemap.h"
 #include "fs.h"
 #include "hash.h"
+#include "indexsnapshot.h"
 #include "init.h"
 #include "policy/fees.h"
 #include "policy/policy.h"
@@ -30,6 +35,7 @@
 #include "script/script.h"
 #include "script/sigcache.h"
 #include "script/standard.h"
+#include "statelayers.h"
 #include "timedata.h"
 #include "tinyformat.h"
 #include "txdb.h"
@@ -44,6 +50,7 @@
 #include "warnings.h"
 
 #include <atomic>
+#include <deque>
 #include <sstream>
 
 #include <boost/algorithm/string/join.hpp>
@@ -61,6 +68,7 @@
 CCriticalSection cs_main;
 
 BlockMap mapBlockIndex;
+CBlockIndexArena arenaBlockIndex;
 CChain chainActive;
 CBlockIndex* pindexBestHeader = nullptr;
 CWaitableCriticalSection csBestBlock;
@@ -141,6 +149,16 @@ std::multimap<CBlockIndex*, CBlockIndex*> mapBlocksUnlinked;
 CCriticalSection cs_LastBlockFile;
 std::vector<CBlockFileInfo> vinfoBlockFile;
 int nLastBlockFile = 0;
+/** Appends the block and undo data placed by FindBlockPos and FindUndoPos */
+static CBlockFileWriter blockFileWriter([](int nFile, bool fUndo) {
+    return GetBlockPosFilename(CDiskBlockPos(nFile, 0), fUndo ? "rev" : "blk");
+});
+/** Reads ahead the blocks that an import connects, between StartBlockPrefetch and StopBlockPrefetch */
+static std::unique_ptr<CBlockPrefetcher> pblockprefetcher;
+/** Maps the block files that raw blocks are served from */
+static CBlockFileMap blockFileMap([](int nFile) {
+    return GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk");
+});
 /** Global flag to indicate we should check to see if there are
      *  block/undo files that should be deleted.  Set on startup
      *  or if we allocate more file space when we're in prune mode
@@ -204,6 +222,7 @@ CBlockIndex* FindForkInGlobalIndex(const CChain& chain, const CBlockLocator& loc
 }
 
 CCoinsViewDB* pcoinsdbview = nullptr;
+CCoinsViewWriteBehind* pcoinswritebehind = nullptr;
 CCoinsViewCache* pcoinsTip = nullptr;
 CBlockTreeDB* pblocktree = nullptr;
 
@@ -461,6 +480,22 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
+//! Contract transactions accepted to the mempool that wait for ThreadContractDryRun
+static boost::mutex cs_dryRunQueue;
+static CConditionVariable cvDryRunQueue;
+static std::deque<CTransactionRef> dryRunQueue;
+
+static void QueueContractDryRun(const CTransactionRef& ptx)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(cs_dryRunQueue);
+        if (dryRunQueue.size() >= MAX_MEMPOOL_DRYRUN_QUEUE)
+            return;
+        dryRunQueue.push_back(ptx);
+    }
+    cvDryRunQueue.notify_one();
+}
+
 static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced, bool fOverrideMempoolLimit, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache)
 {
     const CTransaction& tx = *ptx;
@@ -869,6 +904,11 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         // Store transaction in memory
         pool.addUnchecked(hash, entry, setAncestors, validForFeeEstimation);
 
+        // Dry-run the contract outputs without cs_main, now that the scripts
+        // passed so unsigned junk costs no execution
+        if (tx.HasCreateOrCall() && pState)
+            QueueContractDryRun(ptx);
+
         // trim mempool and check if tx was trimmed
         if (!fOverrideMempoolLimit) {
             LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
@@ -882,6 +922,52 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     return true;
 }
 
+// Dry-run the contract outputs of a mempool transaction on a fork of the tip
+// state. Block assembly reuses the result while neither the tip state nor the
+// accounts it read have changed; a transaction that can only fail is evicted.
+static void DryRunMempoolContract(const CTransactionRef& ptx)
+{
+    std::shared_ptr<sc::State> view;
+    {
+        LOCK(cs_main);
+        if (!mempool.exists(ptx->GetHash()))
+            return;
+        view = std::make_shared<sc::State>(sc::State::fork(*pState, pState->rootHash()));
+    }
+
+    auto preExecution = std::make_shared<CContractPreExecution>();
+    bool fFinalFailure;
+    if (!SmartContract(view.get()).PreExecuteTx(*ptx, *preExecution, fFinalFailure, MAX_MEMPOOL_DRYRUN_GAS, MAX_MEMPOOL_DRYRUN_TIME * 1000))
+        return;
+
+    // cs_main too, so the mempool does not shrink under block assembly holding it
+    LOCK2(cs_main, mempool.cs);
+    if (fFinalFailure) {
+        if (mempool.exists(ptx->GetHash())) {
+            LogPrint(BCLog::MEMPOOL, "%s: removing tx %s whose contracts can only fail\n", __func__, ptx->GetHash().ToString());
+            mempool.removeRecursive(*ptx);
+        }
+        return;
+    }
+    mempool.SetContractPreExecution(ptx->GetHash(), std::move(preExecution));
+}
+
+void ThreadContractDryRun()
+{
+    RenameThread("ybtc-dryrun");
+    while (true) {
+        CTransactionRef ptx;
+        {
+            boost::unique_lock<boost::mutex> lock(cs_dryRunQueue);
+            while (dryRunQueue.empty())
+                cvDryRunQueue.wait(lock);
+            ptx = std::move(dryRunQueue.front());
+            dryRunQueue.pop_front();
+        }
+        DryRunMempoolContract(ptx);
+    }
+}
+
 /** (try to) add transaction to memory pool with a specified acceptance time **/
 static bool AcceptToMemoryPoolWithTime(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& tx, bool fLimitFree, bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced, bool fOverrideMempoolLimit, const CAmount nAbsurdFee)
 {
@@ -919,6 +1005,7 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
     if (fTxIndex) {
         CDiskTxPos postx;
         if (pblocktree->ReadTxIndex(hash, postx)) {
+            blockFileWriter.WaitForRead(postx.nFile, false, postx.nPos);
             CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
             if (file.IsNull())
                 return error("%s: OpenBlockFile failed", __func__);
@@ -966,21 +1053,16 @@ bool GetTransaction(const uint256& hash, CTransactionRef& txOut, const Consensus
 
 static bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenBlockFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("WriteBlockToDisk: OpenBlockFile failed");
+    // Index header and block, appended by the block file writer
+    unsigned int nSize = GetSerializeSize(block, SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned char> data;
+    data.reserve(CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize) + nSize);
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0, FLATDATA(messageStart), nSize, block);
 
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, block);
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write block
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("WriteBlockToDisk: ftell failed");
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << block;
+    const unsigned int nPosRecord = pos.nPos;
+    pos.nPos += CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize);
+    if (!blockFileWriter.Append(pos.nFile, false, nPosRecord, std::move(data)))
+        return error("WriteBlockToDisk: writing block file %u failed", pos.nFile);
 
     return true;
 }
@@ -990,6 +1072,7 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus:
     block.SetNull();
 
     // Open history file to read
+    blockFileWriter.WaitForRead(pos.nFile, false, pos.nPos);
     CAutoFile filein(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("ReadBlockFromDisk: OpenBlockFile failed for %s", pos.ToString());
@@ -1018,6 +1101,30 @@ bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus
     return true;
 }
 
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart)
+{
+    const CDiskBlockPos pos = pindex->GetBlockPos();
+    if (pos.IsNull())
+        return error("%s: no block data for %s", __func__, pindex->ToString());
+    blockFileWriter.WaitForRead(pos.nFile, false, pos.nPos);
+    if (!blockFileMap.ReadRecord(pos.nFile, pos.nPos, (const unsigned char*)messageStart, MAX_BLOCK_SERIALIZED_SIZE, vchBlock))
+        return error("%s: no block record at %s", __func__, pos.ToString());
+
+    // Check the header against the index, as ReadBlockFromDisk does; it is all
+    // that is deserialized, from a prefix that holds it with its signature
+    CBlockHeader header;
+    try {
+        CDataStream ssHeader((const char*)vchBlock.data(), (const char*)vchBlock.data() + std::min<size_t>(vchBlock.size(), 1024), SER_DISK, CLIENT_VERSION);
+        ssHeader >> header;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize error - %s at %s", __func__, e.what(), pos.ToString());
+    }
+    if (header.GetHash() != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, pindex->ToString(), pos.ToString());
+
+    return true;
+}
+
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams)
 {
     int halvings = nHeight / consensusParams.nSubsidyHalvingInterval;
@@ -1333,27 +1440,21 @@ namespace
 {
 bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint256& hashBlock, const CMessageHeader::MessageStartChars& messageStart)
 {
-    // Open history file to append
-    CAutoFile fileout(OpenUndoFile(pos), SER_DISK, CLIENT_VERSION);
-    if (fileout.IsNull())
-        return error("%s: OpenUndoFile failed", __func__);
-
-    // Write index header
-    unsigned int nSize = GetSerializeSize(fileout, blockundo);
-    fileout << FLATDATA(messageStart) << nSize;
-
-    // Write undo data
-    long fileOutPos = ftell(fileout.Get());
-    if (fileOutPos < 0)
-        return error("%s: ftell failed", __func__);
-    pos.nPos = (unsigned int)fileOutPos;
-    fileout << blockundo;
-
-    // calculate & write checksum
+    // calculate checksum
     CHashWriter hasher(SER_GETHASH, PROTOCOL_VERSION);
     hasher << hashBlock;
     hasher << blockundo;
-    fileout << hasher.GetHash();
+
+    // Index header, undo data and checksum, appended by the block file writer
+    unsigned int nSize = GetSerializeSize(blockundo, SER_DISK, CLIENT_VERSION);
+    std::vector<unsigned char> data;
+    data.reserve(CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize) + nSize + sizeof(uint256));
+    CVectorWriter(SER_DISK, CLIENT_VERSION, data, 0, FLATDATA(messageStart), nSize, blockundo, hasher.GetHash());
+
+    const unsigned int nPosRecord = pos.nPos;
+    pos.nPos += CMessageHeader::MESSAGE_START_SIZE + sizeof(nSize);
+    if (!blockFileWriter.Append(pos.nFile, true, nPosRecord, std::move(data)))
+        return error("%s: writing undo file %u failed", __func__, pos.nFile);
 
     return true;
 }
@@ -1361,6 +1462,7 @@ bool UndoWriteToDisk(const CBlockUndo& blockundo, CDiskBlockPos& pos, const uint
 bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock)
 {
     // Open history file to read
+    blockFileWriter.WaitForRead(pos.nFile, true, pos.nPos);
     CAutoFile filein(OpenUndoFile(pos, true), SER_DISK, CLIENT_VERSION);
     if (filein.IsNull())
         return error("%s: OpenUndoFile failed", __func__);
@@ -1513,27 +1615,37 @@ static DisconnectResult DisconnectBlock(const CBlock& block, const CBlockIndex*
     return fClean ? DISCONNECT_OK : DISCONNECT_UNCLEAN;
 }
 
-void static FlushBlockFile(bool fFinalize = false)
+/**
+ * Make the block and undo data written so far durable, syncing each file
+ * written since the last call once. With fFinalize, also trim the current
+ * block and undo files, which are left for the next ones, to their size.
+ */
+static bool FlushBlockFile(bool fFinalize = false)
 {
     LOCK(cs_LastBlockFile);
 
+    if (!blockFileWriter.Sync())
+        return false;
+    if (!fFinalize)
+        return true;
+
     CDiskBlockPos posOld(nLastBlockFile, 0);
 
+    blockFileMap.Drop(nLastBlockFile);
     FILE* fileOld = OpenBlockFile(posOld);
     if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
+        TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nSize);
         FileCommit(fileOld);
         fclose(fileOld);
     }
 
     fileOld = OpenUndoFile(posOld);
     if (fileOld) {
-        if (fFinalize)
-            TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
+        TruncateFile(fileOld, vinfoBlockFile[nLastBlockFile].nUndoSize);
         FileCommit(fileOld);
         fclose(fileOld);
     }
+    return true;
 }
 
 static bool FindUndoPos(CValidationState& state, int nFile, CDiskBlockPos& pos, unsigned int nAddSize);
@@ -1561,6 +1673,10 @@ int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Para
         }
     }
 
+    // Not a deployment: the bit says the header carries its producer's signature
+    if (IsCasinoSlotEnforced(pindexPrev ? pindexPrev->nHeight + 1 : 0, params))
+        nVersion |= BLOCK_VERSION_CASINO_SIGNED;
+
     return nVersion;
 }
 
@@ -1652,7 +1768,7 @@ static bool CheckContractRefundFee(const CBlock& block, std::vector<CTxOut>& vRe
     return true;
 }
 
-bool CheckContractTx(const CBlock& block, CValidationState& state, bool hasContract)
+bool CheckContractTx(const CBlock& block, CValidationState& state, bool hasContract, CBlockReceipts* pReceipts)
 {
 
     
@@ -1671,7 +1787,7 @@ bool CheckContractTx(const CBlock& block, CValidationState& state, bool hasContr
 
     std::vector<CTxOut> vRefundGasFee = std::vector<CTxOut>();
 
-    if (!smct.GetBlockContract(checkBlock, vRefundGasFee)) {
+    if (!smct.GetBlockContract(checkBlock, vRefundGasFee, pReceipts)) {
         pState->setRoot(oldHashStateRoot);
         LogPrintf("Execute contract failed...\n");
         return state.DoS(100, false, REJECT_INVALID, "bad-contract when connecting block", true, "get contract failed");
@@ -1715,6 +1831,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     if (!CheckBlock(block, state, chainparams.GetConsensus(), !fJustCheck, !fJustCheck))
         return error("%s: Consensus::CheckBlock: %s", __func__, FormatStateMessage(state));
 
+    // The header was accepted without knowing the schedule of its phase, which
+    // is known now that its ancestors are connected. Templates are only signed
+    // once they are built.
+    if (!fJustCheck && pindex->pprev && !CheckCasinoProducer(block, state, chainparams.GetConsensus(), pindex->pprev))
+        return error("%s: CheckCasinoProducer: %s", __func__, FormatStateMessage(state));
+
     // verify that the view's current state corresponds to the previous block
     uint256 hashPrevBlock = pindex->pprev == nullptr ? uint256() : pindex->pprev->GetBlockHash();
     assert(hashPrevBlock == view.GetBestBlock());
@@ -1884,7 +2006,12 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     }
 
 
-    if (!CheckContractTx(block, state, hasContract))
+    CBlockReceipts blockReceipts;
+    CBlockReceipts* pReceipts = preceiptdb && !fJustCheck ? &blockReceipts : nullptr;
+    // A block connected again on the root it was executed on gets its result back from its layer
+    const sc::h256 hashParentRoot(pState->rootHash());
+    const bool fExecute = !hasContract || fJustCheck || !ApplyStateLayer(block, pReceipts);
+    if (fExecute && !CheckContractTx(block, state, hasContract, pReceipts))
         return state.DoS(100, error("%s: CheckContractTx failed", __func__), REJECT_INVALID, "block-validation-failed");
 
     int64_t nTime3 = GetTimeMicros();
@@ -1914,6 +2041,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         return true;
     }
 
+    if (fExecute && hasContract)
+        AddStateLayer(block, hashParentRoot, pState->rootHash(), pReceipts);
+
     // Write undo information to disk
     if (pindex->GetUndoPos().IsNull() || !pindex->IsValid(BLOCK_VALID_SCRIPTS)) {
         if (pindex->GetUndoPos().IsNull()) {
@@ -1936,6 +2066,9 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
         if (!pblocktree->WriteTxIndex(vPos))
             return AbortNode(state, "Failed to write transaction index");
 
+    if (!WriteBlockReceipts(pindex, blockReceipts))
+        return AbortNode(state, "Failed to write contract receipts");
+
     // add this block to the view's block chain
     view.SetBestBlock(pindex->GetBlockHash());
 
@@ -1950,6 +2083,180 @@ static bool ConnectBlock(const CBlock& block, CValidationState& state, CBlockInd
     return true;
 }
 
+/**
+ * Writes what a full flush froze, without cs_main, so that block connection
+ * goes on meanwhile. At most one flush is queued or being written: the next
+ * full flush waits for it, which is the stall nTotalWaitTime counts.
+ */
+struct CChainstateWriter
+{
+    boost::mutex mutex;
+    boost::condition_variable cond;
+    bool fQueued = false;   //!< A frozen flush waits for its write or is being written
+    bool fWritten = false;  //!< ...and the write finished
+    bool fOk = true;        //!< ...without errors
+    int64_t nWriteTime = 0; //!< ...in this many microseconds
+};
+
+static CChainstateWriter* pchainstateWriter = nullptr;
+static boost::thread* pchainstateWriterThread = nullptr;
+static CChainstateFlushStats chainstateFlushStats; // protected by cs_main
+
+// The contract state goes first, so that the best block written with the coins
+// never names a state root that is not on disk
+static bool WriteFrozenChainstate()
+{
+    if (pState && !pState->db().writeFrozen())
+        return false;
+    return pcoinswritebehind->WritePending();
+}
+
+static void ReleaseFrozenChainstate(int64_t nWriteTime)
+{
+    AssertLockHeld(cs_main);
+    if (pState)
+        pState->db().releaseFrozen();
+    pcoinswritebehind->ReleasePending();
+    chainstateFlushStats.fWriting = false;
+    chainstateFlushStats.nPendingUsage = 0;
+    chainstateFlushStats.nLastWriteTime = nWriteTime;
+    chainstateFlushStats.nTotalWriteTime += nWriteTime;
+}
+
+static void ThreadChainstateWriter()
+{
+    RenameThread("ybtc-flush");
+    CChainstateWriter& writer = *pchainstateWriter;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(writer.mutex);
+            while (!writer.fQueued || writer.fWritten)
+                writer.cond.wait(lock);
+        }
+        int64_t nStart = GetTimeMicros();
+        bool fOk = WriteFrozenChainstate();
+        {
+            boost::lock_guard<boost::mutex> lock(writer.mutex);
+            writer.fWritten = true;
+            writer.fOk = fOk;
+            writer.nWriteTime = GetTimeMicros() - nStart;
+        }
+        writer.cond.notify_all();
+    }
+}
+
+// Release the flush the writer finished, waiting for it with fWait. False if its write failed.
+static bool FinishChainstateWrite(bool fWait)
+{
+    AssertLockHeld(cs_main);
+    if (!pchainstateWriter)
+        return true;
+    CChainstateWriter& writer = *pchainstateWriter;
+    int64_t nWriteTime;
+    {
+        boost::unique_lock<boost::mutex> lock(writer.mutex);
+        if (!writer.fQueued)
+            return true;
+        if (!writer.fWritten) {
+            if (!fWait)
+                return true;
+            boost::this_thread::disable_interruption di;
+            int64_t nStart = GetTimeMicros();
+            while (!writer.fWritten)
+                writer.cond.wait(lock);
+            chainstateFlushStats.nTotalWaitTime += GetTimeMicros() - nStart;
+        }
+        if (!writer.fOk)
+            return false;
+        writer.fQueued = false;
+        writer.fWritten = false;
+        nWriteTime = writer.nWriteTime;
+    }
+    ReleaseFrozenChainstate(nWriteTime);
+    return true;
+}
+
+void StartChainstateWriter()
+{
+    if (pchainstateWriter || !gArgs.GetBoolArg("-asyncflush", DEFAULT_ASYNC_FLUSH))
+        return;
+    pchainstateWriter = new CChainstateWriter();
+    pchainstateWriterThread = new boost::thread(&ThreadChainstateWriter);
+    LOCK(cs_main);
+    chainstateFlushStats.fAsync = true;
+}
+
+void StopChainstateWriter()
+{
+    if (!pchainstateWriter)
+        return;
+    {
+        LOCK(cs_main);
+        if (!FinishChainstateWrite(true))
+            LogPrintf("%s: failed to write the chainstate\n", __func__);
+        chainstateFlushStats.fAsync = false;
+    }
+    pchainstateWriterThread->interrupt();
+    pchainstateWriterThread->join();
+    delete pchainstateWriterThread;
+    pchainstateWriterThread = nullptr;
+    delete pchainstateWriter;
+    pchainstateWriter = nullptr;
+}
+
+CChainstateFlushStats GetChainstateFlushStats()
+{
+    LOCK(cs_main);
+    return chainstateFlushStats;
+}
+
+void StartBlockFileWriter()
+{
+    if (gArgs.GetBoolArg("-blockwriter", DEFAULT_BLOCK_WRITER))
+        blockFileWriter.Start();
+}
+
+void StopBlockFileWriter()
+{
+    blockFileWriter.Stop();
+    LOCK(cs_LastBlockFile);
+    if (!blockFileWriter.Sync())
+        LogPrintf("%s: failed to write block files\n", __func__);
+}
+
+CBlockWriterStats GetBlockWriterStats()
+{
+    return blockFileWriter.GetStats();
+}
+
+void StartBlockPrefetch(const CChainParams& chainparams)
+{
+    LOCK(cs_main);
+    if (setBlockIndexCandidates.empty())
+        return;
+    std::vector<CBlockPrefetcher::Entry> vPath;
+    for (CBlockIndex* pindex = *setBlockIndexCandidates.rbegin(); pindex && !chainActive.Contains(pindex); pindex = pindex->pprev) {
+        if (pindex->nStatus & BLOCK_HAVE_DATA)
+            vPath.push_back(CBlockPrefetcher::Entry{pindex, pindex->GetBlockPos(), pindex->GetBlockHash()});
+    }
+    if (vPath.empty())
+        return;
+    std::reverse(vPath.begin(), vPath.end());
+    LogPrintf("Reading %u blocks ahead of their connection\n", vPath.size());
+    pblockprefetcher.reset(new CBlockPrefetcher(std::move(vPath), pcoinsdbview, chainparams.GetConsensus(), BLOCK_PREFETCH_THREADS));
+}
+
+void StopBlockPrefetch()
+{
+    std::unique_ptr<CBlockPrefetcher> pprefetcher;
+    {
+        LOCK(cs_main);
+        pprefetcher.swap(pblockprefetcher);
+    }
+    // Joined without cs_main
+    pprefetcher.reset();
+}
+
 /**
  * Update the on-disk chain state.
  * The caches and indexes are flushed depending on the mode we're called with
@@ -1960,6 +2267,7 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
 {
     int64_t nMempoolUsage = mempool.DynamicMemoryUsage();
     LOCK(cs_main);
+    const int64_t nFlushStart = GetTimeMicros();
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
     static int64_t nLastSetChain = 0;
@@ -1968,6 +2276,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
     bool fDoFullFlush = false;
     int64_t nNow = 0;
     try {
+        // Release the flush the background writer finished since
+        if (!FinishChainstateWrite(false))
+            return AbortNode(state, "Failed to write to coin database");
         {
             LOCK(cs_LastBlockFile);
             if (fPruneMode && (fCheckForPruning || nManualPruneHeight > 0) && !fReindex) {
@@ -1997,7 +2308,9 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
                 nLastSetChain = nNow;
             }
             int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-            int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+            // The contract state's trie nodes and the coins being written share the coins cache's budget
+            int64_t nStateUsage = pState ? pState->db().memoryUsage() : 0;
+            int64_t cacheSize = pcoinsTip->DynamicMemoryUsage() + nStateUsage + chainstateFlushStats.nPendingUsage;
             int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
             // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
             bool fCacheLarge = mode == FLUSH_STATE_PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
@@ -2015,7 +2328,8 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
                 if (!CheckDiskSpace(0))
                     return state.Error("out of disk space");
                 // First make sure all block and undo data is flushed to disk.
-                FlushBlockFile();
+                if (!FlushBlockFile())
+                    return AbortNode(state, "Failed to write block files");
                 // Then update all block file information (which may refer to block and undo files).
                 {
                     std::vector<std::pair<int, const CBlockFileInfo*>> vFiles;
@@ -2046,12 +2360,38 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState&
                 // twice (once in the log, and once in the tables). This is already
                 // an overestimation, as most will delete an existing entry or
                 // overwrite one. Still, use a conservative safety factor of 2.
-                if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
+                if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize() + 2 * nStateUsage))
                     return state.Error("out of disk space");
-                // Flush the chainstate (which may refer to block index entries).
+                // Only one flush is frozen at a time
+                if (!FinishChainstateWrite(true))
+                    return AbortNode(state, "Failed to write to coin database");
+                // Freeze the contract state and the chainstate (which may refer to
+                // block index entries). Block connection goes on with empty caches
+                // on top of the frozen ones while they are written.
+                chainstateFlushStats.nPendingUsage = pcoinsTip->DynamicMemoryUsage();
+                if (pState)
+                    pState->db().freeze();
                 if (!pcoinsTip->Flush())
                     return AbortNode(state, "Failed to write to coin database");
+                chainstateFlushStats.fWriting = true;
+                chainstateFlushStats.nFlushes++;
+                if (pchainstateWriter && mode != FLUSH_STATE_ALWAYS) {
+                    {
+                        boost::lock_guard<boost::mutex> lock(pchainstateWriter->mutex);
+                        pchainstateWriter->fQueued = true;
+                    }
+                    pchainstateWriter->cond.notify_all();
+                    chainstateFlushStats.nAsyncFlushes++;
+                } else {
+                    // Callers of an explicit flush expect the databases to be up to date
+                    int64_t nWriteStart = GetTimeMicros();
+                    if (!WriteFrozenChainstate())
+                        return AbortNode(state, "Failed to write to coin database");
+                    ReleaseFrozenChainstate(GetTimeMicros() - nWriteStart);
+                }
                 nLastFlush = nNow;
+                chainstateFlushStats.nLastStallTime = GetTimeMicros() - nFlushStart;
+                chainstateFlushStats.nTotalStallTime += chainstateFlushStats.nLastStallTime;
             }
         }
         if (fDoFullFlush || ((mode == FLUSH_STATE_ALWAYS || mode == FLUSH_STATE_PERIODIC) && nNow > nLastSetChain + (int64_t)DATABASE_WRITE_INTERVAL * 1000000)) {
@@ -2192,6 +2532,8 @@ bool static DisconnectTip(CValidationState& state, const CChainParams& chainpara
         }
     }
 
+    ReceiptIndexBlockDisconnected(pindexDelete);
+
     // Update chainActive and related variables.
     UpdateTip(pindexDelete->pprev, chainparams);
     // Let wallets know transactions went from 1-confirmed to
@@ -2288,14 +2630,14 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     assert(pindexNew->pprev == chainActive.Tip());
     // Read block from disk.
     int64_t nTime1 = GetTimeMicros();
-    std::shared_ptr<const CBlock> pthisBlock;
-    if (!pblock) {
+    std::shared_ptr<const CBlock> pthisBlock = pblock;
+    if (!pthisBlock && pblockprefetcher)
+        pthisBlock = pblockprefetcher->Take(pindexNew);
+    if (!pthisBlock) {
         std::shared_ptr<CBlock> pblockNew = std::make_shared<CBlock>();
         if (!ReadBlockFromDisk(*pblockNew, pindexNew, chainparams.GetConsensus()))
             return AbortNode(state, "Failed to read block");
         pthisBlock = pblockNew;
-    } else {
-        pthisBlock = pblock;
     }
     const CBlock& blockConnecting = *pthisBlock;
     // Apply the block atomically to the chain state.
@@ -2334,6 +2676,8 @@ bool static ConnectTip(CValidationState& state, const CChainParams& chainparams,
     disconnectpool.removeForBlock(blockConnecting.vtx);
     // Update chainActive & related variables.
     UpdateTip(pindexNew, chainparams);
+    ReceiptIndexBlockConnected(pindexNew);
+    CasinoScheduleBlockConnected(pindexNew);
 
     int64_t nTime6 = GetTimeMicros();
     nTimePostConnect += nTime6 - nTime5;
@@ -2429,6 +2773,7 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
 
     // Disconnect active blocks which are no longer in the best chain.
     bool fBlocksDisconnected = false;
+    const int64_t nReorgStart = GetTimeMicros();
     DisconnectedBlockTransactions disconnectpool;
     while (chainActive.Tip() && chainActive.Tip() != pindexFork) {
         if (!DisconnectTip(state, chainparams, &disconnectpool)) {
@@ -2439,6 +2784,7 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
         }
         fBlocksDisconnected = true;
     }
+    const int64_t nDisconnectTime = GetTimeMicros() - nReorgStart;
 
     // Build list of new blocks to connect.
     std::vector<CBlockIndex*> vpindexToConnect;
@@ -2487,6 +2833,7 @@ static bool ActivateBestChainStep(CValidationState& state, const CChainParams& c
     }
 
     if (fBlocksDisconnected) {
+        StateLayersReorg(pindexOldTip->nHeight - (pindexFork ? pindexFork->nHeight : -1), GetTimeMicros() - nReorgStart, nDisconnectTime);
         // If any blocks were disconnected, disconnectpool may be non empty.  Add
         // any disconnected transactions back to the mempool.
         UpdateMempoolForReorg(disconnectpool, true);
@@ -2735,8 +3082,9 @@ static CBlockIndex* AddToBlockIndex(const CBlockHeader& block)
         return it->second;
 
     // Construct new block index object
-    CBlockIndex* pindexNew = new CBlockIndex(block);
-    assert(pindexNew);
+    CBlockIndex* pindexNew = arenaBlockIndex.Allocate();
+    *pindexNew = CBlockIndex(block);
+    arenaBlockIndex.SetBlockSig(*pindexNew, block.vchBlockSig);
     // We assign the sequence id to blocks only when the full data is available,
     // to avoid miners withholding blocks but broadcasting headers, to get a
     // competitive advantage.
@@ -2833,7 +3181,8 @@ static bool FindBlockPos(CValidationState& state, CDiskBlockPos& pos, unsigned i
         if (!fKnown) {
             LogPrintf("Leaving block file %i: %s\n", nLastBlockFile, vinfoBlockFile[nLastBlockFile].ToString());
         }
-        FlushBlockFile(!fKnown);
+        if (!FlushBlockFile(!fKnown))
+            return AbortNode(state, "Failed to write block files");
         nLastBlockFile = nFile;
     }
 
@@ -2901,6 +3250,10 @@ static bool CheckBlockHeader(const CBlockHeader& block, CValidationState& state,
     if (fCheckPOW && !CheckCasino(block.GetHash(), block.nBits, consensusParams))
         return state.DoS(50, false, REJECT_INVALID, "high-hash", false, "proof of work failed");
 
+    // Whatever the height, a header carries at most one compact signature
+    if (block.vchBlockSig.size() > MAX_BLOCK_SIG_SIZE)
+        return state.DoS(100, false, REJECT_INVALID, "bad-blk-sig-length", false, "header signature too large");
+
     return true;
 }
 
@@ -3180,6 +3533,9 @@ static bool AcceptBlockHeader(const CBlockHeader& block, CValidationState& state
         if (!ContextualCheckBlockHeader(block, state, chainparams, pindexPrev, GetAdjustedTime()))
             return error("%s: Consensus::ContextualCheckBlockHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
 
+        if (!CheckCasinoHeader(block, state, chainparams.GetConsensus(), pindexPrev, GetAdjustedTime()))
+            return error("%s: CheckCasinoHeader: %s, %s", __func__, hash.ToString(), FormatStateMessage(state));
+
         if (!pindexPrev->IsValid(BLOCK_VALID_SCRIPTS)) {
             for (const CBlockIndex* failedit : g_failed_blocks) {
                 if (pindexPrev->GetAncestor(failedit->nHeight) == failedit) {
@@ -3422,6 +3778,7 @@ void UnlinkPrunedFiles(const std::set<int>& setFilesToPrune)
 {
     for (std::set<int>::iterator it = setFilesToPrune.begin(); it != setFilesToPrune.end(); ++it) {
         CDiskBlockPos pos(*it, 0);
+        blockFileMap.Drop(*it);
         fs::remove(GetBlockPosFilename(pos, "blk"));
         fs::remove(GetBlockPosFilename(pos, "rev"));
         LogPrintf("Prune: %s deleted blk/rev (%05u)\n", __func__, *it);
@@ -3581,32 +3938,91 @@ CBlockIndex* InsertBlockIndex(uint256 hash)
         return (*mi).second;
 
     // Create new
-    CBlockIndex* pindexNew = new CBlockIndex();
-    if (!pindexNew)
-        throw std::runtime_error(std::string(__func__) + ": new CBlockIndex failed");
+    CBlockIndex* pindexNew = arenaBlockIndex.Allocate();
     mi = mapBlockIndex.insert(std::make_pair(hash, pindexNew)).first;
     pindexNew->phashBlock = &((*mi).first);
 
     return pindexNew;
 }
 
-bool static LoadBlockIndexDB(const CChainParams& chainparams)
+static fs::path GetBlockIndexSnapshotPath()
 {
-    if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex))
+    return GetDataDir() / "blocks" / "indexsnapshot.dat";
+}
+
+/** Load mapBlockIndex from the snapshot sealed in the block tree DB, and drop the seal */
+static bool LoadBlockIndexSnapshot(int nThreads)
+{
+    uint256 nonce;
+    if (!pblocktree->ReadIndexSnapshot(nonce))
+        return false;
+    // Whatever happens from here on changes the block tree DB without the snapshot
+    if (!pblocktree->EraseIndexSnapshot())
+        return false;
+    const fs::path path = GetBlockIndexSnapshotPath();
+    bool fLoaded = ReadBlockIndexSnapshotFile(path, nonce, arenaBlockIndex, mapBlockIndex, nThreads);
+    if (!fLoaded) {
+        mapBlockIndex.clear();
+        arenaBlockIndex.Clear();
+    }
+    fs::remove(path);
+    return fLoaded;
+}
+
+bool DumpBlockIndexSnapshot()
+{
+    LOCK(cs_main);
+    // The snapshot must hold what the block tree DB holds
+    if (!pblocktree || mapBlockIndex.empty() || !setDirtyBlockIndex.empty())
         return false;
 
+    int64_t nStart = GetTimeMillis();
+    std::vector<const CBlockIndex*> vIndex;
+    vIndex.reserve(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vIndex.push_back(item.second);
+    std::sort(vIndex.begin(), vIndex.end(), [](const CBlockIndex* a, const CBlockIndex* b) { return a->nHeight < b->nHeight; });
+
+    const uint256 nonce = GetRandHash();
+    if (!WriteBlockIndexSnapshotFile(GetBlockIndexSnapshotPath(), vIndex, nonce) || !pblocktree->WriteIndexSnapshot(nonce))
+        return false;
+    LogPrintf("Wrote %u block index entries to the snapshot in %dms\n", vIndex.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool static LoadBlockIndexDB(const CChainParams& chainparams)
+{
+    const int nThreads = std::max(nScriptCheckThreads, 1);
+    int64_t nStart = GetTimeMillis();
+    if (LoadBlockIndexSnapshot(nThreads)) {
+        LogPrintf("%s: mapped %u block index entries from the snapshot in %dms\n", __func__, mapBlockIndex.size(), GetTimeMillis() - nStart);
+    } else {
+        if (!pblocktree->LoadBlockIndexGuts(chainparams.GetConsensus(), InsertBlockIndex, arenaBlockIndex, nThreads))
+            return false;
+        LogPrintf("%s: read %u block index entries from the database on %d threads in %dms\n", __func__, mapBlockIndex.size(), nThreads, GetTimeMillis() - nStart);
+    }
+    const int64_t nTimeRead = GetTimeMillis();
+
     boost::this_thread::interruption_point();
 
+    // Sort by height in linear time: count the entries at each height, then
+    // put each one after those of the heights below
+    int nMaxHeight = 0;
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        nMaxHeight = std::max(nMaxHeight, item.second->nHeight);
+    std::vector<size_t> vHeightPos(nMaxHeight + 2, 0);
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vHeightPos[item.second->nHeight + 1]++;
+    for (int nHeight = 0; nHeight <= nMaxHeight; nHeight++)
+        vHeightPos[nHeight + 1] += vHeightPos[nHeight];
+    std::vector<CBlockIndex*> vSortedByHeight(mapBlockIndex.size());
+    for (const std::pair<const uint256, CBlockIndex*>& item : mapBlockIndex)
+        vSortedByHeight[vHeightPos[item.second->nHeight]++] = item.second;
+    std::vector<size_t>().swap(vHeightPos);
+    const int64_t nTimeSort = GetTimeMillis();
+
     // Calculate nChainWork
-    std::vector<std::pair<int, CBlockIndex*>> vSortedByHeight;
-    vSortedByHeight.reserve(mapBlockIndex.size());
-    for (const std::pair<uint256, CBlockIndex*>& item : mapBlockIndex) {
-        CBlockIndex* pindex = item.second;
-        vSortedByHeight.push_back(std::make_pair(pindex->nHeight, pindex));
-    }
-    sort(vSortedByHeight.begin(), vSortedByHeight.end());
-    for (const std::pair<int, CBlockIndex*>& item : vSortedByHeight) {
-        CBlockIndex* pindex = item.second;
+    for (CBlockIndex* pindex : vSortedByHeight) {
         pindex->nChainWork = (pindex->pprev ? pindex->pprev->nChainWork : 0) + GetBlockProof(*pindex);
         pindex->nTimeMax = (pindex->pprev ? std::max(pindex->pprev->nTimeMax, pindex->nTime) : pindex->nTime);
         // We can link the chain of blocks for which we've received transactions at some point.
@@ -3636,6 +4052,8 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         if (pindex->IsValid(BLOCK_VALID_TREE) && (pindexBestHeader == nullptr || CBlockIndexWorkComparator()(pindexBestHeader, pindex)))
             pindexBestHeader = pindex;
     }
+    std::vector<CBlockIndex*>().swap(vSortedByHeight);
+    const int64_t nTimeLink = GetTimeMillis();
 
     // Load block file info
     pblocktree->ReadLastBlockFile(nLastBlockFile);
@@ -3670,6 +4088,9 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams)
         }
     }
 
+    LogPrintf("%s: read %ums, sort %ums, chain work and skip list %ums, block files %ums\n", __func__,
+        nTimeRead - nStart, nTimeSort - nTimeRead, nTimeLink - nTimeSort, GetTimeMillis() - nTimeLink);
+
     // Check whether we have ever pruned block & undo files
     pblocktree->ReadFlag("prunedblockfiles", fHavePruned);
     if (fHavePruned)
@@ -3745,15 +4166,22 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView* coinsview,
     int reportDone = 0;
     sc::h256 oldHashStateRoot(pState->rootHash());
     LogPrintf("[0%%]...");
-    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
-        boost::this_thread::interruption_point();
-        int percentageDone = std::max(1, std::min(99, (int)(((double)(chainActive.Height() - pindex->nHeight)) / (double)nCheckDepth * (nCheckLevel >= 4 ? 50 : 100))));
+    // Levels 0-2 take the first part of the progress, level 3 the next and level 4 the rest
+    const int nProgressPart = nCheckLevel >= 4 ? 25 : nCheckLevel >= 3 ? 50 : 100;
+    CCriticalSection cs_progress;
+    auto reportProgress = [&](int percentageDone) {
+        LOCK(cs_progress);
+        percentageDone = std::max(1, std::min(99, percentageDone));
         if (reportDone < percentageDone / 10) {
             // report every 10% step
             LogPrintf("[%d%%]...", percentageDone);
             reportDone = percentageDone / 10;
         }
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone);
+    };
+
+    std::vector<CBlockIndex*> vVerify;
+    for (CBlockIndex* pindex = chainActive.Tip(); pindex && pindex->pprev; pindex = pindex->pprev) {
         if (pindex->nHeight < chainActive.Height() - nCheckDepth)
             break;
         if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
@@ -3761,38 +4189,74 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView* coinsview,
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
+        vVerify.push_back(pindex);
+    }
+
+    // Levels 0-2 check each block on its own, so they run on all threads. The
+    // failure reported is the one nearest the tip, as a walk from there finds.
+    const int64_t nStart = GetTimeMillis();
+    const int nThreads = std::max(nScriptCheckThreads, 1);
+    std::atomic<size_t> nChecked(0);
+    CCriticalSection cs_failure;
+    size_t nFailure = vVerify.size();
+    std::string strFailure;
+    ParallelFor(vVerify.size(), nThreads, [&](size_t i) {
+        if (ShutdownRequested())
+            return;
+        const CBlockIndex* pindex = vVerify[i];
+        std::string strError;
         CBlock block;
+        CValidationState stateBlock;
         // check level 0: read from disk
-        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
-            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus())) {
+            strError = strprintf("ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         // check level 1: verify block validity
-        if (nCheckLevel >= 1 && !CheckBlock(block, state, chainparams.GetConsensus()))
-            return error("%s: *** found bad block at %d, hash=%s (%s)\n", __func__,
-                pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(state));
+        } else if (nCheckLevel >= 1 && !CheckBlock(block, stateBlock, chainparams.GetConsensus())) {
+            strError = strprintf("found bad block at %d, hash=%s (%s)", pindex->nHeight, pindex->GetBlockHash().ToString(), FormatStateMessage(stateBlock));
         // check level 2: verify undo validity
-        if (nCheckLevel >= 2 && pindex) {
+        } else if (nCheckLevel >= 2) {
             CBlockUndo undo;
             CDiskBlockPos pos = pindex->GetUndoPos();
-            if (!pos.IsNull()) {
-                if (!UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
-                    return error("VerifyDB(): *** found bad undo data at %d, hash=%s\n", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
+            if (!pos.IsNull() && !UndoReadFromDisk(undo, pos, pindex->pprev->GetBlockHash()))
+                strError = strprintf("found bad undo data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
         }
-        // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
-            assert(coins.GetBestBlock() == pindex->GetBlockHash());
-            DisconnectResult res = DisconnectBlock(block, pindex, coins);
-            if (res == DISCONNECT_FAILED) {
-                return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
-            }
-            pindexState = pindex->pprev;
-            if (res == DISCONNECT_UNCLEAN) {
-                nGoodTransactions = 0;
-                pindexFailure = pindex;
-            } else {
-                nGoodTransactions += block.vtx.size();
+        if (!strError.empty()) {
+            LOCK(cs_failure);
+            if (i < nFailure) {
+                nFailure = i;
+                strFailure = strError;
             }
         }
+        reportProgress((int)(++nChecked * nProgressPart / vVerify.size()));
+    });
+    if (nFailure < vVerify.size())
+        return error("VerifyDB(): *** %s", strFailure);
+    const int64_t nTimeChecks = GetTimeMillis();
+    if (ShutdownRequested())
+        return true;
+
+    // check level 3: check for inconsistencies during memory-only disconnect of tip blocks
+    for (size_t i = 0; nCheckLevel >= 3 && i < vVerify.size(); i++) {
+        boost::this_thread::interruption_point();
+        CBlockIndex* pindex = vVerify[i];
+        if (pindex != pindexState || (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) > nCoinCacheUsage)
+            break;
+        reportProgress(nProgressPart + (int)(i * nProgressPart / vVerify.size()));
+        CBlock block;
+        if (!ReadBlockFromDisk(block, pindex, chainparams.GetConsensus()))
+            return error("VerifyDB(): *** ReadBlockFromDisk failed at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        assert(coins.GetBestBlock() == pindex->GetBlockHash());
+        DisconnectResult res = DisconnectBlock(block, pindex, coins);
+        if (res == DISCONNECT_FAILED) {
+            return error("VerifyDB(): *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString());
+        }
+        pindexState = pindex->pprev;
+        if (res == DISCONNECT_UNCLEAN) {
+            nGoodTransactions = 0;
+            pindexFailure = pindex;
+        } else {
+            nGoodTransactions += block.vtx.size();
+        }
         if (ShutdownRequested())
             return true;
     }
@@ -3821,6 +4285,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView* coinsview,
 
     LogPrintf("[DONE].\n");
     LogPrintf("No coin database inconsistencies in last %i blocks (%i transactions)\n", chainActive.Height() - pindexState->nHeight, nGoodTransactions);
+    LogPrintf("%s: levels 0-%d of %u blocks on %d threads %dms, levels 3-4 %dms\n", __func__,
+        std::min(nCheckLevel, 2), vVerify.size(), nThreads, nTimeChecks - nStart, GetTimeMillis() - nTimeChecks);
 
     return true;
 }
@@ -4027,10 +4493,8 @@ void UnloadBlockIndex()
         warningcache[b].clear();
     }
 
-    for (BlockMap::value_type& entry : mapBlockIndex) {
-        delete entry.second;
-    }
     mapBlockIndex.clear();
+    arenaBlockIndex.Clear();
     fHavePruned = false;
 }
 
@@ -4090,118 +4554,121 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return true;
 }
 
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos* dbp)
+bool LoadExternalBlockFiles(const CChainParams& chainparams, const std::vector<CBlockImportFile>& vFiles)
 {
-    // Map of disk positions for blocks with unknown parent (only used for reindex)
-    static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
+    // Blocks with unknown parent, by parent: in memory, or only their position once too many are
+    std::multimap<uint256, CImportedBlock> mapBlocksUnknownParent;
+    size_t nUnknownParentBytes = 0;
     int64_t nStart = GetTimeMillis();
+    int64_t nLastReport = nStart;
+    uint64_t nBlocks = 0, nBytes = 0, nLastReportBlocks = 0, nLastReportBytes = 0;
 
     int nLoaded = 0;
     try {
-        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2 * MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE + 8, SER_DISK, CLIENT_VERSION);
-        uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        CBlockImportReader reader(vFiles, chainparams.MessageStart(), chainparams.GetConsensus(), nScriptCheckThreads + 1);
+        CImportedBlock imported;
+        while (reader.Next(imported)) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++;         // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos() + 1;
-                blkdat >> FLATDATA(buf);
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            const CBlock& block = *imported.pblock;
+            const CDiskBlockPos* dbp = imported.pos.nFile >= 0 ? &imported.pos : nullptr;
+            nBlocks++;
+            nBytes += imported.nSize;
+            int64_t nNow = GetTimeMillis();
+            if (nNow - nLastReport >= IMPORT_PROGRESS_INTERVAL * 1000) {
+                LogPrintf("Importing blocks: %u read, %i loaded, %.1f blocks/s (%.1f MB/s), %u waiting for their parent\n", nBlocks, nLoaded,
+                    (nBlocks - nLastReportBlocks) * 1000.0 / (nNow - nLastReport), (nBytes - nLastReportBytes) / 1000.0 / (nNow - nLastReport), mapBlocksUnknownParent.size());
+                nLastReport = nNow;
+                nLastReportBlocks = nBlocks;
+                nLastReportBytes = nBytes;
             }
-            try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
-                if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                // detect out of order blocks, and store them for later
-                uint256 hash = block.GetHash();
-                if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex.find(block.hashPrevBlock) == mapBlockIndex.end()) {
-                    LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
-                        block.hashPrevBlock.ToString());
-                    if (dbp)
-                        mapBlocksUnknownParent.insert(std::make_pair(block.hashPrevBlock, *dbp));
-                    continue;
+
+            // detect out of order blocks, and store them for later
+            uint256 hash = block.GetHash();
+            bool fParentKnown;
+            {
+                LOCK(cs_main);
+                fParentKnown = hash == chainparams.GetConsensus().hashGenesisBlock || mapBlockIndex.count(block.hashPrevBlock);
+            }
+            if (!fParentKnown) {
+                LogPrint(BCLog::REINDEX, "%s: Out of order block %s, parent %s not known\n", __func__, hash.ToString(),
+                    block.hashPrevBlock.ToString());
+                const uint256 hashPrev = block.hashPrevBlock;
+                if (nUnknownParentBytes + imported.nSize <= MAX_IMPORT_UNKNOWN_PARENT_BYTES) {
+                    nUnknownParentBytes += imported.nSize;
+                    mapBlocksUnknownParent.insert(std::make_pair(hashPrev, std::move(imported)));
+                } else if (dbp) {
+                    imported.pblock.reset();
+                    mapBlocksUnknownParent.insert(std::make_pair(hashPrev, std::move(imported)));
                 }
+                continue;
+            }
 
-                // process in case the block isn't known yet
-                if (mapBlockIndex.count(hash) == 0 || (mapBlockIndex[hash]->nStatus & BLOCK_HAVE_DATA) == 0) {
-                    LOCK(cs_main);
+            // process in case the block isn't known yet
+            {
+                LOCK(cs_main);
+                BlockMap::iterator mi = mapBlockIndex.find(hash);
+                if (mi == mapBlockIndex.end() || (mi->second->nStatus & BLOCK_HAVE_DATA) == 0) {
                     CValidationState state;
-                    if (AcceptBlock(pblock, state, chainparams, nullptr, true, dbp, nullptr))
+                    if (AcceptBlock(imported.pblock, state, chainparams, nullptr, true, dbp, nullptr))
                         nLoaded++;
                     if (state.IsError())
                         break;
-                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mapBlockIndex[hash]->nHeight % 1000 == 0) {
-                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mapBlockIndex[hash]->nHeight);
+                } else if (hash != chainparams.GetConsensus().hashGenesisBlock && mi->second->nHeight % 1000 == 0) {
+                    LogPrint(BCLog::REINDEX, "Block Import: already had block %s at height %d\n", hash.ToString(), mi->second->nHeight);
                 }
+            }
 
-                // Activate the genesis block so normal node progress can continue
-                if (hash == chainparams.GetConsensus().hashGenesisBlock) {
-                    CValidationState state;
-                    if (!ActivateBestChain(state, chainparams)) {
-                        break;
-                    }
+            // Activate the genesis block so normal node progress can continue
+            if (hash == chainparams.GetConsensus().hashGenesisBlock) {
+                CValidationState state;
+                if (!ActivateBestChain(state, chainparams)) {
+                    break;
                 }
+            }
 
-                NotifyHeaderTip();
-
-                // Recursively process earlier encountered successors of this block
-                std::deque<uint256> queue;
-                queue.push_back(hash);
-                while (!queue.empty()) {
-                    uint256 head = queue.front();
-                    queue.pop_front();
-                    std::pair<std::multimap<uint256, CDiskBlockPos>::iterator, std::multimap<uint256, CDiskBlockPos>::iterator> range = mapBlocksUnknownParent.equal_range(head);
-                    while (range.first != range.second) {
-                        std::multimap<uint256, CDiskBlockPos>::iterator it = range.first;
-                        std::shared_ptr<CBlock> pblockrecursive = std::make_shared<CBlock>();
-                        if (ReadBlockFromDisk(*pblockrecursive, it->second, chainparams.GetConsensus())) {
-                            LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
-                                head.ToString());
-                            LOCK(cs_main);
-                            CValidationState dummy;
-                            if (AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, &it->second, nullptr)) {
-                                nLoaded++;
-                                queue.push_back(pblockrecursive->GetHash());
-                            }
+            NotifyHeaderTip();
+
+            // Recursively process earlier encountered successors of this block
+            std::deque<uint256> queue;
+            queue.push_back(hash);
+            while (!queue.empty()) {
+                uint256 head = queue.front();
+                queue.pop_front();
+                std::pair<std::multimap<uint256, CImportedBlock>::iterator, std::multimap<uint256, CImportedBlock>::iterator> range = mapBlocksUnknownParent.equal_range(head);
+                while (range.first != range.second) {
+                    std::multimap<uint256, CImportedBlock>::iterator it = range.first;
+                    std::shared_ptr<const CBlock> pblockrecursive = it->second.pblock;
+                    if (pblockrecursive) {
+                        nUnknownParentBytes -= it->second.nSize;
+                    } else {
+                        std::shared_ptr<CBlock> pblockread = std::make_shared<CBlock>();
+                        if (ReadBlockFromDisk(*pblockread, it->second.pos, chainparams.GetConsensus()))
+                            pblockrecursive = pblockread;
+                    }
+                    if (pblockrecursive) {
+                        LogPrint(BCLog::REINDEX, "%s: Processing out of order child %s of %s\n", __func__, pblockrecursive->GetHash().ToString(),
+                            head.ToString());
+                        LOCK(cs_main);
+                        CValidationState dummy;
+                        if (AcceptBlock(pblockrecursive, dummy, chainparams, nullptr, true, it->second.pos.nFile >= 0 ? &it->second.pos : nullptr, nullptr)) {
+                            nLoaded++;
+                            queue.push_back(pblockrecursive->GetHash());
                         }
-                        range.first++;
-                        mapBlocksUnknownParent.erase(it);
-                        NotifyHeaderTip();
                     }
+                    range.first++;
+                    mapBlocksUnknownParent.erase(it);
+                    NotifyHeaderTip();
                 }
-            } catch (const std::exception& e) {
-                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
             }
         }
     } catch (const std::runtime_error& e) {
         AbortNode(std::string("System error: ") + e.what());
     }
-    if (nLoaded > 0)
-        LogPrintf("Loaded %i blocks from external file in %dms\n", nLoaded, GetTimeMillis() - nStart);
+    if (nLoaded > 0) {
+        int64_t nTime = std::max<int64_t>(GetTimeMillis() - nStart, 1);
+        LogPrintf("Loaded %i blocks from %u files in %dms (%.1f blocks/s)\n", nLoaded, vFiles.size(), nTime, nLoaded * 1000.0 / nTime);
+    }
     return nLoaded > 0;
 }
 
@@ -4557,11 +5024,9 @@ public:
     CMainCleanup() {}
     ~CMainCleanup()
     {
-        // block headers
-        BlockMap::iterator it1 = mapBlockIndex.begin();
-        for (; it1 != mapBlockIndex.end(); it1++)
-            delete (*it1).second;
+        // block headers, owned by the arena
         mapBlockIndex.clear();
+        arenaBlockIndex.Clear();
     }
 } instance_of_cmaincleanup;
 
@@ -4577,22 +5042,25 @@ bool CheckSenderScript(const CCoinsViewCache& view, const CTransaction& tx)
     return true;
 }
 
-bool CallContract(sc::Address scAddr, std::vector<unsigned char> opcode, std::vector<unsigned char>* output, bool fStateChange)
+bool CallContract(sc::Address scAddr, std::vector<unsigned char> opcode, std::vector<unsigned char>* output, bool fStateChange, sc::State* state)
 {
-    sc::h256 oldHashStateRoot(pState->rootHash());
+    if (!state)
+        state = pState.get();
+    sc::h256 oldHashStateRoot(state->rootHash());
     try {
         sc::Transaction scTx;
         //std::vector<sc::byte>  data(opcode);
         scTx = std::move(sc::Transaction(false, 0, 25, 25000000, scAddr, opcode));
         scTx.forceSender(sc::h160(minerAddress));
-        auto result = pState->execute(scTx);
+        auto result = state->execute(scTx);
         *output = result.output;
     } catch (...) {
-        pState->setRoot(oldHashStateRoot);
+        state->setRoot(oldHashStateRoot);
         return false;
     }
     if (!fStateChange)
-        pState->setRoot(oldHashStateRoot);
+        state->setRoot(oldHashStateRoot);
     return true;
 }
 
+
@@ -33,9 +33,11 @@
 #include <atomic>
 
 class CBlockIndex;
+class CBlockIndexArena;
 class CBlockTreeDB;
 class CChainParams;
 class CCoinsViewDB;
+class CCoinsViewWriteBehind;
 class CInv;
 class CConnman;
 class CScriptCheck;
@@ -43,6 +45,9 @@ class CBlockPolicyEstimator;
 class CTxMemPool;
 class CValidationState;
 struct ChainTxData;
+struct CBlockWriterStats;
+struct CBlockImportFile;
+struct CBlockReceipts;
 
 struct PrecomputedTransactionData;
 struct LockPoints;
@@ -84,13 +89,26 @@ static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
-/** Number of blocks that can be requested at any given time from a single peer. */
+/** Number of blocks that can be requested at any given time from a single peer, until its
+ *  latency and the rate it delivers blocks at are measured. */
 static const int MAX_BLOCKS_IN_TRANSIT_PER_PEER = 16;
-/** Timeout in seconds during which a peer must stall block download progress before being disconnected. */
+/** Most blocks in flight from a single peer once they are: enough to keep blocks coming for
+ *  two round trips, which for our many small blocks can be far more than the above. */
+static const int MAX_ADAPTIVE_BLOCKS_IN_TRANSIT_PER_PEER = 512;
+/** Blocks are requested from a peer once this fraction of its window is free, as one contiguous range. */
+static const int BLOCK_DOWNLOAD_RANGE_FRACTION = 4;
+/** Timeout in seconds during which a peer must stall block download progress before being disconnected, at least. */
 static const unsigned int BLOCK_STALLING_TIMEOUT = 2;
+/** A stalling peer is given this many times the time the blocks in flight from it should take at its rate... */
+static const int64_t BLOCK_STALLING_MARGIN = 4;
+/** ...but no more than this many block slots (CHAIN_BLOCK_INTERVAL). */
+static const int64_t MAX_BLOCK_STALLING_SLOTS = 10;
 /** Number of headers sent in one getheaders result. We rely on the assumption that if a peer sends
  *  less than this number, we reached its tip. Changing this value is a protocol upgrade. */
 static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** Number of headers sent in one getheaders result between peers that both advertise NODE_LARGE_HEADERS.
+ *  Our headers are 179 bytes with their signature, so these fit in a message. */
+static const unsigned int MAX_HEADERS_RESULTS_LARGE = 20000;
 /** Maximum depth of blocks we're willing to serve as compact blocks to peers
  *  when requested. For older blocks, a regular BLOCK response will be sent. */
 static const int MAX_CMPCTBLOCK_DEPTH = 5;
@@ -99,8 +117,12 @@ static const int MAX_BLOCKTXN_DEPTH = 10;
 /** Size of the "block download window": how far ahead of our current height do we fetch?
  *  Larger windows tolerate larger download speed differences between peer, but increase the potential
  *  degree of disordering of blocks on disk (which make reindexing and in the future perhaps pruning
- *  harder). We'll probably want to make this a per-peer adaptive value at some point. */
+ *  harder). This is the least it is: it grows with the windows of blocks in flight per peer. */
 static const unsigned int BLOCK_DOWNLOAD_WINDOW = 1024;
+/** Blocks the download window grows by per block any peer may have in flight beyond MAX_BLOCKS_IN_TRANSIT_PER_PEER... */
+static const unsigned int BLOCK_DOWNLOAD_WINDOW_PER_TRANSIT = 4;
+/** ...up to this size */
+static const unsigned int MAX_BLOCK_DOWNLOAD_WINDOW = 8192;
 /** Time to wait (in seconds) between writing blocks/block index to disk. */
 static const unsigned int DATABASE_WRITE_INTERVAL = 60 * 60;
 /** Time to wait (in seconds) between flushing chainstate to disk. */
@@ -121,10 +143,10 @@ static const unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_INTE
 static const unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
 static const unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
-/** Block download timeout base, expressed in millionths of the block interval (i.e. 10 min) */
-static const int64_t BLOCK_DOWNLOAD_TIMEOUT_BASE = 1000000;
-/** Additional block download timeout per parallel downloading peer (i.e. 5 min) */
-static const int64_t BLOCK_DOWNLOAD_TIMEOUT_PER_PEER = 500000;
+/** Block download timeout base, in block slots (CHAIN_BLOCK_INTERVAL, i.e. 30 s) */
+static const int64_t BLOCK_DOWNLOAD_TIMEOUT_BASE = 10;
+/** Additional block download timeout per parallel downloading peer, in block slots (i.e. 15 s) */
+static const int64_t BLOCK_DOWNLOAD_TIMEOUT_PER_PEER = 5;
 
 static const int64_t DEFAULT_MAX_TIP_AGE = 24 * 60 * 60;
 /** Maximum age of our tip in seconds for us to be considered current for fee estimation */
@@ -134,6 +156,8 @@ static const int64_t MAX_FEE_ESTIMATION_TIP_AGE = 3 * 60 * 60;
 static const bool DEFAULT_PERMIT_BAREMULTISIG = true;
 static const bool DEFAULT_CHECKPOINTS_ENABLED = true;
 static const bool DEFAULT_TXINDEX = false;
+static const bool DEFAULT_RECEIPTINDEX = false;
+static const bool DEFAULT_CONTRACTINDEX = false;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 /** Default for -persistmempool */
 static const bool DEFAULT_PERSIST_MEMPOOL = true;
@@ -161,6 +185,14 @@ static const uint64_t DEFAULT_GAS_LIMIT_OP_SEND = 250000;
 static const CAmount DEFAULT_GAS_PRICE = 0.00000040*COIN;
 static const CAmount MAX_RPC_GAS_PRICE = 0.00000100*COIN;
 static const size_t MAX_CONTRACT_VOUTS = 1000;
+/** Contract transactions whose gas limits add up to more than this are not dry-run at mempool acceptance */
+static const uint64_t MAX_MEMPOOL_DRYRUN_GAS = DEFAULT_GAS_LIMIT_OP_CREATE;
+/** A mempool dry run taking longer than this, in milliseconds, is abandoned */
+static const int64_t MAX_MEMPOOL_DRYRUN_TIME = 25;
+/** Contract transactions that may wait for their dry run; beyond this they go without one */
+static const size_t MAX_MEMPOOL_DRYRUN_QUEUE = 1000;
+/** Default for -contractcodecache, in megabytes */
+static const int64_t DEFAULT_CONTRACT_CODE_CACHE = 32;
 
 static const uint64_t MIN_BLOCK_GAS_LIMIT = 1000000;
 static const uint64_t MAX_BLOCK_GAS_LIMIT = 1000000000;
@@ -186,6 +218,8 @@ extern CBlockPolicyEstimator feeEstimator;
 extern CTxMemPool mempool;
 typedef std::unordered_map<uint256, CBlockIndex*, BlockHasher> BlockMap;
 extern BlockMap mapBlockIndex;
+/** Storage of the entries of mapBlockIndex */
+extern CBlockIndexArena arenaBlockIndex;
 extern uint64_t nLastBlockTx;
 extern uint64_t nLastBlockWeight;
 extern const std::string strMessageMagic;
@@ -232,6 +266,8 @@ static const unsigned int MIN_BLOCKS_TO_KEEP = 288;
 
 static const signed int DEFAULT_CHECKBLOCKS = 6;
 static const unsigned int DEFAULT_CHECKLEVEL = 3;
+/** Default for -asyncflush, writing full flushes of the chainstate in a background thread */
+static const bool DEFAULT_ASYNC_FLUSH = true;
 
 // Require that user allocate at least 550MB for block & undo files (blk???.dat and rev???.dat)
 // At 1MB per block, 288 blocks = 288MB.
@@ -283,8 +319,14 @@ bool CheckDiskSpace(uint64_t nAdditionalBytes = 0);
 FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 fs::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
-/** Import blocks from an external file */
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = nullptr);
+/**
+ * Import blocks from files in the block file format: the block files for a
+ * reindex, or exported ones. They are read, deserialized and checked ahead
+ * by other threads while this one accepts them in file order; blocks that
+ * come before their parent wait for it in memory, or as their position in a
+ * block file once too many do.
+ */
+bool LoadExternalBlockFiles(const CChainParams& chainparams, const std::vector<CBlockImportFile>& vFiles);
 /** Ensures we have a genesis block in the block tree, possibly writing one to disk. */
 bool LoadGenesisBlock(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk,
@@ -296,6 +338,8 @@ bool LoadChainTip(const CChainParams& chainparams);
 void UnloadBlockIndex();
 /** Run an instance of the script checking thread */
 void ThreadScriptCheck();
+/** Run the thread that dry-runs the contract transactions accepted to the mempool */
+void ThreadContractDryRun();
 /** Check whether we are doing an initial block download (synchronizing from disk or network) */
 bool IsInitialBlockDownload();
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
@@ -323,6 +367,35 @@ CBlockIndex * InsertBlockIndex(uint256 hash);
 void FlushStateToDisk();
 /** Prune block files and flush state to disk. */
 void PruneAndFlush();
+
+struct CChainstateFlushStats {
+    bool fAsync = false;            //!< Whether full flushes are written in the background
+    bool fWriting = false;          //!< Whether a write is in progress
+    uint64_t nFlushes = 0;          //!< Full flushes of the chainstate and contract state
+    uint64_t nAsyncFlushes = 0;     //!< ...of which were written in the background
+    int64_t nPendingUsage = 0;      //!< Bytes of coins frozen for the write in progress
+    int64_t nLastWriteTime = 0;     //!< Microseconds the last write took
+    int64_t nTotalWriteTime = 0;
+    int64_t nLastStallTime = 0;     //!< Microseconds the last full flush held up block connection
+    int64_t nTotalStallTime = 0;
+    int64_t nTotalWaitTime = 0;     //!< Microseconds of the stalls spent waiting for the previous write
+};
+
+/** Write full flushes in a background thread from now on (-asyncflush) */
+void StartChainstateWriter();
+/** Finish the write in progress and stop the thread; later flushes write synchronously */
+void StopChainstateWriter();
+/** Get statistics of the full flushes */
+CChainstateFlushStats GetChainstateFlushStats();
+/** Append block and undo data in a background thread from now on (-blockwriter) */
+void StartBlockFileWriter();
+/** Write out and sync what is queued and stop the thread; later appends write synchronously */
+void StopBlockFileWriter();
+/** Get statistics of the block and undo file writes */
+CBlockWriterStats GetBlockWriterStats();
+/** Read the blocks ahead that ConnectTip needs on the way to the best header, until StopBlockPrefetch */
+void StartBlockPrefetch(const CChainParams& chainparams);
+void StopBlockPrefetch();
 /** Prune block files up to a given height */
 void PruneBlockFilesManual(int nManualPruneHeight);
 
@@ -422,6 +495,12 @@ void InitScriptExecutionCache();
 /** Functions for disk access for blocks */
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+/**
+ * Read the block of pindex as it is stored, which is its serialization with
+ * witness data, without deserializing more than its header. Only the header
+ * is checked against the index, as ReadBlockFromDisk does.
+ */
+bool ReadRawBlockFromDisk(std::vector<unsigned char>& vchBlock, const CBlockIndex* pindex, const CMessageHeader::MessageStartChars& messageStart);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -472,6 +551,9 @@ extern CChain chainActive;
 /** Global variable that points to the coins database (protected by cs_main) */
 extern CCoinsViewDB *pcoinsdbview;
 
+/** Global variable that points to the coins flushed from pcoinsTip and not yet written (protected by cs_main) */
+extern CCoinsViewWriteBehind *pcoinswritebehind;
+
 /** Global variable that points to the active CCoinsView (protected by cs_main) */
 extern CCoinsViewCache *pcoinsTip;
 
@@ -506,6 +588,9 @@ static const unsigned int REJECT_HIGHFEE = 0x100;
 /** Get block file info entry for one block file */
 CBlockFileInfo* GetBlockFileInfo(size_t n);
 
+/** Write the block index snapshot, which the next startup loads instead of the block tree DB, if the DB is up to date */
+bool DumpBlockIndexSnapshot();
+
 /** Dump the mempool to disk. */
 void DumpMempool();
 
@@ -514,8 +599,8 @@ bool LoadMempool();
 
 // =================== Smart Contract =============== 
 bool CheckSenderScript(const CCoinsViewCache& view, const CTransaction& tx);
-bool CheckContractTx(const CBlock& block, CValidationState& state, bool hasContract);
-bool CallContract(sc::Address scAddr, std::vector<unsigned char> opcode, std::vector<unsigned char>* output, bool fStateChange = false);
+bool CheckContractTx(const CBlock& block, CValidationState& state, bool hasContract, CBlockReceipts* pReceipts = nullptr);
+bool CallContract(sc::Address scAddr, std::vector<unsigned char> opcode, std::vector<unsigned char>* output, bool fStateChange = false, sc::State* state = nullptr);
 
 
 // =================== CASINO =============== 
@@ -12,8 +12,8 @@
 static const int32_t VERSIONBITS_LAST_OLD_BLOCK_VERSION = 4;
 /** What bits to set in version for versionbits blocks */
 static const int32_t VERSIONBITS_TOP_BITS = 0x20000000UL;
-/** What bitmask determines whether versionbits is in use */
-static const int32_t VERSIONBITS_TOP_MASK = 0xE0000000UL;
+/** What bitmask determines whether versionbits is in use; BLOCK_VERSION_CASINO_SIGNED is left out */
+static const int32_t VERSIONBITS_TOP_MASK = 0xE0000000UL & ~BLOCK_VERSION_CASINO_SIGNED;
 /** Total bits available for versionbits */
 static const int32_t VERSIONBITS_NUM_BITS = 29;
 
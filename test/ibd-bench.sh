@@ -0,0 +1,71 @@
+#!/bin/bash
+# Initial block download benchmark against local regtest peers.
+#
+# Mines a chain of BLOCKS blocks, serves it from PEERS nodes and times a fresh
+# node syncing it from all of them. Arguments are passed on to the syncing
+# node, e.g. -par=1, -debug=net or -compactheaders=0.
+#
+#   BLOCKS=20000 PEERS=4 ./ibd-bench.sh
+#
+# SRC is where ybd and ybc are, for builds outside of the source tree.
+#set -x
+cd $PWD
+
+BLOCKS=${BLOCKS:-5000}
+PEERS=${PEERS:-3}
+DIR=/tmp/ybtc-ibd
+ADDR=mipcBbFg9gMiCh81Kj8tqqdgoZub1ZJRfn
+SRC=${SRC:-${PWD}/../src}
+YBD=${SRC}/ybd
+YBC=${SRC}/ybc
+
+ybc() {
+    local n=$1
+    shift
+    ${YBC} -regtest -datadir=${DIR}/$n -rpcuser=ybtc -rpcpassword=ybtc -rpcport=$((18880 + n)) "$@"
+}
+
+start() {
+    local n=$1
+    shift
+    ${YBD} -regtest -daemon -datadir=${DIR}/$n -port=$((18870 + n)) -rpcport=$((18880 + n)) -rpcuser=ybtc -rpcpassword=ybtc -dnsseed=0 -dns=0 "$@" || exit 1
+    until ybc $n getblockcount >/dev/null 2>&1; do sleep 0.2; done
+}
+
+echo "Create data path..."
+rm -rf ${DIR}
+mkdir -p ${DIR}/0 ${DIR}/1
+
+echo "Mine ${BLOCKS} blocks..."
+start 1 -listen=0
+for ((mined = 0; mined < BLOCKS; mined += 500)); do
+    ybc 1 generatetoaddress $((BLOCKS - mined < 500 ? BLOCKS - mined : 500)) ${ADDR} >/dev/null
+done
+ybc 1 stop >/dev/null
+sleep 3
+
+echo "Start ${PEERS} serving peers..."
+CONNECT=""
+for ((n = 1; n <= PEERS; n++)); do
+    [ $n -gt 1 ] && cp -r ${DIR}/1 ${DIR}/$n
+    start $n -listen
+    CONNECT="${CONNECT} -connect=127.0.0.1:$((18870 + n))"
+done
+
+echo "Sync a fresh node..."
+START=$(date +%s%N)
+start 0 -listen=0 ${CONNECT} "$@"
+until ybc 0 getblockchaininfo | grep -q "\"headers\": ${BLOCKS},"; do sleep 0.1; done
+HEADERS=$(date +%s%N)
+while [ "$(ybc 0 getblockcount)" -lt ${BLOCKS} ]; do sleep 0.1; done
+END=$(date +%s%N)
+
+awk -v b=${BLOCKS} -v t=$(( (HEADERS - START) / 1000000 )) 'BEGIN { printf "Synced %d headers in %.1f s\n", b, t / 1000 }'
+awk -v b=${BLOCKS} -v p=${PEERS} -v t=$(( (END - START) / 1000000 )) 'BEGIN { printf "Synced %d blocks from %d peers in %.1f s, %.0f blocks/s\n", b, p, t / 1000, b * 1000 / t }'
+ybc 0 getpeerinfo | grep -E '"(addr|download_window|block_interval|pingtime)"'
+# Headers sent to the syncing node in either format, over all peers
+ybc 0 getpeerinfo | awk -v b=${BLOCKS} '/bytesrecv_per_msg/ { r = 1 } /}/ { r = 0 } r && /"(headers|cmpctheaders)":/ { gsub(/[",:]/, ""); n[$1] += $2 } END { for (c in n) printf "Received %d bytes of %s, %.1f per block\n", n[c], c, n[c] / b }'
+
+for ((n = 0; n <= PEERS; n++)); do
+    ybc $n stop >/dev/null
+done